@@ -32,6 +32,7 @@
 #include <tcl.h>
 #include <tclTomMath.h>
 #include <clang-c/Index.h>
+#include <clang-c/CXCompilationDatabase.h>
 #if CINDEX_VERSION_MINOR >= 24
 #include <clang-c/CXErrorCode.h>
 #endif
@@ -40,11 +41,18 @@
 #endif
 
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <unistd.h>
+
+#if TCL_MAJOR_VERSION > 8 || (TCL_MAJOR_VERSION == 8 && TCL_MINOR_VERSION >= 6)
+#define CINDEX_USE_NRE
+#endif
 
 //------------------------------------------------------------------ utilities
 
@@ -69,6 +77,37 @@ static Tcl_Obj *convertCXStringToObj(CXString str)
    return result;
 }
 
+// Like convertCXStringToObj, but equal strings share one Tcl_Obj held by
+// table, a TCL_STRING_KEYS hash table.
+static Tcl_Obj *internCXString(Tcl_HashTable *table, CXString str)
+{
+   const char *cstr = clang_getCString(str);
+
+   int            created;
+   Tcl_HashEntry *entry = Tcl_CreateHashEntry(table, cstr != NULL ? cstr : "",
+                                              &created);
+   if (created) {
+      Tcl_Obj *obj = Tcl_NewStringObj(cstr, -1);
+      Tcl_IncrRefCount(obj);
+      Tcl_SetHashValue(entry, obj);
+   }
+   clang_disposeString(str);
+
+   return (Tcl_Obj *)Tcl_GetHashValue(entry);
+}
+
+// Release the objects interned by internCXString and delete table.
+static void deleteInternTable(Tcl_HashTable *table)
+{
+   Tcl_HashSearch search;
+   for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(table, &search);
+        entry != NULL;
+        entry = Tcl_NextHashEntry(&search)) {
+      Tcl_DecrRefCount((Tcl_Obj *)Tcl_GetHashValue(entry));
+   }
+   Tcl_DeleteHashTable(table);
+}
+
 #if CINDEX_VERSION_MINOR >= 32
 static Tcl_Obj *convertCXStringSetToObj(CXStringSet *strset)
 {
@@ -82,11 +121,38 @@ static Tcl_Obj *convertCXStringSetToObj(CXStringSet *strset)
 }
 #endif
 
+// Set the string representation of obj to that of listObj and free
+// listObj unless it is referenced elsewhere.
+static void setStringRepFromObj(Tcl_Obj *obj, Tcl_Obj *listObj)
+{
+   Tcl_IncrRefCount(listObj);
+
+   int         length;
+   const char *str = Tcl_GetStringFromObj(listObj, &length);
+   obj->bytes      = Tcl_Alloc(length + 1);
+   obj->length     = length;
+   memcpy(obj->bytes, str, length + 1);
+
+   Tcl_DecrRefCount(listObj);
+}
+
+// Free the internal representation of obj, keeping its string
+// representation, so that another internal representation can be set.
+static void discardInternalRep(Tcl_Obj *obj)
+{
+   Tcl_GetStringFromObj(obj, NULL);
+   if (obj->typePtr != NULL && obj->typePtr->freeIntRepProc != NULL) {
+      obj->typePtr->freeIntRepProc(obj);
+   }
+   obj->typePtr = NULL;
+}
+
 typedef struct Command
 {
    const char     *name;
    Tcl_ObjCmdProc *proc;
    ClientData      clientData;
+   Tcl_ObjCmdProc *nreProc;     // NULL if the command is not NRE-enabled
 } Command;
 
 static void createAndExportCommands(Tcl_Interp *interp,
@@ -100,9 +166,18 @@ static void createAndExportCommands(Tcl_Interp *interp,
                       commandNameFormat, command[i].name)) {
          Tcl_Panic("command name buffer overflow: %s\n", buffer);
       }
+#ifdef CINDEX_USE_NRE
+      Tcl_Command token = command[i].nreProc != NULL
+         ? Tcl_NRCreateCommand(interp, buffer,
+                               command[i].proc, command[i].nreProc,
+                               command[i].clientData, NULL)
+         : Tcl_CreateObjCommand(interp, buffer, command[i].proc,
+                                command[i].clientData, NULL);
+#else
       Tcl_Command token
          = Tcl_CreateObjCommand(interp, buffer, command[i].proc,
                                 command[i].clientData, NULL);
+#endif
       Tcl_CmdInfo info;
       if (! Tcl_GetCommandInfoFromToken(token, &info)) {
          Tcl_Panic("Tcl_GetCommandInfoFromToken failed: %s\n", buffer);
@@ -373,6 +448,12 @@ static Tcl_Obj *newLayoutLongLongObj(long long value)
 
 //---------------------------------------------------------------------- visit
 
+/* The return codes of the recurse and recursebreak commands.  In the
+ * traversal commands (foreachChild, walk), TCL_RECURSE visits the children
+ * of the current cursor, and TCL_RECURSE_BREAK skips the remaining siblings
+ * of the current cursor and goes on with the next sibling of its parent.
+ * TCL_BREAK ends the whole traversal.
+ */
 enum {
    TCL_RECURSE = 5,
    TCL_RECURSE_BREAK = 6
@@ -564,8 +645,105 @@ static int getFileFromObj(Tcl_Interp        *interp,
    return TCL_OK;
 }
 
-static Tcl_Obj *newLocationObj(CXSourceLocation location)
+struct TUInfo;
+static void retainTUInfo(struct TUInfo *info);
+static void releaseTUInfo(struct TUInfo *info);
+static Tcl_Obj *newFileNameObjForTU(struct TUInfo *info, CXFile file);
+static unsigned getTUGeneration(struct TUInfo *info);
+static int checkLocationTU(Tcl_Interp *interp, Tcl_Obj *obj,
+                           const char *what);
+
+/** The internal representation of cindex-location and cindex-range
+ * Tcl_Objs: the value itself in a single allocation.  The translation unit
+ * the value came from, if known, is kept in ptr2 so that decoding can use
+ * its file name cache, and so that the value is rejected once the TU is
+ * reparsed or deleted.
+ *
+ * The string representations are the lists {CXSourceLocation ptr0 ptr1 int}
+ * and {CXSourceRange ptr0 ptr1 begin end}.  They are generated only when a
+ * script asks for them.
+ */
+typedef struct LocationRep
+{
+   union {
+      CXSourceLocation location;
+      CXSourceRange    range;
+   };
+   unsigned generation;         // the TU's generation at creation
+} LocationRep;
+
+static void freeLocationInternalRep(Tcl_Obj *obj);
+static void dupLocationInternalRep(Tcl_Obj *src, Tcl_Obj *dst);
+static void updateStringOfLocation(Tcl_Obj *obj);
+static int  setLocationFromAny(Tcl_Interp *interp, Tcl_Obj *obj);
+static void updateStringOfRange(Tcl_Obj *obj);
+static int  setRangeFromAny(Tcl_Interp *interp, Tcl_Obj *obj);
+
+static Tcl_ObjType locationObjType = {
+   "cindex-location",
+   freeLocationInternalRep,
+   dupLocationInternalRep,
+   updateStringOfLocation,
+   setLocationFromAny
+};
+
+static Tcl_ObjType rangeObjType = {
+   "cindex-range",
+   freeLocationInternalRep,
+   dupLocationInternalRep,
+   updateStringOfRange,
+   setRangeFromAny
+};
+
+static LocationRep *setLocationInternalRep(Tcl_Obj           *obj,
+                                           const Tcl_ObjType *type,
+                                           struct TUInfo     *tuInfo)
+{
+   LocationRep *rep = (LocationRep *)Tcl_Alloc(sizeof *rep);
+   rep->generation  = 0;
+
+   if (tuInfo != NULL) {
+      retainTUInfo(tuInfo);
+      rep->generation = getTUGeneration(tuInfo);
+   }
+
+   obj->internalRep.twoPtrValue.ptr1 = rep;
+   obj->internalRep.twoPtrValue.ptr2 = tuInfo;
+   obj->typePtr                      = type;
+
+   return rep;
+}
+
+static void freeLocationInternalRep(Tcl_Obj *obj)
+{
+   struct TUInfo *tuInfo = (struct TUInfo *)obj->internalRep.twoPtrValue.ptr2;
+   if (tuInfo != NULL) {
+      releaseTUInfo(tuInfo);
+   }
+
+   Tcl_Free((char *)obj->internalRep.twoPtrValue.ptr1);
+   obj->typePtr = NULL;
+}
+
+static void dupLocationInternalRep(Tcl_Obj *src, Tcl_Obj *dst)
+{
+   LocationRep   *rep    = (LocationRep *)src->internalRep.twoPtrValue.ptr1;
+   struct TUInfo *tuInfo = (struct TUInfo *)src->internalRep.twoPtrValue.ptr2;
+   *setLocationInternalRep(dst, src->typePtr, tuInfo) = *rep;
+}
+
+// Return the translation unit of a cindex-location or cindex-range obj, or
+// NULL if it is not known.
+static struct TUInfo *getLocationTUInfo(Tcl_Obj *obj)
+{
+   return (struct TUInfo *)obj->internalRep.twoPtrValue.ptr2;
+}
+
+static void updateStringOfLocation(Tcl_Obj *obj)
 {
+   CXSourceLocation location
+      = ((LocationRep *)obj->internalRep.twoPtrValue.ptr1)->location;
+
    enum {
       nptrs = sizeof location.ptr_data / sizeof location.ptr_data[0]
    };
@@ -584,15 +762,17 @@ static Tcl_Obj *newLocationObj(CXSourceLocation location)
    }
    elms[int_data_ix] = Tcl_NewLongObj(location.int_data);
 
-   return Tcl_NewListObj(nelms, elms);
+   setStringRepFromObj(obj, Tcl_NewListObj(nelms, elms));
 }
 
-static int getLocationFromObj(Tcl_Interp       *interp,
-                              Tcl_Obj          *obj,
-                              CXSourceLocation *location)
+// Parse the list representation of a source location and convert obj to a
+// cindex-location.
+static int setLocationFromAny(Tcl_Interp *interp, Tcl_Obj *obj)
 {
+   CXSourceLocation location;
+
    enum {
-      nptrs = sizeof location->ptr_data / sizeof location->ptr_data[0]
+      nptrs = sizeof location.ptr_data / sizeof location.ptr_data[0]
    };
 
    enum {
@@ -619,7 +799,7 @@ static int getLocationFromObj(Tcl_Interp       *interp,
 
    for (int i = 0; i < nptrs; ++i) {
       status = getPointerFromObj
-         (interp, elms[ptr_data_ix + i], (void **)&location->ptr_data[i]);
+         (interp, elms[ptr_data_ix + i], (void **)&location.ptr_data[i]);
       if (status != TCL_OK) {
          return status;
       }
@@ -631,9 +811,12 @@ static int getLocationFromObj(Tcl_Interp       *interp,
       goto invalid;
    }
 
-   location->int_data = value;
+   location.int_data = value;
 
-   return status;
+   discardInternalRep(obj);
+   setLocationInternalRep(obj, &locationObjType, NULL)->location = location;
+
+   return TCL_OK;
 
  invalid:
    if (interp != NULL) {
@@ -644,8 +827,47 @@ static int getLocationFromObj(Tcl_Interp       *interp,
    return TCL_ERROR;
 }
 
-static Tcl_Obj *newRangeObj(CXSourceRange range)
+static Tcl_Obj *newLocationObjForTU(struct TUInfo    *tuInfo,
+                                    CXSourceLocation  location)
 {
+   Tcl_Obj *obj = Tcl_NewObj();
+   Tcl_InvalidateStringRep(obj);
+   setLocationInternalRep(obj, &locationObjType, tuInfo)->location = location;
+
+   return obj;
+}
+
+static Tcl_Obj *newLocationObj(CXSourceLocation location)
+{
+   return newLocationObjForTU(NULL, location);
+}
+
+static int getLocationFromObj(Tcl_Interp       *interp,
+                              Tcl_Obj          *obj,
+                              CXSourceLocation *location)
+{
+   if (obj->typePtr != &locationObjType) {
+      int status = setLocationFromAny(interp, obj);
+      if (status != TCL_OK) {
+         return status;
+      }
+   }
+
+   int status = checkLocationTU(interp, obj, "location");
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   *location = ((LocationRep *)obj->internalRep.twoPtrValue.ptr1)->location;
+
+   return TCL_OK;
+}
+
+static void updateStringOfRange(Tcl_Obj *obj)
+{
+   CXSourceRange range
+      = ((LocationRep *)obj->internalRep.twoPtrValue.ptr1)->range;
+
    enum {
       nptrs = sizeof range.ptr_data / sizeof range.ptr_data[0]
    };
@@ -669,15 +891,17 @@ static Tcl_Obj *newRangeObj(CXSourceRange range)
    elms[begin_int_data_ix] = Tcl_NewLongObj(range.begin_int_data);
    elms[end_int_data_ix]   = Tcl_NewLongObj(range.end_int_data);
 
-   return Tcl_NewListObj(nelms, elms);
+   setStringRepFromObj(obj, Tcl_NewListObj(nelms, elms));
 }
 
-static int getRangeFromObj(Tcl_Interp    *interp,
-                           Tcl_Obj       *obj,
-                           CXSourceRange *range)
+// Parse the list representation of a source range and convert obj to a
+// cindex-range.
+static int setRangeFromAny(Tcl_Interp *interp, Tcl_Obj *obj)
 {
+   CXSourceRange range;
+
    enum {
-      nptrs = sizeof range->ptr_data / sizeof range->ptr_data[0]
+      nptrs = sizeof range.ptr_data / sizeof range.ptr_data[0]
    };
 
    enum {
@@ -704,15 +928,15 @@ static int getRangeFromObj(Tcl_Interp    *interp,
 
    for (int i = 0; i < nptrs; ++i) {
       status = getPointerFromObj
-         (interp, elms[ptr_data_ix + i], (void **)&range->ptr_data[i]);
+         (interp, elms[ptr_data_ix + i], (void **)&range.ptr_data[i]);
       if (status != TCL_OK) {
          return status;
       }
    }
 
    unsigned *intdataptr[] = {
-      &range->begin_int_data,
-      &range->end_int_data
+      &range.begin_int_data,
+      &range.end_int_data
    };
 
    for (int i = 0; i < 2; ++i) {
@@ -725,7 +949,10 @@ static int getRangeFromObj(Tcl_Interp    *interp,
       *intdataptr[i] = value;
    }
 
-   return status;
+   discardInternalRep(obj);
+   setLocationInternalRep(obj, &rangeObjType, NULL)->range = range;
+
+   return TCL_OK;
 
  invalid:
    if (interp != NULL) {
@@ -735,13 +962,49 @@ static int getRangeFromObj(Tcl_Interp    *interp,
    return TCL_ERROR;
 }
 
+static Tcl_Obj *newRangeObjForTU(struct TUInfo *tuInfo, CXSourceRange range)
+{
+   Tcl_Obj *obj = Tcl_NewObj();
+   Tcl_InvalidateStringRep(obj);
+   setLocationInternalRep(obj, &rangeObjType, tuInfo)->range = range;
+
+   return obj;
+}
+
+static Tcl_Obj *newRangeObj(CXSourceRange range)
+{
+   return newRangeObjForTU(NULL, range);
+}
+
+static int getRangeFromObj(Tcl_Interp    *interp,
+                           Tcl_Obj       *obj,
+                           CXSourceRange *range)
+{
+   if (obj->typePtr != &rangeObjType) {
+      int status = setRangeFromAny(interp, obj);
+      if (status != TCL_OK) {
+         return status;
+      }
+   }
+
+   int status = checkLocationTU(interp, obj, "range");
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   *range = ((LocationRep *)obj->internalRep.twoPtrValue.ptr1)->range;
+
+   return TCL_OK;
+}
+
 #if CINDEX_VERSION_MINOR >= 22
-static Tcl_Obj *newRangeListObj(CXSourceRangeList *rangeList)
+static Tcl_Obj *newRangeListObj(struct TUInfo     *tuInfo,
+                                CXSourceRangeList *rangeList)
 {
    Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
 
    for (int i = 0; i < rangeList->count; i++) {
-      Tcl_Obj *rangeObj = newRangeObj(rangeList->ranges[i]);
+      Tcl_Obj *rangeObj = newRangeObjForTU(tuInfo, rangeList->ranges[i]);
       Tcl_ListObjAppendElement(NULL, resultObj, rangeObj);
    }
 
@@ -785,10 +1048,11 @@ static Tcl_Obj *newPresumedLocationObj(CXSourceLocation location)
    return Tcl_NewListObj(nelms, elms);
 }
 
-static Tcl_Obj *newDecodedLocationObj(CXFile   file,
-                                      unsigned line,
-                                      unsigned column,
-                                      unsigned offset)
+static Tcl_Obj *newDecodedLocationObj(struct TUInfo *tuInfo,
+                                      CXFile         file,
+                                      unsigned       line,
+                                      unsigned       column,
+                                      unsigned       offset)
 {
    enum {
       filename_ix,
@@ -802,6 +1066,8 @@ static Tcl_Obj *newDecodedLocationObj(CXFile   file,
 
    if (file == NULL) {
       elms[filename_ix] = filenameNullObj;
+   } else if (tuInfo != NULL) {
+      elms[filename_ix] = newFileNameObjForTU(tuInfo, file);
    } else {
       CXString    filename     = clang_getFileName(file);
       const char *filenameCstr = clang_getCString(filename);
@@ -818,46 +1084,248 @@ static Tcl_Obj *newDecodedLocationObj(CXFile   file,
 
 //---------------------------------------------------- index & translationUnit
 
+struct TUInfo;
+
+/** The limits an index puts on the memory of its translation units.  The
+ * least recently used ones are evicted when a limit is exceeded.
+ *
+ * An evicted translation unit is parsed anew on its next use.  The cursors,
+ * types, locations and ranges made before the eviction don't survive it,
+ * and are rejected as values of an evicted translation unit.
+ */
+typedef struct TUPool
+{
+   Tcl_WideInt    maxBytes;     // 0 for no limit
+   int            maxTUs;       // 0 for no limit
+   unsigned long  clock;        // incremented on each use of a TU
+   int            overLimit;    // pinned TUs kept it over its limits
+   Tcl_WideInt    evictions;
+   Tcl_WideInt    restorations;
+} TUPool;
+
 /** The information associated to an index Tcl command.
  */
 typedef struct IndexInfo
 {
-   Tcl_Interp *interp;
-   Tcl_Command cmd;
-   CXIndex     index;
+   Tcl_Interp    *interp;
+   Tcl_Command    cmd;
+   CXIndex            index;
+   unsigned           createOptions; // the arguments of clang_createIndex
+   int                numWorkerIndexes;
+   CXIndex           *workerIndexes; // for parseBatch workers, async parses
+   int                numFreeWorkerIndexes;
+   CXIndex           *freeWorkerIndexes; // the ones no parse is using
+   struct TUInfo     *firstTU;  // the translation units of this index
+   struct AsyncParse *firstAsyncParse; // the parses running in background
+   struct Disposer   *disposer; // NULL until a reparse replaces a TU
+   TUPool             pool;
+   int                numDeletedBusyTUs; // deleted, but still in use
+   int                deleted;  // the command is gone, waiting for them
 } IndexInfo;
 
+/** Cursors interned by a translation unit in handle mode.
+ *
+ * Each distinct cursor gets a small integer handle, and its cursor object is
+ * shared by every command that returns it while a script holds it.  The
+ * table doesn't own the objects: an object clears its slot when it is freed,
+ * and only the cursor stays so that the handle string can be resolved.  The
+ * table is emptied whenever the translation unit's generation changes.
+ */
+typedef struct CursorHandleTable
+{
+   int            enabled;
+   int            numHandles;
+   int            capacity;
+   CXCursor      *cursors;      // indexed by handle
+   Tcl_Obj      **objs;         // indexed by handle, NULL once freed
+   Tcl_HashTable  handles;      // normalized CXCursor -> handle
+} CursorHandleTable;
+
+/** A node of the AST index of a translation unit.
+ *
+ * The links are indices of ASTIndex.nodes, or -1 if there is no such node.
+ * The extent is in expansion offsets of file.
+ */
+typedef struct ASTNode
+{
+   CXCursor  cursor;
+   int       parent;            // -1 for the children of the root
+   int       firstChild;
+   int       nextSibling;
+   int       nextOccurrence;    // the next node of an equal cursor, or -1
+   int       depth;             // 1 for the children of the root
+   CXFile    file;              // the file of the start of the extent
+   unsigned  startOffset;
+   unsigned  endOffset;
+} ASTNode;
+
+/** The AST of a translation unit materialized by tu buildIndex.
+ *
+ * The nodes are in pre-order, so node 0 is the first child of the root.
+ * It is discarded whenever the translation unit's generation changes.
+ */
+typedef struct ASTIndex
+{
+   int            numNodes;
+   int            capacity;
+   ASTNode       *nodes;
+   Tcl_HashTable  nodeIds;      // normalized CXCursor -> first node index
+   Tcl_HashTable  intervalTrees; // CXFile -> IntervalTree, built on demand
+} ASTIndex;
+
 /** The information associated to a translationUnit Tcl command.
  */
 typedef struct TUInfo
 {
-   struct TUInfo     *next;
+   struct TUInfo     *next;            // the next TU of parent
+   struct TUInfo    **prevPtr;         // the link pointing to this TU
    IndexInfo         *parent;
    Tcl_Command        cmd;
-   CXTranslationUnit  translationUnit;
+   CXTranslationUnit  translationUnit; // NULL after the command is deleted
+                                       // or while the TU is evicted
+   unsigned           generation;      // incremented on each reparse
+                                       // and eviction
+   unsigned           reparseGeneration; // set by the last reparse
+   int                refCount;        // the command and each cursor object
+   CursorHandleTable  cursorHandles;
+   Tcl_HashTable      fileNames;       // CXFile -> file name Tcl_Obj
+   Tcl_WideInt        fileNameHits;
+   Tcl_WideInt        fileNameMisses;
+   ASTIndex          *astIndex;        // NULL until it is needed
+   Tcl_HashTable      lineTables;      // CXFile -> LineTable, on demand
+   struct ParseJob   *parseArgs;       // how to parse it anew
+   struct AsyncParse *reparse;         // the running background reparse
+   struct ParseJob   *nextReparse;     // the one to run after it, or NULL
+   Tcl_Obj           *nextReparseCommands; // the callbacks of nextReparse
+   unsigned           syncReparses;    // the synchronous reparses so far
+   int                pinCount;        // the holders keeping it loaded
+   int                busyCount;       // the calls running inside libclang
+   struct AsyncParse *deferredParse;   // a finished reparse waiting for
+                                       // busyCount to drop to 0
+   CXTranslationUnit  deletedTU;       // the AST of a deleted command,
+                                       // disposed when busyCount drops to 0
+   int                suspended;       // evicted by the pool
+   unsigned long      lastUse;         // parent->pool.clock at last use
+   Tcl_WideInt        residentBytes;   // as of the last pool check
 } TUInfo;
 
+struct ParseJob;
+struct AsyncParse;
+
+static struct ParseJob *copyParseJob(const struct ParseJob *job,
+                                     Tcl_Obj               *unsavedFileList);
+static void deleteParseJob(struct ParseJob *job);
+static void requestBackgroundReparse(Tcl_Interp      *interp,
+                                     TUInfo          *info,
+                                     Tcl_Obj         *commandObj,
+                                     struct ParseJob *job);
+static void cancelBackgroundReparses(TUInfo *info);
+static void queueAsyncParseEvent(struct AsyncParse *parse);
+static void cancelAsyncParses(IndexInfo *parent);
+static void freeIndexInfo(IndexInfo *info);
+static void stopDisposer(IndexInfo *parent);
+static void enforceTUPool(IndexInfo *parent, TUInfo *keep);
+static int usePooledTU(Tcl_Interp *interp, TUInfo *info);
+
 /** Table holding all created translation units's command info.
+ *
+ * An open addressing hash table with linear probing, keyed by
+ * CXTranslationUnit.  The number of slots is a power of two and the table
+ * is kept at most half full.
  */
-static TUInfo *tuHashTable[32];
+static struct {
+   TUInfo **slots;
+   size_t   capacity;
+   size_t   count;
+} tuRegistry;
 
 /**
- * Calculate a hash of a translationUnit.
+ * Calculate the home slot of a translationUnit in tuRegistry.
  */
-static int tuHash(CXTranslationUnit tu)
+static size_t tuHash(CXTranslationUnit tu)
+{
+   uint64_t hash = (uint64_t)(uintptr_t)tu * UINT64_C(0x9e3779b97f4a7c15);
+   return (size_t)(hash >> 32) & (tuRegistry.capacity - 1);
+}
+
+static void insertTUSlot(TUInfo *info)
+{
+   size_t mask = tuRegistry.capacity - 1;
+   size_t i    = tuHash(info->translationUnit);
+   while (tuRegistry.slots[i] != NULL) {
+      i = (i + 1) & mask;
+   }
+   tuRegistry.slots[i] = info;
+}
+
+static void registerTU(TUInfo *info)
+{
+   if ((tuRegistry.count + 1) * 2 > tuRegistry.capacity) {
+      TUInfo **oldSlots    = tuRegistry.slots;
+      size_t   oldCapacity = tuRegistry.capacity;
+
+      tuRegistry.capacity = oldCapacity == 0 ? 64 : oldCapacity * 2;
+      tuRegistry.slots    = (TUInfo **)
+         Tcl_Alloc(tuRegistry.capacity * sizeof tuRegistry.slots[0]);
+      memset(tuRegistry.slots, 0,
+             tuRegistry.capacity * sizeof tuRegistry.slots[0]);
+
+      for (size_t i = 0; i < oldCapacity; ++i) {
+         if (oldSlots[i] != NULL) {
+            insertTUSlot(oldSlots[i]);
+         }
+      }
+      Tcl_Free((char *)oldSlots);
+   }
+
+   insertTUSlot(info);
+   ++tuRegistry.count;
+}
+
+static void unregisterTU(TUInfo *info)
 {
-   int hashTableSize = sizeof tuHashTable / sizeof tuHashTable[0];
-   return ((uintptr_t)tu / (sizeof(void *) * 4)) % hashTableSize;
+   size_t mask = tuRegistry.capacity - 1;
+   size_t i    = tuHash(info->translationUnit);
+   while (tuRegistry.slots[i] != info) {
+      i = (i + 1) & mask;
+   }
+
+   // Shift the following entries of the cluster back so that no probe
+   // sequence is broken by the hole.
+   for (size_t j = (i + 1) & mask; tuRegistry.slots[j] != NULL;
+        j = (j + 1) & mask) {
+      size_t home = tuHash(tuRegistry.slots[j]->translationUnit);
+      if (((j - home) & mask) >= ((j - i) & mask)) {
+         tuRegistry.slots[i] = tuRegistry.slots[j];
+         i                   = j;
+      }
+   }
+   tuRegistry.slots[i] = NULL;
+   --tuRegistry.count;
 }
 
 //---------------------------------------------------------------------- index
 
-static IndexInfo *createIndexInfo(Tcl_Interp *interp, CXIndex index, Tcl_Command cmd)
+static IndexInfo *createIndexInfo(Tcl_Interp  *interp,
+                                  CXIndex      index,
+                                  unsigned     createOptions,
+                                  Tcl_Command  cmd)
 {
    IndexInfo *info = (IndexInfo *)Tcl_Alloc(sizeof *info);
    info->interp    = interp;
    info->index     = index;
+   info->createOptions    = createOptions;
+   info->numWorkerIndexes = 0;
+   info->workerIndexes    = NULL;
+   info->numFreeWorkerIndexes = 0;
+   info->freeWorkerIndexes    = NULL;
    info->cmd       = cmd;
+   info->firstTU   = NULL;
+   info->firstAsyncParse = NULL;
+   info->disposer        = NULL;
+   memset(&info->pool, 0, sizeof info->pool);
+   info->numDeletedBusyTUs = 0;
+   info->deleted           = 0;
 
    return info;
 }
@@ -872,19 +1340,79 @@ static void indexDeleteProc(ClientData clientData)
 
    Tcl_Interp *interp = info->interp;
 
-   int numentries = sizeof tuHashTable / sizeof tuHashTable[0];
-   for (int i = 0; i < numentries; i++) {
-      for (TUInfo *t = tuHashTable[i]; t != NULL; t = t->next) {
-         if (t->parent == info) {
-            Tcl_DeleteCommandFromToken(interp, t->cmd);
-         }
-      }
+   cancelAsyncParses(info);
+
+   // tuDeleteProc unlinks each translation unit from info->firstTU.
+   while (info->firstTU != NULL) {
+      Tcl_DeleteCommandFromToken(interp, info->firstTU->cmd);
+   }
+
+   stopDisposer(info);
+
+   // The translation units still in use are disposed when they are left,
+   // and the index must outlive them.
+   info->deleted = 1;
+   if (info->numDeletedBusyTUs == 0) {
+      freeIndexInfo(info);
+   }
+}
+
+/** Dispose of the index of info once its command and all its translation
+ * units are gone.
+ */
+static void freeIndexInfo(IndexInfo *info)
+{
+   // The translation units parsed on worker indexes are all gone now.
+   for (int i = 0; i < info->numWorkerIndexes; ++i) {
+      clang_disposeIndex(info->workerIndexes[i]);
    }
+   Tcl_Free((char *)info->workerIndexes);
+   Tcl_Free((char *)info->freeWorkerIndexes);
 
    clang_disposeIndex(info->index);
    Tcl_Free((char *)info);
+}
 
-   return;
+/** Return an index of parent that no other parse is using, for a parse on
+ * a worker thread, or NULL if it can't be created.  libclang doesn't allow
+ * concurrent parses on an index.  The worker indexes are kept until parent
+ * is deleted, as the translation units parsed on them must not outlive
+ * them.
+ */
+static CXIndex acquireWorkerIndex(IndexInfo *parent)
+{
+   CXIndex index;
+   if (parent->numFreeWorkerIndexes > 0) {
+      index = parent->freeWorkerIndexes[--parent->numFreeWorkerIndexes];
+   } else {
+      index = clang_createIndex(parent->createOptions & (1 << 0),
+                                parent->createOptions & (1 << 1));
+      if (index == NULL) {
+         return NULL;
+      }
+
+      int n = parent->numWorkerIndexes + 1;
+      parent->workerIndexes = (CXIndex *)
+         Tcl_Realloc((char *)parent->workerIndexes,
+                     n * sizeof parent->workerIndexes[0]);
+      parent->freeWorkerIndexes = (CXIndex *)
+         Tcl_Realloc((char *)parent->freeWorkerIndexes,
+                     n * sizeof parent->freeWorkerIndexes[0]);
+      parent->workerIndexes[parent->numWorkerIndexes++] = index;
+   }
+
+   clang_CXIndex_setGlobalOptions
+      (index, clang_CXIndex_getGlobalOptions(parent->index));
+
+   return index;
+}
+
+/** Give back an index returned by acquireWorkerIndex once its parse is
+ * done.
+ */
+static void releaseWorkerIndex(IndexInfo *parent, CXIndex index)
+{
+   parent->freeWorkerIndexes[parent->numFreeWorkerIndexes++] = index;
 }
 
 //----------------------------------------------------------- translation unit
@@ -898,351 +1426,1046 @@ static TUInfo * createTUInfo(IndexInfo         *parent,
    info->parent          = parent;
    info->translationUnit = tu;
    info->cmd             = cmd;
-
-   int hash          = tuHash(tu);
-   info->next        = tuHashTable[hash];
-   tuHashTable[hash] = info;
+   info->generation      = 0;
+   info->reparseGeneration = 0;
+   info->refCount        = 1;
+
+   CursorHandleTable *table = &info->cursorHandles;
+   table->enabled    = 0;
+   table->numHandles = 0;
+   table->capacity   = 0;
+   table->cursors    = NULL;
+   table->objs       = NULL;
+   Tcl_InitHashTable(&table->handles, sizeof(CXCursor) / sizeof(int));
+
+   Tcl_InitHashTable(&info->fileNames, TCL_ONE_WORD_KEYS);
+   info->fileNameHits   = 0;
+   info->fileNameMisses = 0;
+   info->astIndex       = NULL;
+   Tcl_InitHashTable(&info->lineTables, TCL_ONE_WORD_KEYS);
+   info->parseArgs      = NULL;
+   info->reparse        = NULL;
+   info->nextReparse    = NULL;
+   info->nextReparseCommands = NULL;
+   info->syncReparses   = 0;
+   info->pinCount       = 0;
+   info->busyCount      = 0;
+   info->deletedTU      = NULL;
+   info->deferredParse  = NULL;
+   info->suspended      = 0;
+   info->lastUse        = 0;
+   info->residentBytes  = 0;
+
+   info->next    = parent->firstTU;
+   info->prevPtr = &parent->firstTU;
+   if (parent->firstTU != NULL) {
+      parent->firstTU->prevPtr = &info->next;
+   }
+   parent->firstTU = info;
+
+   registerTU(info);
 
    return info;
 }
 
-static void tuDeleteProc(ClientData clientData)
+/** Forget all the handles of a translation unit.
+ *
+ * Cursor objects still referenced by scripts keep their internal
+ * representation, but their handles can't be resolved any more.
+ */
+static void clearCursorHandles(TUInfo *info)
 {
-   TUInfo *info = (TUInfo *)clientData;
+   CursorHandleTable *table = &info->cursorHandles;
 
-   clang_disposeTranslationUnit(info->translationUnit);
+   table->numHandles = 0;
 
-   int      hash = tuHash(info->translationUnit);
-   TUInfo **prev = &tuHashTable[hash];
-   while (*prev != info) {
-      prev = &((*prev)->next);
-   }
-   *prev = info->next;
-
-   Tcl_Free((char *)info);
+   Tcl_DeleteHashTable(&table->handles);
+   Tcl_InitHashTable(&table->handles, sizeof(CXCursor) / sizeof(int));
 }
 
-static TUInfo * lookupTranslationUnit(CXTranslationUnit tu)
+/** Forget the cached file names of a translation unit.
+ */
+static void clearFileNames(TUInfo *info)
 {
-   int hash = tuHash(tu);
-   for (TUInfo *p = tuHashTable[hash]; p != NULL; p = p->next) {
-      if (p->translationUnit == tu) {
-         return p;
-      }
+   Tcl_HashSearch search;
+   for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(&info->fileNames, &search);
+        entry != NULL;
+        entry = Tcl_NextHashEntry(&search)) {
+      Tcl_DecrRefCount((Tcl_Obj *)Tcl_GetHashValue(entry));
    }
 
-   return NULL;
+   Tcl_DeleteHashTable(&info->fileNames);
+   Tcl_InitHashTable(&info->fileNames, TCL_ONE_WORD_KEYS);
 }
 
-//----------------------------------------------------------------- diagnostic
+/** The offsets at which the lines of a file start, so that offsets and
+ * line/column pairs can be converted without asking libclang.
+ */
+typedef struct LineTable
+{
+   int       numLines;
+   unsigned  size;              // the size of the file
+   unsigned *lineStarts;
+} LineTable;
 
-static EnumConsts diagnosticSeverityLabels = {
-   .names = {
-      "ignored",
-      "note",
-      "warning",
-      "error",
-      "fatal"
+/** Forget the line tables of a translation unit.
+ */
+static void clearLineTables(TUInfo *info)
+{
+   Tcl_HashSearch search;
+   for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(&info->lineTables, &search);
+        entry != NULL;
+        entry = Tcl_NextHashEntry(&search)) {
+      LineTable *table = (LineTable *)Tcl_GetHashValue(entry);
+      Tcl_Free((char *)table->lineStarts);
+      Tcl_Free((char *)table);
    }
-};
 
-static Tcl_Obj *diagnosticSeverityTagObj;
-static Tcl_Obj *diagnosticLocationTagObj;
-static Tcl_Obj *diagnosticSpellingTagObj;
-static Tcl_Obj *diagnosticEnableTagObj;
-static Tcl_Obj *diagnosticDisableTagObj;
-static Tcl_Obj *diagnosticCategoryTagObj;
-static Tcl_Obj *diagnosticRangesTagObj;
-static Tcl_Obj *diagnosticFixItsTagObj;
+   Tcl_DeleteHashTable(&info->lineTables);
+   Tcl_InitHashTable(&info->lineTables, TCL_ONE_WORD_KEYS);
+}
 
-static Tcl_Obj *newDiagnosticObj(CXDiagnostic diagnostic)
+/** An interval tree over the extents of the AST index nodes starting in a
+ * file.
+ *
+ * ids holds the nodes sorted by start offset.  They form an implicit
+ * balanced search tree: the root of ids[lo .. hi - 1] is the middle
+ * element.  maxEnd[i] is the largest end offset in the subtree rooted at
+ * ids[i].
+ */
+typedef struct IntervalTree
 {
-   enum {
-      severity_tag_ix,
-      severity_ix,
-      location_tag_ix,
-      location_ix,
-      spelling_tag_ix,
-      spelling_ix,
-      enable_tag_ix,
-      enable_ix,
-      disable_tag_ix,
-      disable_ix,
-      category_tag_ix,
-      category_ix,
-      ranges_tag_ix,
-      ranges_ix,
-      fixits_tag_ix,
-      fixits_ix,
-      nelms
-   };
-   Tcl_Obj *resultArray[nelms];
+   int       numIds;
+   int      *ids;
+   unsigned *maxEnd;
+} IntervalTree;
 
-   resultArray[severity_tag_ix] = diagnosticSeverityTagObj;
-   resultArray[location_tag_ix] = diagnosticLocationTagObj;
-   resultArray[spelling_tag_ix] = diagnosticSpellingTagObj;
-   resultArray[enable_tag_ix]   = diagnosticEnableTagObj;
-   resultArray[disable_tag_ix]  = diagnosticDisableTagObj;
-   resultArray[category_tag_ix] = diagnosticCategoryTagObj;
-   resultArray[ranges_tag_ix]   = diagnosticRangesTagObj;
-   resultArray[fixits_tag_ix]   = diagnosticFixItsTagObj;
+/** A node found by queryIntervalTree.
+ */
+typedef struct IntervalTreeHit
+{
+   int       depth;
+   unsigned  startOffset;
+   int       id;
+} IntervalTreeHit;
 
-   enum CXDiagnosticSeverity severity
-      = clang_getDiagnosticSeverity(diagnostic);
-   resultArray[severity_ix]
-      = getEnum(&diagnosticSeverityLabels, severity);
+typedef struct IntervalTreeHits
+{
+   int              numHits;
+   int              capacity;
+   IntervalTreeHit *hits;
+} IntervalTreeHits;
 
-   CXSourceLocation location = clang_getDiagnosticLocation(diagnostic);
-   resultArray[location_ix]  = newLocationObj(location);
+static int compareIntervalTreeHits(const void *lhs, const void *rhs)
+{
+   const IntervalTreeHit *a = (const IntervalTreeHit *)lhs;
+   const IntervalTreeHit *b = (const IntervalTreeHit *)rhs;
 
-   CXString spelling        = clang_getDiagnosticSpelling(diagnostic);
-   resultArray[spelling_ix] = convertCXStringToObj(spelling);
+   // The innermost first.
+   if (a->depth != b->depth) {
+      return b->depth - a->depth;
+   }
 
-   CXString disable;
-   CXString option         = clang_getDiagnosticOption(diagnostic, &disable);
-   resultArray[enable_ix]  = convertCXStringToObj(option);
-   resultArray[disable_ix] = convertCXStringToObj(disable);
+   if (a->startOffset != b->startOffset) {
+      return a->startOffset < b->startOffset ? 1 : -1;
+   }
 
-   CXString category        = clang_getDiagnosticCategoryText(diagnostic);
-   resultArray[category_ix] = convertCXStringToObj(category);
+   return a->id - b->id;
+}
 
-   unsigned   numRanges = clang_getDiagnosticNumRanges(diagnostic);
-   Tcl_Obj  **ranges    = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *) * numRanges);
-   for (unsigned i = 0; i < numRanges; ++i) {
-      CXSourceRange range = clang_getDiagnosticRange(diagnostic, i);
-      ranges[i]           = newRangeObj(range);
+static unsigned buildIntervalTreeMaxEnd(const ASTIndex *index,
+                                        IntervalTree   *tree,
+                                        int             lo,
+                                        int             hi)
+{
+   if (hi <= lo) {
+      return 0;
    }
-   resultArray[ranges_ix] = Tcl_NewListObj(numRanges, ranges);
-   Tcl_Free((char *)ranges);
 
-   unsigned   numFixIts = clang_getDiagnosticNumFixIts(diagnostic);
-   Tcl_Obj  **fixits    = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *) * numFixIts);
-   for (unsigned i = 0; i < numFixIts; ++i) {
-      CXSourceRange range;
-      CXString      fixitStr = clang_getDiagnosticFixIt(diagnostic, i, &range);
+   int      mid    = lo + (hi - lo) / 2;
+   unsigned maxEnd = index->nodes[tree->ids[mid]].endOffset;
+   unsigned left   = buildIntervalTreeMaxEnd(index, tree, lo, mid);
+   unsigned right  = buildIntervalTreeMaxEnd(index, tree, mid + 1, hi);
 
-      Tcl_Obj *fixit[2];
-      fixit[0] = newRangeObj(range);
-      fixit[1] = convertCXStringToObj(fixitStr);
+   maxEnd = left > maxEnd ? left : maxEnd;
+   maxEnd = right > maxEnd ? right : maxEnd;
+   tree->maxEnd[mid] = maxEnd;
 
-      fixits[i] = Tcl_NewListObj(2, fixit);
+   return maxEnd;
+}
+
+/** Return the interval tree of file, building it if necessary.
+ */
+static IntervalTree *getIntervalTree(ASTIndex *index, CXFile file)
+{
+   int            created;
+   Tcl_HashEntry *entry = Tcl_CreateHashEntry(&index->intervalTrees,
+                                              (const char *)file, &created);
+   if (!created) {
+      return (IntervalTree *)Tcl_GetHashValue(entry);
+   }
+
+   IntervalTree *tree = (IntervalTree *)Tcl_Alloc(sizeof *tree);
+   Tcl_SetHashValue(entry, tree);
+
+   // Sort (start offset, id) pairs, since qsort can't see the nodes.
+   IntervalTreeHit *keys = (IntervalTreeHit *)
+      Tcl_Alloc(index->numNodes * sizeof keys[0] + 1);
+   int n = 0;
+   for (int i = 0; i < index->numNodes; ++i) {
+      if (index->nodes[i].file == file) {
+         keys[n].depth       = 0;
+         keys[n].startOffset = index->nodes[i].startOffset;
+         keys[n].id          = i;
+         ++n;
+      }
    }
-   resultArray[fixits_ix] = Tcl_NewListObj(numFixIts, fixits);
-   Tcl_Free((char *)fixits);
+   qsort(keys, n, sizeof keys[0], compareIntervalTreeHits);
 
-   return Tcl_NewListObj(nelms, resultArray);
+   // compareIntervalTreeHits sorts in descending order.
+   tree->numIds = n;
+   tree->ids    = (int *)Tcl_Alloc(n * sizeof tree->ids[0] + 1);
+   tree->maxEnd = (unsigned *)Tcl_Alloc(n * sizeof tree->maxEnd[0] + 1);
+   for (int i = 0; i < n; ++i) {
+      tree->ids[i] = keys[n - 1 - i].id;
+   }
+   Tcl_Free((char *)keys);
+
+   buildIntervalTreeMaxEnd(index, tree, 0, n);
+
+   return tree;
 }
 
-//--------------------------------------------------------------------- cursor
+static void deleteIntervalTrees(ASTIndex *index)
+{
+   Tcl_HashSearch search;
+   for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(&index->intervalTrees,
+                                                  &search);
+        entry != NULL;
+        entry = Tcl_NextHashEntry(&search)) {
+      IntervalTree *tree = (IntervalTree *)Tcl_GetHashValue(entry);
+      Tcl_Free((char *)tree->ids);
+      Tcl_Free((char *)tree->maxEnd);
+      Tcl_Free((char *)tree);
+   }
 
-static Tcl_Obj *cursorKindNames;
-static Tcl_Obj *cursorKindValues;
+   Tcl_DeleteHashTable(&index->intervalTrees);
+}
 
-static void createCursorKindTable(void)
+/** Add the nodes in ids[lo .. hi - 1] whose extents overlap [start, end) to
+ * hits.
+ */
+static void queryIntervalTree(const ASTIndex     *index,
+                              const IntervalTree *tree,
+                              int                 lo,
+                              int                 hi,
+                              unsigned            start,
+                              unsigned            end,
+                              IntervalTreeHits   *hits)
+{
+   while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+      if (tree->maxEnd[mid] <= start) {
+         return;
+      }
+
+      queryIntervalTree(index, tree, lo, mid, start, end, hits);
+
+      const ASTNode *node = &index->nodes[tree->ids[mid]];
+      if (end <= node->startOffset) {
+         return;
+      }
+
+      if (start < node->endOffset) {
+         if (hits->numHits == hits->capacity) {
+            hits->capacity = hits->capacity == 0 ? 16 : hits->capacity * 2;
+            hits->hits     = (IntervalTreeHit *)
+               Tcl_Realloc((char *)hits->hits,
+                           hits->capacity * sizeof hits->hits[0]);
+         }
+         IntervalTreeHit *hit = &hits->hits[hits->numHits++];
+         hit->depth       = node->depth;
+         hit->startOffset = node->startOffset;
+         hit->id          = tree->ids[mid];
+      }
+
+      lo = mid + 1;
+   }
+}
+
+/** Discard the AST index of a translation unit.
+ */
+static void deleteASTIndex(TUInfo *info)
 {
-   static NameValuePair table[] = {
-      { "UnexposedDecl",
-        CXCursor_UnexposedDecl },
-      { "StructDecl",
-        CXCursor_StructDecl },
-      { "UnionDecl",
-        CXCursor_UnionDecl },
-      { "ClassDecl",
-        CXCursor_ClassDecl },
-      { "EnumDecl",
-        CXCursor_EnumDecl },
-      { "FieldDecl",
-        CXCursor_FieldDecl },
-      { "EnumConstantDecl",
-        CXCursor_EnumConstantDecl },
-      { "FunctionDecl",
-        CXCursor_FunctionDecl },
-      { "VarDecl",
-        CXCursor_VarDecl },
-      { "ParmDecl",
-        CXCursor_ParmDecl },
-      { "ObjCInterfaceDecl",
-        CXCursor_ObjCInterfaceDecl },
-      { "ObjCCategoryDecl",
-        CXCursor_ObjCCategoryDecl },
-      { "ObjCProtocolDecl",
-        CXCursor_ObjCProtocolDecl },
-      { "ObjCPropertyDecl",
-        CXCursor_ObjCPropertyDecl },
-      { "ObjCIvarDecl",
-        CXCursor_ObjCIvarDecl },
-      { "ObjCInstanceMethodDecl",
-        CXCursor_ObjCInstanceMethodDecl },
-      { "ObjCClassMethodDecl",
-        CXCursor_ObjCClassMethodDecl },
-      { "ObjCImplementationDecl",
-        CXCursor_ObjCImplementationDecl },
-      { "ObjCCategoryImplDecl",
-        CXCursor_ObjCCategoryImplDecl },
-      { "TypedefDecl",
-        CXCursor_TypedefDecl },
-      { "CXXMethod",
-        CXCursor_CXXMethod },
-      { "Namespace",
-        CXCursor_Namespace },
-      { "LinkageSpec",
-        CXCursor_LinkageSpec },
-      { "Constructor",
-        CXCursor_Constructor },
-      { "Destructor",
-        CXCursor_Destructor },
-      { "ConversionFunction",
-        CXCursor_ConversionFunction },
-      { "TemplateTypeParameter",
-        CXCursor_TemplateTypeParameter },
-      { "NonTypeTemplateParameter",
-        CXCursor_NonTypeTemplateParameter },
-      { "TemplateTemplateParameter",
-        CXCursor_TemplateTemplateParameter },
-      { "FunctionTemplate",
-        CXCursor_FunctionTemplate },
-      { "ClassTemplate",
-        CXCursor_ClassTemplate },
-      { "ClassTemplatePartialSpecialization",
-        CXCursor_ClassTemplatePartialSpecialization },
-      { "NamespaceAlias",
-        CXCursor_NamespaceAlias },
-      { "UsingDirective",
-        CXCursor_UsingDirective },
-      { "UsingDeclaration",
-        CXCursor_UsingDeclaration },
-      { "TypeAliasDecl",
-        CXCursor_TypeAliasDecl },
-      { "ObjCSynthesizeDecl",
-        CXCursor_ObjCSynthesizeDecl },
-      { "ObjCDynamicDecl",
-        CXCursor_ObjCDynamicDecl },
-      { "CXXAccessSpecifier",
-        CXCursor_CXXAccessSpecifier },
-      /* { "CXCursor_FirstDecl", */
-      /*   CXCursor_FirstDecl }, */
-      /* { "CXCursor_LastDecl", */
-      /*   CXCursor_LastDecl }, */
-      /* { "FirstRef", */
-      /*   CXCursor_FirstRef }, */
-      { "ObjCSuperClassRef",
-        CXCursor_ObjCSuperClassRef },
-      { "ObjCProtocolRef",
-        CXCursor_ObjCProtocolRef },
-      { "ObjCClassRef",
-        CXCursor_ObjCClassRef },
-      { "TypeRef",
-        CXCursor_TypeRef },
-      { "CXXBaseSpecifier",
-        CXCursor_CXXBaseSpecifier },
-      { "TemplateRef",
-        CXCursor_TemplateRef },
-      { "NamespaceRef",
-        CXCursor_NamespaceRef },
-      { "MemberRef",
-        CXCursor_MemberRef },
-      { "LabelRef",
-        CXCursor_LabelRef },
-      { "OverloadedDeclRef",
-        CXCursor_OverloadedDeclRef },
-      { "VariableRef",
-        CXCursor_VariableRef },
-      /* { "LastRef", */
-      /*   CXCursor_LastRef }, */
-      /* { "FirstInvalid", */
-      /*   CXCursor_FirstInvalid }, */
-      { "InvalidFile",
-        CXCursor_InvalidFile },
-      { "NoDeclFound",
-        CXCursor_NoDeclFound },
-      { "NotImplemented",
-        CXCursor_NotImplemented },
-      { "InvalidCode",
-        CXCursor_InvalidCode },
-      /* { "LastInvalid", */
-      /*   CXCursor_LastInvalid }, */
-      /* { "FirstExpr", */
-      /*   CXCursor_FirstExpr }, */
-      { "UnexposedExpr",
-        CXCursor_UnexposedExpr },
-      { "DeclRefExpr",
-        CXCursor_DeclRefExpr },
-      { "MemberRefExpr",
-        CXCursor_MemberRefExpr },
-      { "CallExpr",
-        CXCursor_CallExpr },
-      { "ObjCMessageExpr",
-        CXCursor_ObjCMessageExpr },
-      { "BlockExpr",
-        CXCursor_BlockExpr },
-      { "IntegerLiteral",
-        CXCursor_IntegerLiteral },
-      { "FloatingLiteral",
-        CXCursor_FloatingLiteral },
-      { "ImaginaryLiteral",
-        CXCursor_ImaginaryLiteral },
-      { "StringLiteral",
-        CXCursor_StringLiteral },
-      { "CharacterLiteral",
-        CXCursor_CharacterLiteral },
-      { "ParenExpr",
-        CXCursor_ParenExpr },
-      { "UnaryOperator",
-        CXCursor_UnaryOperator },
-      { "ArraySubscriptExpr",
-        CXCursor_ArraySubscriptExpr },
-      { "BinaryOperator",
-        CXCursor_BinaryOperator },
-      { "CompoundAssignOperator",
-        CXCursor_CompoundAssignOperator },
-      { "ConditionalOperator",
-        CXCursor_ConditionalOperator },
-      { "CStyleCastExpr",
-        CXCursor_CStyleCastExpr },
-      { "CompoundLiteralExpr",
-        CXCursor_CompoundLiteralExpr },
-      { "InitListExpr",
-        CXCursor_InitListExpr },
-      { "AddrLabelExpr",
-        CXCursor_AddrLabelExpr },
-      { "StmtExpr",
-        CXCursor_StmtExpr },
-      { "GenericSelectionExpr",
-        CXCursor_GenericSelectionExpr },
-      { "GNUNullExpr",
-        CXCursor_GNUNullExpr },
-      { "CXXStaticCastExpr",
-        CXCursor_CXXStaticCastExpr },
-      { "CXXDynamicCastExpr",
-        CXCursor_CXXDynamicCastExpr },
-      { "CXXReinterpretCastExpr",
-        CXCursor_CXXReinterpretCastExpr },
-      { "CXXConstCastExpr",
-        CXCursor_CXXConstCastExpr },
-      { "CXXFunctionalCastExpr",
-        CXCursor_CXXFunctionalCastExpr },
-      { "CXXTypeidExpr",
-        CXCursor_CXXTypeidExpr },
-      { "CXXBoolLiteralExpr",
-        CXCursor_CXXBoolLiteralExpr },
-      { "CXXNullPtrLiteralExpr",
-        CXCursor_CXXNullPtrLiteralExpr },
-      { "CXXThisExpr",
-        CXCursor_CXXThisExpr },
-      { "CXXThrowExpr",
-        CXCursor_CXXThrowExpr },
-      { "CXXNewExpr",
-        CXCursor_CXXNewExpr },
-      { "CXXDeleteExpr",
-        CXCursor_CXXDeleteExpr },
-      { "UnaryExpr",
-        CXCursor_UnaryExpr },
-      { "ObjCStringLiteral",
-        CXCursor_ObjCStringLiteral },
-      { "ObjCEncodeExpr",
-        CXCursor_ObjCEncodeExpr },
-      { "ObjCSelectorExpr",
-        CXCursor_ObjCSelectorExpr },
+   ASTIndex *index = info->astIndex;
+   if (index == NULL) {
+      return;
+   }
+
+   Tcl_DeleteHashTable(&index->nodeIds);
+   deleteIntervalTrees(index);
+   Tcl_Free((char *)index->nodes);
+   Tcl_Free((char *)index);
+   info->astIndex = NULL;
+}
+
+// clang_equalCursors ignores data[1] of declarations, which depends on the
+// path the cursor was reached by.  Clear it to make a hash key.
+static CXCursor getASTIndexKey(CXCursor cursor)
+{
+   if (clang_isDeclaration(clang_getCursorKind(cursor))) {
+      cursor.data[1] = NULL;
+   }
+
+   return cursor;
+}
+
+/** A cursor waiting to become a node while an AST index is built.
+ */
+typedef struct PendingASTNode
+{
+   CXCursor cursor;
+   int      parent;
+   int      depth;
+} PendingASTNode;
+
+/** The state of buildASTIndex.  The top of the stack of pending cursors is
+ * the next node in pre-order.
+ */
+typedef struct BuildASTIndexInfo
+{
+   PendingASTNode *pending;
+   int             numPending;
+   int             capacity;
+   int            *lastChild;   // per node, the last child linked so far
+} BuildASTIndexInfo;
+
+static enum CXChildVisitResult pushASTIndexChild(CXCursor     cursor,
+                                                 CXCursor     parent,
+                                                 CXClientData clientData)
+{
+   BuildASTIndexInfo *info = (BuildASTIndexInfo *)clientData;
+
+   if (info->numPending == info->capacity) {
+      info->capacity = info->capacity == 0 ? 256 : info->capacity * 2;
+      info->pending  = (PendingASTNode *)
+         Tcl_Realloc((char *)info->pending,
+                     info->capacity * sizeof info->pending[0]);
+   }
+   info->pending[info->numPending++].cursor = cursor;
+
+   return CXChildVisit_Continue;
+}
+
+// Push the children of cursor, the first one on the top.
+static void pushASTIndexChildren(BuildASTIndexInfo *info,
+                                 CXCursor           cursor,
+                                 int                parent,
+                                 int                depth)
+{
+   int first = info->numPending;
+   clang_visitChildren(cursor, pushASTIndexChild, info);
+
+   for (int i = first, j = info->numPending - 1; i < j; ++i, --j) {
+      CXCursor tmp = info->pending[i].cursor;
+      info->pending[i].cursor = info->pending[j].cursor;
+      info->pending[j].cursor = tmp;
+   }
+   for (int i = first; i < info->numPending; ++i) {
+      info->pending[i].parent = parent;
+      info->pending[i].depth  = depth;
+   }
+}
+
+/** Add the nodes of the subtree of root to index in pre-order.  The stack
+ * of pending cursors is explicit, so deep ASTs don't overflow the C stack.
+ */
+static void buildASTIndex(ASTIndex *index, CXCursor root)
+{
+   BuildASTIndexInfo info = {
+      .pending    = NULL,
+      .numPending = 0,
+      .capacity   = 0,
+      .lastChild  = NULL,
+   };
+   int lastTopLevel = -1;
+
+   pushASTIndexChildren(&info, root, -1, 1);
+
+   while (info.numPending > 0) {
+      --info.numPending;
+      CXCursor cursor = info.pending[info.numPending].cursor;
+      int      parent = info.pending[info.numPending].parent;
+      int      depth  = info.pending[info.numPending].depth;
+
+      if (index->numNodes == index->capacity) {
+         index->capacity = index->capacity == 0 ? 1024 : index->capacity * 2;
+         index->nodes    = (ASTNode *)
+            Tcl_Realloc((char *)index->nodes,
+                        index->capacity * sizeof index->nodes[0]);
+         info.lastChild  = (int *)
+            Tcl_Realloc((char *)info.lastChild,
+                        index->capacity * sizeof info.lastChild[0]);
+      }
+
+      int      id   = index->numNodes++;
+      ASTNode *node = &index->nodes[id];
+      node->cursor         = cursor;
+      node->parent         = parent;
+      node->firstChild     = -1;
+      node->nextSibling    = -1;
+      node->nextOccurrence = -1;
+      node->depth          = depth;
+      info.lastChild[id]   = -1;
+
+      CXSourceRange extent = clang_getCursorExtent(cursor);
+      clang_getExpansionLocation(clang_getRangeStart(extent),
+                                 &node->file, NULL, NULL, &node->startOffset);
+      clang_getExpansionLocation(clang_getRangeEnd(extent),
+                                 NULL, NULL, NULL, &node->endOffset);
+
+      int *lastSibling = parent >= 0 ? &info.lastChild[parent] : &lastTopLevel;
+      if (*lastSibling >= 0) {
+         index->nodes[*lastSibling].nextSibling = id;
+      } else if (parent >= 0) {
+         index->nodes[parent].firstChild = id;
+      }
+      *lastSibling = id;
+
+      // A cursor reached by several paths has a node for each occurrence.
+      // They are chained from the first one.
+      CXCursor       key = getASTIndexKey(cursor);
+      int            created;
+      Tcl_HashEntry *entry = Tcl_CreateHashEntry(&index->nodeIds,
+                                                 (const char *)&key,
+                                                 &created);
+      if (created) {
+         Tcl_SetHashValue(entry, (ClientData)(intptr_t)id);
+      } else {
+         int last = (int)(intptr_t)Tcl_GetHashValue(entry);
+         while (index->nodes[last].nextOccurrence >= 0) {
+            last = index->nodes[last].nextOccurrence;
+         }
+         index->nodes[last].nextOccurrence = id;
+      }
+
+      pushASTIndexChildren(&info, cursor, id, depth + 1);
+   }
+
+   Tcl_Free((char *)info.pending);
+   Tcl_Free((char *)info.lastChild);
+}
+
+/** Return the AST index of a translation unit, building it if necessary.
+ */
+static ASTIndex *getASTIndex(TUInfo *info)
+{
+   if (info->astIndex != NULL) {
+      return info->astIndex;
+   }
+
+   ASTIndex *index = (ASTIndex *)Tcl_Alloc(sizeof *index);
+   index->numNodes = 0;
+   index->capacity = 0;
+   index->nodes    = NULL;
+   Tcl_InitHashTable(&index->nodeIds, sizeof(CXCursor) / sizeof(int));
+   Tcl_InitHashTable(&index->intervalTrees, TCL_ONE_WORD_KEYS);
+
+   buildASTIndex(index,
+                 clang_getTranslationUnitCursor(info->translationUnit));
+
+   info->astIndex = index;
+
+   return index;
+}
+
+/** Find the node of cursor in index.  Returns -1 for the root, and -2 if
+ * cursor is not in the index.
+ */
+static int findASTNode(ASTIndex *index, CXCursor cursor)
+{
+   if (clang_getCursorKind(cursor) == CXCursor_TranslationUnit) {
+      return -1;
+   }
+
+   CXCursor       key   = getASTIndexKey(cursor);
+   Tcl_HashEntry *entry = Tcl_FindHashEntry(&index->nodeIds,
+                                            (const char *)&key);
+   if (entry == NULL) {
+      return -2;
+   }
+
+   // Prefer the occurrence the cursor itself came from, if it is told apart
+   // by the fields getASTIndexKey clears.
+   int first = (int)(intptr_t)Tcl_GetHashValue(entry);
+   for (int id = first; id >= 0; id = index->nodes[id].nextOccurrence) {
+      if (memcmp(&index->nodes[id].cursor, &cursor, sizeof cursor) == 0) {
+         return id;
+      }
+   }
+
+   return first;
+}
+
+/** Return the shared file name obj of file, which belongs to the
+ * translation unit info.
+ */
+static Tcl_Obj *newFileNameObjForTU(TUInfo *info, CXFile file)
+{
+   if (info->translationUnit == NULL) {
+      CXString  filename = clang_getFileName(file);
+      Tcl_Obj  *result   = newFileNameObj(clang_getCString(filename));
+      clang_disposeString(filename);
+
+      return result;
+   }
+
+   int            created;
+   Tcl_HashEntry *entry = Tcl_CreateHashEntry(&info->fileNames,
+                                              (const char *)file, &created);
+   if (!created) {
+      ++info->fileNameHits;
+      return (Tcl_Obj *)Tcl_GetHashValue(entry);
+   }
+
+   ++info->fileNameMisses;
+
+   CXString  filename = clang_getFileName(file);
+   Tcl_Obj  *result   = Tcl_NewStringObj(clang_getCString(filename), -1);
+   clang_disposeString(filename);
+
+   Tcl_IncrRefCount(result);
+   Tcl_SetHashValue(entry, result);
+
+   return result;
+}
+
+static void retainTUInfo(TUInfo *info)
+{
+   ++info->refCount;
+}
+
+static void releaseTUInfo(TUInfo *info)
+{
+   if (--info->refCount == 0) {
+      CursorHandleTable *table = &info->cursorHandles;
+      Tcl_DeleteHashTable(&table->handles);
+      Tcl_DeleteHashTable(&info->fileNames);
+      Tcl_Free((char *)table->cursors);
+      Tcl_Free((char *)table->objs);
+      Tcl_Free((char *)info);
+   }
+}
+
+/** Mark the translation unit of info as the most recently used one of the
+ * pool.
+ */
+static void markTUUsed(TUInfo *info)
+{
+   info->lastUse = ++info->parent->pool.clock;
+}
+
+/** Keep the translation unit of info loaded: the pool doesn't evict it
+ * until the last pin is released.  A reparse may still replace its AST.
+ */
+static void pinTU(TUInfo *info)
+{
+   retainTUInfo(info);
+   ++info->pinCount;
+}
+
+static void unpinTU(TUInfo *info)
+{
+   if (--info->pinCount == 0 && info->cmd != NULL) {
+      markTUUsed(info);
+      if (info->parent->pool.overLimit) {
+         enforceTUPool(info->parent, info);
+      }
+   }
+
+   releaseTUInfo(info);
+}
+
+/** Keep the AST of info in place while a call into libclang that may run
+ * scripts, such as clang_visitChildren for walk, is running over it.  This
+ * pins it too.  A background reparse that is done meanwhile is installed
+ * once the last such call returns.
+ */
+static void enterTU(TUInfo *info)
+{
+   pinTU(info);
+   ++info->busyCount;
+}
+
+static void leaveTU(TUInfo *info)
+{
+   if (--info->busyCount == 0 && info->deletedTU != NULL) {
+      IndexInfo *parent = info->parent;
+      clang_disposeTranslationUnit(info->deletedTU);
+      info->deletedTU = NULL;
+      if (--parent->numDeletedBusyTUs == 0 && parent->deleted) {
+         freeIndexInfo(parent);
+      }
+   }
+
+   if (info->busyCount == 0 && info->deferredParse != NULL) {
+      struct AsyncParse *parse = info->deferredParse;
+      info->deferredParse = NULL;
+      queueAsyncParseEvent(parse);
+   }
+
+   unpinTU(info);
+}
+
+static unsigned getTUGeneration(TUInfo *info)
+{
+   return info->generation;
+}
+
+/** Set the error message for a value of the translation unit info made at
+ * an older generation, which a reparse or an eviction has made stale.  what
+ * names the value.
+ */
+static void setStaleTUError(Tcl_Interp  *interp,
+                            TUInfo      *info,
+                            unsigned     generation,
+                            const char  *what)
+{
+   if (interp == NULL) {
+      return;
+   }
+
+   Tcl_SetObjResult(interp,
+                    Tcl_ObjPrintf(generation < info->reparseGeneration
+                                  ? "the %s's translation unit has been "
+                                    "reparsed"
+                                  : "the %s's translation unit has been "
+                                    "evicted from the pool",
+                                  what));
+}
+
+/** Check that the translation unit of info is still the one a traversal
+ * started on at generation, after the traversal ran a script.  what names
+ * the values the traversal hands out.
+ */
+static int checkTraversedTU(Tcl_Interp *interp,
+                            TUInfo     *info,
+                            unsigned    generation,
+                            const char *what)
+{
+   if (info->cmd == NULL) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("the %s's translation unit has been "
+                                     "deleted", what));
+      return TCL_ERROR;
+   }
+
+   if (info->generation != generation) {
+      setStaleTUError(interp, info, generation, what);
+      return TCL_ERROR;
+   }
+
+   return TCL_OK;
+}
+
+// Reject the cindex-location or cindex-range obj if its translation unit has
+// been deleted or reparsed since obj was created.  what names the value in
+// the error message.
+static int checkLocationTU(Tcl_Interp *interp, Tcl_Obj *obj, const char *what)
+{
+   TUInfo      *tuInfo = (TUInfo *)obj->internalRep.twoPtrValue.ptr2;
+   LocationRep *rep    = (LocationRep *)obj->internalRep.twoPtrValue.ptr1;
+
+   if (tuInfo == NULL) {
+      return TCL_OK;
+   }
+
+   if (tuInfo->cmd == NULL) {
+      if (interp != NULL) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("invalid source %s", what));
+      }
+      return TCL_ERROR;
+   }
+
+   if (rep->generation != tuInfo->generation) {
+      setStaleTUError(interp, tuInfo, rep->generation, what);
+      return TCL_ERROR;
+   }
+
+   return TCL_OK;
+}
+
+static void tuDeleteProc(ClientData clientData)
+{
+   TUInfo *info = (TUInfo *)clientData;
+
+   *info->prevPtr = info->next;
+   if (info->next != NULL) {
+      info->next->prevPtr = info->prevPtr;
+   }
+
+   // A translation unit evicted by the pool is already disposed.  One that
+   // a call into libclang is running over is disposed when it returns.
+   if (!info->suspended) {
+      unregisterTU(info);
+      if (info->busyCount > 0) {
+         info->deletedTU = info->translationUnit;
+         ++info->parent->numDeletedBusyTUs;
+      } else {
+         clang_disposeTranslationUnit(info->translationUnit);
+      }
+   }
+
+   // Cursor objects may still refer to info.  They see the NULL
+   // translationUnit and reject themselves.
+   info->translationUnit = NULL;
+   info->cmd             = NULL;
+   clearCursorHandles(info);
+   clearFileNames(info);
+   clearLineTables(info);
+   deleteASTIndex(info);
+   if (info->parseArgs != NULL) {
+      deleteParseJob(info->parseArgs);
+      info->parseArgs = NULL;
+   }
+   if (info->nextReparse != NULL) {
+      deleteParseJob(info->nextReparse);
+      Tcl_DecrRefCount(info->nextReparseCommands);
+      info->nextReparse         = NULL;
+      info->nextReparseCommands = NULL;
+   }
+   // The running reparse, if any, sees the NULL translationUnit.
+   info->reparse = NULL;
+   releaseTUInfo(info);
+}
+
+static TUInfo * lookupTranslationUnit(CXTranslationUnit tu)
+{
+   if (tuRegistry.count == 0) {
+      return NULL;
+   }
+
+   size_t mask = tuRegistry.capacity - 1;
+   for (size_t i = tuHash(tu); tuRegistry.slots[i] != NULL;
+        i = (i + 1) & mask) {
+      if (tuRegistry.slots[i]->translationUnit == tu) {
+         return tuRegistry.slots[i];
+      }
+   }
+
+   return NULL;
+}
+
+//----------------------------------------------------------------- diagnostic
+
+static EnumConsts diagnosticSeverityLabels = {
+   .names = {
+      "ignored",
+      "note",
+      "warning",
+      "error",
+      "fatal"
+   }
+};
+
+static Tcl_Obj *diagnosticSeverityTagObj;
+static Tcl_Obj *diagnosticLocationTagObj;
+static Tcl_Obj *diagnosticSpellingTagObj;
+static Tcl_Obj *diagnosticEnableTagObj;
+static Tcl_Obj *diagnosticDisableTagObj;
+static Tcl_Obj *diagnosticCategoryTagObj;
+static Tcl_Obj *diagnosticRangesTagObj;
+static Tcl_Obj *diagnosticFixItsTagObj;
+
+static Tcl_Obj *newDiagnosticObj(TUInfo *info, CXDiagnostic diagnostic)
+{
+   enum {
+      severity_tag_ix,
+      severity_ix,
+      location_tag_ix,
+      location_ix,
+      spelling_tag_ix,
+      spelling_ix,
+      enable_tag_ix,
+      enable_ix,
+      disable_tag_ix,
+      disable_ix,
+      category_tag_ix,
+      category_ix,
+      ranges_tag_ix,
+      ranges_ix,
+      fixits_tag_ix,
+      fixits_ix,
+      nelms
+   };
+   Tcl_Obj *resultArray[nelms];
+
+   resultArray[severity_tag_ix] = diagnosticSeverityTagObj;
+   resultArray[location_tag_ix] = diagnosticLocationTagObj;
+   resultArray[spelling_tag_ix] = diagnosticSpellingTagObj;
+   resultArray[enable_tag_ix]   = diagnosticEnableTagObj;
+   resultArray[disable_tag_ix]  = diagnosticDisableTagObj;
+   resultArray[category_tag_ix] = diagnosticCategoryTagObj;
+   resultArray[ranges_tag_ix]   = diagnosticRangesTagObj;
+   resultArray[fixits_tag_ix]   = diagnosticFixItsTagObj;
+
+   enum CXDiagnosticSeverity severity
+      = clang_getDiagnosticSeverity(diagnostic);
+   resultArray[severity_ix]
+      = getEnum(&diagnosticSeverityLabels, severity);
+
+   CXSourceLocation location = clang_getDiagnosticLocation(diagnostic);
+   resultArray[location_ix]  = newLocationObjForTU(info, location);
+
+   CXString spelling        = clang_getDiagnosticSpelling(diagnostic);
+   resultArray[spelling_ix] = convertCXStringToObj(spelling);
+
+   CXString disable;
+   CXString option         = clang_getDiagnosticOption(diagnostic, &disable);
+   resultArray[enable_ix]  = convertCXStringToObj(option);
+   resultArray[disable_ix] = convertCXStringToObj(disable);
+
+   CXString category        = clang_getDiagnosticCategoryText(diagnostic);
+   resultArray[category_ix] = convertCXStringToObj(category);
+
+   unsigned   numRanges = clang_getDiagnosticNumRanges(diagnostic);
+   Tcl_Obj  **ranges    = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *) * numRanges);
+   for (unsigned i = 0; i < numRanges; ++i) {
+      CXSourceRange range = clang_getDiagnosticRange(diagnostic, i);
+      ranges[i]           = newRangeObjForTU(info, range);
+   }
+   resultArray[ranges_ix] = Tcl_NewListObj(numRanges, ranges);
+   Tcl_Free((char *)ranges);
+
+   unsigned   numFixIts = clang_getDiagnosticNumFixIts(diagnostic);
+   Tcl_Obj  **fixits    = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *) * numFixIts);
+   for (unsigned i = 0; i < numFixIts; ++i) {
+      CXSourceRange range;
+      CXString      fixitStr = clang_getDiagnosticFixIt(diagnostic, i, &range);
+
+      Tcl_Obj *fixit[2];
+      fixit[0] = newRangeObjForTU(info, range);
+      fixit[1] = convertCXStringToObj(fixitStr);
+
+      fixits[i] = Tcl_NewListObj(2, fixit);
+   }
+   resultArray[fixits_ix] = Tcl_NewListObj(numFixIts, fixits);
+   Tcl_Free((char *)fixits);
+
+   return Tcl_NewListObj(nelms, resultArray);
+}
+
+//--------------------------------------------------------------------- cursor
+
+static Tcl_Obj *cursorKindNames;
+static Tcl_Obj *cursorKindValues;
+
+static void createCursorKindTable(void)
+{
+   static NameValuePair table[] = {
+      { "UnexposedDecl",
+        CXCursor_UnexposedDecl },
+      { "StructDecl",
+        CXCursor_StructDecl },
+      { "UnionDecl",
+        CXCursor_UnionDecl },
+      { "ClassDecl",
+        CXCursor_ClassDecl },
+      { "EnumDecl",
+        CXCursor_EnumDecl },
+      { "FieldDecl",
+        CXCursor_FieldDecl },
+      { "EnumConstantDecl",
+        CXCursor_EnumConstantDecl },
+      { "FunctionDecl",
+        CXCursor_FunctionDecl },
+      { "VarDecl",
+        CXCursor_VarDecl },
+      { "ParmDecl",
+        CXCursor_ParmDecl },
+      { "ObjCInterfaceDecl",
+        CXCursor_ObjCInterfaceDecl },
+      { "ObjCCategoryDecl",
+        CXCursor_ObjCCategoryDecl },
+      { "ObjCProtocolDecl",
+        CXCursor_ObjCProtocolDecl },
+      { "ObjCPropertyDecl",
+        CXCursor_ObjCPropertyDecl },
+      { "ObjCIvarDecl",
+        CXCursor_ObjCIvarDecl },
+      { "ObjCInstanceMethodDecl",
+        CXCursor_ObjCInstanceMethodDecl },
+      { "ObjCClassMethodDecl",
+        CXCursor_ObjCClassMethodDecl },
+      { "ObjCImplementationDecl",
+        CXCursor_ObjCImplementationDecl },
+      { "ObjCCategoryImplDecl",
+        CXCursor_ObjCCategoryImplDecl },
+      { "TypedefDecl",
+        CXCursor_TypedefDecl },
+      { "CXXMethod",
+        CXCursor_CXXMethod },
+      { "Namespace",
+        CXCursor_Namespace },
+      { "LinkageSpec",
+        CXCursor_LinkageSpec },
+      { "Constructor",
+        CXCursor_Constructor },
+      { "Destructor",
+        CXCursor_Destructor },
+      { "ConversionFunction",
+        CXCursor_ConversionFunction },
+      { "TemplateTypeParameter",
+        CXCursor_TemplateTypeParameter },
+      { "NonTypeTemplateParameter",
+        CXCursor_NonTypeTemplateParameter },
+      { "TemplateTemplateParameter",
+        CXCursor_TemplateTemplateParameter },
+      { "FunctionTemplate",
+        CXCursor_FunctionTemplate },
+      { "ClassTemplate",
+        CXCursor_ClassTemplate },
+      { "ClassTemplatePartialSpecialization",
+        CXCursor_ClassTemplatePartialSpecialization },
+      { "NamespaceAlias",
+        CXCursor_NamespaceAlias },
+      { "UsingDirective",
+        CXCursor_UsingDirective },
+      { "UsingDeclaration",
+        CXCursor_UsingDeclaration },
+      { "TypeAliasDecl",
+        CXCursor_TypeAliasDecl },
+      { "ObjCSynthesizeDecl",
+        CXCursor_ObjCSynthesizeDecl },
+      { "ObjCDynamicDecl",
+        CXCursor_ObjCDynamicDecl },
+      { "CXXAccessSpecifier",
+        CXCursor_CXXAccessSpecifier },
+      /* { "CXCursor_FirstDecl", */
+      /*   CXCursor_FirstDecl }, */
+      /* { "CXCursor_LastDecl", */
+      /*   CXCursor_LastDecl }, */
+      /* { "FirstRef", */
+      /*   CXCursor_FirstRef }, */
+      { "ObjCSuperClassRef",
+        CXCursor_ObjCSuperClassRef },
+      { "ObjCProtocolRef",
+        CXCursor_ObjCProtocolRef },
+      { "ObjCClassRef",
+        CXCursor_ObjCClassRef },
+      { "TypeRef",
+        CXCursor_TypeRef },
+      { "CXXBaseSpecifier",
+        CXCursor_CXXBaseSpecifier },
+      { "TemplateRef",
+        CXCursor_TemplateRef },
+      { "NamespaceRef",
+        CXCursor_NamespaceRef },
+      { "MemberRef",
+        CXCursor_MemberRef },
+      { "LabelRef",
+        CXCursor_LabelRef },
+      { "OverloadedDeclRef",
+        CXCursor_OverloadedDeclRef },
+      { "VariableRef",
+        CXCursor_VariableRef },
+      /* { "LastRef", */
+      /*   CXCursor_LastRef }, */
+      /* { "FirstInvalid", */
+      /*   CXCursor_FirstInvalid }, */
+      { "InvalidFile",
+        CXCursor_InvalidFile },
+      { "NoDeclFound",
+        CXCursor_NoDeclFound },
+      { "NotImplemented",
+        CXCursor_NotImplemented },
+      { "InvalidCode",
+        CXCursor_InvalidCode },
+      /* { "LastInvalid", */
+      /*   CXCursor_LastInvalid }, */
+      /* { "FirstExpr", */
+      /*   CXCursor_FirstExpr }, */
+      { "UnexposedExpr",
+        CXCursor_UnexposedExpr },
+      { "DeclRefExpr",
+        CXCursor_DeclRefExpr },
+      { "MemberRefExpr",
+        CXCursor_MemberRefExpr },
+      { "CallExpr",
+        CXCursor_CallExpr },
+      { "ObjCMessageExpr",
+        CXCursor_ObjCMessageExpr },
+      { "BlockExpr",
+        CXCursor_BlockExpr },
+      { "IntegerLiteral",
+        CXCursor_IntegerLiteral },
+      { "FloatingLiteral",
+        CXCursor_FloatingLiteral },
+      { "ImaginaryLiteral",
+        CXCursor_ImaginaryLiteral },
+      { "StringLiteral",
+        CXCursor_StringLiteral },
+      { "CharacterLiteral",
+        CXCursor_CharacterLiteral },
+      { "ParenExpr",
+        CXCursor_ParenExpr },
+      { "UnaryOperator",
+        CXCursor_UnaryOperator },
+      { "ArraySubscriptExpr",
+        CXCursor_ArraySubscriptExpr },
+      { "BinaryOperator",
+        CXCursor_BinaryOperator },
+      { "CompoundAssignOperator",
+        CXCursor_CompoundAssignOperator },
+      { "ConditionalOperator",
+        CXCursor_ConditionalOperator },
+      { "CStyleCastExpr",
+        CXCursor_CStyleCastExpr },
+      { "CompoundLiteralExpr",
+        CXCursor_CompoundLiteralExpr },
+      { "InitListExpr",
+        CXCursor_InitListExpr },
+      { "AddrLabelExpr",
+        CXCursor_AddrLabelExpr },
+      { "StmtExpr",
+        CXCursor_StmtExpr },
+      { "GenericSelectionExpr",
+        CXCursor_GenericSelectionExpr },
+      { "GNUNullExpr",
+        CXCursor_GNUNullExpr },
+      { "CXXStaticCastExpr",
+        CXCursor_CXXStaticCastExpr },
+      { "CXXDynamicCastExpr",
+        CXCursor_CXXDynamicCastExpr },
+      { "CXXReinterpretCastExpr",
+        CXCursor_CXXReinterpretCastExpr },
+      { "CXXConstCastExpr",
+        CXCursor_CXXConstCastExpr },
+      { "CXXFunctionalCastExpr",
+        CXCursor_CXXFunctionalCastExpr },
+      { "CXXTypeidExpr",
+        CXCursor_CXXTypeidExpr },
+      { "CXXBoolLiteralExpr",
+        CXCursor_CXXBoolLiteralExpr },
+      { "CXXNullPtrLiteralExpr",
+        CXCursor_CXXNullPtrLiteralExpr },
+      { "CXXThisExpr",
+        CXCursor_CXXThisExpr },
+      { "CXXThrowExpr",
+        CXCursor_CXXThrowExpr },
+      { "CXXNewExpr",
+        CXCursor_CXXNewExpr },
+      { "CXXDeleteExpr",
+        CXCursor_CXXDeleteExpr },
+      { "UnaryExpr",
+        CXCursor_UnaryExpr },
+      { "ObjCStringLiteral",
+        CXCursor_ObjCStringLiteral },
+      { "ObjCEncodeExpr",
+        CXCursor_ObjCEncodeExpr },
+      { "ObjCSelectorExpr",
+        CXCursor_ObjCSelectorExpr },
       { "ObjCProtocolExpr",
         CXCursor_ObjCProtocolExpr },
       { "ObjCBridgedCastExpr",
@@ -1258,1443 +2481,6216 @@ static void createCursorKindTable(void)
       { "ObjCSelfExpr",
         CXCursor_ObjCSelfExpr },
 #if CINDEX_VERSION_MINOR >= 31
-      { "OMPArraySectionExpr",
-        CXCursor_OMPArraySectionExpr },
+      { "OMPArraySectionExpr",
+        CXCursor_OMPArraySectionExpr },
+#endif
+#if CINDEX_VERSION_MINOR >= 36
+      { "ObjCAvailabilityCheckExpr",
+        CXCursor_ObjCAvailabilityCheckExpr },
+#endif
+      /* { "LastExpr", */
+      /*   CXCursor_LastExpr }, */
+      /* { "FirstStmt", */
+      /*   CXCursor_FirstStmt }, */
+      { "UnexposedStmt",
+        CXCursor_UnexposedStmt },
+      { "LabelStmt",
+        CXCursor_LabelStmt },
+      { "CompoundStmt",
+        CXCursor_CompoundStmt },
+      { "CaseStmt",
+        CXCursor_CaseStmt },
+      { "DefaultStmt",
+        CXCursor_DefaultStmt },
+      { "IfStmt",
+        CXCursor_IfStmt },
+      { "SwitchStmt",
+        CXCursor_SwitchStmt },
+      { "WhileStmt",
+        CXCursor_WhileStmt },
+      { "DoStmt",
+        CXCursor_DoStmt },
+      { "ForStmt",
+        CXCursor_ForStmt },
+      { "GotoStmt",
+        CXCursor_GotoStmt },
+      { "IndirectGotoStmt",
+        CXCursor_IndirectGotoStmt },
+      { "ContinueStmt",
+        CXCursor_ContinueStmt },
+      { "BreakStmt",
+        CXCursor_BreakStmt },
+      { "ReturnStmt",
+        CXCursor_ReturnStmt },
+      /* { "GCCAsmStmt", */
+      /*   CXCursor_GCCAsmStmt }, */
+      { "AsmStmt",
+        CXCursor_AsmStmt },
+      { "ObjCAtTryStmt",
+        CXCursor_ObjCAtTryStmt },
+      { "ObjCAtCatchStmt",
+        CXCursor_ObjCAtCatchStmt },
+      { "ObjCAtFinallyStmt",
+        CXCursor_ObjCAtFinallyStmt },
+      { "ObjCAtThrowStmt",
+        CXCursor_ObjCAtThrowStmt },
+      { "ObjCAtSynchronizedStmt",
+        CXCursor_ObjCAtSynchronizedStmt },
+      { "ObjCAutoreleasePoolStmt",
+        CXCursor_ObjCAutoreleasePoolStmt },
+      { "ObjCForCollectionStmt",
+        CXCursor_ObjCForCollectionStmt },
+      { "CXXCatchStmt",
+        CXCursor_CXXCatchStmt },
+      { "CXXTryStmt",
+        CXCursor_CXXTryStmt },
+      { "CXXForRangeStmt",
+        CXCursor_CXXForRangeStmt },
+      { "SEHTryStmt",
+        CXCursor_SEHTryStmt },
+      { "SEHExceptStmt",
+        CXCursor_SEHExceptStmt },
+      { "SEHFinallyStmt",
+        CXCursor_SEHFinallyStmt },
+      { "MSAsmStmt",
+        CXCursor_MSAsmStmt },
+      { "NullStmt",
+        CXCursor_NullStmt },
+      { "DeclStmt",
+        CXCursor_DeclStmt },
+      { "OMPParallelDirective",
+        CXCursor_OMPParallelDirective },
+#if CINDEX_VERSION_MINOR >= 25
+      { "OMPSimdDirective",
+        CXCursor_OMPSimdDirective },
+#endif
+#if CINDEX_VERSION_MINOR >= 28
+      { "OMPForDirective",
+        CXCursor_OMPForDirective },
+      { "OMPSectionsDirective",
+        CXCursor_OMPSectionsDirective },
+      { "OMPSectionDirective",
+        CXCursor_OMPSectionDirective },
+      { "OMPSingleDirective",
+        CXCursor_OMPSingleDirective },
+      { "OMPParallelForDirective",
+        CXCursor_OMPParallelForDirective },
+      { "OMPParallelSectionsDirective",
+        CXCursor_OMPParallelSectionsDirective },
+      { "OMPTaskDirective",
+        CXCursor_OMPTaskDirective },
+      { "OMPMasterDirective",
+        CXCursor_OMPMasterDirective },
+      { "OMPCriticalDirective",
+        CXCursor_OMPCriticalDirective },
+      { "OMPTaskyieldDirective",
+        CXCursor_OMPTaskyieldDirective },
+      { "OMPBarrierDirective",
+        CXCursor_OMPBarrierDirective },
+      { "OMPTaskwaitDirective",
+        CXCursor_OMPTaskwaitDirective },
+      { "OMPFlushDirective",
+        CXCursor_OMPFlushDirective },
+      { "SEHLeaveStmt",
+        CXCursor_SEHLeaveStmt },
+      { "OMPOrderedDirective",
+        CXCursor_OMPOrderedDirective },
+      { "OMPAtomicDirective",
+        CXCursor_OMPAtomicDirective },
+#endif
+#if CINDEX_VERSION_MINOR >= 29
+      { "OMPForSimdDirective",
+        CXCursor_OMPForSimdDirective },
+      { "OMPParallelForSimdDirective",
+        CXCursor_OMPParallelForSimdDirective },
+      { "OMPTargetDirective",
+        CXCursor_OMPTargetDirective },
+      { "OMPTeamsDirective",
+        CXCursor_OMPTeamsDirective },
+#endif
+#if CINDEX_VERSION_MINOR >= 31
+      { "OMPTaskgroupDirective",
+        CXCursor_OMPTaskgroupDirective },
+      { "OMPCancellationPointDirective",
+        CXCursor_OMPCancellationPointDirective },
+      { "OMPCancelDirective",
+        CXCursor_OMPCancelDirective },
+      { "OMPTargetDataDirective",
+        CXCursor_OMPTargetDataDirective },
+#endif
+#if CINDEX_VERSION_MINOR >= 32
+      { "OMPTaskLoopDirective",
+        CXCursor_OMPTaskLoopDirective },
+      { "OMPTaskLoopSimdDirective",
+        CXCursor_OMPTaskLoopSimdDirective },
+#endif
+#if CINDEX_VERSION_MINOR >= 33
+      { "OMPDistributeDirective",
+        CXCursor_OMPDistributeDirective },
+#endif
+#if CINDEX_VERSION_MINOR >= 34
+      { "OMPTargetEnterDataDirective",
+        CXCursor_OMPTargetEnterDataDirective },
+      { "OMPTargetExitDataDirective",
+        CXCursor_OMPTargetExitDataDirective },
+      { "OMPTargetParallelDirective",
+        CXCursor_OMPTargetParallelDirective },
+      { "OMPTargetParallelForDirective",
+        CXCursor_OMPTargetParallelForDirective },
+#endif
+#if CINDEX_VERSION_MINOR >= 35
+      { "OMPTargetUpdateDirective",
+        CXCursor_OMPTargetUpdateDirective },
+#endif
+#if CINDEX_VERSION_MINOR >= 36
+      { "OMPDistributeParallelForDirective",
+        CXCursor_OMPDistributeParallelForDirective },
+      { "OMPDistributeSimdDirective",
+        CXCursor_OMPDistributeSimdDirective },
+      { "OMPTargetParallelForSimdDirective",
+        CXCursor_OMPTargetParallelForSimdDirective },
+      { "OMPTargetSimdDirective",
+        CXCursor_OMPTargetSimdDirective },
+      { "OMPTeamsDistributeDirective",
+        CXCursor_OMPTeamsDistributeDirective },
+      { "OMPTeamsDistributeSimdDirective",
+        CXCursor_OMPTeamsDistributeSimdDirective },
+#endif
+#if CINDEX_VERSION_MINOR >= 37
+      { "OMPTeamsDistributeParallelForSimdDirective",
+        CXCursor_OMPTeamsDistributeParallelForSimdDirective },
+#endif
+#if CINDEX_VERSION_MINOR >= 38
+      { "OMPTeamsDistributeParallelForDirective",
+        CXCursor_OMPTeamsDistributeParallelForDirective },
+      { "OMPTargetTeamsDirective",
+        CXCursor_OMPTargetTeamsDirective },
+      { "OMPTargetTeamsDistributeDirective",
+        CXCursor_OMPTargetTeamsDistributeDirective },
+      { "OMPTargetTeamsDistributeParallelForDirective",
+        CXCursor_OMPTargetTeamsDistributeParallelForDirective },
+      { "OMPTargetTeamsDistributeParallelForSimdDirective",
+        CXCursor_OMPTargetTeamsDistributeParallelForSimdDirective },
+      { "OMPTargetTeamsDistributeSimdDirective",
+        CXCursor_OMPTargetTeamsDistributeSimdDirective },
+#endif
+      /* { "LastStmt", */
+      /*   CXCursor_LastStmt }, */
+      { "TranslationUnit",
+        CXCursor_TranslationUnit },
+      /* { "FirstAttr", */
+      /*   CXCursor_FirstAttr }, */
+      { "UnexposedAttr",
+        CXCursor_UnexposedAttr },
+      { "IBActionAttr",
+        CXCursor_IBActionAttr },
+      { "IBOutletAttr",
+        CXCursor_IBOutletAttr },
+      { "IBOutletCollectionAttr",
+        CXCursor_IBOutletCollectionAttr },
+      { "CXXFinalAttr",
+        CXCursor_CXXFinalAttr },
+      { "CXXOverrideAttr",
+        CXCursor_CXXOverrideAttr },
+      { "AnnotateAttr",
+        CXCursor_AnnotateAttr },
+      { "AsmLabelAttr",
+        CXCursor_AsmLabelAttr },
+      { "PackedAttr",
+        CXCursor_PackedAttr },
+#if CINDEX_VERSION_MINOR >= 26
+      { "PureAttr",
+        CXCursor_PureAttr },
+      { "ConstAttr",
+        CXCursor_ConstAttr },
+      { "NoDuplicateAttr",
+        CXCursor_NoDuplicateAttr },
+#endif
+#if CINDEX_VERSION_MINOR >= 28
+      { "CUDAConstantAttr",
+        CXCursor_CUDAConstantAttr },
+      { "CUDADeviceAttr",
+        CXCursor_CUDADeviceAttr },
+      { "CUDAGlobalAttr",
+        CXCursor_CUDAGlobalAttr },
+      { "CUDAHostAttr",
+        CXCursor_CUDAHostAttr },
+      { "CUDASharedAttr",
+        CXCursor_CUDASharedAttr },
+#endif
+#if CINDEX_VERSION_MINOR >= 31
+      { "VisibilityAttr",
+        CXCursor_VisibilityAttr },
+#endif
+#if CINDEX_VERSION_MINOR >= 32
+      { "DLLExport",
+        CXCursor_DLLExport },
+      { "DLLImport",
+        CXCursor_DLLImport },
+#endif
+      /* { "LastAttr", */
+      /*   CXCursor_LastAttr }, */
+      /* { "FirstPreprocessing", */
+      /*   CXCursor_FirstPreprocessing }, */
+      { "PreprocessingDirective",
+        CXCursor_PreprocessingDirective },
+      { "MacroDefinition",
+        CXCursor_MacroDefinition },
+      { "MacroExpansion",
+        CXCursor_MacroExpansion },
+      { "MacroInstantiation",
+        CXCursor_MacroInstantiation },
+      { "InclusionDirective",
+        CXCursor_InclusionDirective },
+      /* { "LastPreprocessing", */
+      /*   CXCursor_LastPreprocessing }, */
+      /* { "FirstExtraDecl", */
+      /*   CXCursor_FirstExtraDecl }, */
+      { "ModuleImportDecl",
+        CXCursor_ModuleImportDecl },
+#if CINDEX_VERSION_MINOR >= 30
+      { "OverloadCandidate",
+        CXCursor_OverloadCandidate },
+#endif
+#if CINDEX_VERSION_MINOR >= 32
+      { "TypeAliasTemplateDecl",
+        CXCursor_TypeAliasTemplateDecl },
+#endif
+#if CINDEX_VERSION_MINOR >= 36
+      { "StaticAssert",
+        CXCursor_StaticAssert },
+      { "FriendDecl",
+        CXCursor_FriendDecl },
+#endif
+      /* { "LastExtraDecl", */
+      /*   CXCursor_LastExtraDecl }, */
+#if CINDEX_VERSION_MINOR >= 30
+      { "OverloadCandidate",
+        CXCursor_OverloadCandidate },
+#endif
+      { NULL }
+   };
+
+   createNameValueTable(&cursorKindNames, &cursorKindValues, table);
+
+   Tcl_IncrRefCount(cursorKindNames);
+   Tcl_IncrRefCount(cursorKindValues);
+}
+
+// Return the name of a cursor kind, or NULL if kind is not known.
+static Tcl_Obj *getCursorKindNameObj(enum CXCursorKind kind)
+{
+   Tcl_Obj *kindObj = Tcl_NewIntObj(kind);
+   Tcl_IncrRefCount(kindObj);
+
+   Tcl_Obj *kindName = NULL;
+   if (Tcl_DictObjGet(NULL, cursorKindNames, kindObj, &kindName) != TCL_OK) {
+      Tcl_Panic("cursorKindNames corrupted");
+   }
+   Tcl_DecrRefCount(kindObj);
+
+   return kindName;
+}
+
+static int getCursorKindFromObj(Tcl_Interp         *interp,
+                                Tcl_Obj            *obj,
+                                enum CXCursorKind  *kind)
+{
+   Tcl_Obj *kindObj = NULL;
+   if (Tcl_DictObjGet(NULL, cursorKindValues, obj, &kindObj) != TCL_OK) {
+      Tcl_Panic("cursorKindValues corrupted");
+   }
+
+   if (kindObj == NULL) {
+      if (interp != NULL) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("invalid cursor kind: %s",
+                                        Tcl_GetStringFromObj(obj, NULL)));
+      }
+      return TCL_ERROR;
+   }
+
+   int value;
+   if (Tcl_GetIntFromObj(NULL, kindObj, &value) != TCL_OK) {
+      Tcl_Panic("cursorKindValues corrupted");
+   }
+   *kind = value;
+
+   return TCL_OK;
+}
+
+/** A set of cursor kinds.
+ */
+typedef struct CursorKindSet
+{
+   uint32_t bits[1024 / 32];    // larger than the largest CXCursorKind
+} CursorKindSet;
+
+static int cursorKindSetContains(const CursorKindSet *set,
+                                 enum CXCursorKind    kind)
+{
+   unsigned i = kind;
+   return i < sizeof set->bits * CHAR_BIT
+      && (set->bits[i / 32] & (UINT32_C(1) << (i % 32))) != 0;
+}
+
+static void cursorKindSetAdd(CursorKindSet *set, enum CXCursorKind kind)
+{
+   unsigned i = kind;
+   if (i >= sizeof set->bits * CHAR_BIT) {
+      Tcl_Panic("cursor kind %u is out of CursorKindSet", i);
+   }
+   set->bits[i / 32] |= UINT32_C(1) << (i % 32);
+}
+
+// Convert a list of cursor kind names to a set.
+static int getCursorKindSetFromObj(Tcl_Interp    *interp,
+                                   Tcl_Obj       *obj,
+                                   CursorKindSet *set)
+{
+   int       n;
+   Tcl_Obj **elms;
+   int status = Tcl_ListObjGetElements(interp, obj, &n, &elms);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   memset(set, 0, sizeof *set);
+
+   for (int i = 0; i < n; ++i) {
+      enum CXCursorKind kind;
+      status = getCursorKindFromObj(interp, elms[i], &kind);
+      if (status != TCL_OK) {
+         return status;
+      }
+
+      cursorKindSetAdd(set, kind);
+   }
+
+   return TCL_OK;
+}
+
+/** The internal representation of a cindex-cursor Tcl_Obj.
+ *
+ * The string representation is the list {kind xdata data0 data1 data2
+ * generation}, or tuName:generation:handle if the cursor is interned in the
+ * handle table of its translation unit.  It is generated only when a script
+ * asks for it.  The generation lets a copy of the string be rejected once the
+ * translation unit has been reparsed or evicted.
+ */
+typedef struct CursorRep
+{
+   CXCursor  cursor;
+   TUInfo   *tuInfo;            // NULL if the cursor has no translation unit
+   unsigned  generation;        // tuInfo->generation at creation
+   int       handle;            // -1 if the cursor is not interned
+} CursorRep;
+
+static void freeCursorInternalRep(Tcl_Obj *obj);
+static void dupCursorInternalRep(Tcl_Obj *src, Tcl_Obj *dst);
+static void updateStringOfCursor(Tcl_Obj *obj);
+static int  setCursorFromAny(Tcl_Interp *interp, Tcl_Obj *obj);
+
+static Tcl_ObjType cursorObjType = {
+   "cindex-cursor",
+   freeCursorInternalRep,
+   dupCursorInternalRep,
+   updateStringOfCursor,
+   setCursorFromAny
+};
+
+static void setCursorInternalRep(Tcl_Obj *obj, CXCursor cursor, TUInfo *tuInfo)
+{
+   CursorRep *rep  = (CursorRep *)Tcl_Alloc(sizeof *rep);
+   rep->cursor     = cursor;
+   rep->tuInfo     = tuInfo;
+   rep->generation = tuInfo != NULL ? tuInfo->generation : 0;
+   rep->handle     = -1;
+
+   if (tuInfo != NULL) {
+      retainTUInfo(tuInfo);
+   }
+
+   obj->internalRep.twoPtrValue.ptr1 = rep;
+   obj->internalRep.twoPtrValue.ptr2 = NULL;
+   obj->typePtr                      = &cursorObjType;
+}
+
+static void freeCursorInternalRep(Tcl_Obj *obj)
+{
+   CursorRep *rep = (CursorRep *)obj->internalRep.twoPtrValue.ptr1;
+
+   if (rep->handle >= 0) {
+      // Release the slot of the handle table if obj is the shared object.
+      CursorHandleTable *table = &rep->tuInfo->cursorHandles;
+      if (rep->generation == rep->tuInfo->generation
+          && rep->handle < table->numHandles
+          && table->objs[rep->handle] == obj) {
+         table->objs[rep->handle] = NULL;
+      }
+   }
+
+   if (rep->tuInfo != NULL) {
+      releaseTUInfo(rep->tuInfo);
+   }
+   Tcl_Free((char *)rep);
+
+   obj->typePtr = NULL;
+}
+
+static void dupCursorInternalRep(Tcl_Obj *src, Tcl_Obj *dst)
+{
+   CursorRep *rep = (CursorRep *)src->internalRep.twoPtrValue.ptr1;
+
+   setCursorInternalRep(dst, rep->cursor, rep->tuInfo);
+
+   CursorRep *dstRep  = (CursorRep *)dst->internalRep.twoPtrValue.ptr1;
+   dstRep->generation = rep->generation;
+   dstRep->handle     = rep->handle;
+}
+
+static Tcl_Obj *newCursorListObj(CXCursor cursor, unsigned generation)
+{
+   enum {
+      ndata = sizeof cursor.data / sizeof cursor.data[0]
+   };
+
+   enum {
+      kind_ix,
+      xdata_ix,
+      data_ix,
+      generation_ix = data_ix + ndata,
+      nelms
+   };
+
+   Tcl_Obj *elms[nelms];
+
+   Tcl_Obj *kindName = getCursorKindNameObj(cursor.kind);
+   if (kindName == NULL) {
+      Tcl_Panic("cursor kind %d is not valid", cursor.kind);
+   }
+   elms[kind_ix]  = kindName;
+   elms[xdata_ix] = Tcl_NewLongObj(cursor.xdata);
+
+   for (int i = 0; i < ndata; ++i) {
+      elms[data_ix + i] = newPointerObj(cursor.data[i]);
+   }
+   elms[generation_ix] = Tcl_NewLongObj(generation);
+
+   return Tcl_NewListObj(nelms, elms);
+}
+
+static void updateStringOfCursor(Tcl_Obj *obj)
+{
+   CursorRep *rep    = (CursorRep *)obj->internalRep.twoPtrValue.ptr1;
+   TUInfo    *tuInfo = rep->tuInfo;
+
+   if (rep->handle < 0 || tuInfo->cmd == NULL) {
+      setStringRepFromObj(obj, newCursorListObj(rep->cursor, rep->generation));
+      return;
+   }
+
+   Tcl_Obj *handleObj = Tcl_NewObj();
+   Tcl_GetCommandFullName(tuInfo->parent->interp, tuInfo->cmd, handleObj);
+   Tcl_AppendPrintfToObj(handleObj, ":%u:%d", rep->generation, rep->handle);
+   setStringRepFromObj(obj, handleObj);
+}
+
+static int tuInstanceObjCmd(ClientData     clientData,
+                            Tcl_Interp    *interp,
+                            int            objc,
+                            Tcl_Obj *const objv[]);
+
+// Parse a cursor handle of the form tuName:generation:handle.  Returns
+// TCL_CONTINUE if the string doesn't look like a handle.
+static int setCursorFromHandle(Tcl_Interp *interp, Tcl_Obj *obj)
+{
+   int         length;
+   const char *str = Tcl_GetStringFromObj(obj, &length);
+
+   for (int i = 0; i < length; ++i) {
+      if (isspace((unsigned char)str[i])) {
+         return TCL_CONTINUE;
+      }
+   }
+
+   const char *handleStr = strrchr(str, ':');
+   if (handleStr == NULL || handleStr == str) {
+      return TCL_CONTINUE;
+   }
+
+   const char *generationStr = handleStr - 1;
+   while (generationStr > str && *generationStr != ':') {
+      --generationStr;
+   }
+   if (generationStr == str) {
+      return TCL_CONTINUE;
+   }
+
+   char               *end;
+   unsigned long long  generation = strtoull(generationStr + 1, &end, 10);
+   if (end != handleStr || end == generationStr + 1) {
+      return TCL_CONTINUE;
+   }
+
+   unsigned long long handle = strtoull(handleStr + 1, &end, 10);
+   if (*end != '\0' || end == handleStr + 1) {
+      return TCL_CONTINUE;
+   }
+
+   if (interp == NULL) {
+      return TCL_ERROR;
+   }
+
+   Tcl_DString tuName;
+   Tcl_DStringInit(&tuName);
+   Tcl_DStringAppend(&tuName, str, generationStr - str);
+
+   Tcl_CmdInfo cmdInfo;
+   int found = Tcl_GetCommandInfo(interp, Tcl_DStringValue(&tuName),
+                                  &cmdInfo);
+   Tcl_DStringFree(&tuName);
+
+   if (!found || cmdInfo.objProc != tuInstanceObjCmd) {
+      goto invalid_cursor;
+   }
+
+   TUInfo            *tuInfo = (TUInfo *)cmdInfo.objClientData;
+   CursorHandleTable *table  = &tuInfo->cursorHandles;
+
+   if (generation != tuInfo->generation) {
+      setStaleTUError(interp, tuInfo, generation, "cursor");
+      return TCL_ERROR;
+   }
+
+   if (handle >= (unsigned long long)table->numHandles) {
+      goto invalid_cursor;
+   }
+
+   discardInternalRep(obj);
+   setCursorInternalRep(obj, table->cursors[handle], tuInfo);
+
+   CursorRep *rep = (CursorRep *)obj->internalRep.twoPtrValue.ptr1;
+   rep->handle    = (int)handle;
+
+   return TCL_OK;
+
+ invalid_cursor:
+   Tcl_SetObjResult(interp, Tcl_NewStringObj("invalid cursor object", -1));
+
+   return TCL_ERROR;
+}
+
+// Parse the string representation of a cursor and convert obj to a
+// cindex-cursor.
+static int setCursorFromAny(Tcl_Interp *interp, Tcl_Obj *obj)
+{
+   int status = setCursorFromHandle(interp, obj);
+   if (status != TCL_CONTINUE) {
+      return status;
+   }
+
+   CXCursor result = { 0 };
+
+   enum {
+      ndata = sizeof result.data / sizeof result.data[0]
+   };
+
+   enum {
+      kind_ix,
+      xdata_ix,
+      data_ix,
+      generation_ix = data_ix + ndata,
+      nelms
+   };
+
+   int       n;
+   Tcl_Obj **elms;
+   status = Tcl_ListObjGetElements(interp, obj, &n, &elms);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   if (n != nelms) {
+      goto invalid_cursor;
+   }
+
+   status = getCursorKindFromObj(interp, elms[kind_ix], &result.kind);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   status = Tcl_GetIntFromObj(NULL, elms[xdata_ix], &result.xdata);
+   if (status != TCL_OK) {
+      goto invalid_cursor;
+   }
+
+   for (int i = 0; i < ndata; ++i) {
+      status = getPointerFromObj(NULL, elms[data_ix + i],
+                                 (void **)&result.data[i]);
+      if (status != TCL_OK) {
+         goto invalid_cursor;
+      }
+   }
+
+   unsigned generation;
+   status = getUnsignedFromObj(NULL, elms[generation_ix], &generation);
+   if (status != TCL_OK) {
+      goto invalid_cursor;
+   }
+
+   CXTranslationUnit  tu     = clang_Cursor_getTranslationUnit(result);
+   TUInfo            *tuInfo = lookupTranslationUnit(tu);
+   if (tuInfo == NULL) {
+      goto invalid_cursor;
+   }
+
+   if (generation != tuInfo->generation) {
+      if (interp != NULL) {
+         setStaleTUError(interp, tuInfo, generation, "cursor");
+      }
+      return TCL_ERROR;
+   }
+
+   discardInternalRep(obj);
+   setCursorInternalRep(obj, result, tuInfo);
+
+   return TCL_OK;
+
+ invalid_cursor:
+   if (interp != NULL) {
+      Tcl_SetObjResult(interp,
+                       Tcl_NewStringObj("invalid cursor object", -1));
+   }
+
+   return TCL_ERROR;
+}
+
+// Create the shared cursor object of handle in the handle table of tuInfo.
+static Tcl_Obj *newInternedCursorObj(TUInfo *tuInfo, int handle)
+{
+   Tcl_Obj *obj = Tcl_NewObj();
+   Tcl_InvalidateStringRep(obj);
+   setCursorInternalRep(obj, tuInfo->cursorHandles.cursors[handle], tuInfo);
+   ((CursorRep *)obj->internalRep.twoPtrValue.ptr1)->handle = handle;
+
+   return obj;
+}
+
+// Return the shared cursor object of cursor in the handle table of tuInfo,
+// adding it if necessary.
+static Tcl_Obj *internCursor(TUInfo *tuInfo, CXCursor cursor)
+{
+   CursorHandleTable *table = &tuInfo->cursorHandles;
+
+   // Cursors that clang_equalCursors considers equal share a handle.
+   CXCursor       key = getASTIndexKey(cursor);
+   int            created;
+   Tcl_HashEntry *entry = Tcl_CreateHashEntry(&table->handles,
+                                              (const char *)&key,
+                                              &created);
+   if (!created) {
+      int handle = (int)(intptr_t)Tcl_GetHashValue(entry);
+      if (table->objs[handle] == NULL) {
+         table->objs[handle] = newInternedCursorObj(tuInfo, handle);
+      }
+      return table->objs[handle];
+   }
+
+   if (table->numHandles == table->capacity) {
+      table->capacity = table->capacity == 0 ? 64 : table->capacity * 2;
+      table->cursors  = (CXCursor *)
+         Tcl_Realloc((char *)table->cursors,
+                     table->capacity * sizeof table->cursors[0]);
+      table->objs     = (Tcl_Obj **)
+         Tcl_Realloc((char *)table->objs,
+                     table->capacity * sizeof table->objs[0]);
+   }
+
+   int handle = table->numHandles++;
+   Tcl_SetHashValue(entry, (ClientData)(intptr_t)handle);
+
+   table->cursors[handle] = cursor;
+   table->objs[handle]    = newInternedCursorObj(tuInfo, handle);
+
+   return table->objs[handle];
+}
+
+static Tcl_Obj *newCursorObjForTU(TUInfo *tuInfo, CXCursor cursor)
+{
+   if (tuInfo != NULL && tuInfo->cursorHandles.enabled
+       && tuInfo->translationUnit != NULL) {
+      return internCursor(tuInfo, cursor);
+   }
+
+   Tcl_Obj *obj = Tcl_NewObj();
+   Tcl_InvalidateStringRep(obj);
+   setCursorInternalRep(obj, cursor, tuInfo);
+
+   return obj;
+}
+
+static Tcl_Obj *newCursorObj(CXCursor cursor)
+{
+   CXTranslationUnit tu = clang_Cursor_getTranslationUnit(cursor);
+
+   return newCursorObjForTU(tu != NULL ? lookupTranslationUnit(tu) : NULL,
+                            cursor);
+}
+
+static int
+getCursorFromObj(Tcl_Interp *interp, Tcl_Obj *obj, CXCursor *cursor)
+{
+   if (obj->typePtr != &cursorObjType) {
+      int status = setCursorFromAny(interp, obj);
+      if (status != TCL_OK) {
+         return status;
+      }
+   }
+
+   CursorRep *rep    = (CursorRep *)obj->internalRep.twoPtrValue.ptr1;
+   TUInfo    *tuInfo = rep->tuInfo;
+
+   // An evicted translation unit has no AST either, but its command is
+   // still there.
+   if (tuInfo == NULL || tuInfo->cmd == NULL) {
+      if (interp != NULL) {
+         Tcl_SetObjResult(interp,
+                          Tcl_NewStringObj("invalid cursor object", -1));
+      }
+      return TCL_ERROR;
+   }
+
+   if (rep->generation != tuInfo->generation) {
+      setStaleTUError(interp, tuInfo, rep->generation, "cursor");
+      return TCL_ERROR;
+   }
+
+   markTUUsed(tuInfo);
+   *cursor = rep->cursor;
+
+   return TCL_OK;
+}
+
+// Return the translation unit of obj, which getCursorFromObj has accepted.
+static TUInfo *getCursorTUInfo(Tcl_Obj *obj)
+{
+   return ((CursorRep *)obj->internalRep.twoPtrValue.ptr1)->tuInfo;
+}
+
+//---------------------------------------------------------------- cursor scope
+
+/** The files a traversal is limited to.
+ *
+ * Traversals skip the subtree of a cursor out of the scope without looking
+ * into it.  The options that set up a scope are common to the traversal
+ * commands and parsed by parseCursorScopeOption.
+ */
+typedef struct CursorScope {
+   unsigned  optionsFound;         // 1 << the index in cursorScopeOptions
+   int       mainFileOnly;
+   int       excludeSystemHeaders;
+   int       limitToFiles;         // 0 for all files
+   int       numFiles;
+   CXFile   *files;
+} CursorScope;
+
+static const char *cursorScopeOptions[] = {
+   "-excludeSystemHeaders",
+   "-files",
+   "-mainFileOnly",
+   NULL
+};
+
+enum {
+   cursorScopeOption_excludeSystemHeaders,
+   cursorScopeOption_files,
+   cursorScopeOption_mainFileOnly
+};
+
+static void initCursorScope(CursorScope *scope)
+{
+   scope->optionsFound         = 0;
+   scope->mainFileOnly         = 0;
+   scope->excludeSystemHeaders = 0;
+   scope->limitToFiles         = 0;
+   scope->numFiles             = 0;
+   scope->files                = NULL;
+}
+
+static void clearCursorScope(CursorScope *scope)
+{
+   Tcl_Free((char *)scope->files);
+   initCursorScope(scope);
+}
+
+static int addCursorScopeFile(Tcl_Interp        *interp,
+                              CursorScope       *scope,
+                              CXTranslationUnit  tu,
+                              Tcl_Obj           *filenameObj)
+{
+   const char *filename = Tcl_GetStringFromObj(filenameObj, NULL);
+   CXFile      file     = clang_getFile(tu, filename);
+   if (file == NULL) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("file \"%s\" is not a part of "
+                                     "the translation unit",
+                                     filename));
+      return TCL_ERROR;
+   }
+
+   scope->files = (CXFile *)
+      Tcl_Realloc((char *)scope->files,
+                  (scope->numFiles + 1) * sizeof scope->files[0]);
+   scope->files[scope->numFiles++] = file;
+   scope->limitToFiles             = 1;
+
+   return TCL_OK;
+}
+
+// Parse objv[*i] if it is one of cursorScopeOptions, advancing *i past its
+// value.  Returns TCL_CONTINUE if it is not.  options are the other options
+// of the command, or NULL.  Like Tcl_GetIndexFromObj, an abbreviation is
+// accepted if it is unique among both tables.
+static int parseCursorScopeOption(Tcl_Interp        *interp,
+                                  CursorScope       *scope,
+                                  CXTranslationUnit  tu,
+                                  const char       **options,
+                                  int                objc,
+                                  Tcl_Obj *const     objv[],
+                                  int               *i)
+{
+   int optionNumber;
+   if (Tcl_GetIndexFromObj(NULL, objv[*i], cursorScopeOptions,
+                           "option", 0, &optionNumber) != TCL_OK) {
+      return TCL_CONTINUE;
+   }
+
+   int         length;
+   const char *arg = Tcl_GetStringFromObj(objv[*i], &length);
+   if (options != NULL
+       && strcmp(arg, cursorScopeOptions[optionNumber]) != 0) {
+      int numPrefixed = 0;
+      for (int j = 0; options[j] != NULL; ++j) {
+         if (strcmp(arg, options[j]) == 0) {
+            return TCL_CONTINUE;
+         }
+         if (strncmp(arg, options[j], length) == 0) {
+            ++numPrefixed;
+         }
+      }
+      if (numPrefixed > 0) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("ambiguous option \"%s\"", arg));
+         return TCL_ERROR;
+      }
+   }
+
+   if ((scope->optionsFound & (1 << optionNumber)) != 0) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("%s is specified more than once.",
+                                     cursorScopeOptions[optionNumber]));
+      return TCL_ERROR;
+   }
+   scope->optionsFound |= 1 << optionNumber;
+
+   switch (optionNumber) {
+
+   case cursorScopeOption_excludeSystemHeaders:
+      scope->excludeSystemHeaders = 1;
+      break;
+
+   case cursorScopeOption_mainFileOnly:
+      scope->mainFileOnly = 1;
+      break;
+
+   case cursorScopeOption_files: {
+      if (objc <= *i + 1) {
+         Tcl_SetObjResult(interp,
+                          Tcl_NewStringObj("-files is not followed by a "
+                                           "list of files", -1));
+         return TCL_ERROR;
+      }
+
+      int       n;
+      Tcl_Obj **elms;
+      int status = Tcl_ListObjGetElements(interp, objv[++*i], &n, &elms);
+      if (status != TCL_OK) {
+         return status;
+      }
+
+      // An empty list selects no file at all.
+      scope->limitToFiles = 1;
+      for (int j = 0; j < n; ++j) {
+         status = addCursorScopeFile(interp, scope, tu, elms[j]);
+         if (status != TCL_OK) {
+            return status;
+         }
+      }
+      break;
+   }
+
+   }
+
+   return TCL_OK;
+}
+
+// Parse objv, which must consist of cursorScopeOptions only.
+static int parseCursorScopeOptions(Tcl_Interp        *interp,
+                                   CursorScope       *scope,
+                                   CXTranslationUnit  tu,
+                                   int                objc,
+                                   Tcl_Obj *const     objv[])
+{
+   for (int i = 0; i < objc; ++i) {
+      int status = parseCursorScopeOption(interp, scope, tu, NULL,
+                                          objc, objv, &i);
+      if (status == TCL_CONTINUE) {
+         // Leave the usual error message for an unknown option.
+         int index;
+         Tcl_GetIndexFromObj(interp, objv[i], cursorScopeOptions,
+                             "option", 0, &index);
+         return TCL_ERROR;
+      }
+      if (status != TCL_OK) {
+         return status;
+      }
+   }
+
+   return TCL_OK;
+}
+
+static int isCursorScopeLimited(const CursorScope *scope)
+{
+   return scope->mainFileOnly || scope->excludeSystemHeaders
+      || scope->limitToFiles;
+}
+
+static int isCursorInScope(const CursorScope *scope, CXCursor cursor)
+{
+   if (! isCursorScopeLimited(scope)) {
+      return 1;
+   }
+
+   CXSourceLocation location = clang_getCursorLocation(cursor);
+
+   if (scope->mainFileOnly && !clang_Location_isFromMainFile(location)) {
+      return 0;
+   }
+
+   if (scope->excludeSystemHeaders
+       && clang_Location_isInSystemHeader(location)) {
+      return 0;
+   }
+
+   if (scope->limitToFiles) {
+      CXFile file;
+      clang_getExpansionLocation(location, &file, NULL, NULL, NULL);
+      for (int i = 0; i < scope->numFiles; ++i) {
+         if (scope->files[i] == file) {
+            return 1;
+         }
+      }
+      return 0;
+   }
+
+   return 1;
+}
+
+//----------------------------------------------------------------------- type
+
+static Tcl_Obj *typeKindValues;
+static Tcl_Obj *typeKindNames;
+
+static void createCXTypeTable(void)
+{
+   static NameValuePair table[] = {
+      { "Invalid",
+        CXType_Invalid },
+      { "Unexposed",
+        CXType_Unexposed },
+      { "Void",
+        CXType_Void },
+      { "Bool",
+        CXType_Bool },
+      { "Char_U",
+        CXType_Char_U },
+      { "UChar",
+        CXType_UChar },
+      { "Char16",
+        CXType_Char16 },
+      { "Char32",
+        CXType_Char32 },
+      { "UShort",
+        CXType_UShort },
+      { "UInt",
+        CXType_UInt },
+      { "ULong",
+        CXType_ULong },
+      { "ULongLong",
+        CXType_ULongLong },
+      { "UInt128",
+        CXType_UInt128 },
+      { "Char_S",
+        CXType_Char_S },
+      { "SChar",
+        CXType_SChar },
+      { "WChar",
+        CXType_WChar },
+      { "Short",
+        CXType_Short },
+      { "Int",
+        CXType_Int },
+      { "Long",
+        CXType_Long },
+      { "LongLong",
+        CXType_LongLong },
+      { "Int128",
+        CXType_Int128 },
+      { "Float",
+        CXType_Float },
+      { "Double",
+        CXType_Double },
+      { "LongDouble",
+        CXType_LongDouble },
+      { "NullPtr",
+        CXType_NullPtr },
+      { "Overload",
+        CXType_Overload },
+      { "Dependent",
+        CXType_Dependent },
+      { "ObjCId",
+        CXType_ObjCId },
+      { "ObjCClass",
+        CXType_ObjCClass },
+      { "ObjCSel",
+        CXType_ObjCSel },
+#if CINDEX_VERSION_MINOR >= 35
+      { "Float128",
+        CXType_Float128 },
+#endif
+#if CINDEX_VERSION_MINOR >= 38
+      { "Half",
+        CXType_Half },
+#endif
+      { "Complex",
+        CXType_Complex },
+      { "Pointer",
+        CXType_Pointer },
+      { "BlockPointer",
+        CXType_BlockPointer },
+      { "LValueReference",
+        CXType_LValueReference },
+      { "RValueReference",
+        CXType_RValueReference },
+      { "Record",
+        CXType_Record },
+      { "Enum",
+        CXType_Enum },
+      { "Typedef",
+        CXType_Typedef },
+      { "ObjCInterface",
+        CXType_ObjCInterface },
+      { "ObjCObjectPointer",
+        CXType_ObjCObjectPointer },
+      { "FunctionNoProto",
+        CXType_FunctionNoProto },
+      { "FunctionProto",
+        CXType_FunctionProto },
+      { "ConstantArray",
+        CXType_ConstantArray },
+      { "Vector",
+        CXType_Vector },
+      { "IncompleteArray",
+        CXType_IncompleteArray },
+      { "VariableArray",
+        CXType_VariableArray },
+      { "DependentSizedArray",
+        CXType_DependentSizedArray },
+      { "MemberPointer",
+        CXType_MemberPointer },
+#if CINDEX_VERSION_MINOR >= 32
+      { "Auto",
+        CXType_Auto },
+#endif
+#if CINDEX_VERSION_MINOR >= 35
+      { "Elaborated",
+        CXType_Elaborated },
+#endif
+      { NULL }
+   };
+
+   createNameValueTable(&typeKindNames, &typeKindValues, table);
+
+   Tcl_IncrRefCount(typeKindNames);
+   Tcl_IncrRefCount(typeKindValues);
+}
+
+/** The internal representation of a cindex-type Tcl_Obj.
+ *
+ * The string representation is the list {kind data0 data1 generation}.  It is
+ * generated only when a script asks for it.  Like a cursor, a type points
+ * into the AST of its translation unit, and is rejected once the AST is gone.
+ */
+typedef struct TypeRep
+{
+   CXType    type;
+   TUInfo   *tuInfo;            // NULL if the type has no translation unit
+   unsigned  generation;        // tuInfo->generation at creation
+} TypeRep;
+
+static void freeTypeInternalRep(Tcl_Obj *obj);
+static void dupTypeInternalRep(Tcl_Obj *src, Tcl_Obj *dst);
+static void updateStringOfType(Tcl_Obj *obj);
+static int  setTypeFromAny(Tcl_Interp *interp, Tcl_Obj *obj);
+
+static Tcl_ObjType typeObjType = {
+   "cindex-type",
+   freeTypeInternalRep,
+   dupTypeInternalRep,
+   updateStringOfType,
+   setTypeFromAny
+};
+
+static void setTypeInternalRep(Tcl_Obj *obj, CXType type, TUInfo *tuInfo)
+{
+   TypeRep *rep    = (TypeRep *)Tcl_Alloc(sizeof *rep);
+   rep->type       = type;
+   rep->tuInfo     = tuInfo;
+   rep->generation = tuInfo != NULL ? tuInfo->generation : 0;
+
+   if (tuInfo != NULL) {
+      retainTUInfo(tuInfo);
+   }
+
+   obj->internalRep.twoPtrValue.ptr1 = rep;
+   obj->internalRep.twoPtrValue.ptr2 = NULL;
+   obj->typePtr                      = &typeObjType;
+}
+
+static void freeTypeInternalRep(Tcl_Obj *obj)
+{
+   TypeRep *rep = (TypeRep *)obj->internalRep.twoPtrValue.ptr1;
+
+   if (rep->tuInfo != NULL) {
+      releaseTUInfo(rep->tuInfo);
+   }
+   Tcl_Free((char *)rep);
+
+   obj->typePtr = NULL;
+}
+
+static void dupTypeInternalRep(Tcl_Obj *src, Tcl_Obj *dst)
+{
+   TypeRep *rep = (TypeRep *)src->internalRep.twoPtrValue.ptr1;
+
+   setTypeInternalRep(dst, rep->type, rep->tuInfo);
+
+   TypeRep *dstRep    = (TypeRep *)dst->internalRep.twoPtrValue.ptr1;
+   dstRep->generation = rep->generation;
+}
+
+static Tcl_Obj *newTypeListObj(CXType type, unsigned generation)
+{
+   Tcl_Obj *kind = Tcl_NewIntObj(type.kind);
+   Tcl_IncrRefCount(kind);
+   Tcl_Obj *kindName;
+   if (Tcl_DictObjGet(NULL, typeKindNames, kind, &kindName) != TCL_OK
+       || kindName == NULL) {
+      Tcl_Panic("typeKindNames(%d) corrupted", type.kind);
+   }
+   Tcl_DecrRefCount(kind);
+
+   enum {
+      ndata = sizeof type.data / sizeof type.data[0]
+   };
+
+   enum {
+      kind_ix,
+      data_ix,
+      generation_ix = data_ix + ndata,
+      nelms
+   };
+
+   Tcl_Obj* elements[nelms];
+   elements[kind_ix] = kindName;
+   for (int i = 0; i < ndata; ++i) {
+      elements[data_ix + i] = newPointerObj(type.data[i]);
+   }
+   elements[generation_ix] = Tcl_NewLongObj(generation);
+
+   return Tcl_NewListObj(nelms, elements);
+}
+
+static void updateStringOfType(Tcl_Obj *obj)
+{
+   TypeRep *rep = (TypeRep *)obj->internalRep.twoPtrValue.ptr1;
+
+   setStringRepFromObj(obj, newTypeListObj(rep->type, rep->generation));
+}
+
+// Parse the list representation of a type and convert obj to a cindex-type.
+static int setTypeFromAny(Tcl_Interp *interp, Tcl_Obj *obj)
+{
+   CXType result = { 0 };
+
+   enum {
+      ndata = sizeof result.data / sizeof result.data[0]
+   };
+
+   enum {
+      kind_ix,
+      data_ix,
+      generation_ix = data_ix + ndata,
+      nelms
+   };
+
+   int       nelms_actual = 0;
+   Tcl_Obj **elms         = NULL;
+   if (Tcl_ListObjGetElements(NULL, obj, &nelms_actual, &elms) != TCL_OK
+       || nelms_actual != nelms) {
+      goto invalid_type;
+   }
+
+   Tcl_Obj *kindObj;
+   if (Tcl_DictObjGet(NULL, typeKindValues, elms[kind_ix], &kindObj)
+       != TCL_OK
+       || kindObj == NULL) {
+      goto invalid_type;
+   }
+
+   int kind;
+   int status = Tcl_GetIntFromObj(NULL, kindObj, &kind);
+   if (status != TCL_OK) {
+      goto invalid_type;
+   }
+   result.kind = kind;
+
+   for (int i = 0; i < ndata; ++i) {
+      if (getPointerFromObj(NULL, elms[data_ix + i], &result.data[i])
+          != TCL_OK) {
+         goto invalid_type;
+      }
+   }
+
+   unsigned generation;
+   if (getUnsignedFromObj(NULL, elms[generation_ix], &generation) != TCL_OK) {
+      goto invalid_type;
+   }
+
+   // data[1] is the translation unit of the type.
+   TUInfo *tuInfo = NULL;
+   if (result.data[1] != NULL) {
+      tuInfo = lookupTranslationUnit((CXTranslationUnit)result.data[1]);
+      if (tuInfo == NULL) {
+         goto invalid_type;
+      }
+
+      if (generation != tuInfo->generation) {
+         if (interp != NULL) {
+            setStaleTUError(interp, tuInfo, generation, "type");
+         }
+         return TCL_ERROR;
+      }
+   }
+
+   discardInternalRep(obj);
+   setTypeInternalRep(obj, result, tuInfo);
+
+   return TCL_OK;
+
+ invalid_type:
+   if (interp != NULL) {
+      Tcl_SetObjResult(interp,
+                       Tcl_NewStringObj("invalid type object", -1));
+   }
+   return TCL_ERROR;
+}
+
+static Tcl_Obj *newTypeObj(CXType type)
+{
+   TUInfo *tuInfo = NULL;
+   if (type.data[1] != NULL) {
+      tuInfo = lookupTranslationUnit((CXTranslationUnit)type.data[1]);
+   }
+
+   Tcl_Obj *obj = Tcl_NewObj();
+   Tcl_InvalidateStringRep(obj);
+   setTypeInternalRep(obj, type, tuInfo);
+
+   return obj;
+}
+
+static int getTypeFromObj(Tcl_Interp *interp, Tcl_Obj *obj, CXType *output)
+{
+   if (obj->typePtr != &typeObjType) {
+      int status = setTypeFromAny(interp, obj);
+      if (status != TCL_OK) {
+         return status;
+      }
+   }
+
+   TypeRep *rep    = (TypeRep *)obj->internalRep.twoPtrValue.ptr1;
+   TUInfo  *tuInfo = rep->tuInfo;
+
+   if (tuInfo != NULL && tuInfo->cmd == NULL) {
+      if (interp != NULL) {
+         Tcl_SetObjResult(interp,
+                          Tcl_NewStringObj("invalid type object", -1));
+      }
+      return TCL_ERROR;
+   }
+
+   if (tuInfo != NULL && rep->generation != tuInfo->generation) {
+      setStaleTUError(interp, tuInfo, rep->generation, "type");
+      return TCL_ERROR;
+   }
+
+   if (tuInfo != NULL) {
+      markTUUsed(tuInfo);
+   }
+   *output = rep->type;
+
+   return TCL_OK;
+}
+
+// Return the translation unit of obj, which getTypeFromObj has accepted, or
+// NULL if it is not known.
+static TUInfo *getTypeTUInfo(Tcl_Obj *obj)
+{
+   return ((TypeRep *)obj->internalRep.twoPtrValue.ptr1)->tuInfo;
+}
+
+//--------------------------------------------------------- type equal command
+
+static int typeEqualObjCmd(ClientData     clientData,
+                           Tcl_Interp    *interp,
+                           int            objc,
+                           Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type1_ix,
+      type2_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type1 type2");
+      return TCL_ERROR;
+   }
+
+   CXType types[2];
+   for (int i = 0; i < 2; ++i) {
+      int status = getTypeFromObj(interp, objv[type1_ix + i], &types[i]);
+      if (status != TCL_OK) {
+         return status;
+      }
+   }
+
+   int      result    = clang_equalTypes(types[0], types[1]) != 0;
+   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//-------------------------------------------------- type foreachField command
+
+#if CINDEX_VERSION_MINOR >= 30
+/** The translation unit a type foreachField command runs over, if known.
+ */
+typedef struct ForeachFieldInfo {
+   TUInfo   *tuInfo;
+   unsigned  generation;        // tuInfo->generation at the start
+} ForeachFieldInfo;
+
+static enum CXVisitorResult foreachFieldHelper(CXCursor     cursor,
+                                               CXClientData clientData)
+{
+   int status = TCL_OK;
+
+   struct VisitInfo *visitInfo = (VisitInfo *)clientData;
+   ForeachFieldInfo *fieldInfo = (ForeachFieldInfo *)visitInfo->clientData;
+
+   Tcl_Obj *cursorObj = newCursorObj(cursor);
+   Tcl_Obj *fieldName = visitInfo->variableNames[0];
+   Tcl_IncrRefCount(cursorObj);
+   if (Tcl_ObjSetVar2(visitInfo->interp, fieldName,
+                      NULL, cursorObj, TCL_LEAVE_ERR_MSG) == NULL) {
+      status = TCL_ERROR;
+      goto cleanup;
+   }
+
+   status = Tcl_EvalObjEx(visitInfo->interp, visitInfo->scriptObj, 0);
+
+   if ((status == TCL_OK || status == TCL_CONTINUE)
+       && fieldInfo->tuInfo != NULL
+       && checkTraversedTU(visitInfo->interp, fieldInfo->tuInfo,
+                           fieldInfo->generation, "type") != TCL_OK) {
+      status = TCL_ERROR;
+   }
+
+cleanup:
+   if (cursorObj) {
+      Tcl_DecrRefCount(cursorObj);
+   }
+
+   switch (status) {
+   case TCL_OK:
+   case TCL_CONTINUE:
+      return CXVisit_Continue;
+   case TCL_BREAK:
+      return CXVisit_Break;
+   default:
+      visitInfo->returnCode = status;
+      return CXVisit_Break;
+   }
+}
+
+static int typeForeachFieldObjCmd(ClientData     clientData,
+                                  Tcl_Interp    *interp,
+                                  int            objc,
+                                  Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      recordType_ix,
+      varName_ix,
+      script_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix, objv, "recordType varName script");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[recordType_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   Tcl_Obj **varNames = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *));
+   varNames[0] = objv[varName_ix];
+
+   TUInfo *tuInfo = getTypeTUInfo(objv[recordType_ix]);
+   ForeachFieldInfo fieldInfo = {
+      .tuInfo     = tuInfo,
+      .generation = tuInfo != NULL ? tuInfo->generation : 0,
+   };
+
+   VisitInfo visitInfo = {
+      .interp        = interp,
+      .variableNames = varNames,
+      .numVariables  = 1,
+      .scriptObj     = objv[script_ix],
+      .returnCode    = TCL_OK,
+      .clientData    = &fieldInfo,
+   };
+
+   if (tuInfo != NULL) {
+      enterTU(tuInfo);
+   }
+   clang_Type_visitFields(type, foreachFieldHelper, &visitInfo);
+   if (tuInfo != NULL) {
+      leaveTU(tuInfo);
+   }
+
+   Tcl_Free((void *)varNames);
+
+   return visitInfo.returnCode;
+}
 #endif
+
+//--------------------------------- type functionTypeCallingConvention command
+
+static Tcl_Obj *callingConvValues;
+static Tcl_Obj *callingConvNames;
+
+static void createCallingConvTable(void)
+{
+   static NameValuePair table[] = {
+      { "Default",
+        CXCallingConv_Default },
+      { "C",
+        CXCallingConv_C },
+      { "X86StdCall",
+        CXCallingConv_X86StdCall },
+      { "X86FastCall",
+        CXCallingConv_X86FastCall },
+      { "X86ThisCall",
+        CXCallingConv_X86ThisCall },
+      { "X86Pascal",
+        CXCallingConv_X86Pascal },
+      { "AAPCS",
+        CXCallingConv_AAPCS },
+      { "AAPCS_VFP",
+        CXCallingConv_AAPCS_VFP },
 #if CINDEX_VERSION_MINOR >= 36
-      { "ObjCAvailabilityCheckExpr",
-        CXCursor_ObjCAvailabilityCheckExpr },
-#endif
-      /* { "LastExpr", */
-      /*   CXCursor_LastExpr }, */
-      /* { "FirstStmt", */
-      /*   CXCursor_FirstStmt }, */
-      { "UnexposedStmt",
-        CXCursor_UnexposedStmt },
-      { "LabelStmt",
-        CXCursor_LabelStmt },
-      { "CompoundStmt",
-        CXCursor_CompoundStmt },
-      { "CaseStmt",
-        CXCursor_CaseStmt },
-      { "DefaultStmt",
-        CXCursor_DefaultStmt },
-      { "IfStmt",
-        CXCursor_IfStmt },
-      { "SwitchStmt",
-        CXCursor_SwitchStmt },
-      { "WhileStmt",
-        CXCursor_WhileStmt },
-      { "DoStmt",
-        CXCursor_DoStmt },
-      { "ForStmt",
-        CXCursor_ForStmt },
-      { "GotoStmt",
-        CXCursor_GotoStmt },
-      { "IndirectGotoStmt",
-        CXCursor_IndirectGotoStmt },
-      { "ContinueStmt",
-        CXCursor_ContinueStmt },
-      { "BreakStmt",
-        CXCursor_BreakStmt },
-      { "ReturnStmt",
-        CXCursor_ReturnStmt },
-      /* { "GCCAsmStmt", */
-      /*   CXCursor_GCCAsmStmt }, */
-      { "AsmStmt",
-        CXCursor_AsmStmt },
-      { "ObjCAtTryStmt",
-        CXCursor_ObjCAtTryStmt },
-      { "ObjCAtCatchStmt",
-        CXCursor_ObjCAtCatchStmt },
-      { "ObjCAtFinallyStmt",
-        CXCursor_ObjCAtFinallyStmt },
-      { "ObjCAtThrowStmt",
-        CXCursor_ObjCAtThrowStmt },
-      { "ObjCAtSynchronizedStmt",
-        CXCursor_ObjCAtSynchronizedStmt },
-      { "ObjCAutoreleasePoolStmt",
-        CXCursor_ObjCAutoreleasePoolStmt },
-      { "ObjCForCollectionStmt",
-        CXCursor_ObjCForCollectionStmt },
-      { "CXXCatchStmt",
-        CXCursor_CXXCatchStmt },
-      { "CXXTryStmt",
-        CXCursor_CXXTryStmt },
-      { "CXXForRangeStmt",
-        CXCursor_CXXForRangeStmt },
-      { "SEHTryStmt",
-        CXCursor_SEHTryStmt },
-      { "SEHExceptStmt",
-        CXCursor_SEHExceptStmt },
-      { "SEHFinallyStmt",
-        CXCursor_SEHFinallyStmt },
-      { "MSAsmStmt",
-        CXCursor_MSAsmStmt },
-      { "NullStmt",
-        CXCursor_NullStmt },
-      { "DeclStmt",
-        CXCursor_DeclStmt },
-      { "OMPParallelDirective",
-        CXCursor_OMPParallelDirective },
-#if CINDEX_VERSION_MINOR >= 25
-      { "OMPSimdDirective",
-        CXCursor_OMPSimdDirective },
-#endif
-#if CINDEX_VERSION_MINOR >= 28
-      { "OMPForDirective",
-        CXCursor_OMPForDirective },
-      { "OMPSectionsDirective",
-        CXCursor_OMPSectionsDirective },
-      { "OMPSectionDirective",
-        CXCursor_OMPSectionDirective },
-      { "OMPSingleDirective",
-        CXCursor_OMPSingleDirective },
-      { "OMPParallelForDirective",
-        CXCursor_OMPParallelForDirective },
-      { "OMPParallelSectionsDirective",
-        CXCursor_OMPParallelSectionsDirective },
-      { "OMPTaskDirective",
-        CXCursor_OMPTaskDirective },
-      { "OMPMasterDirective",
-        CXCursor_OMPMasterDirective },
-      { "OMPCriticalDirective",
-        CXCursor_OMPCriticalDirective },
-      { "OMPTaskyieldDirective",
-        CXCursor_OMPTaskyieldDirective },
-      { "OMPBarrierDirective",
-        CXCursor_OMPBarrierDirective },
-      { "OMPTaskwaitDirective",
-        CXCursor_OMPTaskwaitDirective },
-      { "OMPFlushDirective",
-        CXCursor_OMPFlushDirective },
-      { "SEHLeaveStmt",
-        CXCursor_SEHLeaveStmt },
-      { "OMPOrderedDirective",
-        CXCursor_OMPOrderedDirective },
-      { "OMPAtomicDirective",
-        CXCursor_OMPAtomicDirective },
+      { "X86RegCall",
+        CXCallingConv_X86RegCall },
+#elif CINDEX_VERSION_MINOR >= 30
+      { "Unused", 8},
+#else
+      { "PnaclCall",
+        CXCallingConv_PnaclCall },
 #endif
-#if CINDEX_VERSION_MINOR >= 29
-      { "OMPForSimdDirective",
-        CXCursor_OMPForSimdDirective },
-      { "OMPParallelForSimdDirective",
-        CXCursor_OMPParallelForSimdDirective },
-      { "OMPTargetDirective",
-        CXCursor_OMPTargetDirective },
-      { "OMPTeamsDirective",
-        CXCursor_OMPTeamsDirective },
+      { "IntelOclBicc",
+        CXCallingConv_IntelOclBicc },
+      { "X86_64Win64",
+        CXCallingConv_X86_64Win64 },
+      { "X86_64SysV",
+        CXCallingConv_X86_64SysV },
+#if CINDEX_VERSION_MINOR >= 30
+      { "X86VectorCall",
+        CXCallingConv_X86VectorCall },
 #endif
-#if CINDEX_VERSION_MINOR >= 31
-      { "OMPTaskgroupDirective",
-        CXCursor_OMPTaskgroupDirective },
-      { "OMPCancellationPointDirective",
-        CXCursor_OMPCancellationPointDirective },
-      { "OMPCancelDirective",
-        CXCursor_OMPCancelDirective },
-      { "OMPTargetDataDirective",
-        CXCursor_OMPTargetDataDirective },
+#if CINDEX_VERSION_MINOR >= 34
+      { "Swift",
+        CXCallingConv_Swift },
 #endif
-#if CINDEX_VERSION_MINOR >= 32
-      { "OMPTaskLoopDirective",
-        CXCursor_OMPTaskLoopDirective },
-      { "OMPTaskLoopSimdDirective",
-        CXCursor_OMPTaskLoopSimdDirective },
+#if CINDEX_VERSION_MINOR >= 35
+      { "PreserveMost",
+        CXCallingConv_PreserveMost },
+      { "PreserveAll",
+        CXCallingConv_PreserveAll },
 #endif
+      { "Invalid",
+        CXCallingConv_Invalid },
+      { "Unexposed",
+        CXCallingConv_Unexposed },
+      { NULL }
+   };
+
+   createNameValueTable(&callingConvNames, &callingConvValues, table);
+
+   Tcl_IncrRefCount(callingConvNames);
+   Tcl_IncrRefCount(callingConvValues);
+}
+
+#if CINDEX_VERSION_MINOR >= 33
+//-------------------------------------------------- type objCEncoding command
+
+static int typeObjCEncodingObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, 0, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType cxtype;
+   int status = getTypeFromObj(interp, objv[type_ix], &cxtype);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   Tcl_Obj    *resultObj = NULL;
+   if (CXType_Invalid == cxtype.kind) {
+      resultObj = Tcl_NewObj();
+   } else {
+      CXString objcencoding = clang_Type_getObjCEncoding(cxtype);
+      resultObj = convertCXStringToObj(objcencoding);
+   }
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+#endif
+//------------------------------------------------------ type offsetof command
+
+static int typeOffsetOfObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      field_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, 1, objv, "type field");
+      return TCL_ERROR;
+   }
+
+   CXType cxtype;
+   int status = getTypeFromObj(interp, objv[type_ix], &cxtype);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   const char *field     = Tcl_GetStringFromObj(objv[field_ix], NULL);
+   long long   result    = clang_Type_getOffsetOf(cxtype, field);
+   Tcl_Obj    *resultObj = newLayoutLongLongObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//-------------------------------------------------------- type -> int command
+
+static int typeToIntObjCmd(ClientData     clientData,
+                           Tcl_Interp    *interp,
+                           int            objc,
+                           Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   int      result    = ((int (*)(CXType))clientData)(type);
+   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//------------------------------------------------------- type -> bool command
+
+static int typeToBoolObjCmd(ClientData     clientData,
+                            Tcl_Interp    *interp,
+                            int            objc,
+                            Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   int      result    = ((unsigned (*)(CXType))clientData)(type) != 0;
+   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//-------------------------------------------------- type -> long long command
+
+static int typeToLongLongObjCmd(ClientData     clientData,
+                                Tcl_Interp    *interp,
+                                int            objc,
+                                Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   long long  result    = ((long long (*)(CXType))clientData)(type);
+   Tcl_Obj   *resultObj = newIntmaxObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//----------------------------------------------------- type -> string command
+
+static int typeToStringObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   CXString (*proc)(CXType) = (CXString (*)(CXType))clientData;
+   CXString    result       = proc(type);
+   const char *resultCstr   = clang_getCString(result);
+   Tcl_Obj    *resultObj    = Tcl_NewStringObj(resultCstr, -1);
+   Tcl_SetObjResult(interp, resultObj);
+   clang_disposeString(result);
+
+   return TCL_OK;
+}
+
+//------------------------------------------------------- type -> enum command
+
+typedef int (*TypeToEnumProc)(CXType);
+
+typedef struct TypeToEnumInfo
+{
+   EnumConsts     *labels;
+   TypeToEnumProc  proc;
+} TypeToEnumInfo;
+
+static int typeToEnumObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   TypeToEnumInfo *info = (TypeToEnumInfo *)clientData;
+
+   int      result    = (info->proc)(type);
+   Tcl_Obj *resultObj = getEnum(info->labels, result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//------------------------------------------------ type -> named value command
+
+typedef unsigned (*TypeToNamedValueProc)(CXType);
+
+typedef struct TypeToNamedValueInfo
+{
+   Tcl_Obj              *names;
+   TypeToNamedValueProc  proc;
+} TypeToNamedValueInfo;
+
+static int typeToNamedValueObjCmd(ClientData     clientData,
+                                  Tcl_Interp    *interp,
+                                  int            objc,
+                                  Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   TypeToNamedValueInfo *info = (TypeToNamedValueInfo *)clientData;
+
+   unsigned  value    = info->proc(type);
+   Tcl_Obj  *valueObj = Tcl_NewLongObj(value);
+   Tcl_IncrRefCount(valueObj);
+
+   Tcl_Obj *resultObj;
+   status = Tcl_DictObjGet(NULL, info->names, valueObj, &resultObj);
+   Tcl_DecrRefCount(valueObj);
+   if (status != TCL_OK) {
+      Tcl_Panic("%s: unknown value: %d", __func__, value);
+   }
+
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//----------------------------------------------------- type -> cursor command
+
+static int typeToCursorObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   CXCursor  result    = ((CXCursor (*)(CXType))clientData)(type);
+   Tcl_Obj  *resultObj = newCursorObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//------------------------------------------------------- type -> type command
+
+static int typeToTypeObjCmd(ClientData     clientData,
+                            Tcl_Interp    *interp,
+                            int            objc,
+                            Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   CXType   result    = ((CXType (*)(CXType))clientData)(type);
+   Tcl_Obj *resultObj = newTypeObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//--------------------------------------------- type, unsigned -> type command
+
+static int typeUnsignedToTypeObjCmd(ClientData     clientData,
+                                    Tcl_Interp    *interp,
+                                    int            objc,
+                                    Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      number_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type unsigned");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   unsigned number;
+   status = getUnsignedFromObj(interp, objv[number_ix], &number);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   typedef CXType (*ProcType)(CXType, unsigned);
+
+   CXType   result    = ((ProcType)clientData)(type, number);
+   Tcl_Obj *resultObj = newTypeObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//------------------------------------------- type -> layout long long command
+
+static int typeToLayoutLongLongObjCmd(ClientData     clientData,
+                                      Tcl_Interp    *interp,
+                                      int            objc,
+                                      Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType cxtype;
+   int status = getTypeFromObj(interp, objv[type_ix], &cxtype);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   long long  result    = ((long long (*)(CXType))clientData)(cxtype);
+   Tcl_Obj   *resultObj = newLayoutLongLongObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//-------------------------------------------------- type -> type list command
+
+typedef struct TypeToTypeListInfo {
+    int (*getNum)(CXType);
+    CXType (*getIndex)(CXType, unsigned);
+} TypeToTypeListInfo;
+
+static int typeToTypeListObjCmd(ClientData     clientData,
+                                Tcl_Interp    *interp,
+                                int            objc,
+                                Tcl_Obj *const objv[]) {
+   enum {
+      command_ix,
+      type_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      return TCL_ERROR;
+   }
+
+   CXType type;
+   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   TypeToTypeListInfo *procs = ((TypeToTypeListInfo *)clientData);
+
+   int num = procs->getNum(type);
+   if (num > 0) {
+      Tcl_Obj **results
+         = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *) * num);
+      for (int i = 0; i < num; i++) {
+         results[i] = newTypeObj(procs->getIndex(type, i));
+      }
+
+      Tcl_Obj *resultObj = Tcl_NewListObj(num, results);
+      Tcl_SetObjResult(interp, resultObj);
+
+      Tcl_Free((char *)results);
+   } else {
+      Tcl_SetObjResult(interp, Tcl_NewListObj(0, NULL));
+   }
+
+   return TCL_OK;
+}
+
+//------------------------------------------------------ cursor::equal command
+
+static int cursorEqualObjCmd(ClientData     clientData,
+                             Tcl_Interp    *interp,
+                             int            objc,
+                             Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      cursor1_ix,
+      cursor2_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor1 cursor2");
+      return TCL_ERROR;
+   }
+
+   CXCursor cursors[2];
+   for (int i = 0; i < 2; ++i) {
+      int status = getCursorFromObj(interp, objv[cursor1_ix + i], &cursors[i]);
+      if (status != TCL_OK) {
+         return status;
+      }
+   }
+
+   int      result    = clang_equalCursors(cursors[0], cursors[1]) != 0;
+   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
 #if CINDEX_VERSION_MINOR >= 33
-      { "OMPDistributeDirective",
-        CXCursor_OMPDistributeDirective },
-#endif
-#if CINDEX_VERSION_MINOR >= 34
-      { "OMPTargetEnterDataDirective",
-        CXCursor_OMPTargetEnterDataDirective },
-      { "OMPTargetExitDataDirective",
-        CXCursor_OMPTargetExitDataDirective },
-      { "OMPTargetParallelDirective",
-        CXCursor_OMPTargetParallelDirective },
-      { "OMPTargetParallelForDirective",
-        CXCursor_OMPTargetParallelForDirective },
-#endif
-#if CINDEX_VERSION_MINOR >= 35
-      { "OMPTargetUpdateDirective",
-        CXCursor_OMPTargetUpdateDirective },
-#endif
-#if CINDEX_VERSION_MINOR >= 36
-      { "OMPDistributeParallelForDirective",
-        CXCursor_OMPDistributeParallelForDirective },
-      { "OMPDistributeSimdDirective",
-        CXCursor_OMPDistributeSimdDirective },
-      { "OMPTargetParallelForSimdDirective",
-        CXCursor_OMPTargetParallelForSimdDirective },
-      { "OMPTargetSimdDirective",
-        CXCursor_OMPTargetSimdDirective },
-      { "OMPTeamsDistributeDirective",
-        CXCursor_OMPTeamsDistributeDirective },
-      { "OMPTeamsDistributeSimdDirective",
-        CXCursor_OMPTeamsDistributeSimdDirective },
-#endif
+//---------------------------------------------------- cursor evaluate command
+
+static int cursorEvaluateObjCmd(ClientData     clientData,
+                                Tcl_Interp    *interp,
+                                int            objc,
+                                Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      cursor_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      return TCL_ERROR;
+   }
+
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   Tcl_Obj *resultObj = NULL;
+
+   CXEvalResult evalresult = clang_Cursor_Evaluate(cursor);
+
+   switch (clang_EvalResult_getKind(evalresult)) {
+   case CXEval_Int:
 #if CINDEX_VERSION_MINOR >= 37
-      { "OMPTeamsDistributeParallelForSimdDirective",
-        CXCursor_OMPTeamsDistributeParallelForSimdDirective },
-#endif
-#if CINDEX_VERSION_MINOR >= 38
-      { "OMPTeamsDistributeParallelForDirective",
-        CXCursor_OMPTeamsDistributeParallelForDirective },
-      { "OMPTargetTeamsDirective",
-        CXCursor_OMPTargetTeamsDirective },
-      { "OMPTargetTeamsDistributeDirective",
-        CXCursor_OMPTargetTeamsDistributeDirective },
-      { "OMPTargetTeamsDistributeParallelForDirective",
-        CXCursor_OMPTargetTeamsDistributeParallelForDirective },
-      { "OMPTargetTeamsDistributeParallelForSimdDirective",
-        CXCursor_OMPTargetTeamsDistributeParallelForSimdDirective },
-      { "OMPTargetTeamsDistributeSimdDirective",
-        CXCursor_OMPTargetTeamsDistributeSimdDirective },
-#endif
-      /* { "LastStmt", */
-      /*   CXCursor_LastStmt }, */
-      { "TranslationUnit",
-        CXCursor_TranslationUnit },
-      /* { "FirstAttr", */
-      /*   CXCursor_FirstAttr }, */
-      { "UnexposedAttr",
-        CXCursor_UnexposedAttr },
-      { "IBActionAttr",
-        CXCursor_IBActionAttr },
-      { "IBOutletAttr",
-        CXCursor_IBOutletAttr },
-      { "IBOutletCollectionAttr",
-        CXCursor_IBOutletCollectionAttr },
-      { "CXXFinalAttr",
-        CXCursor_CXXFinalAttr },
-      { "CXXOverrideAttr",
-        CXCursor_CXXOverrideAttr },
-      { "AnnotateAttr",
-        CXCursor_AnnotateAttr },
-      { "AsmLabelAttr",
-        CXCursor_AsmLabelAttr },
-      { "PackedAttr",
-        CXCursor_PackedAttr },
-#if CINDEX_VERSION_MINOR >= 26
-      { "PureAttr",
-        CXCursor_PureAttr },
-      { "ConstAttr",
-        CXCursor_ConstAttr },
-      { "NoDuplicateAttr",
-        CXCursor_NoDuplicateAttr },
-#endif
-#if CINDEX_VERSION_MINOR >= 28
-      { "CUDAConstantAttr",
-        CXCursor_CUDAConstantAttr },
-      { "CUDADeviceAttr",
-        CXCursor_CUDADeviceAttr },
-      { "CUDAGlobalAttr",
-        CXCursor_CUDAGlobalAttr },
-      { "CUDAHostAttr",
-        CXCursor_CUDAHostAttr },
-      { "CUDASharedAttr",
-        CXCursor_CUDASharedAttr },
+      resultObj = Tcl_NewIntObj(clang_EvalResult_isUnsignedInt(evalresult)
+                                ? clang_EvalResult_getAsUnsigned(evalresult)
+                                : clang_EvalResult_getAsLongLong(evalresult));
+#else
+      resultObj = Tcl_NewIntObj(clang_EvalResult_getAsInt(evalresult));
 #endif
-#if CINDEX_VERSION_MINOR >= 31
-      { "VisibilityAttr",
-        CXCursor_VisibilityAttr },
+      break;
+   case CXEval_Float:
+      resultObj = Tcl_NewDoubleObj(clang_EvalResult_getAsDouble(evalresult));
+      break;
+   default:
+      resultObj = Tcl_NewStringObj(clang_EvalResult_getAsStr(evalresult), -1);
+      break;
+   }
+
+   clang_EvalResult_dispose(evalresult);
+
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
 #endif
+
+//-------------------------------------- cursor::enumConstantDeclValue command
+
+static int cursorEnumConstantDeclValueObjCmd(ClientData     clientData,
+                                             Tcl_Interp    *interp,
+                                             int            objc,
+                                             Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      cursor_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      return TCL_ERROR;
+   }
+
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   if (cursor.kind != CXCursor_EnumConstantDecl) {
+      Tcl_SetObjResult
+         (interp,
+          Tcl_NewStringObj("cursor kind must be EnumConstantDecl", -1));
+      return TCL_ERROR;
+   }
+
+   Tcl_Obj *result = NULL;
+
+   CXCursor parent  = clang_getCursorSemanticParent(cursor);
+   CXType   inttype = clang_getEnumDeclIntegerType(parent);
+   switch (inttype.kind) {
+
+   case CXType_Bool:
+   case CXType_Char_U:
+   case CXType_UChar:
+   case CXType_Char16:
+   case CXType_Char32:
+   case CXType_UShort:
+   case CXType_UInt:
+   case CXType_ULong:
+   case CXType_ULongLong:
+   case CXType_UInt128: {
+      unsigned long long value
+         = clang_getEnumConstantDeclUnsignedValue(cursor);
+      result = newUintmaxObj(value);
+      break;
+   }
+
+   case CXType_Char_S:
+   case CXType_SChar:
+   case CXType_WChar:
+   case CXType_Short:
+   case CXType_Int:
+   case CXType_Long:
+   case CXType_LongLong:
+   case CXType_Int128: {
+      long long value = clang_getEnumConstantDeclValue(cursor);
+      result = newIntmaxObj(value);
+      break;
+   }
+
+   default:
+      Tcl_Panic("clang_getEnumDeclIntegerType returns unexpected type: %d",
+                inttype.kind);
+   }
+
+   Tcl_SetObjResult(interp, result);
+
+   return TCL_OK;
+}
+
+//------------------------------------------------------- cursor::null command
+
+static int cursorNullObjCmd(ClientData     clientData,
+                            Tcl_Interp    *interp,
+                            int            objc,
+                            Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
+      return TCL_ERROR;
+   }
+
+   CXCursor  result    = clang_getNullCursor();
+   Tcl_Obj  *resultObj = newCursorObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//------------------------------------------ cursor overridenCursors command
+
+static int cursorOverriddenCursorsObjCmd(ClientData     clientData,
+                                         Tcl_Interp    *interp,
+                                         int            objc,
+                                         Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      cursor_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      return TCL_ERROR;
+   }
+
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   CXCursor *overridden    = NULL;
+   unsigned  numOverridden = 0;
+   clang_getOverriddenCursors(cursor, &overridden, &numOverridden);
+
+   Tcl_Obj **results
+      = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *) * numOverridden);
+   for (int i = 0; i < numOverridden; ++i) {
+      results[i] = newCursorObj(overridden[i]);
+   }
+
+   clang_disposeOverriddenCursors(overridden);
+
+   Tcl_Obj *resultObj = Tcl_NewListObj(numOverridden, results);
+   Tcl_SetObjResult(interp, resultObj);
+
+   Tcl_Free((char *)results);
+
+   return TCL_OK;
+}
+
+//-------------------------------------- cursor platformAvailability command
+
+static Tcl_Obj *alwaysDeprecatedTagObj;
+static Tcl_Obj *deprecatedMessageTagObj;
+static Tcl_Obj *alwaysUnavailableTagObj;
+static Tcl_Obj *unavailableMessageTagObj;
+static Tcl_Obj *availabilityTagObj;
+static Tcl_Obj *availabilityPlatformTagObj;
+static Tcl_Obj *availabilityIntroducedTagObj;
+static Tcl_Obj *availabilityDeprecatedTagObj;
+static Tcl_Obj *availabilityObsoletedTagObj;
+static Tcl_Obj *availabilityUnavailableTagObj;
+static Tcl_Obj *availabilityMessageTagObj;
+
+static int cursorPlatformAvailabilityObjCmd(ClientData     clientData,
+                                            Tcl_Interp    *interp,
+                                            int            objc,
+                                            Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      cursor_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      return TCL_ERROR;
+   }
+
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   int availability_size
+      = clang_getCursorPlatformAvailability
+          (cursor, NULL, NULL, NULL, NULL, NULL, 0);
+
+   CXPlatformAvailability *availability
+      = (CXPlatformAvailability *)Tcl_Alloc(sizeof(CXPlatformAvailability)
+                                            * availability_size);
+
+   int      always_deprecated;
+   CXString deprecated_message;
+   int      always_unavailable;
+   CXString unavailable_message;
+   clang_getCursorPlatformAvailability(cursor,
+                                       &always_deprecated,
+                                       &deprecated_message,
+                                       &always_unavailable,
+                                       &unavailable_message,
+                                       availability,
+                                       availability_size);
+
+   enum {
+      always_deprecated_tag_ix,
+      always_deprecated_ix,
+      deprecated_message_tag_ix,
+      deprecated_message_ix,
+      always_unavailable_tag_ix,
+      always_unavailable_ix,
+      unavailable_message_tag_ix,
+      unavailable_message_ix,
+      availability_tag_ix,
+      availability_ix,
+      nelms
+   };
+
+   Tcl_Obj *resultElms[nelms];
+
+   resultElms[always_deprecated_tag_ix]
+      = alwaysDeprecatedTagObj;
+   resultElms[always_deprecated_ix]
+      = Tcl_NewIntObj(always_deprecated);
+
+   resultElms[deprecated_message_tag_ix]
+      = deprecatedMessageTagObj;
+   resultElms[deprecated_message_ix]
+      = convertCXStringToObj(deprecated_message);
+
+   resultElms[always_unavailable_tag_ix]
+      = alwaysUnavailableTagObj;
+   resultElms[always_unavailable_ix]
+      = Tcl_NewIntObj(always_unavailable);
+
+   resultElms[unavailable_message_tag_ix]
+      = unavailableMessageTagObj;
+   resultElms[unavailable_message_ix]
+      = convertCXStringToObj(unavailable_message);
+
+   resultElms[availability_tag_ix]
+      = availabilityTagObj;
+   resultElms[availability_ix]
+      = Tcl_NewObj();
+   for (int i = 0; i < availability_size; ++i) {
+      enum {
+         platform_tag_ix,
+         platform_ix,
+         introduced_tag_ix,
+         introduced_ix,
+         deprecated_tag_ix,
+         deprecated_ix,
+         obsoleted_tag_ix,
+         obsoleted_ix,
+         unavailable_tag_ix,
+         unavailable_ix,
+         message_tag_ix,
+         message_ix,
+         nelms
+      };
+
+      Tcl_Obj *elms[nelms];
+
+      elms[platform_tag_ix]
+         = availabilityPlatformTagObj;
+      elms[platform_ix]
+         = Tcl_NewStringObj(clang_getCString(availability[i].Platform), -1);
+
+      elms[introduced_tag_ix]
+         = availabilityIntroducedTagObj;
+      elms[introduced_ix]
+         = newVersionObj(availability[i].Introduced);
+
+      elms[deprecated_tag_ix]
+         = availabilityDeprecatedTagObj;
+      elms[deprecated_ix]
+         = newVersionObj(availability[i].Deprecated);
+
+      elms[obsoleted_tag_ix]
+         = availabilityObsoletedTagObj;
+      elms[obsoleted_ix]
+         = newVersionObj(availability[i].Obsoleted);
+
+      elms[unavailable_tag_ix]
+         = availabilityUnavailableTagObj;
+      elms[unavailable_ix]
+         = Tcl_NewIntObj(availability[i].Unavailable != 0);
+
+      elms[message_tag_ix]
+         = availabilityMessageTagObj;
+      elms[message_ix]
+         = Tcl_NewStringObj(clang_getCString(availability[i].Message), -1);
+
+      Tcl_Obj *elm = Tcl_NewListObj(nelms, elms);
+      Tcl_ListObjAppendElement(NULL, resultElms[i], elm);
+
+      clang_disposeCXPlatformAvailability(availability + i);
+   }
+
+   Tcl_Free((char *)availability);
+
+   Tcl_Obj *resultObj = Tcl_NewListObj(nelms, resultElms);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//---------------------------------------- cursor referenceNameRange command
+
+static int cursorReferenceNameRangeObjCmd(ClientData     clientData,
+                                          Tcl_Interp    *interp,
+                                          int            objc,
+                                          Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      options_ix
+   };
+
+   static const char *options[] = {
+      "-wantQualifier",
+      "-wantTemplateArgs",
+      "-wantSinglePiece",
+      NULL
+   };
+
+   unsigned flags = 0;
+   int i;
+   for (i = 1; i < objc; ++i) {
+      const char *arg = Tcl_GetStringFromObj(objv[i], NULL);
+      if (arg[0] != '-') {
+         break;
+      }
+
+      int optionNumber;
+      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                       "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         return TCL_ERROR;
+      }
+
+      flags |= 1 << optionNumber;
+   }
+
+   Tcl_Obj *cursorObj     = objv[i];
+   Tcl_Obj *pieceIndexObj = objv[i + 1];
+   if (i + 2 != objc) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                       "?options...? cursor pieceIndex");
+      return TCL_ERROR;
+   }
+
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, cursorObj, &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   unsigned pieceIndex;
+   status = getUnsignedFromObj(interp, pieceIndexObj, &pieceIndex);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   CXSourceRange result
+      = clang_getCursorReferenceNameRange(cursor, flags, pieceIndex);
+   Tcl_Obj *resultObj = newRangeObjForTU(getCursorTUInfo(cursorObj), result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//------------------------------------------ cursor::translationUnit command
+
+static int cursorTranslationUnitObjCmd(ClientData     clientData,
+                                       Tcl_Interp    *interp,
+                                       int            objc,
+                                       Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      cursor_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      return TCL_ERROR;
+   }
+
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   CXTranslationUnit  tu   = clang_Cursor_getTranslationUnit(cursor);
+   TUInfo            *info = lookupTranslationUnit(tu);
+   if (info == NULL) {
+      Tcl_Panic("invalid cursor");
+   }
+
+   Tcl_Obj *tuObj = Tcl_NewObj();
+   Tcl_GetCommandFullName(interp, info->cmd, tuObj);
+   Tcl_SetObjResult(interp, tuObj);
+
+   return TCL_OK;
+}
+
+//-------------------------------------------------- cursor -> attribute command
+
+/** A function that computes an attribute of a cursor.
+ *
+ * The commands of the form "cursor name cursor" are built on these, and
+ * cursor attrs calls them directly.  clientData is that of the command.
+ * It returns NULL with an error message in interp on failure.
+ */
+typedef Tcl_Obj *(*CursorAttrProc)(Tcl_Interp *interp,
+                                   ClientData  clientData,
+                                   TUInfo     *tuInfo,
+                                   CXCursor    cursor);
+
+static int cursorAttrObjCmd(CursorAttrProc  proc,
+                            ClientData      clientData,
+                            Tcl_Interp     *interp,
+                            int             objc,
+                            Tcl_Obj *const  objv[])
+{
+   enum {
+      command_ix,
+      cursor_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      return TCL_ERROR;
+   }
+
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   Tcl_Obj *resultObj
+      = proc(interp, clientData, getCursorTUInfo(objv[cursor_ix]), cursor);
+   if (resultObj == NULL) {
+      return TCL_ERROR;
+   }
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//------------------------------------------------------ cursor -> int command
+
+static Tcl_Obj *cursorToIntObj(Tcl_Interp *interp,
+                               ClientData  clientData,
+                               TUInfo     *tuInfo,
+                               CXCursor    cursor)
+{
+   int result = ((int (*)(CXCursor))clientData)(cursor);
+   return Tcl_NewIntObj(result);
+}
+
+static int cursorToIntObjCmd(ClientData     clientData,
+                             Tcl_Interp    *interp,
+                             int            objc,
+                             Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToIntObj, clientData, interp, objc, objv);
+}
+
+//------------------------------------------------- cursor -> unsigned command
+
+static Tcl_Obj *cursorToUnsignedObj(Tcl_Interp *interp,
+                                    ClientData  clientData,
+                                    TUInfo     *tuInfo,
+                                    CXCursor    cursor)
+{
+   unsigned result = ((unsigned (*)(CXCursor))clientData)(cursor);
+   return Tcl_NewLongObj(result);
+}
+
+static int cursorToUnsignedObjCmd(ClientData     clientData,
+                                  Tcl_Interp    *interp,
+                                  int            objc,
+                                  Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToUnsignedObj, clientData,
+                           interp, objc, objv);
+}
+
+//----------------------------------------------------- cursor -> bool command
+
+static Tcl_Obj *cursorToBoolObj(Tcl_Interp *interp,
+                                ClientData  clientData,
+                                TUInfo     *tuInfo,
+                                CXCursor    cursor)
+{
+   unsigned value  = ((unsigned (*)(CXCursor))clientData)(cursor);
+   int      result = value != 0;
+   return Tcl_NewIntObj(result);
+}
+
+static int cursorToBoolObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToBoolObj, clientData, interp, objc, objv);
+}
+
+//----------------------------------------------------- cursor -> enum command
+
+typedef int (*CursorToEnumProc)(CXCursor);
+
+typedef struct CursorToEnumInfo
+{
+   EnumConsts       *labels;
+   CursorToEnumProc  proc;
+} CursorToEnumInfo;
+
+static Tcl_Obj *cursorToEnumObj(Tcl_Interp *interp,
+                                ClientData  clientData,
+                                TUInfo     *tuInfo,
+                                CXCursor    cursor)
+{
+   CursorToEnumInfo *info = (CursorToEnumInfo *)clientData;
+
+   int result = (info->proc)(cursor);
+   return getEnum(info->labels, result);
+}
+
+static int cursorToEnumObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToEnumObj, clientData, interp, objc, objv);
+}
+
+//-------------------------------------------------- cursor -> bitmask command
+
+typedef unsigned (*CursorToBitMaskProc)(CXCursor);
+
+typedef struct CursorToBitMaskInfo
+{
+   BitMask             *masks;
+   Tcl_Obj             *none;
+   CursorToBitMaskProc  proc;
+} CursorToBitMaskInfo;
+
+static Tcl_Obj *cursorToBitMaskObj(Tcl_Interp *interp,
+                                   ClientData  clientData,
+                                   TUInfo     *tuInfo,
+                                   CXCursor    cursor)
+{
+   CursorToBitMaskInfo *info = (CursorToBitMaskInfo *)clientData;
+
+   unsigned value = (info->proc)(cursor);
+
+   // bitMaskToString leaves the result alone for an empty mask.
+   Tcl_ResetResult(interp);
+   if (bitMaskToString(interp, info->masks, info->none, value) != TCL_OK) {
+      return NULL;
+   }
+
+   return Tcl_GetObjResult(interp);
+}
+
+static int cursorToBitMaskObjCmd(ClientData     clientData,
+                                 Tcl_Interp    *interp,
+                                 int            objc,
+                                 Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToBitMaskObj, clientData,
+                           interp, objc, objv);
+}
+
+static unsigned getObjCPropertyAttributes(CXCursor cursor)
+{
+   return clang_Cursor_getObjCPropertyAttributes(cursor, 0);
+}
+
+//--------------------------------------------------- cursor -> string command
+
+static Tcl_Obj *cursorToStringObj(Tcl_Interp *interp,
+                                  ClientData  clientData,
+                                  TUInfo     *tuInfo,
+                                  CXCursor    cursor)
+{
+   CXString result = ((CXString (*)(CXCursor))clientData)(cursor);
+   return convertCXStringToObj(result);
+}
+
+static int cursorToStringObjCmd(ClientData     clientData,
+                                Tcl_Interp    *interp,
+                                int            objc,
+                                Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToStringObj, clientData,
+                           interp, objc, objv);
+}
+
 #if CINDEX_VERSION_MINOR >= 32
-      { "DLLExport",
-        CXCursor_DLLExport },
-      { "DLLImport",
-        CXCursor_DLLImport },
+//----------------------------------------------- cursor -> string set command
+
+static Tcl_Obj *cursorToStringSetObj(Tcl_Interp *interp,
+                                     ClientData  clientData,
+                                     TUInfo     *tuInfo,
+                                     CXCursor    cursor)
+{
+   CXStringSet *result = ((CXStringSet *(*)(CXCursor))clientData)(cursor);
+   if (result) {
+      return convertCXStringSetToObj(result);
+   }
+
+   return Tcl_NewObj();
+}
+
+static int cursorToStringSetObjCmd(ClientData     clientData,
+                                   Tcl_Interp    *interp,
+                                   int            objc,
+                                   Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToStringSetObj, clientData,
+                           interp, objc, objv);
+}
+
 #endif
-      /* { "LastAttr", */
-      /*   CXCursor_LastAttr }, */
-      /* { "FirstPreprocessing", */
-      /*   CXCursor_FirstPreprocessing }, */
-      { "PreprocessingDirective",
-        CXCursor_PreprocessingDirective },
-      { "MacroDefinition",
-        CXCursor_MacroDefinition },
-      { "MacroExpansion",
-        CXCursor_MacroExpansion },
-      { "MacroInstantiation",
-        CXCursor_MacroInstantiation },
-      { "InclusionDirective",
-        CXCursor_InclusionDirective },
-      /* { "LastPreprocessing", */
-      /*   CXCursor_LastPreprocessing }, */
-      /* { "FirstExtraDecl", */
-      /*   CXCursor_FirstExtraDecl }, */
-      { "ModuleImportDecl",
-        CXCursor_ModuleImportDecl },
+//----------------------------------------------------- cursor -> file command
+
+static Tcl_Obj *cursorToFileObj(Tcl_Interp *interp,
+                                ClientData  clientData,
+                                TUInfo     *tuInfo,
+                                CXCursor    cursor)
+{
+   CXFile   result    = ((CXFile (*)(CXCursor))clientData)(cursor);
+   CXString resultStr = clang_getFileName(result);
+   return convertCXStringToObj(resultStr);
+}
+
+static int cursorToFileObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToFileObj, clientData, interp, objc, objv);
+}
+
+//------------------------------------------------- cursor -> location command
+
+static Tcl_Obj *cursorToLocationObj(Tcl_Interp *interp,
+                                    ClientData  clientData,
+                                    TUInfo     *tuInfo,
+                                    CXCursor    cursor)
+{
+   typedef CXSourceLocation (*ProcType)(CXCursor);
+
+   CXSourceLocation result = ((ProcType)clientData)(cursor);
+   return newLocationObjForTU(tuInfo, result);
+}
+
+static int cursorToLocationObjCmd(ClientData     clientData,
+                                  Tcl_Interp    *interp,
+                                  int            objc,
+                                  Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToLocationObj, clientData,
+                           interp, objc, objv);
+}
+
+//---------------------------------------------------- cursor -> range command
+
+static Tcl_Obj *cursorToRangeObj(Tcl_Interp *interp,
+                                 ClientData  clientData,
+                                 TUInfo     *tuInfo,
+                                 CXCursor    cursor)
+{
+   typedef CXSourceRange (*ProcType)(CXCursor);
+
+   CXSourceRange result = ((ProcType)clientData)(cursor);
+   return newRangeObjForTU(tuInfo, result);
+}
+
+static int cursorToRangeObjCmd(ClientData     clientData,
+                               Tcl_Interp    *interp,
+                               int            objc,
+                               Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToRangeObj, clientData, interp, objc, objv);
+}
+
+//--------------------------------------------------- cursor -> cursor command
+
+static Tcl_Obj *cursorToCursorObj(Tcl_Interp *interp,
+                                  ClientData  clientData,
+                                  TUInfo     *tuInfo,
+                                  CXCursor    cursor)
+{
+   CXCursor result = ((CXCursor (*)(CXCursor))clientData)(cursor);
+   return newCursorObj(result);
+}
+
+static int cursorToCursorObjCmd(ClientData     clientData,
+                                Tcl_Interp    *interp,
+                                int            objc,
+                                Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToCursorObj, clientData,
+                           interp, objc, objv);
+}
+
+//----------------------------------------- cursor, unsigned -> cursor command
+
+static int cursorUnsignedToCursorObjCmd(ClientData     clientData,
+                                        Tcl_Interp    *interp,
+                                        int            objc,
+                                        Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      cursor_ix,
+      number_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor number");
+      return TCL_ERROR;
+   }
+
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   unsigned number;
+   status = getUnsignedFromObj(interp, objv[number_ix], &number);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   typedef CXCursor (*ProcType)(CXCursor, unsigned);
+
+   CXCursor  result    = ((ProcType)clientData)(cursor, number);
+   Tcl_Obj  *resultObj = newCursorObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//------------------------------------------ cursor, unsigned -> range command
+
+static int cursorUnsignedToRangeObjCmd(ClientData     clientData,
+                                       Tcl_Interp    *interp,
+                                       int            objc,
+                                       Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      cursor_ix,
+      number_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor number");
+      return TCL_ERROR;
+   }
+
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   unsigned number;
+   status = getUnsignedFromObj(interp, objv[number_ix], &number);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   typedef CXSourceRange (*ProcType)(CXCursor, unsigned);
+
+   CXSourceRange  result    = ((ProcType)clientData)(cursor, number);
+   Tcl_Obj       *resultObj
+      = newRangeObjForTU(getCursorTUInfo(objv[cursor_ix]), result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//----------------------------------------------------- cursor -> type command
+
+static Tcl_Obj *cursorToTypeObj(Tcl_Interp *interp,
+                                ClientData  clientData,
+                                TUInfo     *tuInfo,
+                                CXCursor    cursor)
+{
+   CXType result = ((CXType (*)(CXCursor))clientData)(cursor);
+   return newTypeObj(result);
+}
+
+static int cursorToTypeObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToTypeObj, clientData, interp, objc, objv);
+}
+
+//----------------------------------------------------- cursor -> kind command
+
+static Tcl_Obj *cursorToKindObj(Tcl_Interp *interp,
+                                ClientData  clientData,
+                                TUInfo     *tuInfo,
+                                CXCursor    cursor)
+{
+   typedef unsigned (*ProcType)(CXCursor);
+
+   ProcType           proc    = (ProcType)clientData;
+   enum CXCursorKind  kind    = proc(cursor);
+   Tcl_Obj           *nameObj = getCursorKindNameObj(kind);
+   if (nameObj == NULL) {
+      Tcl_Panic("cursor kind %d is not valid", kind);
+   }
+
+   return nameObj;
+}
+
+static int cursorToKindObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToKindObj, clientData, interp, objc, objv);
+}
+
+//--------------------------------------------- cursor -> kind -> bool command
+
+static Tcl_Obj *cursorToKindToBoolObj(Tcl_Interp *interp,
+                                      ClientData  clientData,
+                                      TUInfo     *tuInfo,
+                                      CXCursor    cursor)
+{
+   typedef unsigned (*ProcType)(enum CXCursorKind);
+
+   ProcType           proc   = (ProcType)clientData;
+   enum CXCursorKind  kind   = clang_getCursorKind(cursor);
+   int                result = proc(kind) != 0;
+   return Tcl_NewIntObj(result);
+}
+
+static int cursorToKindToBoolObjCmd(ClientData     clientData,
+                                    Tcl_Interp    *interp,
+                                    int            objc,
+                                    Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToKindToBoolObj, clientData,
+                           interp, objc, objv);
+}
+
 #if CINDEX_VERSION_MINOR >= 30
-      { "OverloadCandidate",
-        CXCursor_OverloadCandidate },
+//----------------------------------------- cursor -> layout long long command
+
+static Tcl_Obj *cursorToLayoutLongLongObj(Tcl_Interp *interp,
+                                          ClientData  clientData,
+                                          TUInfo     *tuInfo,
+                                          CXCursor    cursor)
+{
+   long long result = ((long long (*)(CXCursor))clientData)(cursor);
+   return newLayoutLongLongObj(result);
+}
+
+static int cursorToLayoutLongLongObjCmd(ClientData     clientData,
+                                        Tcl_Interp    *interp,
+                                        int            objc,
+                                        Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToLayoutLongLongObj, clientData,
+                           interp, objc, objv);
+}
+
 #endif
+//---------------------------------------------- cursor -> cursor list command
+
+typedef struct CursorToCursorListInfo {
+   union {
+      unsigned (*getNumUnsigned)(CXCursor);
+      int (*getNumInt)(CXCursor);
+   };
+   CXCursor (*getIndex)(CXCursor, unsigned);
+   enum {
+      CursorToCursorListInfo_Int,
+      CursorToCursorListInfo_Unsigned
+   } returnType;
+} CursorToCursorListInfo;
+
+static Tcl_Obj *cursorToCursorListObj(Tcl_Interp *interp,
+                                      ClientData  clientData,
+                                      TUInfo     *tuInfo,
+                                      CXCursor    cursor)
+{
+   CursorToCursorListInfo *procs = ((CursorToCursorListInfo *)clientData);
+   unsigned num = 0;
+   switch (procs->returnType) {
+   case CursorToCursorListInfo_Unsigned:
+      num = procs->getNumUnsigned(cursor);
+      break;
+   case CursorToCursorListInfo_Int:
+      {
+         int tmp = procs->getNumInt(cursor);
+         num = (unsigned)(tmp < 0? 0 : tmp);
+         break;
+      }
+   }
+
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+   for (int i = 0; i < num; i++) {
+      Tcl_ListObjAppendElement(NULL, resultObj,
+                               newCursorObj(procs->getIndex(cursor, i)));
+   }
+
+   return resultObj;
+}
+
+static int cursorToCursorListObjCmd(ClientData     clientData,
+                                    Tcl_Interp    *interp,
+                                    int            objc,
+                                    Tcl_Obj *const objv[])
+{
+   return cursorAttrObjCmd(cursorToCursorListObj, clientData,
+                           interp, objc, objv);
+}
+
+//------------------------------------------------------- cursor attrs command
+
+/** The attribute functions of the commands in the cursor ensemble.
+ *
+ * cursor attrs accepts the name of any subcommand of the ensemble whose
+ * procedure is listed here.
+ */
+static const struct {
+   Tcl_ObjCmdProc *cmdProc;
+   CursorAttrProc  attrProc;
+} cursorAttrProcs[] = {
+   { cursorToIntObjCmd,            cursorToIntObj },
+   { cursorToUnsignedObjCmd,       cursorToUnsignedObj },
+   { cursorToBoolObjCmd,           cursorToBoolObj },
+   { cursorToEnumObjCmd,           cursorToEnumObj },
+   { cursorToBitMaskObjCmd,        cursorToBitMaskObj },
+   { cursorToStringObjCmd,         cursorToStringObj },
 #if CINDEX_VERSION_MINOR >= 32
-      { "TypeAliasTemplateDecl",
-        CXCursor_TypeAliasTemplateDecl },
+   { cursorToStringSetObjCmd,      cursorToStringSetObj },
 #endif
-#if CINDEX_VERSION_MINOR >= 36
-      { "StaticAssert",
-        CXCursor_StaticAssert },
-      { "FriendDecl",
-        CXCursor_FriendDecl },
-#endif
-      /* { "LastExtraDecl", */
-      /*   CXCursor_LastExtraDecl }, */
+   { cursorToFileObjCmd,           cursorToFileObj },
+   { cursorToLocationObjCmd,       cursorToLocationObj },
+   { cursorToRangeObjCmd,          cursorToRangeObj },
+   { cursorToCursorObjCmd,         cursorToCursorObj },
+   { cursorToTypeObjCmd,           cursorToTypeObj },
+   { cursorToKindObjCmd,           cursorToKindObj },
+   { cursorToKindToBoolObjCmd,     cursorToKindToBoolObj },
 #if CINDEX_VERSION_MINOR >= 30
-      { "OverloadCandidate",
-        CXCursor_OverloadCandidate },
+   { cursorToLayoutLongLongObjCmd, cursorToLayoutLongLongObj },
 #endif
-      { NULL }
+   { cursorToCursorListObjCmd,     cursorToCursorListObj },
+   { NULL }
+};
+
+// Look up an attribute name in commands, the command table of the cursor
+// ensemble.
+static int getCursorAttrFromObj(Tcl_Interp     *interp,
+                                const Command  *commands,
+                                Tcl_Obj        *obj,
+                                int            *index,
+                                CursorAttrProc *proc)
+{
+   int status = Tcl_GetIndexFromObjStruct(interp, obj, commands,
+                                          sizeof commands[0], "attribute",
+                                          TCL_EXACT, index);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   for (int i = 0; cursorAttrProcs[i].cmdProc != NULL; ++i) {
+      if (cursorAttrProcs[i].cmdProc == commands[*index].proc) {
+         *proc = cursorAttrProcs[i].attrProc;
+         return TCL_OK;
+      }
+   }
+
+   Tcl_SetObjResult(interp,
+                    Tcl_ObjPrintf("%s is not an attribute",
+                                  commands[*index].name));
+   return TCL_ERROR;
+}
+
+// Compute the attributes of a cursor and return them as a dictionary whose
+// keys are attrObjs.
+static Tcl_Obj *newCursorAttrsObj(Tcl_Interp            *interp,
+                                  const Command         *commands,
+                                  const int             *attrs,
+                                  const CursorAttrProc  *procs,
+                                  Tcl_Obj *const         attrObjs[],
+                                  int                    numAttrs,
+                                  Tcl_Obj               *cursorObj)
+{
+   CXCursor cursor;
+   if (getCursorFromObj(interp, cursorObj, &cursor) != TCL_OK) {
+      return NULL;
+   }
+
+   TUInfo  *tuInfo   = getCursorTUInfo(cursorObj);
+   Tcl_Obj *valueObj = NULL;
+   Tcl_Obj *dictObj  = Tcl_NewDictObj();
+   for (int i = 0; i < numAttrs; ++i) {
+      const Command *command = &commands[attrs[i]];
+      valueObj = procs[i](interp, command->clientData, tuInfo, cursor);
+      if (valueObj == NULL) {
+         Tcl_DecrRefCount(dictObj);
+         return NULL;
+      }
+      Tcl_DictObjPut(NULL, dictObj, attrObjs[i], valueObj);
+   }
+
+   return dictObj;
+}
+
+static int cursorAttrsObjCmd(ClientData     clientData,
+                             Tcl_Interp    *interp,
+                             int            objc,
+                             Tcl_Obj *const objv[])
+{
+   static const char *options[] = {
+      "-list", NULL
+   };
+
+   enum {
+      list_ix
+   };
+
+   const Command *commands = (const Command *)clientData;
+
+   int listMode = 0;
+   int i;
+   for (i = 1; i < objc; ++i) {
+      const char *arg = Tcl_GetStringFromObj(objv[i], NULL);
+      if (arg[0] != '-') {
+         break;
+      }
+
+      int index;
+      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                       "option", 0, &index);
+      if (status != TCL_OK) {
+         return status;
+      }
+
+      switch (index) {
+      case list_ix:
+         if (listMode) {
+            Tcl_SetObjResult(interp,
+                             Tcl_ObjPrintf("%s is specified more than once.",
+                                           arg));
+            return TCL_ERROR;
+         }
+         listMode = 1;
+         break;
+      }
+   }
+
+   if (objc - i != 2) {
+      Tcl_WrongNumArgs(interp, 1, objv, "?-list? cursor attributes");
+      return TCL_ERROR;
+   }
+
+   Tcl_Obj *cursorArg = objv[i];
+   Tcl_Obj *attrsArg  = objv[i + 1];
+
+   int       numAttrs;
+   Tcl_Obj **attrObjs;
+   int status = Tcl_ListObjGetElements(interp, attrsArg, &numAttrs, &attrObjs);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   // Resolve the attribute names once for all the cursors.
+   int            *attrs = (int *)Tcl_Alloc(numAttrs * sizeof attrs[0] + 1);
+   CursorAttrProc *procs
+      = (CursorAttrProc *)Tcl_Alloc(numAttrs * sizeof procs[0] + 1);
+   for (int j = 0; j < numAttrs; ++j) {
+      status = getCursorAttrFromObj(interp, commands, attrObjs[j],
+                                    &attrs[j], &procs[j]);
+      if (status != TCL_OK) {
+         goto cleanup;
+      }
+   }
+
+   if (! listMode) {
+      Tcl_Obj *resultObj = newCursorAttrsObj(interp, commands, attrs, procs,
+                                             attrObjs, numAttrs, cursorArg);
+      if (resultObj == NULL) {
+         status = TCL_ERROR;
+         goto cleanup;
+      }
+      Tcl_SetObjResult(interp, resultObj);
+      goto cleanup;
+   }
+
+   int       numCursors;
+   Tcl_Obj **cursorObjs;
+   status = Tcl_ListObjGetElements(interp, cursorArg,
+                                   &numCursors, &cursorObjs);
+   if (status != TCL_OK) {
+      goto cleanup;
+   }
+
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+   for (int j = 0; j < numCursors; ++j) {
+      Tcl_Obj *attrsObj = newCursorAttrsObj(interp, commands, attrs, procs,
+                                            attrObjs, numAttrs,
+                                            cursorObjs[j]);
+      if (attrsObj == NULL) {
+         Tcl_DecrRefCount(resultObj);
+         status = TCL_ERROR;
+         goto cleanup;
+      }
+      Tcl_ListObjAppendElement(NULL, resultObj, attrsObj);
+   }
+   Tcl_SetObjResult(interp, resultObj);
+
+cleanup:
+   Tcl_Free((char *)attrs);
+   Tcl_Free((char *)procs);
+
+   return status;
+}
+
+//--------------------------------------------------------- cursor map command
+
+static int cursorMapObjCmd(ClientData     clientData,
+                           Tcl_Interp    *interp,
+                           int            objc,
+                           Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      attribute_ix,
+      cursors_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "attribute cursors");
+      return TCL_ERROR;
+   }
+
+   const Command *commands = (const Command *)clientData;
+
+   int            attr;
+   CursorAttrProc proc;
+   int status = getCursorAttrFromObj(interp, commands, objv[attribute_ix],
+                                     &attr, &proc);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   int       numCursors;
+   Tcl_Obj **cursorObjs;
+   status = Tcl_ListObjGetElements(interp, objv[cursors_ix],
+                                   &numCursors, &cursorObjs);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+   for (int i = 0; i < numCursors; ++i) {
+      CXCursor cursor;
+      Tcl_Obj *valueObj = NULL;
+      if (getCursorFromObj(interp, cursorObjs[i], &cursor) == TCL_OK) {
+         valueObj = proc(interp, commands[attr].clientData,
+                         getCursorTUInfo(cursorObjs[i]), cursor);
+      }
+      if (valueObj == NULL) {
+         Tcl_DecrRefCount(resultObj);
+         return TCL_ERROR;
+      }
+      Tcl_ListObjAppendElement(NULL, resultObj, valueObj);
+   }
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//------------------------------------------------------ cursor filter command
+
+// Evaluate a predicate of the cursor::is ensemble.
+static int testCursorPredicate(const Command *command, CXCursor cursor)
+{
+   if (command->proc == cursorToKindToBoolObjCmd) {
+      typedef unsigned (*ProcType)(enum CXCursorKind);
+      return ((ProcType)command->clientData)(clang_getCursorKind(cursor))
+         != 0;
+   }
+
+   return ((unsigned (*)(CXCursor))command->clientData)(cursor) != 0;
+}
+
+static int cursorFilterObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      optional_ix
+   };
+
+   static const char *options[] = {
+      "-kind",
+      "-predicate",
+      NULL,
+   };
+
+   enum {
+      option_kind,
+      option_predicate,
+   };
+
+   if (objc < optional_ix + 1) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                       "?-kind kinds? ?-predicate predicates? cursors");
+      return TCL_ERROR;
+   }
+
+   // clientData is the command table of the cursor::is ensemble.
+   const Command *predicates = (const Command *)clientData;
+
+   CursorKindSet   kinds;
+   CursorKindSet  *kindsPtr = NULL;
+   int             numTests = 0;
+   const Command **tests    = NULL;
+   int             status   = TCL_OK;
+
+   unsigned options_found = 0;
+   int      cursors_ix    = objc - 1;
+   for (int i = optional_ix; i < cursors_ix; ++i) {
+      int optionNumber;
+      status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                   "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         goto cleanup;
+      }
+
+      if ((options_found & (1 << optionNumber)) != 0) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("%s is specified more than once.",
+                                        Tcl_GetStringFromObj(objv[i], NULL)));
+         status = TCL_ERROR;
+         goto cleanup;
+      }
+      options_found |= 1 << optionNumber;
+
+      if (cursors_ix <= i + 1) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("%s is not followed by a value",
+                                        Tcl_GetStringFromObj(objv[i], NULL)));
+         status = TCL_ERROR;
+         goto cleanup;
+      }
+
+      Tcl_Obj *valueObj = objv[++i];
+
+      switch (optionNumber) {
+
+      case option_kind:
+         status = getCursorKindSetFromObj(interp, valueObj, &kinds);
+         if (status != TCL_OK) {
+            goto cleanup;
+         }
+         kindsPtr = &kinds;
+         break;
+
+      case option_predicate: {
+         Tcl_Obj **nameObjs;
+         status = Tcl_ListObjGetElements(interp, valueObj,
+                                         &numTests, &nameObjs);
+         if (status != TCL_OK) {
+            goto cleanup;
+         }
+
+         tests = (const Command **)
+            Tcl_Alloc(numTests * sizeof tests[0] + 1);
+         for (int j = 0; j < numTests; ++j) {
+            int index;
+            status = Tcl_GetIndexFromObjStruct(interp, nameObjs[j],
+                                               predicates,
+                                               sizeof predicates[0],
+                                               "predicate", TCL_EXACT,
+                                               &index);
+            if (status != TCL_OK) {
+               goto cleanup;
+            }
+            if (predicates[index].clientData == NULL) {
+               Tcl_SetObjResult(interp,
+                                Tcl_ObjPrintf("%s is not supported "
+                                              "as a predicate",
+                                              predicates[index].name));
+               status = TCL_ERROR;
+               goto cleanup;
+            }
+            tests[j] = &predicates[index];
+         }
+         break;
+      }
+
+      }
+   }
+
+   int       numCursors;
+   Tcl_Obj **cursorObjs;
+   status = Tcl_ListObjGetElements(interp, objv[cursors_ix],
+                                   &numCursors, &cursorObjs);
+   if (status != TCL_OK) {
+      goto cleanup;
+   }
+
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+   for (int i = 0; i < numCursors; ++i) {
+      CXCursor cursor;
+      status = getCursorFromObj(interp, cursorObjs[i], &cursor);
+      if (status != TCL_OK) {
+         Tcl_DecrRefCount(resultObj);
+         goto cleanup;
+      }
+
+      if (kindsPtr != NULL
+          && ! cursorKindSetContains(kindsPtr, clang_getCursorKind(cursor))) {
+         continue;
+      }
+
+      int j;
+      for (j = 0; j < numTests; ++j) {
+         if (! testCursorPredicate(tests[j], cursor)) {
+            break;
+         }
+      }
+      if (j < numTests) {
+         continue;
+      }
+
+      Tcl_ListObjAppendElement(NULL, resultObj, cursorObjs[i]);
+   }
+   Tcl_SetObjResult(interp, resultObj);
+
+cleanup:
+   Tcl_Free((char *)tests);
+
+   return status;
+}
+
+//-------------------------------------------------------- cursor sort command
+
+/** An element of the list being sorted by cursor sort.
+ *
+ * Elements are ordered by key, then by offset.  position breaks ties so
+ * that the sort is stable.
+ */
+typedef struct CursorSortKey {
+   Tcl_Obj  *cursorObj;
+   CXString  key;
+   unsigned  offset;
+   int       position;
+} CursorSortKey;
+
+static int compareCursorSortKeys(const void *lhs, const void *rhs)
+{
+   const CursorSortKey *a = (const CursorSortKey *)lhs;
+   const CursorSortKey *b = (const CursorSortKey *)rhs;
+
+   const char *aKey = clang_getCString(a->key);
+   const char *bKey = clang_getCString(b->key);
+   int result = strcmp(aKey != NULL ? aKey : "", bKey != NULL ? bKey : "");
+   if (result != 0) {
+      return result;
+   }
+
+   if (a->offset != b->offset) {
+      return a->offset < b->offset ? -1 : 1;
+   }
+
+   return a->position - b->position;
+}
+
+static int cursorSortObjCmd(ClientData     clientData,
+                            Tcl_Interp    *interp,
+                            int            objc,
+                            Tcl_Obj *const objv[])
+{
+   static const char *sortKeys[] = {
+      "location",
+      "spelling",
+      NULL
+   };
+
+   enum {
+      sortKey_location,
+      sortKey_spelling
+   };
+
+   int sortKey = sortKey_location;
+   if (objc == 4 && strcmp(Tcl_GetStringFromObj(objv[1], NULL), "-by") == 0) {
+      int status = Tcl_GetIndexFromObj(interp, objv[2], sortKeys,
+                                       "sort key", 0, &sortKey);
+      if (status != TCL_OK) {
+         return status;
+      }
+   } else if (objc != 2) {
+      Tcl_WrongNumArgs(interp, 1, objv, "?-by location|spelling? cursors");
+      return TCL_ERROR;
+   }
+
+   int       numCursors;
+   Tcl_Obj **cursorObjs;
+   int status = Tcl_ListObjGetElements(interp, objv[objc - 1],
+                                       &numCursors, &cursorObjs);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   CursorSortKey *keys
+      = (CursorSortKey *)Tcl_Alloc(numCursors * sizeof keys[0] + 1);
+   int numKeys = 0;
+   for (; numKeys < numCursors; ++numKeys) {
+      CXCursor cursor;
+      status = getCursorFromObj(interp, cursorObjs[numKeys], &cursor);
+      if (status != TCL_OK) {
+         break;
+      }
+
+      CursorSortKey *key = &keys[numKeys];
+      key->cursorObj = cursorObjs[numKeys];
+      key->position  = numKeys;
+
+      switch (sortKey) {
+      case sortKey_location: {
+         CXFile file;
+         clang_getExpansionLocation(clang_getCursorLocation(cursor),
+                                    &file, NULL, NULL, &key->offset);
+         key->key = clang_getFileName(file);
+         break;
+      }
+      case sortKey_spelling:
+         key->key    = clang_getCursorSpelling(cursor);
+         key->offset = 0;
+         break;
+      }
+   }
+
+   if (status == TCL_OK) {
+      qsort(keys, numKeys, sizeof keys[0], compareCursorSortKeys);
+
+      Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+      for (int i = 0; i < numKeys; ++i) {
+         Tcl_ListObjAppendElement(NULL, resultObj, keys[i].cursorObj);
+      }
+      Tcl_SetObjResult(interp, resultObj);
+   }
+
+   for (int i = 0; i < numKeys; ++i) {
+      clang_disposeString(keys[i].key);
+   }
+   Tcl_Free((char *)keys);
+
+   return status;
+}
+
+//----------------------------------------------------- cursor tree navigation
+
+/** Find the node of the cursor in the AST index of its translation unit.
+ *
+ * The index is built on the first use.  *nodeId is -1 for the root.
+ */
+static int getASTNodeFromObj(Tcl_Interp  *interp,
+                             Tcl_Obj     *cursorObj,
+                             TUInfo     **tuInfo,
+                             ASTIndex   **index,
+                             int         *nodeId)
+{
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, cursorObj, &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   *tuInfo = getCursorTUInfo(cursorObj);
+   *index  = getASTIndex(*tuInfo);
+   *nodeId = findASTNode(*index, cursor);
+   if (*nodeId == -2) {
+      Tcl_SetObjResult(interp,
+                       Tcl_NewStringObj("the cursor is not a node of the "
+                                        "translation unit's AST", -1));
+      return TCL_ERROR;
+   }
+
+   return TCL_OK;
+}
+
+enum CursorNavigation {
+   cursorNavigationChildren,
+   cursorNavigationDepth,
+   cursorNavigationNextSibling,
+   cursorNavigationParent
+};
+
+static int cursorNavigationObjCmd(ClientData     clientData,
+                                  Tcl_Interp    *interp,
+                                  int            objc,
+                                  Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      cursor_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      return TCL_ERROR;
+   }
+
+   TUInfo   *tuInfo;
+   ASTIndex *index;
+   int       id;
+   int status = getASTNodeFromObj(interp, objv[cursor_ix],
+                                  &tuInfo, &index, &id);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   ASTNode  *node   = id >= 0 ? &index->nodes[id] : NULL;
+   CXCursor  result = clang_getNullCursor();
+
+   switch ((enum CursorNavigation)clientData) {
+
+   case cursorNavigationChildren: {
+      Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+      int      child     = node == NULL
+         ? (index->numNodes > 0 ? 0 : -1)
+         : node->firstChild;
+      for (; child >= 0; child = index->nodes[child].nextSibling) {
+         Tcl_ListObjAppendElement
+            (NULL, resultObj,
+             newCursorObjForTU(tuInfo, index->nodes[child].cursor));
+      }
+      Tcl_SetObjResult(interp, resultObj);
+      return TCL_OK;
+   }
+
+   case cursorNavigationDepth:
+      Tcl_SetObjResult(interp, Tcl_NewIntObj(node == NULL ? 0 : node->depth));
+      return TCL_OK;
+
+   case cursorNavigationNextSibling:
+      if (node != NULL && node->nextSibling >= 0) {
+         result = index->nodes[node->nextSibling].cursor;
+      }
+      break;
+
+   case cursorNavigationParent:
+      if (node != NULL) {
+         result = node->parent >= 0
+            ? index->nodes[node->parent].cursor
+            : clang_getTranslationUnitCursor(tuInfo->translationUnit);
+      }
+      break;
+   }
+
+   Tcl_SetObjResult(interp, newCursorObjForTU(tuInfo, result));
+
+   return TCL_OK;
+}
+
+//------------------------ translation unit instance's diagnostic list command
+
+static int tuDiagnosticListObjCmd(ClientData     clientData,
+                                  Tcl_Interp    *interp,
+                                  int            objc,
+                                  Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
+      return TCL_ERROR;
+   }
+
+   TUInfo *info = (TUInfo *)clientData;
+
+   unsigned numDiags = clang_getNumDiagnostics(info->translationUnit);
+   Tcl_Obj **diags = (Tcl_Obj **)Tcl_Alloc(numDiags * sizeof(Tcl_Obj *));
+   for (int i = 0; i < numDiags; i++) {
+      CXDiagnostic  diagnostic = clang_getDiagnostic(info->translationUnit, i);
+      diags[i] = newDiagnosticObj(info, diagnostic);
+      clang_disposeDiagnostic(diagnostic);
+   }
+   Tcl_SetObjResult(interp, Tcl_NewListObj(numDiags, diags));
+
+   Tcl_Free((char *)diags);
+
+   return TCL_OK;
+}
+
+//---------------------- translation unit instance's diagnostic decode command
+
+static int tuDiagnosticDecodeObjCmd(ClientData     clientData,
+                                    Tcl_Interp    *interp,
+                                    int            objc,
+                                    Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      index_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
+      return TCL_ERROR;
+   }
+
+   int index = 0;
+   int status = Tcl_GetIntFromObj(interp, objv[index_ix], &index);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   TUInfo *info = (TUInfo *)clientData;
+
+   unsigned numDiags = clang_getNumDiagnostics(info->translationUnit);
+   if (0 > index || numDiags <= index) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("index %d is out of range", index));
+      return TCL_ERROR;
+   }
+
+   CXDiagnostic  diagnostic = clang_getDiagnostic(info->translationUnit,
+                                                  index);
+   Tcl_Obj      *resultObj  = newDiagnosticObj(info, diagnostic);
+   Tcl_SetObjResult(interp, resultObj);
+   clang_disposeDiagnostic(diagnostic);
+
+   return TCL_OK;
+}
+
+//---------------------- translation unit instance's diagnostic format command
+
+static BitMask diagnosticFormatOptions[] = {
+   { "-displaySourceLocation" },
+   { "-displayColumn" },
+   { "-displaySourceRanges" },
+   { "-displayOption" },
+   { "-displayCategoryId" },
+   { "-displayCategoryName" },
+   { NULL }
+};
+
+static int tuDiagnosticFormatObjCmd(ClientData     clientData,
+                                    Tcl_Interp    *interp,
+                                    int            objc,
+                                    Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      index_ix,
+      options_ix
+   };
+
+   if (objc < index_ix + 1) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "index ?option?...");
+      return TCL_ERROR;
+   }
+
+   int index = 0;
+   int status = Tcl_GetIntFromObj(interp, objv[index_ix], &index);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   TUInfo *info = (TUInfo *)clientData;
+
+   unsigned flags = 0;
+   if (objc == options_ix) {
+      flags = clang_defaultDiagnosticDisplayOptions();
+   } else if (objc == options_ix + 1
+              && (objv[options_ix] == noneTagObj
+                  || strcmp(Tcl_GetStringFromObj(objv[options_ix], NULL),
+                            Tcl_GetStringFromObj(noneTagObj, NULL)) == 0)) {
+   } else {
+      for (int i = options_ix; i < objc; ++i) {
+         int optionNumber;
+         status = Tcl_GetIndexFromObjStruct
+            (interp, objv[options_ix + i],
+             diagnosticFormatOptions,
+             sizeof diagnosticFormatOptions[0],
+             "option", 0, &optionNumber);
+         if (status != TCL_OK) {
+            return status;
+         }
+
+         flags |= diagnosticFormatOptions[optionNumber].mask == 0
+            ? 1 << optionNumber
+            : diagnosticFormatOptions[optionNumber].mask;
+      }
+
+      if ((flags & CXDiagnostic_DisplayColumn) != 0
+          || (flags & CXDiagnostic_DisplaySourceRanges) != 0) {
+         flags |= CXDiagnostic_DisplaySourceLocation;
+      }
+   }
+
+   unsigned numDiags = clang_getNumDiagnostics(info->translationUnit);
+   if (index < 0 || numDiags <= index) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("index %d is out of range", index));
+      return TCL_ERROR;
+   }
+
+   CXDiagnostic  diagnostic = clang_getDiagnostic(info->translationUnit,
+                                                  index);
+   CXString      result     = clang_formatDiagnostic(diagnostic, flags);
+   Tcl_Obj      *resultObj  = convertCXStringToObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+   clang_disposeDiagnostic(diagnostic);
+
+   return TCL_OK;
+}
+
+//---------------------- translation unit instance's diagnostic number command
+
+static int tuDiagnosticNumberObjCmd(ClientData     clientData,
+                                    Tcl_Interp    *interp,
+                                    int            objc,
+                                    Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
+      return TCL_ERROR;
+   }
+
+   TUInfo *info = (TUInfo *)clientData;
+
+   unsigned  result    = clang_getNumDiagnostics(info->translationUnit);
+   Tcl_Obj  *resultObj = Tcl_NewLongObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//----------------------------- translation unit instance's buildIndex command
+
+static int tuBuildIndexObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
+      return TCL_ERROR;
+   }
+
+   TUInfo *info = (TUInfo *)clientData;
+
+   // Rebuild it in case the caller wants a fresh one.
+   deleteASTIndex(info);
+   ASTIndex *index = getASTIndex(info);
+
+   Tcl_SetObjResult(interp, Tcl_NewIntObj(index->numNodes));
+
+   return TCL_OK;
+}
+
+//--------------------------------- translation unit instance's cursor command
+
+static int tuCursorObjCmd(ClientData     clientData,
+                          Tcl_Interp    *interp,
+                          int            objc,
+                          Tcl_Obj *const objv[])
+{
+   TUInfo *info = (TUInfo *)clientData;
+
+   enum {
+      command_ix,
+      optional_ix
+   };
+
+   static const char *options[] = {
+      "-location",
+      "-file",
+      "-line",
+      "-column",
+      "-offset",
+      NULL,
+   };
+
+   enum {
+      option_location,
+      option_file,
+      option_line,
+      option_column,
+      option_offset,
+   };
+
+   unsigned          options_found = 0;
+   CXSourceLocation  location      = clang_getNullLocation();
+   unsigned          line          = 0;
+   unsigned          column        = 0;
+   unsigned          offset        = 0;
+   CXFile            file          = NULL;
+
+   for (int i = optional_ix; i < objc; ++i) {
+      int optionNumber;
+      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                       "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         return status;
+      }
+
+      if ((options_found & (1 << optionNumber)) != 0) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("%s is specified more than once.",
+                                        Tcl_GetStringFromObj(objv[i], NULL)));
+         return TCL_ERROR;
+      }
+
+      switch (optionNumber) {
+
+      case option_location:
+         if (options_found != 0) {
+            goto invalid_form;
+         }
+
+         if (objc <= i + 1) {
+            Tcl_SetObjResult(interp,
+                             Tcl_NewStringObj("-location is not followed by a "
+                                              "source location",
+                                              -1));
+            return TCL_ERROR;
+         }
+
+         status = getLocationFromObj(interp, objv[i + 1], &location);
+         if (status != TCL_OK) {
+            return status;
+         }
+
+         i++;
+
+         break;
+
+      case option_file:
+         if ((options_found & (1 << option_location)) != 0) {
+            goto invalid_form;
+         }
+
+         if (objc <= i + 1) {
+            Tcl_SetObjResult(interp,
+                             Tcl_NewStringObj("-file is not followed by a "
+                                              "filename",
+                                              -1));
+            return TCL_ERROR;
+         }
+
+         const char *filename = Tcl_GetStringFromObj(objv[i + 1], NULL);
+         file = clang_getFile(info->translationUnit, filename);
+         if (file == NULL) {
+            goto invalid_location;
+         }
+
+         i++;
+
+         break;
+
+      case option_line:
+      case option_column:
+         if ((options_found & ((1 << option_location)
+                               | (1 << option_offset))) != 0) {
+            goto invalid_form;
+         }
+
+         if (objc <= i + 1) {
+            Tcl_SetObjResult(interp,
+                             Tcl_ObjPrintf("%s is not followed by a %s",
+                                           Tcl_GetStringFromObj(objv[i], NULL),
+                                           optionNumber == option_line
+                                           ? "line number"
+                                           : "column number"));
+            return TCL_ERROR;
+         }
+
+         status = getUnsignedFromObj(interp, objv[i + 1],
+                                     optionNumber == option_line
+                                     ? &line
+                                     : &column);
+         if (status != TCL_OK) {
+            return status;
+         }
+
+         i++;
+
+         break;
+
+      case option_offset:
+         if ((options_found & ((1 << option_location)
+                               | (1 << option_line)
+                               | (1 << option_column))) != 0) {
+            goto invalid_form;
+         }
+
+         if (objc <= i + 1) {
+            Tcl_SetObjResult(interp,
+                             Tcl_NewStringObj("-offset is not "
+                                              "followed by an offset",
+                                              -1));
+            return TCL_ERROR;
+         }
+         
+         status = getUnsignedFromObj(interp, objv[i + 1], &offset);
+         if (status != TCL_OK) {
+            return status;
+         }
+
+         i++;
+
+         break;
+
+      default:
+         Tcl_Panic("unknown option number");
+
+      }
+
+      options_found |= 1 << optionNumber;
+   }
+
+   CXCursor cursor;
+   unsigned line_and_column_form = (1 << option_file)
+      | (1 << option_line)
+      | (1 << option_column);
+   unsigned offset_form = (1 << option_file) | (1 << option_offset);
+   unsigned location_form = (1 << option_location);
+
+   if (options_found == 0) {
+
+      cursor = clang_getTranslationUnitCursor(info->translationUnit);
+
+   } else {
+
+      if ((options_found & line_and_column_form) == line_and_column_form) {
+
+         location = clang_getLocation(info->translationUnit,
+                                      file, line, column);
+
+      } else if ((options_found & offset_form) == offset_form) {
+
+         location = clang_getLocationForOffset(info->translationUnit,
+                                               file, offset);
+
+      } else if ((options_found & location_form) == location_form) {
+
+        // Location provided as argument.
+
+      } else {
+
+         goto invalid_form;
+
+      }
+
+      if (clang_equalLocations(location, clang_getNullLocation())) {
+         goto invalid_location;
+      }
+
+      cursor = clang_getCursor(info->translationUnit, location);
+
+   }
+
+   if (clang_Cursor_isNull(cursor)) {
+      goto invalid_location;
+   }
+
+   Tcl_Obj *cursorObj = newCursorObj(cursor);
+   Tcl_SetObjResult(interp, cursorObj);
+
+   return TCL_OK;
+
+ invalid_form:
+   Tcl_SetObjResult(interp,
+                    Tcl_NewStringObj("the specified location is not valid.",
+                                     -1));
+   return TCL_ERROR;
+
+ invalid_location:
+   Tcl_SetObjResult(interp,
+                    Tcl_NewStringObj("the specified location is "
+                                     "not a part of the translation unit.",
+                                     -1));
+   return TCL_ERROR;
+}
+
+//-------------------------------- translation unit instance's cursors command
+
+/** A position given to the cursors command, remembered with its index in
+ * the argument so that the results can be returned in input order.
+ */
+typedef struct CursorsPosition
+{
+   unsigned line;               // or the offset
+   unsigned column;
+   int      index;
+} CursorsPosition;
+
+static int compareCursorsPositions(const void *lhs, const void *rhs)
+{
+   const CursorsPosition *a = (const CursorsPosition *)lhs;
+   const CursorsPosition *b = (const CursorsPosition *)rhs;
+
+   if (a->line != b->line) {
+      return a->line < b->line ? -1 : 1;
+   }
+
+   if (a->column != b->column) {
+      return a->column < b->column ? -1 : 1;
+   }
+
+   return a->index - b->index;
+}
+
+static int tuCursorsObjCmd(ClientData     clientData,
+                           Tcl_Interp    *interp,
+                           int            objc,
+                           Tcl_Obj *const objv[])
+{
+   TUInfo *info = (TUInfo *)clientData;
+
+   enum {
+      command_ix,
+      file_option_ix,
+      file_ix,
+      positions_option_ix,
+      positions_ix,
+      nargs
+   };
+
+   static const char *options[] = {
+      "-offsets",
+      "-positions",
+      NULL,
+   };
+
+   enum {
+      option_offsets,
+      option_positions,
+   };
+
+   if (objc != nargs
+       || strcmp(Tcl_GetStringFromObj(objv[file_option_ix], NULL),
+                 "-file") != 0) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                       "-file filename -positions|-offsets list");
+      return TCL_ERROR;
+   }
+
+   int optionNumber;
+   int status = Tcl_GetIndexFromObj(interp, objv[positions_option_ix],
+                                    options, "option", 0, &optionNumber);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   const char *filename = Tcl_GetStringFromObj(objv[file_ix], NULL);
+   CXFile      file     = clang_getFile(info->translationUnit, filename);
+   if (file == NULL) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("file \"%s\" is not a part of "
+                                     "the translation unit",
+                                     filename));
+      return TCL_ERROR;
+   }
+
+   int       n;
+   Tcl_Obj **elms;
+   status = Tcl_ListObjGetElements(interp, objv[positions_ix], &n, &elms);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   CursorsPosition *positions = (CursorsPosition *)
+      Tcl_Alloc(n * sizeof positions[0] + 1);
+   for (int i = 0; i < n; ++i) {
+      positions[i].line   = 0;
+      positions[i].column = 0;
+      positions[i].index  = i;
+
+      if (optionNumber == option_offsets) {
+         status = getUnsignedFromObj(interp, elms[i], &positions[i].line);
+         if (status != TCL_OK) {
+            goto cleanup;
+         }
+         continue;
+      }
+
+      int       pairc;
+      Tcl_Obj **pairv;
+      status = Tcl_ListObjGetElements(interp, elms[i], &pairc, &pairv);
+      if (status != TCL_OK) {
+         goto cleanup;
+      }
+      if (pairc != 2) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("position \"%s\" is not a "
+                                        "{line column} pair",
+                                        Tcl_GetStringFromObj(elms[i], NULL)));
+         status = TCL_ERROR;
+         goto cleanup;
+      }
+      status = getUnsignedFromObj(interp, pairv[0], &positions[i].line);
+      if (status == TCL_OK) {
+         status = getUnsignedFromObj(interp, pairv[1], &positions[i].column);
+      }
+      if (status != TCL_OK) {
+         goto cleanup;
+      }
+   }
+
+   // Visiting the positions in the file order keeps libclang's lookups
+   // local, and lets equal positions and cursors share one object.
+   qsort(positions, n, sizeof positions[0], compareCursorsPositions);
+
+   Tcl_Obj **results = (Tcl_Obj **)Tcl_Alloc(n * sizeof results[0] + 1);
+   CXCursor  prevCursor    = clang_getNullCursor();
+   Tcl_Obj  *prevCursorObj = NULL;
+   for (int i = 0; i < n; ++i) {
+      const CursorsPosition *position = &positions[i];
+
+      if (0 < i && position->line == positions[i - 1].line
+          && position->column == positions[i - 1].column) {
+         results[position->index] = prevCursorObj;
+         continue;
+      }
+
+      CXSourceLocation location = optionNumber == option_offsets
+         ? clang_getLocationForOffset(info->translationUnit,
+                                      file, position->line)
+         : clang_getLocation(info->translationUnit,
+                             file, position->line, position->column);
+      CXCursor cursor = clang_equalLocations(location,
+                                             clang_getNullLocation())
+         ? clang_getNullCursor()
+         : clang_getCursor(info->translationUnit, location);
+
+      if (prevCursorObj == NULL || !clang_equalCursors(cursor, prevCursor)) {
+         prevCursor    = cursor;
+         prevCursorObj = newCursorObjForTU(info, cursor);
+      }
+      results[position->index] = prevCursorObj;
+   }
+
+   Tcl_SetObjResult(interp, Tcl_NewListObj(n, results));
+   Tcl_Free((char *)results);
+
+ cleanup:
+   Tcl_Free((char *)positions);
+
+   return status;
+}
+
+//--------------- translation unit instance's cursorsAt and cursorsIn commands
+
+// Return the cursors of info whose extents in file overlap [start, end),
+// innermost first.
+static Tcl_Obj *newOverlappingCursorsObj(TUInfo   *info,
+                                         CXFile    file,
+                                         unsigned  start,
+                                         unsigned  end)
+{
+   ASTIndex     *index = getASTIndex(info);
+   IntervalTree *tree  = getIntervalTree(index, file);
+
+   IntervalTreeHits hits = { 0, 0, NULL };
+   queryIntervalTree(index, tree, 0, tree->numIds, start, end, &hits);
+   qsort(hits.hits, hits.numHits, sizeof hits.hits[0],
+         compareIntervalTreeHits);
+
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+   for (int i = 0; i < hits.numHits; ++i) {
+      Tcl_ListObjAppendElement
+         (NULL, resultObj,
+          newCursorObjForTU(info, index->nodes[hits.hits[i].id].cursor));
+   }
+   Tcl_Free((char *)hits.hits);
+
+   return resultObj;
+}
+
+enum CursorsQuery {
+   cursorsQueryAt,
+   cursorsQueryIn
+};
+
+static int tuCursorsQuery(TUInfo            *info,
+                          enum CursorsQuery  query,
+                          Tcl_Interp        *interp,
+                          int                objc,
+                          Tcl_Obj *const     objv[])
+{
+   enum {
+      command_ix,
+      option_ix
    };
 
-   createNameValueTable(&cursorKindNames, &cursorKindValues, table);
+   static const char *options[] = {
+      "-file",
+      "-offset",
+      "-range",
+      NULL,
+   };
 
-   Tcl_IncrRefCount(cursorKindNames);
-   Tcl_IncrRefCount(cursorKindValues);
+   enum {
+      option_file,
+      option_offset,
+      option_range,
+   };
+
+   const char *usage = query == cursorsQueryAt
+      ? "-file filename -offset offset"
+      : "-file filename -range {start end}";
+
+   unsigned options_found = 0;
+   CXFile   file          = NULL;
+   unsigned start         = 0;
+   unsigned end           = 0;
+
+   for (int i = option_ix; i < objc; ++i) {
+      int optionNumber;
+      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                       "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         return status;
+      }
+
+      if ((options_found & (1 << optionNumber)) != 0) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("%s is specified more than once.",
+                                        Tcl_GetStringFromObj(objv[i], NULL)));
+         return TCL_ERROR;
+      }
+      options_found |= 1 << optionNumber;
+
+      if ((optionNumber == option_offset && query != cursorsQueryAt)
+          || (optionNumber == option_range && query != cursorsQueryIn)) {
+         Tcl_WrongNumArgs(interp, command_ix + 1, objv, usage);
+         return TCL_ERROR;
+      }
+
+      if (objc <= i + 1) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("%s is not followed by a value",
+                                        Tcl_GetStringFromObj(objv[i], NULL)));
+         return TCL_ERROR;
+      }
+
+      Tcl_Obj *valueObj = objv[++i];
+
+      switch (optionNumber) {
+
+      case option_file: {
+         const char *filename = Tcl_GetStringFromObj(valueObj, NULL);
+         file = clang_getFile(info->translationUnit, filename);
+         if (file == NULL) {
+            Tcl_SetObjResult(interp,
+                             Tcl_ObjPrintf("file \"%s\" is not a part of "
+                                           "the translation unit",
+                                           filename));
+            return TCL_ERROR;
+         }
+         break;
+      }
+
+      case option_offset:
+         status = getUnsignedFromObj(interp, valueObj, &start);
+         if (status != TCL_OK) {
+            return status;
+         }
+         end = start + 1;
+         break;
+
+      case option_range: {
+         int       n;
+         Tcl_Obj **elms;
+         status = Tcl_ListObjGetElements(interp, valueObj, &n, &elms);
+         if (status != TCL_OK) {
+            return status;
+         }
+         if (n != 2) {
+            Tcl_SetObjResult(interp,
+                             Tcl_NewStringObj("-range is not followed by "
+                                              "{start end}", -1));
+            return TCL_ERROR;
+         }
+         status = getUnsignedFromObj(interp, elms[0], &start);
+         if (status == TCL_OK) {
+            status = getUnsignedFromObj(interp, elms[1], &end);
+         }
+         if (status != TCL_OK) {
+            return status;
+         }
+         break;
+      }
+
+      }
+   }
+
+   if (options_found != ((1 << option_file)
+                         | (1 << (query == cursorsQueryAt
+                                  ? option_offset : option_range)))) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, usage);
+      return TCL_ERROR;
+   }
+
+   Tcl_SetObjResult(interp, newOverlappingCursorsObj(info, file, start, end));
+
+   return TCL_OK;
 }
 
-static Tcl_Obj *newCursorObj(CXCursor cursor)
+static int tuCursorsAtObjCmd(ClientData     clientData,
+                             Tcl_Interp    *interp,
+                             int            objc,
+                             Tcl_Obj *const objv[])
+{
+   return tuCursorsQuery((TUInfo *)clientData, cursorsQueryAt,
+                         interp, objc, objv);
+}
+
+static int tuCursorsInObjCmd(ClientData     clientData,
+                             Tcl_Interp    *interp,
+                             int            objc,
+                             Tcl_Obj *const objv[])
+{
+   return tuCursorsQuery((TUInfo *)clientData, cursorsQueryIn,
+                         interp, objc, objv);
+}
+
+//-------------------------- translation unit instance's cursorHandles command
+
+static int tuCursorHandlesObjCmd(ClientData     clientData,
+                                 Tcl_Interp    *interp,
+                                 int            objc,
+                                 Tcl_Obj *const objv[])
 {
+   TUInfo *info = (TUInfo *)clientData;
+
    enum {
-      ndata = sizeof cursor.data / sizeof cursor.data[0]
+      command_ix,
+      enable_ix,
+      nargs
    };
 
+   if (objc != enable_ix && objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "?boolean?");
+      return TCL_ERROR;
+   }
+
+   CursorHandleTable *table = &info->cursorHandles;
+
+   if (objc == nargs) {
+      int enabled;
+      int status = Tcl_GetBooleanFromObj(interp, objv[enable_ix], &enabled);
+      if (status != TCL_OK) {
+         return status;
+      }
+
+      if (!enabled) {
+         clearCursorHandles(info);
+      }
+      table->enabled = enabled;
+   }
+
+   Tcl_SetObjResult(interp, Tcl_NewBooleanObj(table->enabled));
+
+   return TCL_OK;
+}
+
+//----------------------------- translation unit instance's diagnostic command
+
+static int tuDiagnosticObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
    enum {
-      kind_ix,
-      xdata_ix,
-      data_ix,
-      nelms = data_ix + ndata
+      command_ix,
+      subcommand_ix,
+      numMandatoryArgs
    };
 
-   Tcl_Obj *elms[nelms];
+   if (objc < numMandatoryArgs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
+      return TCL_ERROR;
+   }
 
-   Tcl_Obj *kind = Tcl_NewIntObj(cursor.kind);
-   Tcl_IncrRefCount(kind);
-   Tcl_Obj *kindName;
-   if (Tcl_DictObjGet(NULL, cursorKindNames, kind, &kindName) != TCL_OK) {
-      Tcl_Panic("cursor kind %d is not valid", cursor.kind);
+   static Command subcommands[] = {
+      { "decode",
+        tuDiagnosticDecodeObjCmd },
+      { "format",
+        tuDiagnosticFormatObjCmd },
+      { "number",
+        tuDiagnosticNumberObjCmd },
+      { NULL },
+   };
+
+   int commandNumber;
+   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
+                                          subcommands, sizeof subcommands[0],
+                                          "subcommand", 0, &commandNumber);
+   if (status != TCL_OK) {
+      return status;
    }
-   Tcl_DecrRefCount(kind);
-   elms[kind_ix]  = kindName;
-   elms[xdata_ix] = Tcl_NewLongObj(cursor.xdata);
 
-   for (int i = 0; i < ndata; ++i) {
-      elms[data_ix + i] = newPointerObj(cursor.data[i]);
+   return subcommands[commandNumber].proc(clientData, interp,
+                                          objc - subcommand_ix,
+                                          objv + subcommand_ix);
+}
+
+//----------------------------------- translation unit instance's dump command
+
+enum DumpField {
+   dumpFieldKind,
+   dumpFieldParent,
+   dumpFieldSpelling,
+   dumpFieldFile,
+   dumpFieldLine,
+   dumpFieldColumn,
+   dumpFieldUSR,
+   dumpFieldType,
+   numDumpFields
+};
+
+static const char *dumpFieldNames[] = {
+   "kind",
+   "parent",
+   "spelling",
+   "file",
+   "line",
+   "column",
+   "usr",
+   "type",
+   NULL
+};
+
+typedef struct DumpInfo {
+   TUInfo        *tuInfo;
+   CursorScope    scope;
+   unsigned       fields;                   // 1 << enum DumpField
+   Tcl_Obj       *columns[numDumpFields];
+   Tcl_HashTable  strings[numDumpFields];   // interned strings of columns
+   int            count;                    // the number of nodes so far
+   int            parent;                   // -1 for the top level
+} DumpInfo;
+
+static enum CXChildVisitResult dumpHelper(CXCursor     cursor,
+                                          CXCursor     parent,
+                                          CXClientData clientData)
+{
+   DumpInfo *info = (DumpInfo *)clientData;
+
+   if (! isCursorInScope(&info->scope, cursor)) {
+      return CXChildVisit_Continue;
    }
 
-   return Tcl_NewListObj(nelms, elms);
+   CXSourceLocation location = clang_getCursorLocation(cursor);
+
+   int      index  = info->count++;
+   unsigned fields = info->fields;
+
+   if (fields & (1U << dumpFieldKind)) {
+      Tcl_Obj *kindName = getCursorKindNameObj(clang_getCursorKind(cursor));
+      if (kindName == NULL) {
+         Tcl_Panic("cursor kind %d is not valid", clang_getCursorKind(cursor));
+      }
+      Tcl_ListObjAppendElement(NULL, info->columns[dumpFieldKind], kindName);
+   }
+
+   if (fields & (1U << dumpFieldParent)) {
+      Tcl_ListObjAppendElement(NULL, info->columns[dumpFieldParent],
+                               Tcl_NewIntObj(info->parent));
+   }
+
+   if (fields & (1U << dumpFieldSpelling)) {
+      Tcl_ListObjAppendElement
+         (NULL, info->columns[dumpFieldSpelling],
+          internCXString(&info->strings[dumpFieldSpelling],
+                         clang_getCursorSpelling(cursor)));
+   }
+
+   unsigned locationFields = (1U << dumpFieldFile)
+      | (1U << dumpFieldLine) | (1U << dumpFieldColumn);
+   if (fields & locationFields) {
+      CXFile   file;
+      unsigned line;
+      unsigned column;
+      clang_getExpansionLocation(location, &file, &line, &column, NULL);
+
+      if (fields & (1U << dumpFieldFile)) {
+         Tcl_ListObjAppendElement(NULL, info->columns[dumpFieldFile],
+                                  file == NULL ? filenameNullObj
+                                  : newFileNameObjForTU(info->tuInfo, file));
+      }
+      if (fields & (1U << dumpFieldLine)) {
+         Tcl_ListObjAppendElement(NULL, info->columns[dumpFieldLine],
+                                  Tcl_NewLongObj(line));
+      }
+      if (fields & (1U << dumpFieldColumn)) {
+         Tcl_ListObjAppendElement(NULL, info->columns[dumpFieldColumn],
+                                  Tcl_NewLongObj(column));
+      }
+   }
+
+   if (fields & (1U << dumpFieldUSR)) {
+      Tcl_ListObjAppendElement
+         (NULL, info->columns[dumpFieldUSR],
+          internCXString(&info->strings[dumpFieldUSR],
+                         clang_getCursorUSR(cursor)));
+   }
+
+   if (fields & (1U << dumpFieldType)) {
+      Tcl_ListObjAppendElement
+         (NULL, info->columns[dumpFieldType],
+          internCXString(&info->strings[dumpFieldType],
+                         clang_getTypeSpelling(clang_getCursorType(cursor))));
+   }
+
+   // Recurse by ourselves to keep track of the parent index.
+   int parentIndex = info->parent;
+   info->parent    = index;
+   clang_visitChildren(cursor, dumpHelper, info);
+   info->parent    = parentIndex;
+
+   return CXChildVisit_Continue;
 }
 
-static int
-getCursorFromObj(Tcl_Interp *interp, Tcl_Obj *obj, CXCursor *cursor)
-{
-   CXCursor result = { 0 };
+static int tuDumpObjCmd(ClientData     clientData,
+                        Tcl_Interp    *interp,
+                        int            objc,
+                        Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      optional_ix
+   };
+
+   static const char *options[] = {
+      "-fields",
+      NULL
+   };
+
+   enum {
+      option_fields
+   };
+
+   TUInfo   *info     = (TUInfo *)clientData;
+   DumpInfo  dumpInfo = {
+      .tuInfo = info,
+      .parent = -1,
+   };
+   initCursorScope(&dumpInfo.scope);
+
+   int fieldOrder[numDumpFields];
+   int numFields = 0;
+
+   int status = TCL_OK;
+   for (int i = optional_ix; i < objc; ++i) {
+      status = parseCursorScopeOption(interp, &dumpInfo.scope,
+                                      info->translationUnit, options,
+                                      objc, objv, &i);
+      if (status == TCL_OK) {
+         continue;
+      }
+      if (status != TCL_CONTINUE) {
+         goto cleanup;
+      }
+
+      int optionNumber;
+      status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                   "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         goto cleanup;
+      }
 
-   enum {
-      ndata = sizeof result.data / sizeof result.data[0]
-   };
+      switch (optionNumber) {
 
-   enum {
-      kind_ix,
-      xdata_ix,
-      data_ix,
-      nelms = data_ix + ndata,
-   };
+      case option_fields: {
+         if (objc <= i + 1) {
+            Tcl_SetObjResult(interp,
+                             Tcl_NewStringObj("-fields is not followed by a "
+                                              "list of fields", -1));
+            status = TCL_ERROR;
+            goto cleanup;
+         }
 
-   int       n;
-   Tcl_Obj **elms;
-   int status = Tcl_ListObjGetElements(interp, obj, &n, &elms);
-   if (status != TCL_OK) {
-      return status;
-   }
+         int       n;
+         Tcl_Obj **elms;
+         status = Tcl_ListObjGetElements(interp, objv[++i], &n, &elms);
+         if (status != TCL_OK) {
+            goto cleanup;
+         }
 
-   if (n != nelms) {
-      goto invalid_cursor;
-   }
+         dumpInfo.fields = 0;
+         numFields       = 0;
+         for (int j = 0; j < n; ++j) {
+            int field;
+            status = Tcl_GetIndexFromObj(interp, elms[j], dumpFieldNames,
+                                         "field", 0, &field);
+            if (status != TCL_OK) {
+               goto cleanup;
+            }
+            if ((dumpInfo.fields & (1U << field)) == 0) {
+               dumpInfo.fields |= 1U << field;
+               fieldOrder[numFields++] = field;
+            }
+         }
 
-   Tcl_Obj* kindObj = NULL;
-   if (Tcl_DictObjGet(NULL, cursorKindValues, elms[kind_ix], &kindObj)
-       != TCL_OK) {
-      Tcl_Panic("cursorKindValues corrupted");
+         break;
+      }
+      }
    }
 
-   if (kindObj == NULL) {
-      const char *kind = Tcl_GetStringFromObj(elms[kind_ix], NULL);
-      Tcl_SetObjResult(interp,
-                       Tcl_ObjPrintf("invalid cursor kind: %s", kind));
-      return TCL_ERROR;
+   if (numFields == 0) {
+      for (int i = 0; i < numDumpFields; ++i) {
+         dumpInfo.fields |= 1U << i;
+         fieldOrder[numFields++] = i;
+      }
    }
 
-   int kind;
-   status = Tcl_GetIntFromObj(NULL, kindObj, &kind);
-   if (status != TCL_OK) {
-      Tcl_Panic("cursorKindValues corrupted");
+   for (int i = 0; i < numDumpFields; ++i) {
+      dumpInfo.columns[i] = Tcl_NewListObj(0, NULL);
+      Tcl_IncrRefCount(dumpInfo.columns[i]);
+      Tcl_InitHashTable(&dumpInfo.strings[i], TCL_STRING_KEYS);
    }
-   result.kind = kind;
 
-   status = Tcl_GetIntFromObj(NULL, elms[xdata_ix], &result.xdata);
-   if (status != TCL_OK) {
-      goto invalid_cursor;
-   }
+   CXCursor root = clang_getTranslationUnitCursor(info->translationUnit);
+   clang_visitChildren(root, dumpHelper, &dumpInfo);
 
-   for (int i = 0; i < ndata; ++i) {
-      status = getPointerFromObj(NULL, elms[data_ix + i],
-                                 (void **)&result.data[i]);
-      if (status != TCL_OK) {
-         goto invalid_cursor;
-      }
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+   for (int i = 0; i < numFields; ++i) {
+      int field = fieldOrder[i];
+      Tcl_ListObjAppendElement(NULL, resultObj,
+                               Tcl_NewStringObj(dumpFieldNames[field], -1));
+      Tcl_ListObjAppendElement(NULL, resultObj, dumpInfo.columns[field]);
    }
 
-   CXTranslationUnit tu = clang_Cursor_getTranslationUnit(result);
-   if (lookupTranslationUnit(tu) == NULL) {
-      goto invalid_cursor;
+   for (int i = 0; i < numDumpFields; ++i) {
+      Tcl_DecrRefCount(dumpInfo.columns[i]);
+      deleteInternTable(&dumpInfo.strings[i]);
    }
 
-   *cursor = result;
-
-   return TCL_OK;
+   Tcl_SetObjResult(interp, resultObj);
 
- invalid_cursor:
-   Tcl_SetObjResult(interp, Tcl_NewStringObj("invalid cursor object", -1));
+cleanup:
+   clearCursorScope(&dumpInfo.scope);
 
-   return TCL_ERROR;
+   return status;
 }
 
-//----------------------------------------------------------------------- type
+//--------------------------------- translation unit instance's export command
+
+/* The binary export format
+ *
+ * All integers are little endian.  An export file consists of a header,
+ * the node records, the string table, and a trailer:
+ *
+ *   offset              size  contents
+ *   0                   8     magic "CIDXAST1"
+ *   8                   4     the size of a node record (24)
+ *   12                  4     reserved (0)
+ *   16                  24*N  node records in pre-order
+ *   blobPos             B     the strings, each terminated by a NUL
+ *                             byte, padded to a multiple of 8 bytes
+ *   offsetsPos          4*S+4 the offset of each string from blobPos, and
+ *                             the size of the strings, padded to a
+ *                             multiple of 8 bytes
+ *   end - 40            40    trailer: N, S, blobPos, offsetsPos as 8 byte
+ *                             integers, and the magic again
+ *
+ * A node record consists of six 4 byte integers: the cursor kind, the index
+ * of the parent node (-1 for top level nodes), the string ids of the
+ * spelling, the USR and the file name (0xffffffff if there is no file), and
+ * the offset of the expansion location in the file.
+ *
+ * Since the record size is fixed and the string offsets come in an array,
+ * readers can map the file and access any node or string directly.
+ */
 
-static Tcl_Obj *typeKindValues;
-static Tcl_Obj *typeKindNames;
+enum {
+   exportHeaderSize  = 16,
+   exportRecordSize  = 24,
+   exportTrailerSize = 40,
+   exportBufferSize  = 65536,
+   exportNoString    = 0xffffffff,
+};
 
-static void createCXTypeTable(void)
-{
-   static NameValuePair table[] = {
-      { "Invalid",
-        CXType_Invalid },
-      { "Unexposed",
-        CXType_Unexposed },
-      { "Void",
-        CXType_Void },
-      { "Bool",
-        CXType_Bool },
-      { "Char_U",
-        CXType_Char_U },
-      { "UChar",
-        CXType_UChar },
-      { "Char16",
-        CXType_Char16 },
-      { "Char32",
-        CXType_Char32 },
-      { "UShort",
-        CXType_UShort },
-      { "UInt",
-        CXType_UInt },
-      { "ULong",
-        CXType_ULong },
-      { "ULongLong",
-        CXType_ULongLong },
-      { "UInt128",
-        CXType_UInt128 },
-      { "Char_S",
-        CXType_Char_S },
-      { "SChar",
-        CXType_SChar },
-      { "WChar",
-        CXType_WChar },
-      { "Short",
-        CXType_Short },
-      { "Int",
-        CXType_Int },
-      { "Long",
-        CXType_Long },
-      { "LongLong",
-        CXType_LongLong },
-      { "Int128",
-        CXType_Int128 },
-      { "Float",
-        CXType_Float },
-      { "Double",
-        CXType_Double },
-      { "LongDouble",
-        CXType_LongDouble },
-      { "NullPtr",
-        CXType_NullPtr },
-      { "Overload",
-        CXType_Overload },
-      { "Dependent",
-        CXType_Dependent },
-      { "ObjCId",
-        CXType_ObjCId },
-      { "ObjCClass",
-        CXType_ObjCClass },
-      { "ObjCSel",
-        CXType_ObjCSel },
-#if CINDEX_VERSION_MINOR >= 35
-      { "Float128",
-        CXType_Float128 },
-#endif
-#if CINDEX_VERSION_MINOR >= 38
-      { "Half",
-        CXType_Half },
-#endif
-      { "Complex",
-        CXType_Complex },
-      { "Pointer",
-        CXType_Pointer },
-      { "BlockPointer",
-        CXType_BlockPointer },
-      { "LValueReference",
-        CXType_LValueReference },
-      { "RValueReference",
-        CXType_RValueReference },
-      { "Record",
-        CXType_Record },
-      { "Enum",
-        CXType_Enum },
-      { "Typedef",
-        CXType_Typedef },
-      { "ObjCInterface",
-        CXType_ObjCInterface },
-      { "ObjCObjectPointer",
-        CXType_ObjCObjectPointer },
-      { "FunctionNoProto",
-        CXType_FunctionNoProto },
-      { "FunctionProto",
-        CXType_FunctionProto },
-      { "ConstantArray",
-        CXType_ConstantArray },
-      { "Vector",
-        CXType_Vector },
-      { "IncompleteArray",
-        CXType_IncompleteArray },
-      { "VariableArray",
-        CXType_VariableArray },
-      { "DependentSizedArray",
-        CXType_DependentSizedArray },
-      { "MemberPointer",
-        CXType_MemberPointer },
-#if CINDEX_VERSION_MINOR >= 32
-      { "Auto",
-        CXType_Auto },
-#endif
-#if CINDEX_VERSION_MINOR >= 35
-      { "Elaborated",
-        CXType_Elaborated },
-#endif
-      { NULL }
-   };
+static const char exportMagic[8] = { 'C', 'I', 'D', 'X', 'A', 'S', 'T', '1' };
 
-   createNameValueTable(&typeKindNames, &typeKindValues, table);
+enum ExportFormat {
+   exportFormatBinary,
+   exportFormatJsonl,
+};
 
-   Tcl_IncrRefCount(typeKindNames);
-   Tcl_IncrRefCount(typeKindValues);
+static void putUint32(unsigned char *p, uint32_t value)
+{
+   for (int i = 0; i < 4; ++i) {
+      p[i] = (unsigned char)(value >> (i * 8));
+   }
 }
 
-static Tcl_Obj *newTypeObj(CXType type)
+static void putUint64(unsigned char *p, uint64_t value)
 {
-   Tcl_Obj *kind = Tcl_NewIntObj(type.kind);
-   Tcl_IncrRefCount(kind);
-   Tcl_Obj *kindName;
-   if (Tcl_DictObjGet(NULL, typeKindNames, kind, &kindName) != TCL_OK
-       || kindName == NULL) {
-      Tcl_Panic("typeKindNames(%d) corrupted", type.kind);
+   for (int i = 0; i < 8; ++i) {
+      p[i] = (unsigned char)(value >> (i * 8));
    }
-   Tcl_DecrRefCount(kind);
+}
 
-   enum {
-      ndata = sizeof type.data / sizeof type.data[0]
-   };
+static uint32_t getUint32(const unsigned char *p)
+{
+   uint32_t value = 0;
+   for (int i = 3; i >= 0; --i) {
+      value = (value << 8) | p[i];
+   }
+   return value;
+}
 
-   enum {
-      kind_ix,
-      data_ix,
-      nelms = data_ix + ndata
-   };
+static uint64_t getUint64(const unsigned char *p)
+{
+   uint64_t value = 0;
+   for (int i = 7; i >= 0; --i) {
+      value = (value << 8) | p[i];
+   }
+   return value;
+}
 
-   Tcl_Obj* elements[nelms];
-   elements[kind_ix] = kindName;
-   for (int i = 0; i < ndata; ++i) {
-      elements[data_ix + i] = newPointerObj(type.data[i]);
+typedef struct ExportWriter {
+   TUInfo            *tuInfo;
+   Tcl_Channel        channel;
+   enum ExportFormat  format;
+   CursorScope        scope;
+   unsigned char      buffer[exportBufferSize];
+   int                used;             // bytes used in buffer
+   int                error;            // errno of a failed write, or 0
+   Tcl_HashTable      stringIds;        // string -> id
+   Tcl_HashTable      fileIds;          // CXFile -> string id
+   Tcl_DString        strings;          // the strings in the order of ids
+   uint32_t          *stringOffsets;    // the offset of each string
+   int                numStrings;
+   int                capacity;
+   int                count;            // the number of nodes so far
+   int                parent;           // -1 for the top level
+} ExportWriter;
+
+// Write all of bytes to the channel of writer.  A write that fails or makes
+// no progress sets writer->error, to EIO if the channel left errno unset.
+static void writeExportRaw(ExportWriter *writer, const char *bytes, int size)
+{
+   while (writer->error == 0 && size > 0) {
+      int written = Tcl_WriteRaw(writer->channel, bytes, size);
+      if (written <= 0) {
+         writer->error = Tcl_GetErrno() != 0 ? Tcl_GetErrno() : EIO;
+         return;
+      }
+      bytes += written;
+      size  -= written;
    }
+}
 
-   return Tcl_NewListObj(nelms, elements);
+static void flushExport(ExportWriter *writer)
+{
+   writeExportRaw(writer, (const char *)writer->buffer, writer->used);
+   writer->used = 0;
 }
 
-static int getTypeFromObj(Tcl_Interp *interp, Tcl_Obj *obj, CXType *output)
+static void writeExport(ExportWriter *writer, const void *bytes, int size)
 {
-   CXType result = { 0 };
+   if (exportBufferSize < writer->used + size) {
+      flushExport(writer);
+   }
 
-   enum {
-      ndata = sizeof result.data / sizeof result.data[0]
-   };
+   if (exportBufferSize < size) {
+      writeExportRaw(writer, (const char *)bytes, size);
+      return;
+   }
 
-   enum {
-      kind_ix,
-      data_ix,
-      nelms = data_ix + ndata
-   };
+   memcpy(writer->buffer + writer->used, bytes, size);
+   writer->used += size;
+}
 
-   int       nelms_actual = 0;
-   Tcl_Obj **elms         = NULL;
-   if (Tcl_ListObjGetElements(NULL, obj, &nelms_actual, &elms) != TCL_OK
-       || nelms_actual != nelms) {
-      goto invalid_type;
-   }
+// Write str as a JSON string.
+static void writeExportJsonString(ExportWriter *writer, const char *str)
+{
+   writeExport(writer, "\"", 1);
 
-   Tcl_Obj *kindObj;
-   if (Tcl_DictObjGet(NULL, typeKindValues, elms[kind_ix], &kindObj)
-       != TCL_OK
-       || kindObj == NULL) {
-      goto invalid_type;
-   }
+   const char *run = str;
+   for (const char *p = str; *p != '\0'; ++p) {
+      unsigned char c = *p;
+      if (c >= 0x20 && c != '"' && c != '\\') {
+         continue;
+      }
 
-   int kind;
-   int status = Tcl_GetIntFromObj(interp, kindObj, &kind);
-   if (status != TCL_OK) {
-      goto invalid_type;
+      writeExport(writer, run, p - run);
+      run = p + 1;
+
+      char escape[8];
+      int  size = c == '"' || c == '\\'
+         ? snprintf(escape, sizeof escape, "\\%c", c)
+         : snprintf(escape, sizeof escape, "\\u%04x", c);
+      writeExport(writer, escape, size);
    }
-   result.kind = kind;
+   writeExport(writer, run, strlen(run));
 
-   for (int i = 0; i < ndata; ++i) {
-      if (getPointerFromObj(NULL, elms[data_ix + i], &result.data[i])
-          != TCL_OK) {
-         goto invalid_type;
-      }
+   writeExport(writer, "\"", 1);
+}
+
+static uint32_t getExportStringId(ExportWriter *writer, const char *str)
+{
+   int            created;
+   Tcl_HashEntry *entry = Tcl_CreateHashEntry(&writer->stringIds, str,
+                                              &created);
+   if (!created) {
+      return (uint32_t)(uintptr_t)Tcl_GetHashValue(entry);
    }
 
-   *output = result;
+   if (writer->numStrings == writer->capacity) {
+      writer->capacity      = writer->capacity == 0
+         ? 1024 : writer->capacity * 2;
+      writer->stringOffsets = (uint32_t *)
+         Tcl_Realloc((char *)writer->stringOffsets,
+                     writer->capacity * sizeof writer->stringOffsets[0]);
+   }
 
-   return TCL_OK;
+   uint32_t id = writer->numStrings++;
+   writer->stringOffsets[id] = Tcl_DStringLength(&writer->strings);
+   Tcl_DStringAppend(&writer->strings, str, strlen(str) + 1);
+   Tcl_SetHashValue(entry, (ClientData)(uintptr_t)id);
 
- invalid_type:
-   Tcl_SetObjResult(interp,
-                    Tcl_NewStringObj("invalid type object", -1));
-   return TCL_ERROR;
+   return id;
 }
 
-//--------------------------------------------------------- type equal command
-
-static int typeEqualObjCmd(ClientData     clientData,
-                           Tcl_Interp    *interp,
-                           int            objc,
-                           Tcl_Obj *const objv[])
+static uint32_t getExportStringIdOfCXString(ExportWriter *writer,
+                                            CXString      str)
 {
-   enum {
-      command_ix,
-      type1_ix,
-      type2_ix,
-      nargs
-   };
+   const char *cstr = clang_getCString(str);
+   uint32_t    id   = getExportStringId(writer, cstr != NULL ? cstr : "");
+   clang_disposeString(str);
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type1 type2");
-      return TCL_ERROR;
-   }
+   return id;
+}
 
-   CXType types[2];
-   for (int i = 0; i < 2; ++i) {
-      int status = getTypeFromObj(interp, objv[type1_ix + i], &types[i]);
-      if (status != TCL_OK) {
-         return status;
-      }
+static uint32_t getExportFileId(ExportWriter *writer, CXFile file)
+{
+   if (file == NULL) {
+      return exportNoString;
    }
 
-   int      result    = clang_equalTypes(types[0], types[1]) != 0;
-   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   int            created;
+   Tcl_HashEntry *entry = Tcl_CreateHashEntry(&writer->fileIds,
+                                              (const char *)file, &created);
+   if (created) {
+      uint32_t id = getExportStringIdOfCXString(writer,
+                                                clang_getFileName(file));
+      Tcl_SetHashValue(entry, (ClientData)(uintptr_t)id);
+   }
 
-   return TCL_OK;
+   return (uint32_t)(uintptr_t)Tcl_GetHashValue(entry);
 }
 
-//-------------------------------------------------- type foreachField command
-
-#if CINDEX_VERSION_MINOR >= 30
-static enum CXVisitorResult foreachFieldHelper(CXCursor     cursor,
-                                               CXClientData clientData)
+static void writeExportJsonNode(ExportWriter *writer,
+                                int           index,
+                                CXCursor      cursor,
+                                CXFile        file,
+                                unsigned      offset)
 {
-   int status = TCL_OK;
+   char buffer[64];
+   int  size;
 
-   struct VisitInfo *visitInfo = (VisitInfo *)clientData;
+   size = snprintf(buffer, sizeof buffer, "{\"index\":%d,\"kind\":", index);
+   writeExport(writer, buffer, size);
 
-   Tcl_Obj *cursorObj = newCursorObj(cursor);
-   Tcl_Obj *fieldName = visitInfo->variableNames[0];
-   Tcl_IncrRefCount(cursorObj);
-   if (Tcl_ObjSetVar2(visitInfo->interp, fieldName,
-                      NULL, cursorObj, TCL_LEAVE_ERR_MSG) == NULL) {
-      status = TCL_ERROR;
-      goto cleanup;
+   Tcl_Obj *kindName = getCursorKindNameObj(clang_getCursorKind(cursor));
+   if (kindName == NULL) {
+      Tcl_Panic("cursor kind %d is not valid", clang_getCursorKind(cursor));
    }
+   writeExportJsonString(writer, Tcl_GetStringFromObj(kindName, NULL));
 
-   status = Tcl_EvalObjEx(visitInfo->interp, visitInfo->scriptObj, 0);
+   size = snprintf(buffer, sizeof buffer, ",\"parent\":%d,\"spelling\":",
+                   writer->parent);
+   writeExport(writer, buffer, size);
 
-cleanup:
-   if (cursorObj) {
-      Tcl_DecrRefCount(cursorObj);
-   }
+   CXString spelling = clang_getCursorSpelling(cursor);
+   writeExportJsonString(writer, clang_getCString(spelling));
+   clang_disposeString(spelling);
 
-   switch (status) {
-   case TCL_OK:
-   case TCL_CONTINUE:
-      return CXVisit_Continue;
-   case TCL_BREAK:
-      return CXVisit_Break;
-   default:
-      visitInfo->returnCode = status;
-      return CXVisit_Break;
+   writeExport(writer, ",\"usr\":", 7);
+
+   CXString usr = clang_getCursorUSR(cursor);
+   writeExportJsonString(writer, clang_getCString(usr));
+   clang_disposeString(usr);
+
+   writeExport(writer, ",\"file\":", 8);
+
+   if (file == NULL) {
+      writeExport(writer, "null", 4);
+   } else {
+      Tcl_Obj *filename = newFileNameObjForTU(writer->tuInfo, file);
+      writeExportJsonString(writer, Tcl_GetStringFromObj(filename, NULL));
    }
+
+   size = snprintf(buffer, sizeof buffer, ",\"offset\":%u}\n", offset);
+   writeExport(writer, buffer, size);
 }
 
-static int typeForeachFieldObjCmd(ClientData     clientData,
-                                  Tcl_Interp    *interp,
-                                  int            objc,
-                                  Tcl_Obj *const objv[])
+static enum CXChildVisitResult exportHelper(CXCursor     cursor,
+                                            CXCursor     parent,
+                                            CXClientData clientData)
 {
-   enum {
-      command_ix,
-      recordType_ix,
-      varName_ix,
-      script_ix,
-      nargs
-   };
+   ExportWriter *writer = (ExportWriter *)clientData;
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix, objv, "recordType varName script");
-      return TCL_ERROR;
+   if (writer->error != 0) {
+      return CXChildVisit_Break;
    }
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[recordType_ix], &type);
-   if (status != TCL_OK) {
-      return status;
+   if (! isCursorInScope(&writer->scope, cursor)) {
+      return CXChildVisit_Continue;
    }
 
-   Tcl_Obj **varNames = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *));
-   varNames[0] = objv[varName_ix];
+   int index = writer->count++;
 
-   VisitInfo visitInfo = {
-      .interp        = interp,
-      .variableNames = varNames,
-      .numVariables  = 1,
-      .scriptObj     = objv[script_ix],
-      .returnCode    = TCL_OK,
-   };
+   CXFile   file;
+   unsigned offset;
+   clang_getExpansionLocation(clang_getCursorLocation(cursor),
+                              &file, NULL, NULL, &offset);
 
-   clang_Type_visitFields(type, foreachFieldHelper, &visitInfo);
+   if (writer->format == exportFormatJsonl) {
+      writeExportJsonNode(writer, index, cursor, file, offset);
+   } else {
+      unsigned char record[exportRecordSize];
+      putUint32(record,      clang_getCursorKind(cursor));
+      putUint32(record + 4,  (uint32_t)writer->parent);
+      putUint32(record + 8,
+                getExportStringIdOfCXString(writer,
+                                            clang_getCursorSpelling(cursor)));
+      putUint32(record + 12,
+                getExportStringIdOfCXString(writer,
+                                            clang_getCursorUSR(cursor)));
+      putUint32(record + 16, getExportFileId(writer, file));
+      putUint32(record + 20, offset);
+      writeExport(writer, record, sizeof record);
+   }
 
-   Tcl_Free((void *)varNames);
+   // Recurse by ourselves to keep track of the parent index.
+   int parentIndex = writer->parent;
+   writer->parent  = index;
+   clang_visitChildren(cursor, exportHelper, writer);
+   writer->parent  = parentIndex;
 
-   return visitInfo.returnCode;
+   return writer->error != 0 ? CXChildVisit_Break : CXChildVisit_Continue;
 }
-#endif
-
-//--------------------------------- type functionTypeCallingConvention command
 
-static Tcl_Obj *callingConvValues;
-static Tcl_Obj *callingConvNames;
+static void writeExportPadding(ExportWriter *writer, uint64_t size)
+{
+   static const unsigned char zeros[8];
+   writeExport(writer, zeros, (8 - size % 8) % 8);
+}
 
-static void createCallingConvTable(void)
+// Write the string table and the trailer of the binary format.
+static void writeExportStrings(ExportWriter *writer)
 {
-   static NameValuePair table[] = {
-      { "Default",
-        CXCallingConv_Default },
-      { "C",
-        CXCallingConv_C },
-      { "X86StdCall",
-        CXCallingConv_X86StdCall },
-      { "X86FastCall",
-        CXCallingConv_X86FastCall },
-      { "X86ThisCall",
-        CXCallingConv_X86ThisCall },
-      { "X86Pascal",
-        CXCallingConv_X86Pascal },
-      { "AAPCS",
-        CXCallingConv_AAPCS },
-      { "AAPCS_VFP",
-        CXCallingConv_AAPCS_VFP },
-#if CINDEX_VERSION_MINOR >= 36
-      { "X86RegCall",
-        CXCallingConv_X86RegCall },
-#elif CINDEX_VERSION_MINOR >= 30
-      { "Unused", 8},
-#else
-      { "PnaclCall",
-        CXCallingConv_PnaclCall },
-#endif
-      { "IntelOclBicc",
-        CXCallingConv_IntelOclBicc },
-      { "X86_64Win64",
-        CXCallingConv_X86_64Win64 },
-      { "X86_64SysV",
-        CXCallingConv_X86_64SysV },
-#if CINDEX_VERSION_MINOR >= 30
-      { "X86VectorCall",
-        CXCallingConv_X86VectorCall },
-#endif
-#if CINDEX_VERSION_MINOR >= 34
-      { "Swift",
-        CXCallingConv_Swift },
-#endif
-#if CINDEX_VERSION_MINOR >= 35
-      { "PreserveMost",
-        CXCallingConv_PreserveMost },
-      { "PreserveAll",
-        CXCallingConv_PreserveAll },
-#endif
-      { "Invalid",
-        CXCallingConv_Invalid },
-      { "Unexposed",
-        CXCallingConv_Unexposed },
-      { NULL }
-   };
+   uint64_t blobPos  = exportHeaderSize
+      + (uint64_t)writer->count * exportRecordSize;
+   uint64_t blobSize = Tcl_DStringLength(&writer->strings);
 
-   createNameValueTable(&callingConvNames, &callingConvValues, table);
+   writeExport(writer, Tcl_DStringValue(&writer->strings), blobSize);
+   writeExportPadding(writer, blobSize);
 
-   Tcl_IncrRefCount(callingConvNames);
-   Tcl_IncrRefCount(callingConvValues);
-}
+   uint64_t offsetsPos = blobPos + (blobSize + 7) / 8 * 8;
+   for (int i = 0; i <= writer->numStrings; ++i) {
+      unsigned char offset[4];
+      putUint32(offset, i < writer->numStrings
+                ? writer->stringOffsets[i] : (uint32_t)blobSize);
+      writeExport(writer, offset, sizeof offset);
+   }
+   writeExportPadding(writer, (writer->numStrings + 1) * 4);
 
-#if CINDEX_VERSION_MINOR >= 33
-//-------------------------------------------------- type objCEncoding command
+   unsigned char trailer[exportTrailerSize];
+   putUint64(trailer,      writer->count);
+   putUint64(trailer + 8,  writer->numStrings);
+   putUint64(trailer + 16, blobPos);
+   putUint64(trailer + 24, offsetsPos);
+   memcpy(trailer + 32, exportMagic, sizeof exportMagic);
+   writeExport(writer, trailer, sizeof trailer);
+}
 
-static int typeObjCEncodingObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+static int tuExportObjCmd(ClientData     clientData,
+                          Tcl_Interp    *interp,
+                          int            objc,
+                          Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      type_ix,
-      nargs
+      channel_ix,
+      optional_ix
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, 0, objv, "type");
+   static const char *options[] = {
+      "-format",
+      NULL
+   };
+
+   static const char *formats[] = {
+      "binary",
+      "jsonl",
+      NULL
+   };
+
+   if (objc < optional_ix) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                       "channel ?-format binary|jsonl? ?-files files? "
+                       "?-mainFileOnly? ?-excludeSystemHeaders?");
       return TCL_ERROR;
    }
 
-   CXType cxtype;
-   int status = getTypeFromObj(interp, objv[type_ix], &cxtype);
-   if (status != TCL_OK) {
-      return status;
+   int         mode;
+   const char *channelName = Tcl_GetStringFromObj(objv[channel_ix], NULL);
+   Tcl_Channel channel     = Tcl_GetChannel(interp, channelName, &mode);
+   if (channel == NULL) {
+      return TCL_ERROR;
    }
 
-   Tcl_Obj    *resultObj = NULL;
-   if (CXType_Invalid == cxtype.kind) {
-      resultObj = Tcl_NewObj();
-   } else {
-      CXString objcencoding = clang_Type_getObjCEncoding(cxtype);
-      resultObj = convertCXStringToObj(objcencoding);
+   if ((mode & TCL_WRITABLE) == 0) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("channel \"%s\" wasn't opened for "
+                                     "writing", channelName));
+      return TCL_ERROR;
    }
-   Tcl_SetObjResult(interp, resultObj);
 
-   return TCL_OK;
-}
+   TUInfo      *info = (TUInfo *)clientData;
+   CursorScope  scope;
+   initCursorScope(&scope);
 
-#endif
-//------------------------------------------------------ type offsetof command
+   int format = exportFormatBinary;
+   for (int i = optional_ix; i < objc; ++i) {
+      int status = parseCursorScopeOption(interp, &scope,
+                                          info->translationUnit, options,
+                                          objc, objv, &i);
+      if (status == TCL_OK) {
+         continue;
+      }
+      if (status != TCL_CONTINUE) {
+         clearCursorScope(&scope);
+         return status;
+      }
 
-static int typeOffsetOfObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
-{
-   enum {
-      command_ix,
-      type_ix,
-      field_ix,
-      nargs
-   };
+      int option;
+      status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                   "option", 0, &option);
+      if (status == TCL_OK && objc <= i + 1) {
+         Tcl_SetObjResult(interp,
+                          Tcl_NewStringObj("-format is not followed by a "
+                                           "format", -1));
+         status = TCL_ERROR;
+      }
+
+      if (status == TCL_OK) {
+         status = Tcl_GetIndexFromObj(interp, objv[++i], formats,
+                                      "format", 0, &format);
+      }
+
+      if (status != TCL_OK) {
+         clearCursorScope(&scope);
+         return status;
+      }
+   }
+
+   // Our buffer is written with Tcl_WriteRaw, bypassing the channel's
+   // buffer, encoding and translation.
+   if (Tcl_Flush(channel) != TCL_OK) {
+      clearCursorScope(&scope);
+      goto write_error;
+   }
+
+   ExportWriter *writer = (ExportWriter *)Tcl_Alloc(sizeof *writer);
+   writer->tuInfo        = info;
+   writer->channel       = channel;
+   writer->format        = format;
+   writer->scope         = scope;
+   writer->used          = 0;
+   writer->error         = 0;
+   writer->stringOffsets = NULL;
+   writer->numStrings    = 0;
+   writer->capacity      = 0;
+   writer->count         = 0;
+   writer->parent        = -1;
+   Tcl_InitHashTable(&writer->stringIds, TCL_STRING_KEYS);
+   Tcl_InitHashTable(&writer->fileIds, TCL_ONE_WORD_KEYS);
+   Tcl_DStringInit(&writer->strings);
+
+   if (format == exportFormatBinary) {
+      unsigned char header[exportHeaderSize];
+      memcpy(header, exportMagic, sizeof exportMagic);
+      putUint32(header + 8,  exportRecordSize);
+      putUint32(header + 12, 0);
+      writeExport(writer, header, sizeof header);
+   }
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, 1, objv, "type field");
-      return TCL_ERROR;
+   CXCursor root = clang_getTranslationUnitCursor(info->translationUnit);
+   clang_visitChildren(root, exportHelper, writer);
+
+   if (format == exportFormatBinary) {
+      writeExportStrings(writer);
    }
+   flushExport(writer);
 
-   CXType cxtype;
-   int status = getTypeFromObj(interp, objv[type_ix], &cxtype);
-   if (status != TCL_OK) {
-      return status;
+   int error = writer->error;
+   int count = writer->count;
+
+   Tcl_DeleteHashTable(&writer->stringIds);
+   Tcl_DeleteHashTable(&writer->fileIds);
+   Tcl_DStringFree(&writer->strings);
+   clearCursorScope(&writer->scope);
+   Tcl_Free((char *)writer->stringOffsets);
+   Tcl_Free((char *)writer);
+
+   if (error != 0) {
+      Tcl_SetErrno(error);
+      goto write_error;
    }
 
-   const char *field     = Tcl_GetStringFromObj(objv[field_ix], NULL);
-   long long   result    = clang_Type_getOffsetOf(cxtype, field);
-   Tcl_Obj    *resultObj = newLayoutLongLongObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   Tcl_SetObjResult(interp, Tcl_NewIntObj(count));
 
    return TCL_OK;
+
+ write_error:
+   Tcl_SetObjResult(interp,
+                    Tcl_ObjPrintf("error writing \"%s\": %s",
+                                  channelName, Tcl_PosixError(interp)));
+   return TCL_ERROR;
 }
 
-//-------------------------------------------------------- type -> int command
+//-------------------------- translation unit instance's fileNameCache command
 
-static int typeToIntObjCmd(ClientData     clientData,
-                           Tcl_Interp    *interp,
-                           int            objc,
-                           Tcl_Obj *const objv[])
+static int tuFileNameCacheObjCmd(ClientData     clientData,
+                                 Tcl_Interp    *interp,
+                                 int            objc,
+                                 Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      type_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
       return TCL_ERROR;
    }
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[type_ix], &type);
-   if (status != TCL_OK) {
-      return status;
-   }
+   TUInfo *info = (TUInfo *)clientData;
 
-   int      result    = ((int (*)(CXType))clientData)(type);
-   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   Tcl_Obj *elms[] = {
+      Tcl_NewStringObj("entries", -1),
+      Tcl_NewIntObj(info->fileNames.numEntries),
+      Tcl_NewStringObj("hits", -1),
+      Tcl_NewWideIntObj(info->fileNameHits),
+      Tcl_NewStringObj("misses", -1),
+      Tcl_NewWideIntObj(info->fileNameMisses),
+   };
+
+   Tcl_SetObjResult(interp,
+                    Tcl_NewListObj(sizeof elms / sizeof elms[0], elms));
 
    return TCL_OK;
 }
 
-//------------------------------------------------------- type -> bool command
+//-------------------------- translation unit instance's reparseStatus command
 
-static int typeToBoolObjCmd(ClientData     clientData,
-                            Tcl_Interp    *interp,
-                            int            objc,
-                            Tcl_Obj *const objv[])
+/** Report where the background reparse of a translation unit is: none,
+ * running, or held until the traversals of its AST are done.
+ */
+static int tuReparseStatusObjCmd(ClientData     clientData,
+                                 Tcl_Interp    *interp,
+                                 int            objc,
+                                 Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      type_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
       return TCL_ERROR;
    }
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[type_ix], &type);
-   if (status != TCL_OK) {
-      return status;
+   TUInfo     *info   = (TUInfo *)clientData;
+   const char *status = "none";
+   if (info->reparse != NULL) {
+      status = info->deferredParse == info->reparse ? "held" : "running";
    }
 
-   int      result    = ((unsigned (*)(CXType))clientData)(type) != 0;
-   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   Tcl_SetObjResult(interp, Tcl_NewStringObj(status, -1));
 
    return TCL_OK;
 }
 
-//-------------------------------------------------- type -> long long command
+//------------------------------------------------- tuInclusionsHelper command
 
-static int typeToLongLongObjCmd(ClientData     clientData,
-                                Tcl_Interp    *interp,
-                                int            objc,
-                                Tcl_Obj *const objv[])
+typedef struct InclusionsInfo {
+   unsigned    maxDepth;        /* Don't eval after this depth. */
+   TUInfo     *tuInfo;          /* The TU the locations belong to. */
+} InclusionsInfo;
+
+static void tuInclusionsHelper(CXFile            includedFile,
+                               CXSourceLocation *inclusionStack,
+                               unsigned          depth,
+                               CXClientData      clientData)
 {
-   enum {
-      command_ix,
-      type_ix,
-      nargs
-   };
+   int status = TCL_OK;
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
-      return TCL_ERROR;
+   struct VisitInfo *visitInfo = (VisitInfo *)clientData;
+   struct InclusionsInfo *inclusionsInfo = (InclusionsInfo *)visitInfo->clientData;
+
+   /*
+    * Return value does not drive the recursion, as is the case with
+    * clang_visitChildren.  Use visitInfo to keep recursion state.
+    */
+   switch (visitInfo->returnCode) {
+   case TCL_OK:
+   case TCL_RECURSE:
+      /* Evaluate the script */
+      break;
+
+   case TCL_CONTINUE:
+      if(depth > inclusionsInfo->maxDepth) {
+         /* Do not recurse deeper than maxDepth. */
+         return;
+      } else if(depth <= inclusionsInfo->maxDepth) {
+         /* Keep recursing normally once out of the subtree. */
+         inclusionsInfo->maxDepth = 0;
+         visitInfo->returnCode = TCL_OK;
+      }
+      break;
+
+   default:
+      /* Ignore till the end for TCL_BREAK, TCL_ERROR, etc. */
+      return;
    }
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[type_ix], &type);
-   if (status != TCL_OK) {
-      return status;
+
+   Tcl_Obj *filenameVarName = visitInfo->variableNames[0];
+   Tcl_Obj *stackVarName = visitInfo->variableNames[1];
+   Tcl_Obj *filenameObj = NULL;
+   Tcl_Obj *stackObj = NULL;
+
+   /* File name. */
+   CXString filename = clang_getFileName(includedFile);
+   filenameObj = convertCXStringToObj(filename);
+   Tcl_IncrRefCount(filenameObj);
+   if (Tcl_ObjSetVar2(visitInfo->interp, filenameVarName,
+                      NULL, filenameObj, TCL_LEAVE_ERR_MSG) == NULL) {
+      status = TCL_ERROR;
+      goto cleanup;
    }
 
-   long long  result    = ((long long (*)(CXType))clientData)(type);
-   Tcl_Obj   *resultObj = newIntmaxObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   /* Stack.  Grows to the right (lappend).*/
+   Tcl_Obj **elms = (Tcl_Obj **)Tcl_Alloc(depth * sizeof(Tcl_Obj *));
+   for (int i = 0; i < depth; i++) {
+      elms[depth - i - 1]
+         = newLocationObjForTU(inclusionsInfo->tuInfo, inclusionStack[i]);
+   }
+   stackObj = Tcl_NewListObj(depth, elms);
+   Tcl_Free((char *)elms);
+   Tcl_IncrRefCount(stackObj);
+   if (Tcl_ObjSetVar2(visitInfo->interp, stackVarName,
+                      NULL, stackObj, TCL_LEAVE_ERR_MSG) == NULL) {
+      status = TCL_ERROR;
+      goto cleanup;
+   }
 
-   return TCL_OK;
+   status = Tcl_EvalObjEx(visitInfo->interp, visitInfo->scriptObj, 0);
+
+cleanup:
+   if (filenameObj) {
+      Tcl_DecrRefCount(filenameObj);
+   }
+   if (stackObj) {
+      Tcl_DecrRefCount(stackObj);
+   }
+
+   switch (status) {
+   case TCL_OK:
+   case TCL_RECURSE:
+      visitInfo->returnCode = status;
+      break;
+   case TCL_CONTINUE:
+      inclusionsInfo->maxDepth = depth;
+      visitInfo->returnCode = TCL_CONTINUE;
+      break;
+   case TCL_BREAK:
+      visitInfo->returnCode = TCL_BREAK;
+      break;
+   default:
+      visitInfo->returnCode = status;
+   }
+   return;
 }
 
-//----------------------------------------------------- type -> string command
+//----------------------------- translation unit instance's inclusions command
 
-static int typeToStringObjCmd(ClientData     clientData,
+static int tuInclusionsObjCmd(ClientData     clientData,
                               Tcl_Interp    *interp,
                               int            objc,
                               Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      type_ix,
+      variableNames_ix,
+      script_ix,
       nargs
    };
 
+   Tcl_Obj *varNamesObj = NULL;
+   int status = TCL_OK;
+
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
-      return TCL_ERROR;
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "{fileVarName filestackVarName} script");
+      status = TCL_ERROR;
+      goto cleanup;
    }
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   TUInfo *info = (TUInfo *)clientData;
+
+   int       numVars = 0;
+   Tcl_Obj **varNames = NULL;
+   varNamesObj = Tcl_DuplicateObj(objv[variableNames_ix]);
+   Tcl_IncrRefCount(varNamesObj);
+   status = Tcl_ListObjGetElements(interp, varNamesObj, &numVars, &varNames);
    if (status != TCL_OK) {
-      return status;
+      goto cleanup;
+   } else if (numVars != 2) {
+      Tcl_SetObjResult(interp, Tcl_NewStringObj("invalid loop variables: must be fileVarName filestackVarName", -1));
+      status = TCL_ERROR;
+      goto cleanup;
    }
 
-   CXString (*proc)(CXType) = (CXString (*)(CXType))clientData;
-   CXString    result       = proc(type);
-   const char *resultCstr   = clang_getCString(result);
-   Tcl_Obj    *resultObj    = Tcl_NewStringObj(resultCstr, -1);
-   Tcl_SetObjResult(interp, resultObj);
-   clang_disposeString(result);
+   InclusionsInfo inclusionsInfo = {
+      .maxDepth         = 0,
+      .tuInfo           = info,
+   };
 
-   return TCL_OK;
-}
+   VisitInfo visitInfo = {
+      .interp           = interp,
+      .variableNames    = varNames,
+      .numVariables     = numVars,
+      .scriptObj        = objv[script_ix],
+      .returnCode       = TCL_OK,
+      .clientData = (void *)&inclusionsInfo
+   };
 
-//------------------------------------------------------- type -> enum command
+   clang_getInclusions(info->translationUnit, tuInclusionsHelper, &visitInfo);
 
-typedef int (*TypeToEnumProc)(CXType);
+   /* Convert traversal-related return codes to TCL_OK. */
+   switch (visitInfo.returnCode) {
+   case TCL_OK:
+   case TCL_CONTINUE:
+   case TCL_RECURSE:
+   case TCL_BREAK:
+      status = TCL_OK;
+      break;
+   default:
+      /* Keep the interpreter's result */
+      status = visitInfo.returnCode;
+   }
 
-typedef struct TypeToEnumInfo
-{
-   EnumConsts     *labels;
-   TypeToEnumProc  proc;
-} TypeToEnumInfo;
+cleanup:
+   if (varNamesObj) {
+      Tcl_DecrRefCount(varNamesObj);
+   }
 
-static int typeToEnumObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+   return status;
+}
+
+//---------------------------------- translation unit instance's index command
+
+static int tuIndexObjCmd(ClientData     clientData,
+                         Tcl_Interp    *interp,
+                         int            objc,
+                         Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      type_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
       return TCL_ERROR;
    }
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[type_ix], &type);
-   if (status != TCL_OK) {
-      return status;
-   }
-
-   TypeToEnumInfo *info = (TypeToEnumInfo *)clientData;
+   TUInfo *info = (TUInfo *)clientData;
 
-   int      result    = (info->proc)(type);
-   Tcl_Obj *resultObj = getEnum(info->labels, result);
-   Tcl_SetObjResult(interp, resultObj);
+   Tcl_Obj *tuObj = Tcl_NewObj();
+   Tcl_GetCommandFullName(interp, info->parent->cmd, tuObj);
+   Tcl_SetObjResult(interp, tuObj);
 
    return TCL_OK;
 }
 
-//------------------------------------------------ type -> named value command
-
-typedef unsigned (*TypeToNamedValueProc)(CXType);
-
-typedef struct TypeToNamedValueInfo
-{
-   Tcl_Obj              *names;
-   TypeToNamedValueProc  proc;
-} TypeToNamedValueInfo;
+//--------------- translation unit instance's isMultipleIncludeGuarded command
 
-static int typeToNamedValueObjCmd(ClientData     clientData,
-                                  Tcl_Interp    *interp,
-                                  int            objc,
-                                  Tcl_Obj *const objv[])
+static int tuIsMultipleIncludeGuardedObjCmd(ClientData     clientData,
+                                            Tcl_Interp    *interp,
+                                            int            objc,
+                                            Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      type_ix,
+      filename_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename");
       return TCL_ERROR;
    }
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   TUInfo *info = (TUInfo *)clientData;
+
+   CXFile file;
+   int status = getFileFromObj(interp, info->translationUnit,
+                               objv[filename_ix], &file);
    if (status != TCL_OK) {
       return status;
    }
 
-   TypeToNamedValueInfo *info = (TypeToNamedValueInfo *)clientData;
+   unsigned result
+      = clang_isFileMultipleIncludeGuarded(info->translationUnit, file);
+   Tcl_Obj *resultObj = Tcl_NewLongObj(result);
+   Tcl_SetObjResult(interp, resultObj);
 
-   unsigned  value    = info->proc(type);
-   Tcl_Obj  *valueObj = Tcl_NewLongObj(value);
-   Tcl_IncrRefCount(valueObj);
+   return TCL_OK;
+}
 
-   Tcl_Obj *resultObj;
-   status = Tcl_DictObjGet(NULL, info->names, valueObj, &resultObj);
-   Tcl_DecrRefCount(valueObj);
-   if (status != TCL_OK) {
-      Tcl_Panic("%s: unknown value: %d", __func__, value);
+//------------------------------ translation unit instance's lineTable command
+
+#if CINDEX_VERSION_MINOR >= 35
+/** Return the line table of file, building it if necessary.  Return NULL
+ * if libclang doesn't have the contents of the file.
+ */
+static LineTable *getLineTable(TUInfo *info, CXFile file)
+{
+   Tcl_HashEntry *entry = Tcl_FindHashEntry(&info->lineTables,
+                                            (const char *)file);
+   if (entry != NULL) {
+      return (LineTable *)Tcl_GetHashValue(entry);
    }
 
-   Tcl_SetObjResult(interp, resultObj);
+   size_t      size;
+   const char *contents = clang_getFileContents(info->translationUnit,
+                                                file, &size);
+   if (contents == NULL) {
+      return NULL;
+   }
 
-   return TCL_OK;
+   int numLines = 1;
+   for (const char *p = contents, *end = contents + size;
+        (p = memchr(p, '\n', end - p)) != NULL;
+        ++p) {
+      ++numLines;
+   }
+
+   LineTable *table  = (LineTable *)Tcl_Alloc(sizeof *table);
+   table->numLines   = numLines;
+   table->size       = size;
+   table->lineStarts = (unsigned *)
+      Tcl_Alloc(numLines * sizeof table->lineStarts[0]);
+
+   int line = 0;
+   table->lineStarts[line++] = 0;
+   for (size_t i = 0; i < size; ++i) {
+      if (contents[i] == '\n') {
+         table->lineStarts[line++] = i + 1;
+      }
+   }
+
+   int created;
+   entry = Tcl_CreateHashEntry(&info->lineTables, (const char *)file,
+                               &created);
+   Tcl_SetHashValue(entry, table);
+
+   return table;
 }
 
-//----------------------------------------------------- type -> cursor command
+// Return the 0-origin line containing offset.
+static int findLineOfOffset(const LineTable *table, unsigned offset)
+{
+   int lo = 0;
+   int hi = table->numLines;
+   while (hi - lo > 1) {
+      int mid = lo + (hi - lo) / 2;
+      if (table->lineStarts[mid] <= offset) {
+         lo = mid;
+      } else {
+         hi = mid;
+      }
+   }
 
-static int typeToCursorObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+   return lo;
+}
+
+static int tuLineTableObjCmd(ClientData     clientData,
+                             Tcl_Interp    *interp,
+                             int            objc,
+                             Tcl_Obj *const objv[])
 {
+   TUInfo *info = (TUInfo *)clientData;
+
    enum {
       command_ix,
-      type_ix,
+      filename_ix,
+      option_ix,
+      list_ix,
       nargs
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
+   static const char *options[] = {
+      "-offsets",
+      "-positions",
+      NULL,
+   };
+
+   enum {
+      option_offsets,
+      option_positions,
+   };
+
+   if (objc != filename_ix + 1 && objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                       "filename ?-offsets|-positions list?");
       return TCL_ERROR;
    }
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[type_ix], &type);
+   int optionNumber = -1;
+   if (objc == nargs) {
+      int status = Tcl_GetIndexFromObj(interp, objv[option_ix], options,
+                                       "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         return status;
+      }
+   }
+
+   const char *filename = Tcl_GetStringFromObj(objv[filename_ix], NULL);
+   CXFile      file     = clang_getFile(info->translationUnit, filename);
+   LineTable  *table    = file != NULL ? getLineTable(info, file) : NULL;
+   if (table == NULL) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("file \"%s\" is not a part of "
+                                     "the translation unit",
+                                     filename));
+      return TCL_ERROR;
+   }
+
+   if (optionNumber < 0) {
+      Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+      for (int i = 0; i < table->numLines; ++i) {
+         Tcl_ListObjAppendElement(NULL, resultObj,
+                                  Tcl_NewLongObj(table->lineStarts[i]));
+      }
+      Tcl_SetObjResult(interp, resultObj);
+
+      return TCL_OK;
+   }
+
+   int       n;
+   Tcl_Obj **elms;
+   int status = Tcl_ListObjGetElements(interp, objv[list_ix], &n, &elms);
    if (status != TCL_OK) {
       return status;
    }
 
-   CXCursor  result    = ((CXCursor (*)(CXType))clientData)(type);
-   Tcl_Obj  *resultObj = newCursorObj(result);
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+
+   for (int i = 0; i < n; ++i) {
+      if (optionNumber == option_offsets) {
+         unsigned offset;
+         status = getUnsignedFromObj(interp, elms[i], &offset);
+         if (status != TCL_OK) {
+            goto error;
+         }
+         if (table->size < offset) {
+            Tcl_SetObjResult(interp,
+                             Tcl_ObjPrintf("offset %u is beyond the end of "
+                                           "the file", offset));
+            goto error;
+         }
+
+         int      line = findLineOfOffset(table, offset);
+         Tcl_Obj *pair[2];
+         pair[0] = Tcl_NewLongObj(line + 1);
+         pair[1] = Tcl_NewLongObj(offset - table->lineStarts[line] + 1);
+         Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewListObj(2, pair));
+         continue;
+      }
+
+      int       pairc;
+      Tcl_Obj **pairv;
+      unsigned  line;
+      unsigned  column;
+      status = Tcl_ListObjGetElements(interp, elms[i], &pairc, &pairv);
+      if (status != TCL_OK) {
+         goto error;
+      }
+      if (pairc != 2) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("position \"%s\" is not a "
+                                        "{line column} pair",
+                                        Tcl_GetStringFromObj(elms[i], NULL)));
+         goto error;
+      }
+      status = getUnsignedFromObj(interp, pairv[0], &line);
+      if (status == TCL_OK) {
+         status = getUnsignedFromObj(interp, pairv[1], &column);
+      }
+      if (status != TCL_OK) {
+         goto error;
+      }
+
+      // A column must be within its line, newline included.  The end of
+      // the file is a valid position, as it is a valid offset.
+      int valid = 0 < line && line <= (unsigned)table->numLines
+         && 0 < column;
+      if (valid) {
+         unsigned start  = table->lineStarts[line - 1];
+         unsigned length = line < (unsigned)table->numLines
+            ? table->lineStarts[line] - start
+            : table->size - start;
+         valid = line < (unsigned)table->numLines
+            ? column - 1 < length
+            : column - 1 <= length;
+      }
+      if (!valid) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("position \"%s\" is not in the file",
+                                        Tcl_GetStringFromObj(elms[i], NULL)));
+         goto error;
+      }
+
+      unsigned offset = table->lineStarts[line - 1] + column - 1;
+      Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewLongObj(offset));
+   }
+
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
+
+ error:
+   Tcl_DecrRefCount(resultObj);
+
+   return TCL_ERROR;
 }
+#endif
 
-//------------------------------------------------------- type -> type command
+//------------------------------- translation unit instance's location command
 
-static int typeToTypeObjCmd(ClientData     clientData,
+static int tuLocationObjCmd(ClientData     clientData,
                             Tcl_Interp    *interp,
                             int            objc,
                             Tcl_Obj *const objv[])
 {
+   TUInfo *info = (TUInfo *)clientData;
+
    enum {
       command_ix,
-      type_ix,
-      nargs
+      option_ix
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
-      return TCL_ERROR;
-   }
+   static const char *options[] = {
+      "-file",
+      "-line",
+      "-column",
+      "-offset",
+      NULL,
+   };
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[type_ix], &type);
-   if (status != TCL_OK) {
-      return status;
-   }
+   enum {
+      option_file,
+      option_line,
+      option_column,
+      option_offset,
+   };
 
-   CXType   result    = ((CXType (*)(CXType))clientData)(type);
-   Tcl_Obj *resultObj = newTypeObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   unsigned options_found = 0;
+   unsigned line          = 0;
+   unsigned column        = 0;
+   unsigned offset        = 0;
+   CXFile   file          = NULL;
 
-   return TCL_OK;
-}
+   for (int i = option_ix; i < objc; ++i) {
+      int optionNumber;
+      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                       "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         return status;
+      }
 
-//--------------------------------------------- type, unsigned -> type command
+      if ((options_found & (1 << optionNumber)) != 0) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("%s is specified more than once.",
+                                        Tcl_GetStringFromObj(objv[i], NULL)));
+         return TCL_ERROR;
+      }
 
-static int typeUnsignedToTypeObjCmd(ClientData     clientData,
-                                    Tcl_Interp    *interp,
-                                    int            objc,
-                                    Tcl_Obj *const objv[])
-{
-   enum {
-      command_ix,
-      type_ix,
-      number_ix,
-      nargs
-   };
+      switch (optionNumber) {
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type unsigned");
-      return TCL_ERROR;
-   }
+      case option_file:
+         if (objc <= i + 1) {
+            Tcl_SetObjResult(interp,
+                             Tcl_NewStringObj("-file is not followed by a "
+                                              "filename",
+                                              -1));
+            return TCL_ERROR;
+         }
+
+         const char *filename = Tcl_GetStringFromObj(objv[i + 1], NULL);
+         file = clang_getFile(info->translationUnit, filename);
+         if (file == NULL) {
+            goto invalid_location;
+         }
+
+         break;
+
+      case option_line:
+      case option_column:
+         if ((options_found & (1 << option_offset)) != 0) {
+            goto invalid_form;
+         }
+
+         if (objc <= i + 1) {
+            const char *option = Tcl_GetStringFromObj(objv[i], NULL);
+            Tcl_SetObjResult(interp,
+                             Tcl_ObjPrintf("%s is not followed by a %s number",
+                                           option, option + 1));
+            return TCL_ERROR;
+         }
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[type_ix], &type);
-   if (status != TCL_OK) {
-      return status;
-   }
+         status = getUnsignedFromObj(interp, objv[i + 1],
+                                     optionNumber == option_line
+                                     ? &line
+                                     : &column);
+         if (status != TCL_OK) {
+            return status;
+         }
 
-   unsigned number;
-   status = getUnsignedFromObj(interp, objv[number_ix], &number);
-   if (status != TCL_OK) {
-      return status;
-   }
+         break;
 
-   typedef CXType (*ProcType)(CXType, unsigned);
+      case option_offset:
+         if ((options_found & ((1 << option_line) | (1 << option_column)))
+             != 0) {
+            goto invalid_form;
+         }
 
-   CXType   result    = ((ProcType)clientData)(type, number);
-   Tcl_Obj *resultObj = newTypeObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+         if (objc <= i + 1) {
+            Tcl_SetObjResult(interp,
+                             Tcl_NewStringObj("-offset is not "
+                                              "followed by an offset",
+                                              -1));
+            return TCL_ERROR;
+         }
+         
+         status = getUnsignedFromObj(interp, objv[i + 1], &offset);
+         if (status != TCL_OK) {
+            return status;
+         }
 
-   return TCL_OK;
-}
+         break;
 
-//------------------------------------------- type -> layout long long command
+      default:
+         Tcl_Panic("unknown option number");
 
-static int typeToLayoutLongLongObjCmd(ClientData     clientData,
-                                      Tcl_Interp    *interp,
-                                      int            objc,
-                                      Tcl_Obj *const objv[])
-{
-   enum {
-      command_ix,
-      type_ix,
-      nargs
-   };
+      }
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
-      return TCL_ERROR;
+      options_found |= 1 << optionNumber;
    }
 
-   CXType cxtype;
-   int status = getTypeFromObj(interp, objv[type_ix], &cxtype);
-   if (status != TCL_OK) {
-      return status;
-   }
+   CXSourceLocation location;
+   unsigned line_and_column_form = (1 << option_file)
+      | (1 << option_line)
+      | (1 << option_column);
+   unsigned offset_form = (1 << option_file) | (1 << option_offset);
+   if ((options_found & line_and_column_form) == line_and_column_form) {
 
-   long long  result    = ((long long (*)(CXType))clientData)(cxtype);
-   Tcl_Obj   *resultObj = newLayoutLongLongObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+      location = clang_getLocation(info->translationUnit,
+                                   file, line, column);
 
-   return TCL_OK;
-}
+   } else if ((options_found & offset_form) == offset_form) {
 
-//-------------------------------------------------- type -> type list command
+      location = clang_getLocationForOffset(info->translationUnit,
+                                            file, offset);
 
-typedef struct TypeToTypeListInfo {
-    int (*getNum)(CXType);
-    CXType (*getIndex)(CXType, unsigned);
-} TypeToTypeListInfo;
+   } else {
 
-static int typeToTypeListObjCmd(ClientData     clientData,
-                                Tcl_Interp    *interp,
-                                int            objc,
-                                Tcl_Obj *const objv[]) {
-   enum {
-      command_ix,
-      type_ix,
-      nargs
-   };
+      goto invalid_form;
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "type");
-      return TCL_ERROR;
    }
 
-   CXType type;
-   int status = getTypeFromObj(interp, objv[type_ix], &type);
-   if (status != TCL_OK) {
-      return status;
+   if (clang_equalLocations(location, clang_getNullLocation())) {
+      goto invalid_location;
    }
 
-   TypeToTypeListInfo *procs = ((TypeToTypeListInfo *)clientData);
-
-   int num = procs->getNum(type);
-   if (num > 0) {
-      Tcl_Obj **results
-         = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *) * num);
-      for (int i = 0; i < num; i++) {
-         results[i] = newTypeObj(procs->getIndex(type, i));
-      }
+   Tcl_Obj *resultObj = newLocationObjForTU(info, location);
+   Tcl_SetObjResult(interp, resultObj);
 
-      Tcl_Obj *resultObj = Tcl_NewListObj(num, results);
-      Tcl_SetObjResult(interp, resultObj);
+   return TCL_OK;
 
-      Tcl_Free((char *)results);
-   } else {
-      Tcl_SetObjResult(interp, Tcl_NewListObj(0, NULL));
-   }
+ invalid_form:
+   Tcl_SetObjResult(interp,
+                    Tcl_NewStringObj("the specified location is not valid.",
+                                     -1));
+   return TCL_ERROR;
 
-   return TCL_OK;
+ invalid_location:
+   Tcl_SetObjResult(interp,
+                    Tcl_NewStringObj("the specified location is "
+                                     "not a part of the translation unit.",
+                                     -1));
+   return TCL_ERROR;
 }
 
-//------------------------------------------------------ cursor::equal command
+//----------------------- translation unit instance's modificationTime command
 
-static int cursorEqualObjCmd(ClientData     clientData,
-                             Tcl_Interp    *interp,
-                             int            objc,
-                             Tcl_Obj *const objv[])
+static int tuModificationTimeObjCmd(ClientData     clientData,
+                                    Tcl_Interp    *interp,
+                                    int            objc,
+                                    Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor1_ix,
-      cursor2_ix,
+      filename_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor1 cursor2");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename");
       return TCL_ERROR;
    }
 
-   CXCursor cursors[2];
-   for (int i = 0; i < 2; ++i) {
-      int status = getCursorFromObj(interp, objv[cursor1_ix + i], &cursors[i]);
-      if (status != TCL_OK) {
-         return status;
-      }
+   TUInfo *info = (TUInfo *)clientData;
+
+   CXFile file;
+   int status = getFileFromObj(interp, info->translationUnit,
+                               objv[filename_ix], &file);
+   if (status != TCL_OK) {
+      return status;
    }
 
-   int      result    = clang_equalCursors(cursors[0], cursors[1]) != 0;
-   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
+   time_t   result    = clang_getFileTime(file);
+   Tcl_Obj *resultObj = newUintmaxObj(result);
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-#if CINDEX_VERSION_MINOR >= 33
-//---------------------------------------------------- cursor evaluate command
+//-------------------------------- translation unit instance's reparse command
 
-static int cursorEvaluateObjCmd(ClientData     clientData,
-                                Tcl_Interp    *interp,
-                                int            objc,
-                                Tcl_Obj *const objv[])
+static struct CXUnsavedFile *createUnsavedFileArray(Tcl_Obj *unsavedFileList)
 {
-   enum {
-      command_ix,
-      cursor_ix,
-      nargs
-   };
-
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
-      return TCL_ERROR;
-   }
+   int       length;
+   Tcl_Obj **unsavedFileListElements;
+   Tcl_ListObjGetElements(NULL, unsavedFileList,
+                          &length, &unsavedFileListElements);
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
-   }
+   int numUnsavedFiles = length >> 1;
 
-   Tcl_Obj *resultObj = NULL;
+   struct CXUnsavedFile *unsavedFiles
+      = (struct CXUnsavedFile *)
+        Tcl_Alloc(numUnsavedFiles * sizeof(struct CXUnsavedFile));
 
-   CXEvalResult evalresult = clang_Cursor_Evaluate(cursor);
+   for (int i = 0; i < numUnsavedFiles; ++i) {
+      unsavedFiles[i].Filename
+         = Tcl_GetStringFromObj(unsavedFileListElements[i * 2], NULL);
 
-   switch (clang_EvalResult_getKind(evalresult)) {
-   case CXEval_Int:
-#if CINDEX_VERSION_MINOR >= 37
-      resultObj = Tcl_NewIntObj(clang_EvalResult_isUnsignedInt(evalresult)
-                                ? clang_EvalResult_getAsUnsigned(evalresult)
-                                : clang_EvalResult_getAsLongLong(evalresult));
-#else
-      resultObj = Tcl_NewIntObj(clang_EvalResult_getAsInt(evalresult));
-#endif
-      break;
-   case CXEval_Float:
-      resultObj = Tcl_NewDoubleObj(clang_EvalResult_getAsDouble(evalresult));
-      break;
-   default:
-      resultObj = Tcl_NewStringObj(clang_EvalResult_getAsStr(evalresult), -1);
-      break;
+      int size;
+      unsavedFiles[i].Contents
+         = Tcl_GetStringFromObj(unsavedFileListElements[i * 2 + 1], &size);
+      unsavedFiles[i].Length = size;
    }
 
-   clang_EvalResult_dispose(evalresult);
-
-   Tcl_SetObjResult(interp, resultObj);
-
-   return TCL_OK;
+   return unsavedFiles;
 }
-#endif
-
-//-------------------------------------- cursor::enumConstantDeclValue command
 
-static int cursorEnumConstantDeclValueObjCmd(ClientData     clientData,
-                                             Tcl_Interp    *interp,
-                                             int            objc,
-                                             Tcl_Obj *const objv[])
+static int tuReparseObjCmd(ClientData     clientData,
+                           Tcl_Interp    *interp,
+                           int            objc,
+                           Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
-      nargs
+      options_ix
+   };
+
+   TUInfo *info = (TUInfo *)clientData;
+
+   enum {
+      unsavedFileOption,
+      asyncOption,
+      commandOption
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
-      return TCL_ERROR;
-   }
+   static const char *options[] = {
+      "-unsavedFile",           // -unsavedFile filename contents
+      "-async",
+      "-command",               // -command callback
+      NULL
+   };
+
+   int      numUnsavedFiles = 0;
+   int      async           = 0;
+   Tcl_Obj *commandObj      = NULL;
+   Tcl_Obj *unsavedFileList = Tcl_NewObj();
+   Tcl_IncrRefCount(unsavedFileList);
+
+   for (int i = options_ix; i < objc; ++i) {
+      int optionNumber;
+      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                       "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         Tcl_DecrRefCount(unsavedFileList);
+         return status;
+      }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
+      if (optionNumber == unsavedFileOption) {
+         // -unsavedFile filename contents
+         if (objc <= i + 2) {
+            Tcl_WrongNumArgs(interp, i, objv, "filename contents ...");
+            Tcl_DecrRefCount(unsavedFileList);
+            return TCL_ERROR;
+         }
+         ++numUnsavedFiles;
+         Tcl_ListObjAppendElement(NULL, unsavedFileList, objv[++i]);
+         Tcl_ListObjAppendElement(NULL, unsavedFileList, objv[++i]);
+      } else if (optionNumber == asyncOption) {
+         async = 1;
+      } else if (optionNumber == commandOption) {
+         if (objc <= i + 1) {
+            Tcl_WrongNumArgs(interp, i, objv, "callback ...");
+            Tcl_DecrRefCount(unsavedFileList);
+            return TCL_ERROR;
+         }
+         commandObj = objv[++i];
+      } else {
+         Tcl_Panic("what?!");
+      }
    }
 
-   if (cursor.kind != CXCursor_EnumConstantDecl) {
-      Tcl_SetObjResult
-         (interp,
-          Tcl_NewStringObj("cursor kind must be EnumConstantDecl", -1));
+   if (commandObj != NULL && !async) {
+      Tcl_SetObjResult(interp,
+                       Tcl_NewStringObj("-command requires -async", -1));
+      Tcl_DecrRefCount(unsavedFileList);
       return TCL_ERROR;
    }
 
-   Tcl_Obj *result = NULL;
-
-   CXCursor parent  = clang_getCursorSemanticParent(cursor);
-   CXType   inttype = clang_getEnumDeclIntegerType(parent);
-   switch (inttype.kind) {
+   if (async) {
+      // Parse the translation unit anew in background.  The command keeps
+      // answering from the current AST until the new one replaces it.
+      struct ParseJob *job = copyParseJob(info->parseArgs, unsavedFileList);
+      Tcl_DecrRefCount(unsavedFileList);
+      requestBackgroundReparse(interp, info, commandObj, job);
 
-   case CXType_Bool:
-   case CXType_Char_U:
-   case CXType_UChar:
-   case CXType_Char16:
-   case CXType_Char32:
-   case CXType_UShort:
-   case CXType_UInt:
-   case CXType_ULong:
-   case CXType_ULongLong:
-   case CXType_UInt128: {
-      unsigned long long value
-         = clang_getEnumConstantDeclUnsignedValue(cursor);
-      result = newUintmaxObj(value);
-      break;
+      return TCL_OK;
    }
 
-   case CXType_Char_S:
-   case CXType_SChar:
-   case CXType_WChar:
-   case CXType_Short:
-   case CXType_Int:
-   case CXType_Long:
-   case CXType_LongLong:
-   case CXType_Int128: {
-      long long value = clang_getEnumConstantDeclValue(cursor);
-      result = newIntmaxObj(value);
-      break;
+   // The instance command itself counts as one call running over the
+   // translation unit.  Any other one is still inside libclang.
+   if (info->busyCount > 1) {
+      Tcl_Obj *tuObj = Tcl_NewObj();
+      Tcl_GetCommandFullName(interp, info->cmd, tuObj);
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("translation unit \"%s\" can't be "
+                                     "reparsed while it is being traversed",
+                                     Tcl_GetStringFromObj(tuObj, NULL)));
+      Tcl_DecrRefCount(tuObj);
+      Tcl_DecrRefCount(unsavedFileList);
+      return TCL_ERROR;
    }
 
-   default:
-      Tcl_Panic("clang_getEnumDeclIntegerType returns unexpected type: %d",
-                inttype.kind);
+   // Background reparses requested before would bring back older contents.
+   cancelBackgroundReparses(info);
+
+   // Remember the unsaved files for parsing it anew later.
+   struct ParseJob *parseArgs = copyParseJob(info->parseArgs,
+                                             unsavedFileList);
+   deleteParseJob(info->parseArgs);
+   info->parseArgs = parseArgs;
+
+   int status = TCL_OK;
+   if (info->suspended) {
+      // An evicted translation unit is parsed anew, with the new unsaved
+      // files.
+      status = usePooledTU(interp, info);
+   } else {
+      struct CXUnsavedFile *unsavedFiles =
+         createUnsavedFileArray(unsavedFileList);
+      unsigned flags = clang_defaultReparseOptions(info->translationUnit);
+      if (clang_reparseTranslationUnit(info->translationUnit,
+                                       numUnsavedFiles,
+                                       unsavedFiles, flags) != 0) {
+         Tcl_Obj *tuObj = Tcl_NewObj();
+         Tcl_GetCommandFullName(interp, info->cmd, tuObj);
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("translation unit \"%s\" is not "
+                                        "valid",
+                                        Tcl_GetStringFromObj(tuObj, NULL)));
+         Tcl_DecrRefCount(tuObj);
+         status = TCL_ERROR;
+      }
+      Tcl_Free((char *)unsavedFiles);
    }
+   Tcl_DecrRefCount(unsavedFileList);
 
-   Tcl_SetObjResult(interp, result);
+   // Cursors created before the reparse point into the disposed AST.
+   ++info->generation;
+   info->reparseGeneration = info->generation;
+   clearCursorHandles(info);
+   clearFileNames(info);
+   clearLineTables(info);
+   deleteASTIndex(info);
 
-   return TCL_OK;
+   return status;
 }
 
-//------------------------------------------------------- cursor::null command
+//-------------------------- translation unit instance's resourceUsage command
 
-static int cursorNullObjCmd(ClientData     clientData,
-                            Tcl_Interp    *interp,
-                            int            objc,
-                            Tcl_Obj *const objv[])
+static int tuResourceUsageObjCmd(ClientData     clientData,
+                                 Tcl_Interp    *interp,
+                                 int            objc,
+                                 Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
@@ -2706,2193 +8702,2900 @@ static int cursorNullObjCmd(ClientData     clientData,
       return TCL_ERROR;
    }
 
-   CXCursor  result    = clang_getNullCursor();
-   Tcl_Obj  *resultObj = newCursorObj(result);
-   Tcl_SetObjResult(interp, resultObj);
-
-   return TCL_OK;
-}
-
-//------------------------------------------ cursor overridenCursors command
+   TUInfo *info = (TUInfo *)clientData;
 
-static int cursorOverriddenCursorsObjCmd(ClientData     clientData,
-                                         Tcl_Interp    *interp,
-                                         int            objc,
-                                         Tcl_Obj *const objv[])
-{
-   enum {
-      command_ix,
-      cursor_ix,
-      nargs
-   };
+   CXTUResourceUsage usage = clang_getCXTUResourceUsage(info->translationUnit);
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
-      return TCL_ERROR;
-   }
+   Tcl_Obj **elms
+      = (Tcl_Obj **)Tcl_Alloc(2 * usage.numEntries * sizeof(Tcl_Obj *));
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
+   for (int i = 0; i < usage.numEntries; ++i) {
+      const char *name = clang_getTUResourceUsageName(usage.entries[i].kind);
+      elms[i * 2]      = Tcl_NewStringObj(name, -1);
+      elms[i * 2 + 1]  = newUintmaxObj(usage.entries[i].amount);
    }
 
-   CXCursor *overridden    = NULL;
-   unsigned  numOverridden = 0;
-   clang_getOverriddenCursors(cursor, &overridden, &numOverridden);
-
-   Tcl_Obj **results
-      = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *) * numOverridden);
-   for (int i = 0; i < numOverridden; ++i) {
-      results[i] = newCursorObj(overridden[i]);
-   }
+   Tcl_Obj *resultObj = Tcl_NewListObj(usage.numEntries * 2, elms);
 
-   clang_disposeOverriddenCursors(overridden);
+   Tcl_Free((char *)elms);
+   clang_disposeCXTUResourceUsage(usage);
 
-   Tcl_Obj *resultObj = Tcl_NewListObj(numOverridden, results);
    Tcl_SetObjResult(interp, resultObj);
 
-   Tcl_Free((char *)results);
-
    return TCL_OK;
 }
 
-//-------------------------------------- cursor platformAvailability command
-
-static Tcl_Obj *alwaysDeprecatedTagObj;
-static Tcl_Obj *deprecatedMessageTagObj;
-static Tcl_Obj *alwaysUnavailableTagObj;
-static Tcl_Obj *unavailableMessageTagObj;
-static Tcl_Obj *availabilityTagObj;
-static Tcl_Obj *availabilityPlatformTagObj;
-static Tcl_Obj *availabilityIntroducedTagObj;
-static Tcl_Obj *availabilityDeprecatedTagObj;
-static Tcl_Obj *availabilityObsoletedTagObj;
-static Tcl_Obj *availabilityUnavailableTagObj;
-static Tcl_Obj *availabilityMessageTagObj;
+//----------------------------------- translation unit instance's save command
 
-static int cursorPlatformAvailabilityObjCmd(ClientData     clientData,
-                                            Tcl_Interp    *interp,
-                                            int            objc,
-                                            Tcl_Obj *const objv[])
+static int tuSaveObjCmd(ClientData     clientData,
+                        Tcl_Interp    *interp,
+                        int            objc,
+                        Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
+      filename_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename");
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
-   }
-
-   int availability_size
-      = clang_getCursorPlatformAvailability
-          (cursor, NULL, NULL, NULL, NULL, NULL, 0);
-
-   CXPlatformAvailability *availability
-      = (CXPlatformAvailability *)Tcl_Alloc(sizeof(CXPlatformAvailability)
-                                            * availability_size);
-
-   int      always_deprecated;
-   CXString deprecated_message;
-   int      always_unavailable;
-   CXString unavailable_message;
-   clang_getCursorPlatformAvailability(cursor,
-                                       &always_deprecated,
-                                       &deprecated_message,
-                                       &always_unavailable,
-                                       &unavailable_message,
-                                       availability,
-                                       availability_size);
-
-   enum {
-      always_deprecated_tag_ix,
-      always_deprecated_ix,
-      deprecated_message_tag_ix,
-      deprecated_message_ix,
-      always_unavailable_tag_ix,
-      always_unavailable_ix,
-      unavailable_message_tag_ix,
-      unavailable_message_ix,
-      availability_tag_ix,
-      availability_ix,
-      nelms
-   };
+   TUInfo     *info     = (TUInfo *)clientData;
+   const char *filename = Tcl_GetStringFromObj(objv[filename_ix], NULL);
+   unsigned    flags    = clang_defaultSaveOptions(info->translationUnit);
+   int         status   = clang_saveTranslationUnit(info->translationUnit,
+                                                    filename, flags);
+   switch (status) {
 
-   Tcl_Obj *resultElms[nelms];
+   case CXSaveError_None:
+      break;
 
-   resultElms[always_deprecated_tag_ix]
-      = alwaysDeprecatedTagObj;
-   resultElms[always_deprecated_ix]
-      = Tcl_NewIntObj(always_deprecated);
+   case CXSaveError_Unknown:
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("an unknown error occurred "
+                                     "while attempting to save to \"%s\"",
+                                     filename));
+      return TCL_ERROR;
 
-   resultElms[deprecated_message_tag_ix]
-      = deprecatedMessageTagObj;
-   resultElms[deprecated_message_ix]
-      = convertCXStringToObj(deprecated_message);
+   case CXSaveError_TranslationErrors:
+   {
+      Tcl_Obj *tuObj = Tcl_NewObj();
+      Tcl_GetCommandFullName(interp, info->cmd, tuObj);
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("errors during translation prevented "
+                                     "the attempt to save \"%s\"",
+                                     Tcl_GetStringFromObj(tuObj, NULL)));
+      Tcl_DecrRefCount(tuObj);
+      return TCL_ERROR;
+   }
 
-   resultElms[always_unavailable_tag_ix]
-      = alwaysUnavailableTagObj;
-   resultElms[always_unavailable_ix]
-      = Tcl_NewIntObj(always_unavailable);
+   case CXSaveError_InvalidTU:
+   {
+      Tcl_Obj *tuObj = Tcl_NewObj();
+      Tcl_GetCommandFullName(interp, info->cmd, tuObj);
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("invalid translation unit \"%s\"",
+                                     Tcl_GetStringFromObj(tuObj, NULL)));
+      Tcl_DecrRefCount(tuObj);
+      return TCL_ERROR;
+   }
 
-   resultElms[unavailable_message_tag_ix]
-      = unavailableMessageTagObj;
-   resultElms[unavailable_message_ix]
-      = convertCXStringToObj(unavailable_message);
+   default:
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("unknown error code is returned by "
+                                     "clang_saveTranslationUnit()"));
+      return TCL_ERROR;
+   }
 
-   resultElms[availability_tag_ix]
-      = availabilityTagObj;
-   resultElms[availability_ix]
-      = Tcl_NewObj();
-   for (int i = 0; i < availability_size; ++i) {
-      enum {
-         platform_tag_ix,
-         platform_ix,
-         introduced_tag_ix,
-         introduced_ix,
-         deprecated_tag_ix,
-         deprecated_ix,
-         obsoleted_tag_ix,
-         obsoleted_ix,
-         unavailable_tag_ix,
-         unavailable_ix,
-         message_tag_ix,
-         message_ix,
-         nelms
-      };
+   return TCL_OK;
+}
 
-      Tcl_Obj *elms[nelms];
+#if CINDEX_VERSION_MINOR >= 22
+//-------------------------- translation unit instance's skippedRanges command
 
-      elms[platform_tag_ix]
-         = availabilityPlatformTagObj;
-      elms[platform_ix]
-         = Tcl_NewStringObj(clang_getCString(availability[i].Platform), -1);
+static int tuSkippedRangesObjCmd(ClientData     clientData,
+                                 Tcl_Interp    *interp,
+                                 int            objc,
+                                 Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      filename_ix,
+      nargs
+   };
 
-      elms[introduced_tag_ix]
-         = availabilityIntroducedTagObj;
-      elms[introduced_ix]
-         = newVersionObj(availability[i].Introduced);
+#if CINDEX_VERSION_MINOR >= 36
+   int margs = filename_ix;
+   const char *argspec = "?filename?";
+#else
+   int margs = nargs;
+   const char *argspec = "filename";
+#endif
 
-      elms[deprecated_tag_ix]
-         = availabilityDeprecatedTagObj;
-      elms[deprecated_ix]
-         = newVersionObj(availability[i].Deprecated);
+   if (objc < margs || objc > nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, argspec);
+      return TCL_ERROR;
+   }
 
-      elms[obsoleted_tag_ix]
-         = availabilityObsoletedTagObj;
-      elms[obsoleted_ix]
-         = newVersionObj(availability[i].Obsoleted);
+   Tcl_Obj *resultObj = NULL;
+   int      status    = TCL_OK;
 
-      elms[unavailable_tag_ix]
-         = availabilityUnavailableTagObj;
-      elms[unavailable_ix]
-         = Tcl_NewIntObj(availability[i].Unavailable != 0);
+   if (objc == nargs) {         // filename provided
+      TUInfo *info = (TUInfo *)clientData;
 
-      elms[message_tag_ix]
-         = availabilityMessageTagObj;
-      elms[message_ix]
-         = Tcl_NewStringObj(clang_getCString(availability[i].Message), -1);
+      CXFile file;
+      status = getFileFromObj(interp, info->translationUnit,
+                                  objv[filename_ix], &file);
+      if (status != TCL_OK) {
+         return status;
+      }
 
-      Tcl_Obj *elm = Tcl_NewListObj(nelms, elms);
-      Tcl_ListObjAppendElement(NULL, resultElms[i], elm);
+      CXSourceRangeList *skippedRanges = clang_getSkippedRanges(info->translationUnit, file);
+      resultObj = newRangeListObj(info, skippedRanges);
+      clang_disposeSourceRangeList(skippedRanges);
+   } else {
+#if CINDEX_VERSION_MINOR >= 36
+      TUInfo *info = (TUInfo *)clientData;
 
-      clang_disposeCXPlatformAvailability(availability + i);
+      CXSourceRangeList *skippedRanges = clang_getAllSkippedRanges(info->translationUnit);
+      resultObj = newRangeListObj(info, skippedRanges);
+      clang_disposeSourceRangeList(skippedRanges);
+#else
+      resultObj = Tcl_NewStringObj("must indicate the filename", -1);
+      status = TCL_ERROR;
+#endif
    }
 
-   Tcl_Free((char *)availability);
-
-   Tcl_Obj *resultObj = Tcl_NewListObj(nelms, resultElms);
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-//---------------------------------------- cursor referenceNameRange command
+#endif
+#if CINDEX_VERSION_MINOR >= 38
+//----------------------------- translation unit instance's targetInfo command
 
-static int cursorReferenceNameRangeObjCmd(ClientData     clientData,
+static int tuTargetInfoTripleObjCmd(ClientData     clientData,
+                                    Tcl_Interp    *interp,
+                                    int            objc,
+                                    Tcl_Obj *const objv[]);
+static int tuTargetInfoPointerWidthObjCmd(ClientData     clientData,
                                           Tcl_Interp    *interp,
                                           int            objc,
-                                          Tcl_Obj *const objv[])
+                                          Tcl_Obj *const objv[]);
+
+static int tuTargetInfoObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      options_ix
-   };
-
-   static const char *options[] = {
-      "-wantQualifier",
-      "-wantTemplateArgs",
-      "-wantSinglePiece",
-      NULL
+      subcommand_ix,
+      numMandatoryArgs
    };
 
-   unsigned flags = 0;
-   int i;
-   for (i = 1; i < objc; ++i) {
-      const char *arg = Tcl_GetStringFromObj(objv[i], NULL);
-      if (arg[0] != '-') {
-         break;
-      }
-
-      int optionNumber;
-      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
-                                       "option", 0, &optionNumber);
-      if (status != TCL_OK) {
-         return TCL_ERROR;
-      }
-
-      flags |= 1 << optionNumber;
-   }
-
-   Tcl_Obj *cursorObj     = objv[i];
-   Tcl_Obj *pieceIndexObj = objv[i + 1];
-   if (i + 2 != objc) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
-                       "?options...? cursor pieceIndex");
+   if (objc < numMandatoryArgs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, cursorObj, &cursor);
+   static Command subcommands[] = {
+      { "triple",
+        tuTargetInfoTripleObjCmd },
+      { "pointerWidth",
+        tuTargetInfoPointerWidthObjCmd },
+      { NULL },
+   };
+
+   int commandNumber;
+   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
+                                          subcommands, sizeof subcommands[0],
+                                          "subcommand", 0, &commandNumber);
    if (status != TCL_OK) {
       return status;
    }
 
-   unsigned pieceIndex;
-   status = getUnsignedFromObj(interp, pieceIndexObj, &pieceIndex);
-   if (status != TCL_OK) {
-      return status;
+   return subcommands[commandNumber].proc(clientData, interp,
+                                          objc - subcommand_ix,
+                                          objv + subcommand_ix);
+}
+
+//------------------------translation unit instance's targetInfoTriple command
+
+static int tuTargetInfoTripleObjCmd(ClientData     clientData,
+                                    Tcl_Interp    *interp,
+                                    int            objc,
+                                    Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
+      return TCL_ERROR;
    }
 
-   CXSourceRange result
-      = clang_getCursorReferenceNameRange(cursor, flags, pieceIndex);
-   Tcl_Obj *resultObj = newRangeObj(result);
+   TUInfo *info = (TUInfo *)clientData;
+
+   CXTargetInfo  targetinfo = clang_getTranslationUnitTargetInfo(info->translationUnit);
+   CXString      triple     = clang_TargetInfo_getTriple(targetinfo);
+   Tcl_Obj      *resultObj  = convertCXStringToObj(triple);
    Tcl_SetObjResult(interp, resultObj);
 
+   clang_TargetInfo_dispose(targetinfo);
+
    return TCL_OK;
 }
 
-//------------------------------------------ cursor::translationUnit command
+//------------------translation unit instance's targetInfoPointerWidth command
 
-static int cursorTranslationUnitObjCmd(ClientData     clientData,
-                                       Tcl_Interp    *interp,
-                                       int            objc,
-                                       Tcl_Obj *const objv[])
+static int tuTargetInfoPointerWidthObjCmd(ClientData     clientData,
+                                          Tcl_Interp    *interp,
+                                          int            objc,
+                                          Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
-   }
+   TUInfo *info = (TUInfo *)clientData;
 
-   CXTranslationUnit  tu   = clang_Cursor_getTranslationUnit(cursor);
-   TUInfo            *info = lookupTranslationUnit(tu);
-   if (info == NULL) {
-      Tcl_Panic("invalid cursor");
-   }
+   CXTargetInfo  targetinfo   = clang_getTranslationUnitTargetInfo(info->translationUnit);
+   int           pointerWidth = clang_TargetInfo_getPointerWidth(targetinfo);
+   Tcl_Obj      *resultObj    = Tcl_NewIntObj(pointerWidth);
+   Tcl_SetObjResult(interp, resultObj);
 
-   Tcl_Obj *tuObj = Tcl_NewObj();
-   Tcl_GetCommandFullName(interp, info->cmd, tuObj);
-   Tcl_SetObjResult(interp, tuObj);
+   clang_TargetInfo_dispose(targetinfo);
 
    return TCL_OK;
 }
 
-//------------------------------------------------------ cursor -> int command
+#endif
 
-static int cursorToIntObjCmd(ClientData     clientData,
-                             Tcl_Interp    *interp,
-                             int            objc,
-                             Tcl_Obj *const objv[])
+//----------------------------- translation unit instance's sourceFile command
+
+static int tuSourceFileObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix, objv, "cursor");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
-   }
-
-   int      result    = ((int (*)(CXCursor))clientData)(cursor);
-   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
+   TUInfo            *info      = (TUInfo *)clientData;
+   CXTranslationUnit  tu        = info->translationUnit;
+   CXString           result    = clang_getTranslationUnitSpelling(tu);
+   Tcl_Obj           *resultObj = convertCXStringToObj(result);
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-//------------------------------------------------- cursor -> unsigned command
+//------------------------------- translation unit instance's uniqueID command
 
-static int cursorToUnsignedObjCmd(ClientData     clientData,
-                                  Tcl_Interp    *interp,
-                                  int            objc,
-                                  Tcl_Obj *const objv[])
+static int tuUniqueIDObjCmd(ClientData     clientData,
+                            Tcl_Interp    *interp,
+                            int            objc,
+                            Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
+      filename_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename");
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   TUInfo *info = (TUInfo *)clientData;
+
+   CXFile file;
+   int status = getFileFromObj(interp, info->translationUnit,
+                               objv[filename_ix], &file);
    if (status != TCL_OK) {
       return status;
    }
 
-   unsigned  result    = ((unsigned (*)(CXCursor))clientData)(cursor);
-   Tcl_Obj  *resultObj = Tcl_NewLongObj(result);
+   CXFileUniqueID uniqueId;
+   if (clang_getFileUniqueID(file, &uniqueId)) {
+      Tcl_SetObjResult(interp,
+                       Tcl_NewStringObj("failed to get file unique ID.", -1));
+      return TCL_ERROR;
+   }
+
+   enum {
+      ndata = sizeof uniqueId.data / sizeof uniqueId.data[0]
+   };
+   Tcl_Obj *elms[ndata];
+   for (int i = 0; i < ndata; ++i) {
+      elms[i] = newUintmaxObj(uniqueId.data[i]);
+   }
+   Tcl_Obj *resultObj = Tcl_NewListObj(ndata, elms);
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-//----------------------------------------------------- cursor -> bool command
+#if CINDEX_VERSION_MINOR >= 13
+//----------------------------------------------- cursorAndRangeVisitor helper
 
-static int cursorToBoolObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
-{
-   enum {
-      command_ix,
-      cursor_ix,
-      nargs
-   };
+enum CXVisitorResult foreachCursorAndRangeVisitor(void *context,
+                                                  CXCursor cursor,
+                                                  CXSourceRange range) {
+   int status = TCL_OK;
+   Tcl_Obj *cursorObj = NULL;
+   Tcl_Obj *rangeObj = NULL;
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
-      return TCL_ERROR;
+   VisitInfo *visitInfo = (VisitInfo *)context;
+
+   cursorObj = newCursorObj(cursor);
+   Tcl_IncrRefCount(cursorObj);
+   if (Tcl_ObjSetVar2(visitInfo->interp, visitInfo->variableNames[0],
+                      NULL, cursorObj, TCL_LEAVE_ERR_MSG) == NULL) {
+      status = TCL_ERROR;
+      goto cleanup;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
+   rangeObj = newRangeObjForTU(getCursorTUInfo(cursorObj), range);
+   Tcl_IncrRefCount(rangeObj);
+   if (Tcl_ObjSetVar2(visitInfo->interp, visitInfo->variableNames[1],
+                      NULL, rangeObj, TCL_LEAVE_ERR_MSG) == NULL) {
+      status = TCL_ERROR;
+      goto cleanup;
    }
 
-   unsigned  value     = ((unsigned (*)(CXCursor))clientData)(cursor);
-   int       result    = value != 0;
-   Tcl_Obj  *resultObj = Tcl_NewIntObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   status = Tcl_EvalObjEx(visitInfo->interp, visitInfo->scriptObj, 0);
 
-   return TCL_OK;
+cleanup:
+   if (cursorObj) {
+      Tcl_DecrRefCount(cursorObj);
+   }
+   if (rangeObj) {
+      Tcl_DecrRefCount(rangeObj);
+   }
+   switch (status) {
+   case TCL_OK:
+   case TCL_CONTINUE:
+      return CXVisit_Continue;
+   case TCL_BREAK:
+      return CXVisit_Break;
+   default:
+      visitInfo->returnCode = status;
+      return CXVisit_Break;
+   }
 }
 
-//----------------------------------------------------- cursor -> enum command
-
-typedef int (*CursorToEnumProc)(CXCursor);
-
-typedef struct CursorToEnumInfo
-{
-   EnumConsts       *labels;
-   CursorToEnumProc  proc;
-} CursorToEnumInfo;
+//--------------------------- translation unit instance's findIncludes command
 
-static int cursorToEnumObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+static int tuFindIncludesObjCmd(ClientData     clientData,
+                                Tcl_Interp    *interp,
+                                int            objc,
+                                Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
+      filename_ix,
+      varNames_ix,
+      script_ix,
       nargs
    };
 
+   int status = TCL_OK;
+   Tcl_Obj *varNamesObj = NULL;
+
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
-      return TCL_ERROR;
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename variableNames script");
+      status = TCL_ERROR;
+      goto cleanup;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   TUInfo *info = (TUInfo *)clientData;
+
+   int       numVars;
+   Tcl_Obj **varNames;
+   varNamesObj = Tcl_DuplicateObj(objv[varNames_ix]);
+   Tcl_IncrRefCount(varNamesObj);
+   status = Tcl_ListObjGetElements(interp, varNamesObj, &numVars, &varNames);
    if (status != TCL_OK) {
-      return status;
+      goto cleanup;
+   } else if (numVars != 2) {
+      Tcl_SetObjResult(interp, Tcl_NewStringObj("invalid loop variables: must be cursor range", -1));
+      status = TCL_ERROR;
+      goto cleanup;
    }
 
-   CursorToEnumInfo *info = (CursorToEnumInfo *)clientData;
-
-   int      result    = (info->proc)(cursor);
-   Tcl_Obj *resultObj = getEnum(info->labels, result);
-   Tcl_SetObjResult(interp, resultObj);
+   CXFile file;
+   status = getFileFromObj(interp, info->translationUnit,
+                               objv[filename_ix], &file);
+   if (status != TCL_OK) {
+      goto cleanup;
+   }
 
-   return TCL_OK;
-}
+   VisitInfo visitInfo = {
+      .interp = interp,
+      .variableNames = varNames,
+      .numVariables = numVars,
+      .scriptObj = objv[script_ix],
+      .returnCode = TCL_OK
+   };
+   CXCursorAndRangeVisitor visitor = {
+      .context = (void *)&visitInfo,
+      .visit = foreachCursorAndRangeVisitor,
+   };
+   CXResult result = clang_findIncludesInFile(info->translationUnit, file,
+                                              visitor);
+   switch (result) {
+   case CXResult_Success:
+   case CXResult_VisitBreak:
+      status = visitInfo.returnCode;
+      break;
+   case CXResult_Invalid:
+      Tcl_SetObjResult(interp, Tcl_NewStringObj("error while finding includes", -1));
+      status = TCL_ERROR;
+      break;
+   }
 
-//-------------------------------------------------- cursor -> bitmask command
+cleanup:
+   if (varNamesObj) {
+      Tcl_DecrRefCount(varNamesObj);
+   }
 
-typedef unsigned (*CursorToBitMaskProc)(CXCursor);
+   return status;
+}
+#endif
 
-typedef struct CursorToBitMaskInfo
-{
-   BitMask             *masks;
-   Tcl_Obj             *none;
-   CursorToBitMaskProc  proc;
-} CursorToBitMaskInfo;
+//------------------------------------------ translation unit instance command
 
-static int cursorToBitMaskObjCmd(ClientData     clientData,
-                                 Tcl_Interp    *interp,
-                                 int            objc,
-                                 Tcl_Obj *const objv[])
+static int tuInstanceObjCmd(ClientData     clientData,
+                            Tcl_Interp    *interp,
+                            int            objc,
+                            Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
-      nargs
+      subcommand_ix,
+      numCommonArgs,
+   };
+
+   if (objc < numCommonArgs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
+      return TCL_ERROR;
+   }
+
+   static Command subcommands[] = {
+      { "buildIndex",
+        tuBuildIndexObjCmd },
+      { "cursor",
+        tuCursorObjCmd },
+      { "cursorHandles",
+        tuCursorHandlesObjCmd },
+      { "cursors",
+        tuCursorsObjCmd },
+      { "cursorsAt",
+        tuCursorsAtObjCmd },
+      { "cursorsIn",
+        tuCursorsInObjCmd },
+      { "diagnostic",
+        tuDiagnosticObjCmd },
+      { "diagnostics",
+        tuDiagnosticListObjCmd },
+      { "dump",
+        tuDumpObjCmd },
+      { "export",
+        tuExportObjCmd },
+      { "fileNameCache",
+        tuFileNameCacheObjCmd },
+#if CINDEX_VERSION_MINOR >= 13
+      { "findIncludes",
+        tuFindIncludesObjCmd },
+#endif
+      { "inclusions",
+        tuInclusionsObjCmd },
+      { "index",
+        tuIndexObjCmd },
+      { "isMultipleIncludeGuarded",
+        tuIsMultipleIncludeGuardedObjCmd },
+#if CINDEX_VERSION_MINOR >= 35
+      { "lineTable",
+        tuLineTableObjCmd },
+#endif
+      { "location",
+        tuLocationObjCmd },
+      { "modificationTime",
+        tuModificationTimeObjCmd },
+      { "reparse",
+        tuReparseObjCmd },
+      { "reparseStatus",
+        tuReparseStatusObjCmd },
+      { "resourceUsage",
+        tuResourceUsageObjCmd },
+      { "save",
+        tuSaveObjCmd },
+      { "sourceFile",
+        tuSourceFileObjCmd },
+      { "skippedRanges",
+        tuSkippedRangesObjCmd },
+#if CINDEX_VERSION_MINOR >= 38
+      { "targetInfo",
+        tuTargetInfoObjCmd },
+#endif
+      { "uniqueID",
+        tuUniqueIDObjCmd },
+      { NULL },
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
-      return TCL_ERROR;
-   }
-
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   int commandNumber;
+   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
+                                          subcommands, sizeof subcommands[0],
+                                          "subcommand", 0, &commandNumber);
    if (status != TCL_OK) {
       return status;
    }
 
-   CursorToBitMaskInfo *info = (CursorToBitMaskInfo *)clientData;
+   // Parse the translation unit anew if the pool has evicted it.  reparse
+   // does that by itself, with its own unsaved files.
+   TUInfo *info = (TUInfo *)clientData;
+   if (subcommands[commandNumber].proc != tuReparseObjCmd) {
+      status = usePooledTU(interp, info);
+      if (status != TCL_OK) {
+         return status;
+      }
+   }
 
-   unsigned value = (info->proc)(cursor);
-   return bitMaskToString(interp, info->masks, info->none, value);
-}
+   enterTU(info);
+   status = subcommands[commandNumber].proc(clientData, interp,
+                                            objc - subcommand_ix,
+                                            objv + subcommand_ix);
+   leaveTU(info);
 
-static unsigned getObjCPropertyAttributes(CXCursor cursor)
-{
-   return clang_Cursor_getObjCPropertyAttributes(cursor, 0);
+   return status;
 }
 
-//--------------------------------------------------- cursor -> string command
+//----------------------------------------------------- indexName pool command
 
-static int cursorToStringObjCmd(ClientData     clientData,
-                                Tcl_Interp    *interp,
-                                int            objc,
-                                Tcl_Obj *const objv[])
+static int indexNamePoolConfigureObjCmd(ClientData     clientData,
+                                        Tcl_Interp    *interp,
+                                        int            objc,
+                                        Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
-      nargs
+      options_ix
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
-      return TCL_ERROR;
-   }
-
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
-   }
-
-   CXString  result    = ((CXString (*)(CXCursor))clientData)(cursor);
-   Tcl_Obj  *resultObj = convertCXStringToObj(result);
-   Tcl_SetObjResult(interp, resultObj);
-
-   return TCL_OK;
-}
-
-#if CINDEX_VERSION_MINOR >= 32
-//----------------------------------------------- cursor -> string set command
+   static const char *options[] = {
+      "-maxBytes",
+      "-maxTUs",
+      NULL
+   };
 
-static int cursorToStringSetObjCmd(ClientData     clientData,
-                                   Tcl_Interp    *interp,
-                                   int            objc,
-                                   Tcl_Obj *const objv[])
-{
    enum {
-      command_ix,
-      cursor_ix,
-      nargs
+      option_maxBytes,
+      option_maxTUs
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
-      return TCL_ERROR;
-   }
+   IndexInfo *info = (IndexInfo *)clientData;
+   TUPool    *pool = &info->pool;
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
-   }
+   if (objc == options_ix) {
+      Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+      Tcl_ListObjAppendElement(NULL, resultObj,
+                               Tcl_NewStringObj(options[option_maxBytes],
+                                                -1));
+      Tcl_ListObjAppendElement(NULL, resultObj,
+                               Tcl_NewWideIntObj(pool->maxBytes));
+      Tcl_ListObjAppendElement(NULL, resultObj,
+                               Tcl_NewStringObj(options[option_maxTUs], -1));
+      Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewIntObj(pool->maxTUs));
+      Tcl_SetObjResult(interp, resultObj);
 
-   CXStringSet *result    = ((CXStringSet *(*)(CXCursor))clientData)(cursor);
-   Tcl_Obj     *resultObj = NULL;
-   if (result) {
-      resultObj = convertCXStringSetToObj(result);
-   } else {
-      resultObj = Tcl_NewObj();
+      return TCL_OK;
    }
-   Tcl_SetObjResult(interp, resultObj);
 
-   return TCL_OK;
-}
+   Tcl_WideInt maxBytes = pool->maxBytes;
+   int         maxTUs   = pool->maxTUs;
 
-#endif
-//----------------------------------------------------- cursor -> file command
+   for (int i = options_ix; i < objc; i += 2) {
+      int optionNumber;
+      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                       "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         return status;
+      }
 
-static int cursorToFileObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
-{
-   enum {
-      command_ix,
-      cursor_ix,
-      nargs
-   };
+      if (objc <= i + 1) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("%s is not followed by a limit",
+                                        options[optionNumber]));
+         return TCL_ERROR;
+      }
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
-      return TCL_ERROR;
-   }
+      if (optionNumber == option_maxBytes) {
+         status = Tcl_GetWideIntFromObj(interp, objv[i + 1], &maxBytes);
+      } else {
+         status = Tcl_GetIntFromObj(interp, objv[i + 1], &maxTUs);
+      }
+      if (status != TCL_OK) {
+         return status;
+      }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
+      if (maxBytes < 0 || maxTUs < 0) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("%s must not be negative",
+                                        options[optionNumber]));
+         return TCL_ERROR;
+      }
    }
 
-   CXFile    result    = ((CXFile (*)(CXCursor))clientData)(cursor);
-   CXString  resultStr = clang_getFileName(result);
-   Tcl_Obj  *resultObj = convertCXStringToObj(resultStr);
-   Tcl_SetObjResult(interp, resultObj);
+   // 0 means no limit.
+   pool->maxBytes = maxBytes;
+   pool->maxTUs   = maxTUs;
+   enforceTUPool(info, NULL);
 
    return TCL_OK;
 }
 
-//------------------------------------------------- cursor -> location command
-
-static int cursorToLocationObjCmd(ClientData     clientData,
-                                  Tcl_Interp    *interp,
-                                  int            objc,
-                                  Tcl_Obj *const objv[])
+static int indexNamePoolStatusObjCmd(ClientData     clientData,
+                                     Tcl_Interp    *interp,
+                                     int            objc,
+                                     Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, NULL);
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
-   }
+   IndexInfo *info = (IndexInfo *)clientData;
 
-   typedef CXSourceLocation (*ProcType)(CXCursor);
+   int numLoaded    = 0;
+   int numSuspended = 0;
+   for (TUInfo *tu = info->firstTU; tu != NULL; tu = tu->next) {
+      if (tu->suspended) {
+         ++numSuspended;
+      } else {
+         ++numLoaded;
+      }
+   }
 
-   CXSourceLocation  result    = ((ProcType)clientData)(cursor);
-   Tcl_Obj          *resultObj = newLocationObj(result);
+   Tcl_Obj *resultObj = Tcl_NewDictObj();
+   Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("loaded", -1),
+                  Tcl_NewIntObj(numLoaded));
+   Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("suspended", -1),
+                  Tcl_NewIntObj(numSuspended));
+   Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("evictions", -1),
+                  Tcl_NewWideIntObj(info->pool.evictions));
+   Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("restorations", -1),
+                  Tcl_NewWideIntObj(info->pool.restorations));
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-//---------------------------------------------------- cursor -> range command
-
-static int cursorToRangeObjCmd(ClientData     clientData,
+static int indexNamePoolObjCmd(ClientData     clientData,
                                Tcl_Interp    *interp,
                                int            objc,
                                Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
-      nargs
+      subcommand_ix,
+      numCommonArgs
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+   if (objc < numCommonArgs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
-   }
-
-   typedef CXSourceRange (*ProcType)(CXCursor);
-
-   CXSourceRange  result    = ((ProcType)clientData)(cursor);
-   Tcl_Obj       *resultObj = newRangeObj(result);
-   Tcl_SetObjResult(interp, resultObj);
-
-   return TCL_OK;
-}
-
-//--------------------------------------------------- cursor -> cursor command
-
-static int cursorToCursorObjCmd(ClientData     clientData,
-                                Tcl_Interp    *interp,
-                                int            objc,
-                                Tcl_Obj *const objv[])
-{
-   enum {
-      command_ix,
-      cursor_ix,
-      nargs
+   static Command subcommands[] = {
+      { "configure",
+        indexNamePoolConfigureObjCmd },
+      { "status",
+        indexNamePoolStatusObjCmd },
+      { NULL }
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
-      return TCL_ERROR;
-   }
-
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   int commandNumber;
+   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
+                                          subcommands, sizeof subcommands[0],
+                                          "subcommand", 0, &commandNumber);
    if (status != TCL_OK) {
       return status;
    }
 
-   CXCursor  result    = ((CXCursor (*)(CXCursor))clientData)(cursor);
-   Tcl_Obj  *resultObj = newCursorObj(result);
-   Tcl_SetObjResult(interp, resultObj);
-
-   return TCL_OK;
+   return subcommands[commandNumber].proc(clientData, interp,
+                                          objc - subcommand_ix,
+                                          objv + subcommand_ix);
 }
 
-//----------------------------------------- cursor, unsigned -> cursor command
+//-------------------------------------------------- indexName options command
 
-static int cursorUnsignedToCursorObjCmd(ClientData     clientData,
-                                        Tcl_Interp    *interp,
-                                        int            objc,
-                                        Tcl_Obj *const objv[])
+static int indexNameOptionsObjCmd(ClientData     clientData,
+                                  Tcl_Interp    *interp,
+                                  int            objc,
+                                  Tcl_Obj *const objv[])
 {
+   static BitMask options[] = {
+      { "-backgroundIndexing" },
+      { "-backgroundEditing" },
+      { "-background", CXGlobalOpt_ThreadBackgroundPriorityForAll },
+      { NULL }
+   };
+
    enum {
-      command_ix,
-      cursor_ix,
-      number_ix,
-      nargs
+      subcommand_ix,
+      options_ix
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor number");
-      return TCL_ERROR;
-   }
+   IndexInfo *info = (IndexInfo *)clientData;
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
+   if (objc == subcommand_ix + 1) {
+      unsigned value = clang_CXIndex_getGlobalOptions(info->index);
+      return bitMaskToString(interp, options, noneTagObj, value);
    }
 
-   unsigned number;
-   status = getUnsignedFromObj(interp, objv[number_ix], &number);
-   if (status != TCL_OK) {
-      return status;
+   unsigned value = 0;
+
+   if (objc == options_ix + 1
+       && (objv[options_ix] == noneTagObj
+           || strcmp(Tcl_GetStringFromObj(objv[options_ix], NULL),
+                     Tcl_GetStringFromObj(noneTagObj, NULL)) == 0)) {
+      // The option list is -none, or ...
+   } else {
+      // ... a list of options
+      for (int i = 1; i < objc; ++i) {
+         int number;
+         int status = Tcl_GetIndexFromObjStruct(interp, objv[i],
+                                                options, sizeof options[0],
+                                                "option", 0, &number);
+         if (status != TCL_OK) {
+            return status;
+         }
+
+         value |= options[number].mask == 0
+            ? 1 << number
+            : options[number].mask;
+      }
    }
 
-   typedef CXCursor (*ProcType)(CXCursor, unsigned);
-
-   CXCursor  result    = ((ProcType)clientData)(cursor, number);
-   Tcl_Obj  *resultObj = newCursorObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   clang_CXIndex_setGlobalOptions(info->index, value);
 
    return TCL_OK;
 }
 
-//------------------------------------------ cursor, unsigned -> range command
+//------------------------------------------------ compilationDatabase command
 
-static int cursorUnsignedToRangeObjCmd(ClientData     clientData,
-                                       Tcl_Interp    *interp,
-                                       int            objc,
-                                       Tcl_Obj *const objv[])
+static void compilationDatabaseDeleteProc(ClientData clientData)
 {
-   enum {
-      command_ix,
-      cursor_ix,
-      number_ix,
-      nargs
-   };
+   clang_CompilationDatabase_dispose((CXCompilationDatabase)clientData);
+}
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor number");
-      return TCL_ERROR;
-   }
+// Return the source file of a compile command, made absolute with the
+// command's directory.
+static Tcl_Obj *newCompileCommandFileObj(CXCompileCommand command)
+{
+   CXString directory = clang_CompileCommand_getDirectory(command);
+   CXString filename  = clang_CompileCommand_getFilename(command);
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
+   Tcl_Obj *elms[2];
+   elms[0] = Tcl_NewStringObj(clang_getCString(directory), -1);
+   elms[1] = Tcl_NewStringObj(clang_getCString(filename), -1);
+   clang_disposeString(directory);
+   clang_disposeString(filename);
+
+   Tcl_Obj *pathObj = Tcl_NewListObj(2, elms);
+   Tcl_IncrRefCount(pathObj);
+   Tcl_Obj *resultObj = Tcl_FSJoinPath(pathObj, -1);
+   Tcl_IncrRefCount(resultObj);
+   Tcl_DecrRefCount(pathObj);
+
+   // Leave the string only, so that the result can be shared freely.
+   Tcl_Obj *fileObj = Tcl_NewStringObj(Tcl_GetString(resultObj), -1);
+   Tcl_DecrRefCount(resultObj);
+
+   return fileObj;
+}
+
+/** Append the command line of a compile command to listObj in the form
+ * clang_parseTranslationUnit takes it: without the compiler and the
+ * source file, and with -working-directory so that relative paths resolve
+ * as they did in the build.
+ */
+static void appendCompileCommandArgs(Tcl_Obj *listObj, CXCompileCommand command)
+{
+   CXString directory = clang_CompileCommand_getDirectory(command);
+   Tcl_ListObjAppendElement(NULL, listObj,
+                            Tcl_NewStringObj("-working-directory", -1));
+   Tcl_ListObjAppendElement(NULL, listObj,
+                            Tcl_NewStringObj(clang_getCString(directory), -1));
+   clang_disposeString(directory);
+
+   CXString    filename     = clang_CompileCommand_getFilename(command);
+   const char *filenameCstr = clang_getCString(filename);
+
+   unsigned numArgs = clang_CompileCommand_getNumArgs(command);
+   for (unsigned i = 1; i < numArgs; ++i) {
+      CXString    arg     = clang_CompileCommand_getArg(command, i);
+      const char *argCstr = clang_getCString(arg);
+      if (strcmp(argCstr, filenameCstr) != 0) {
+         Tcl_ListObjAppendElement(NULL, listObj,
+                                  Tcl_NewStringObj(argCstr, -1));
+      }
+      clang_disposeString(arg);
    }
 
-   unsigned number;
-   status = getUnsignedFromObj(interp, objv[number_ix], &number);
-   if (status != TCL_OK) {
-      return status;
+   clang_disposeString(filename);
+}
+
+/** Get the first compile command of filename in db.  On success, store the
+ * clang arguments in *argsObj and the absolute source file name in
+ * *fileObj.
+ */
+static int getCompileCommand(Tcl_Interp             *interp,
+                             CXCompilationDatabase   db,
+                             Tcl_Obj                *filenameObj,
+                             Tcl_Obj               **argsObj,
+                             Tcl_Obj               **fileObj)
+{
+   const char        *filename = Tcl_GetStringFromObj(filenameObj, NULL);
+   CXCompileCommands  commands
+      = clang_CompilationDatabase_getCompileCommands(db, filename);
+
+   if (commands == NULL || clang_CompileCommands_getSize(commands) == 0) {
+      if (commands != NULL) {
+         clang_CompileCommands_dispose(commands);
+      }
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("no compile command for \"%s\"",
+                                     filename));
+      return TCL_ERROR;
    }
 
-   typedef CXSourceRange (*ProcType)(CXCursor, unsigned);
+   CXCompileCommand command = clang_CompileCommands_getCommand(commands, 0);
+   *argsObj = Tcl_NewListObj(0, NULL);
+   appendCompileCommandArgs(*argsObj, command);
+   *fileObj = newCompileCommandFileObj(command);
 
-   CXSourceRange  result    = ((ProcType)clientData)(cursor, number);
-   Tcl_Obj       *resultObj = newRangeObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   clang_CompileCommands_dispose(commands);
 
    return TCL_OK;
 }
 
-//----------------------------------------------------- cursor -> type command
+static int compilationDatabaseInstanceObjCmd(ClientData     clientData,
+                                             Tcl_Interp    *interp,
+                                             int            objc,
+                                             Tcl_Obj *const objv[]);
 
-static int cursorToTypeObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+/** Like getCompileCommand, but for the compilation database command named
+ * dbNameObj.
+ */
+static int getCompileCommandFromObj(Tcl_Interp  *interp,
+                                    Tcl_Obj     *dbNameObj,
+                                    Tcl_Obj     *filenameObj,
+                                    Tcl_Obj    **argsObj,
+                                    Tcl_Obj    **fileObj)
+{
+   const char  *dbName = Tcl_GetStringFromObj(dbNameObj, NULL);
+   Tcl_CmdInfo  cmdInfo;
+   if (!Tcl_GetCommandInfo(interp, dbName, &cmdInfo)
+       || cmdInfo.objProc != compilationDatabaseInstanceObjCmd) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("\"%s\" is not a compilation database",
+                                     dbName));
+      return TCL_ERROR;
+   }
+
+   return getCompileCommand(interp,
+                            (CXCompilationDatabase)cmdInfo.objClientData,
+                            filenameObj, argsObj, fileObj);
+}
+
+// compilationDatabaseName arguments filename
+static int compilationDatabaseArgumentsObjCmd(ClientData     clientData,
+                                              Tcl_Interp    *interp,
+                                              int            objc,
+                                              Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
+      filename_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename");
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
+   Tcl_Obj *argsObj;
+   Tcl_Obj *fileObj;
+   int status = getCompileCommand(interp, (CXCompilationDatabase)clientData,
+                                  objv[filename_ix], &argsObj, &fileObj);
    if (status != TCL_OK) {
       return status;
    }
 
-   CXType   result    = ((CXType (*)(CXCursor))clientData)(cursor);
-   Tcl_Obj *resultObj = newTypeObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   Tcl_DecrRefCount(fileObj);
+   Tcl_SetObjResult(interp, argsObj);
 
    return TCL_OK;
 }
 
-//----------------------------------------------------- cursor -> kind command
-
-static int cursorToKindObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+// compilationDatabaseName commands ?filename?
+static int compilationDatabaseCommandsObjCmd(ClientData     clientData,
+                                             Tcl_Interp    *interp,
+                                             int            objc,
+                                             Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
+      filename_ix,
       nargs
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+   if (objc != nargs && objc != filename_ix) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "?filename?");
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
-   }
-
-   typedef unsigned (*ProcType)(CXCursor);
-
-   ProcType           proc    = (ProcType)clientData;
-   enum CXCursorKind  kind    = proc(cursor);
-   Tcl_Obj           *kindObj = Tcl_NewIntObj(kind);
+   CXCompilationDatabase db       = (CXCompilationDatabase)clientData;
+   CXCompileCommands     commands = objc == nargs
+      ? clang_CompilationDatabase_getCompileCommands
+           (db, Tcl_GetStringFromObj(objv[filename_ix], NULL))
+      : clang_CompilationDatabase_getAllCompileCommands(db);
 
-   Tcl_IncrRefCount(kindObj);
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+   unsigned n = commands != NULL ? clang_CompileCommands_getSize(commands) : 0;
+   for (unsigned i = 0; i < n; ++i) {
+      CXCompileCommand command = clang_CompileCommands_getCommand(commands, i);
+
+      CXString directory = clang_CompileCommand_getDirectory(command);
+      Tcl_Obj *directoryObj
+         = Tcl_NewStringObj(clang_getCString(directory), -1);
+      clang_disposeString(directory);
+
+      Tcl_Obj  *argsObj = Tcl_NewListObj(0, NULL);
+      unsigned  numArgs = clang_CompileCommand_getNumArgs(command);
+      for (unsigned j = 0; j < numArgs; ++j) {
+         CXString arg = clang_CompileCommand_getArg(command, j);
+         Tcl_ListObjAppendElement(NULL, argsObj,
+                                  Tcl_NewStringObj(clang_getCString(arg), -1));
+         clang_disposeString(arg);
+      }
 
-   Tcl_Obj *resultObj;
-   if (Tcl_DictObjGet(NULL, cursorKindNames, kindObj, &resultObj) != TCL_OK) {
-      Tcl_Panic("cursor kind %d is not valid", kind);
+      Tcl_Obj *dictObj = Tcl_NewDictObj();
+      Tcl_DictObjPut(NULL, dictObj,
+                     Tcl_NewStringObj("directory", -1), directoryObj);
+      Tcl_DictObjPut(NULL, dictObj,
+                     Tcl_NewStringObj("file", -1),
+                     newCompileCommandFileObj(command));
+      Tcl_DictObjPut(NULL, dictObj,
+                     Tcl_NewStringObj("arguments", -1), argsObj);
+      Tcl_ListObjAppendElement(NULL, resultObj, dictObj);
    }
 
-   Tcl_DecrRefCount(kindObj);
+   if (commands != NULL) {
+      clang_CompileCommands_dispose(commands);
+   }
 
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-//--------------------------------------------- cursor -> kind -> bool command
-
-static int cursorToKindToBoolObjCmd(ClientData     clientData,
-                                    Tcl_Interp    *interp,
-                                    int            objc,
-                                    Tcl_Obj *const objv[])
+// compilationDatabaseName files
+static int compilationDatabaseFilesObjCmd(ClientData     clientData,
+                                          Tcl_Interp    *interp,
+                                          int            objc,
+                                          Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, NULL);
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
+   CXCompilationDatabase db       = (CXCompilationDatabase)clientData;
+   CXCompileCommands     commands
+      = clang_CompilationDatabase_getAllCompileCommands(db);
+
+   // A file compiled several times is listed once.
+   Tcl_HashTable seen;
+   Tcl_InitHashTable(&seen, TCL_STRING_KEYS);
+
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+   unsigned n = commands != NULL ? clang_CompileCommands_getSize(commands) : 0;
+   for (unsigned i = 0; i < n; ++i) {
+      CXCompileCommand command = clang_CompileCommands_getCommand(commands, i);
+      Tcl_Obj         *fileObj = newCompileCommandFileObj(command);
+
+      int created;
+      Tcl_CreateHashEntry(&seen, Tcl_GetString(fileObj), &created);
+      if (created) {
+         Tcl_ListObjAppendElement(NULL, resultObj, fileObj);
+      } else {
+         Tcl_DecrRefCount(fileObj);
+      }
    }
 
-   typedef unsigned (*ProcType)(enum CXCursorKind);
+   Tcl_DeleteHashTable(&seen);
+   if (commands != NULL) {
+      clang_CompileCommands_dispose(commands);
+   }
 
-   ProcType           proc      = (ProcType)clientData;
-   enum CXCursorKind  kind      = clang_getCursorKind(cursor);
-   int                result    = proc(kind) != 0;
-   Tcl_Obj           *resultObj = Tcl_NewIntObj(result);
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-#if CINDEX_VERSION_MINOR >= 30
-//----------------------------------------- cursor -> layout long long command
-
-static int cursorToLayoutLongLongObjCmd(ClientData     clientData,
-                                        Tcl_Interp    *interp,
-                                        int            objc,
-                                        Tcl_Obj *const objv[])
+static int compilationDatabaseInstanceObjCmd(ClientData     clientData,
+                                             Tcl_Interp    *interp,
+                                             int            objc,
+                                             Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      cursor_ix,
-      nargs
+      subcommand_ix,
+      numCommonArgs,
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+   if (objc < numCommonArgs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
       return TCL_ERROR;
    }
 
-   CXCursor cxcursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cxcursor);
+   static Command subcommands[] = {
+      { "arguments",
+        compilationDatabaseArgumentsObjCmd },
+      { "commands",
+        compilationDatabaseCommandsObjCmd },
+      { "files",
+        compilationDatabaseFilesObjCmd },
+      { NULL },
+   };
+
+   int commandNumber;
+   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
+                                          subcommands, sizeof subcommands[0],
+                                          "subcommand", 0, &commandNumber);
    if (status != TCL_OK) {
       return status;
    }
 
-   long long  result    = ((long long (*)(CXCursor))clientData)(cxcursor);
-   Tcl_Obj   *resultObj = newLayoutLongLongObj(result);
-   Tcl_SetObjResult(interp, resultObj);
-
-   return TCL_OK;
+   return subcommands[commandNumber].proc(clientData, interp,
+                                          objc - subcommand_ix,
+                                          objv + subcommand_ix);
 }
 
-#endif
-//---------------------------------------------- cursor -> cursor list command
-
-typedef struct CursorToCursorListInfo {
-   union {
-      unsigned (*getNumUnsigned)(CXCursor);
-      int (*getNumInt)(CXCursor);
-   };
-   CXCursor (*getIndex)(CXCursor, unsigned);
-   enum {
-      CursorToCursorListInfo_Int,
-      CursorToCursorListInfo_Unsigned
-   } returnType;
-} CursorToCursorListInfo;
-
-static int cursorToCursorListObjCmd(ClientData     clientData,
-                                       Tcl_Interp    *interp,
-                                       int            objc,
-                                       Tcl_Obj *const objv[]) {
+// cindex::compilationDatabase load name directory
+static int compilationDatabaseLoadObjCmd(ClientData     clientData,
+                                         Tcl_Interp    *interp,
+                                         int            objc,
+                                         Tcl_Obj *const objv[])
+{
    enum {
       command_ix,
-      cursor_ix,
+      name_ix,
+      directory_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "cursor");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "name directory");
       return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
-   if (status != TCL_OK) {
-      return status;
-   }
+   const char *directory = Tcl_GetStringFromObj(objv[directory_ix], NULL);
 
-   CursorToCursorListInfo *procs = ((CursorToCursorListInfo *)clientData);
-   unsigned num = 0;
-   switch (procs->returnType) {
-   case CursorToCursorListInfo_Unsigned:
-      num = procs->getNumUnsigned(cursor);
-      break;
-   case CursorToCursorListInfo_Int:
-      {
-         int tmp = procs->getNumInt(cursor);
-         num = (unsigned)(tmp < 0? 0 : tmp);
-         break;
+   CXCompilationDatabase_Error error;
+   CXCompilationDatabase       db
+      = clang_CompilationDatabase_fromDirectory(directory, &error);
+   if (error != CXCompilationDatabase_NoError) {
+      if (db != NULL) {
+         clang_CompilationDatabase_dispose(db);
       }
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("can't load a compilation database "
+                                     "from \"%s\"", directory));
+      return TCL_ERROR;
    }
-   if (num > 0) {
-      Tcl_Obj **results
-         = (Tcl_Obj **)Tcl_Alloc(sizeof(Tcl_Obj *) * num);
-      for (int i = 0; i < num; i++) {
-         results[i] = newCursorObj(procs->getIndex(cursor, i));
-      }
 
-      Tcl_Obj *resultObj = Tcl_NewListObj(num, results);
-      Tcl_SetObjResult(interp, resultObj);
+   Tcl_Obj *commandNameObj = NULL;
+   newQualifiedName(interp, objv[name_ix], &commandNameObj);
 
-      Tcl_Free((char *)results);
-   }
+   Tcl_CreateObjCommand(interp, Tcl_GetString(commandNameObj),
+                        compilationDatabaseInstanceObjCmd, db,
+                        compilationDatabaseDeleteProc);
+
+   Tcl_SetObjResult(interp, commandNameObj);
 
    return TCL_OK;
 }
 
-//------------------------ translation unit instance's diagnostic list command
+//------------------------------------------------------------------- disposer
 
-static int tuDiagnosticListObjCmd(ClientData     clientData,
-                                  Tcl_Interp    *interp,
-                                  int            objc,
-                                  Tcl_Obj *const objv[])
+/** A thread disposing of the translation units replaced by background
+ * reparses, so that the interpreter doesn't wait for the teardown of large
+ * ASTs.  There is one per index, started on first use.
+ */
+typedef struct Disposer
 {
-   enum {
-      command_ix,
-      nargs
-   };
+   Tcl_Mutex           mutex;
+   Tcl_Condition       condition;
+   int                 stop;        // set when the index is deleted
+   int                 numTUs;      // the translation units to dispose
+   int                 capacity;
+   CXTranslationUnit  *tus;
+   Tcl_ThreadId        thread;
+} Disposer;
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
-      return TCL_ERROR;
+static Tcl_ThreadCreateType disposerThread(ClientData clientData)
+{
+   Disposer *disposer = (Disposer *)clientData;
+
+   Tcl_MutexLock(&disposer->mutex);
+   for (;;) {
+      while (disposer->numTUs == 0 && !disposer->stop) {
+         Tcl_ConditionWait(&disposer->condition, &disposer->mutex, NULL);
+      }
+
+      if (disposer->numTUs == 0) {
+         break;
+      }
+
+      CXTranslationUnit tu = disposer->tus[--disposer->numTUs];
+      Tcl_MutexUnlock(&disposer->mutex);
+      clang_disposeTranslationUnit(tu);
+      Tcl_MutexLock(&disposer->mutex);
    }
+   Tcl_MutexUnlock(&disposer->mutex);
 
-   TUInfo *info = (TUInfo *)clientData;
+   TCL_THREAD_CREATE_RETURN;
+}
 
-   unsigned numDiags = clang_getNumDiagnostics(info->translationUnit);
-   Tcl_Obj **diags = (Tcl_Obj **)Tcl_Alloc(numDiags * sizeof(Tcl_Obj *));
-   for (int i = 0; i < numDiags; i++) {
-      CXDiagnostic  diagnostic = clang_getDiagnostic(info->translationUnit, i);
-      diags[i] = newDiagnosticObj(diagnostic);
-      clang_disposeDiagnostic(diagnostic);
+/** Dispose of tu on the disposer thread of parent.
+ */
+static void disposeTranslationUnitLater(IndexInfo         *parent,
+                                        CXTranslationUnit  tu)
+{
+   Disposer *disposer = parent->disposer;
+
+   if (disposer == NULL) {
+      disposer = (Disposer *)Tcl_Alloc(sizeof *disposer);
+      disposer->mutex     = NULL;
+      disposer->condition = NULL;
+      disposer->stop      = 0;
+      disposer->numTUs    = 0;
+      disposer->capacity  = 0;
+      disposer->tus       = NULL;
+
+      if (Tcl_CreateThread(&disposer->thread, disposerThread, disposer,
+                           TCL_THREAD_STACK_DEFAULT,
+                           TCL_THREAD_JOINABLE) != TCL_OK) {
+         // Tcl without threads.
+         Tcl_Free((char *)disposer);
+         clang_disposeTranslationUnit(tu);
+         return;
+      }
+
+      parent->disposer = disposer;
+   }
+
+   Tcl_MutexLock(&disposer->mutex);
+   if (disposer->numTUs == disposer->capacity) {
+      disposer->capacity = disposer->capacity == 0 ? 4 : disposer->capacity * 2;
+      disposer->tus      = (CXTranslationUnit *)
+         Tcl_Realloc((char *)disposer->tus,
+                     disposer->capacity * sizeof disposer->tus[0]);
+   }
+   disposer->tus[disposer->numTUs++] = tu;
+   Tcl_ConditionNotify(&disposer->condition);
+   Tcl_MutexUnlock(&disposer->mutex);
+}
+
+/** Let the disposer of parent finish its work and stop it.
+ */
+static void stopDisposer(IndexInfo *parent)
+{
+   Disposer *disposer = parent->disposer;
+   if (disposer == NULL) {
+      return;
    }
-   Tcl_SetObjResult(interp, Tcl_NewListObj(numDiags, diags));
 
-   Tcl_Free((char *)diags);
+   Tcl_MutexLock(&disposer->mutex);
+   disposer->stop = 1;
+   Tcl_ConditionNotify(&disposer->condition);
+   Tcl_MutexUnlock(&disposer->mutex);
 
-   return TCL_OK;
+   int result;
+   Tcl_JoinThread(disposer->thread, &result);
+
+   Tcl_ConditionFinalize(&disposer->condition);
+   Tcl_MutexFinalize(&disposer->mutex);
+   Tcl_Free((char *)disposer->tus);
+   Tcl_Free((char *)disposer);
+   parent->disposer = NULL;
 }
 
-//---------------------- translation unit instance's diagnostic decode command
+//----------------------------------------------------------------- parse jobs
 
-static int tuDiagnosticDecodeObjCmd(ClientData     clientData,
-                                    Tcl_Interp    *interp,
-                                    int            objc,
-                                    Tcl_Obj *const objv[])
+/** The arguments and the outcome of a translation unit parse.
+ *
+ * Everything is copied out of the Tcl_Objs so that the parse can run on a
+ * worker thread while the interpreter goes on.
+ */
+typedef struct ParseJob
+{
+   CXIndex               index;
+   int                   preparsed;       // -precompiledFile
+   char                 *sourceFilename;  // NULL if it is in args
+   int                   numArgs;
+   char                **args;
+   int                   numUnsavedFiles;
+   struct CXUnsavedFile *unsavedFiles;
+   unsigned              flags;
+   CXTranslationUnit     tu;              // the result, NULL on failure
+   int                   errorCode;       // 0 on success
+} ParseJob;
+
+static char *copyString(const char *str, int length)
+{
+   char *result = Tcl_Alloc(length + 1);
+   memcpy(result, str, length);
+   result[length] = '\0';
+
+   return result;
+}
+
+/** Create a parse job.  unsavedFileList is a list of alternating file names
+ * and contents, or NULL.
+ */
+static ParseJob *createParseJob(CXIndex         index,
+                                int             preparsed,
+                                const char     *sourceFilename,
+                                int             numArgs,
+                                Tcl_Obj *const  argObjs[],
+                                Tcl_Obj        *unsavedFileList,
+                                unsigned        flags)
 {
-   enum {
-      command_ix,
-      index_ix,
-      nargs
-   };
+   ParseJob *job = (ParseJob *)Tcl_Alloc(sizeof *job);
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
-      return TCL_ERROR;
+   job->index          = index;
+   job->preparsed      = preparsed;
+   job->sourceFilename = sourceFilename != NULL
+      ? copyString(sourceFilename, strlen(sourceFilename))
+      : NULL;
+
+   job->numArgs = numArgs;
+   job->args    = (char **)Tcl_Alloc(numArgs * sizeof job->args[0] + 1);
+   for (int i = 0; i < numArgs; ++i) {
+      int         length;
+      const char *arg = Tcl_GetStringFromObj(argObjs[i], &length);
+      job->args[i]    = copyString(arg, length);
    }
 
-   int index = 0;
-   int status = Tcl_GetIntFromObj(interp, objv[index_ix], &index);
-   if (status != TCL_OK) {
-      return status;
+   int       length = 0;
+   Tcl_Obj **elms   = NULL;
+   if (unsavedFileList != NULL) {
+      Tcl_ListObjGetElements(NULL, unsavedFileList, &length, &elms);
    }
 
-   TUInfo *info = (TUInfo *)clientData;
+   job->numUnsavedFiles = length / 2;
+   job->unsavedFiles    = (struct CXUnsavedFile *)
+      Tcl_Alloc(job->numUnsavedFiles * sizeof job->unsavedFiles[0] + 1);
+   for (int i = 0; i < job->numUnsavedFiles; ++i) {
+      int         size;
+      const char *str = Tcl_GetStringFromObj(elms[i * 2], &size);
+      job->unsavedFiles[i].Filename = copyString(str, size);
 
-   unsigned numDiags = clang_getNumDiagnostics(info->translationUnit);
-   if (0 > index || numDiags <= index) {
-      Tcl_SetObjResult(interp,
-                       Tcl_ObjPrintf("index %d is out of range", index));
-      return TCL_ERROR;
+      str = Tcl_GetStringFromObj(elms[i * 2 + 1], &size);
+      job->unsavedFiles[i].Contents = copyString(str, size);
+      job->unsavedFiles[i].Length   = size;
    }
 
-   CXDiagnostic  diagnostic = clang_getDiagnostic(info->translationUnit,
-                                                  index);
-   Tcl_Obj      *resultObj  = newDiagnosticObj(diagnostic);
-   Tcl_SetObjResult(interp, resultObj);
-   clang_disposeDiagnostic(diagnostic);
+   job->flags     = flags;
+   job->tu        = NULL;
+   job->errorCode = 0;
 
-   return TCL_OK;
+   return job;
 }
 
-//---------------------- translation unit instance's diagnostic format command
-
-static BitMask diagnosticFormatOptions[] = {
-   { "-displaySourceLocation" },
-   { "-displayColumn" },
-   { "-displaySourceRanges" },
-   { "-displayOption" },
-   { "-displayCategoryId" },
-   { "-displayCategoryName" },
-   { NULL }
-};
-
-static int tuDiagnosticFormatObjCmd(ClientData     clientData,
-                                    Tcl_Interp    *interp,
-                                    int            objc,
-                                    Tcl_Obj *const objv[])
+/** Free a parse job.  The translation unit it produced, if any, is left
+ * alone.
+ */
+static void deleteParseJob(ParseJob *job)
 {
-   enum {
-      command_ix,
-      index_ix,
-      options_ix
-   };
+   if (job->sourceFilename != NULL) {
+      Tcl_Free(job->sourceFilename);
+   }
 
-   if (objc < index_ix + 1) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "index ?option?...");
-      return TCL_ERROR;
+   for (int i = 0; i < job->numArgs; ++i) {
+      Tcl_Free(job->args[i]);
    }
+   Tcl_Free((char *)job->args);
 
-   int index = 0;
-   int status = Tcl_GetIntFromObj(interp, objv[index_ix], &index);
-   if (status != TCL_OK) {
-      return status;
+   for (int i = 0; i < job->numUnsavedFiles; ++i) {
+      Tcl_Free((char *)job->unsavedFiles[i].Filename);
+      Tcl_Free((char *)job->unsavedFiles[i].Contents);
    }
+   Tcl_Free((char *)job->unsavedFiles);
 
-   TUInfo *info = (TUInfo *)clientData;
+   Tcl_Free((char *)job);
+}
 
-   unsigned flags = 0;
-   if (objc == options_ix) {
-      flags = clang_defaultDiagnosticDisplayOptions();
-   } else if (objc == options_ix + 1
-              && (objv[options_ix] == noneTagObj
-                  || strcmp(Tcl_GetStringFromObj(objv[options_ix], NULL),
-                            Tcl_GetStringFromObj(noneTagObj, NULL)) == 0)) {
-   } else {
-      for (int i = options_ix; i < objc; ++i) {
-         int optionNumber;
-         status = Tcl_GetIndexFromObjStruct
-            (interp, objv[options_ix + i],
-             diagnosticFormatOptions,
-             sizeof diagnosticFormatOptions[0],
-             "option", 0, &optionNumber);
-         if (status != TCL_OK) {
-            return status;
-         }
+/** Create a parse job with the arguments of job, but the unsaved files in
+ * unsavedFileList.
+ */
+static ParseJob *copyParseJob(const ParseJob *job, Tcl_Obj *unsavedFileList)
+{
+   int       numArgs = job->numArgs;
+   Tcl_Obj **argObjs = (Tcl_Obj **)Tcl_Alloc(numArgs * sizeof argObjs[0] + 1);
+   for (int i = 0; i < numArgs; ++i) {
+      argObjs[i] = Tcl_NewStringObj(job->args[i], -1);
+      Tcl_IncrRefCount(argObjs[i]);
+   }
 
-         flags |= diagnosticFormatOptions[optionNumber].mask == 0
-            ? 1 << optionNumber
-            : diagnosticFormatOptions[optionNumber].mask;
-      }
+   ParseJob *result = createParseJob(job->index, job->preparsed,
+                                     job->sourceFilename, numArgs, argObjs,
+                                     unsavedFileList, job->flags);
 
-      if ((flags & CXDiagnostic_DisplayColumn) != 0
-          || (flags & CXDiagnostic_DisplaySourceRanges) != 0) {
-         flags |= CXDiagnostic_DisplaySourceLocation;
-      }
+   for (int i = 0; i < numArgs; ++i) {
+      Tcl_DecrRefCount(argObjs[i]);
    }
+   Tcl_Free((char *)argObjs);
 
-   unsigned numDiags = clang_getNumDiagnostics(info->translationUnit);
-   if (index < 0 || numDiags <= index) {
-      Tcl_SetObjResult(interp,
-                       Tcl_ObjPrintf("index %d is out of range", index));
-      return TCL_ERROR;
-   }
+   return result;
+}
 
-   CXDiagnostic  diagnostic = clang_getDiagnostic(info->translationUnit,
-                                                  index);
-   CXString      result     = clang_formatDiagnostic(diagnostic, flags);
-   Tcl_Obj      *resultObj  = convertCXStringToObj(result);
-   Tcl_SetObjResult(interp, resultObj);
-   clang_disposeDiagnostic(diagnostic);
+/** Run a parse job.  This doesn't touch any interpreter, so it can be
+ * called on any thread.
+ */
+static void runParseJob(ParseJob *job)
+{
+   CXTranslationUnit tu = NULL;
 
-   return TCL_OK;
+   if (job->preparsed) {
+#if CINDEX_VERSION_MINOR >= 23
+      job->errorCode = clang_createTranslationUnit2(job->index,
+                                                    job->sourceFilename,
+                                                    &tu);
+#else
+      tu = clang_createTranslationUnit(job->index, job->sourceFilename);
+#endif
+   } else {
+#if CINDEX_VERSION_MINOR >= 23
+      job->errorCode = clang_parseTranslationUnit2
+         (job->index, job->sourceFilename,
+          (const char *const *)job->args, job->numArgs,
+          job->unsavedFiles, job->numUnsavedFiles, job->flags, &tu);
+#else
+      tu = clang_parseTranslationUnit
+         (job->index, job->sourceFilename,
+          (const char *const *)job->args, job->numArgs,
+          job->unsavedFiles, job->numUnsavedFiles, job->flags);
+#endif
+   }
+
+#if CINDEX_VERSION_MINOR < 23
+   job->errorCode = tu == NULL;
+#endif
+   job->tu = tu;
 }
 
-//---------------------- translation unit instance's diagnostic number command
+/** Return the error message of a failed parse job, or NULL if it
+ * succeeded.
+ */
+static Tcl_Obj *newParseErrorObj(const ParseJob *job)
+{
+#if CINDEX_VERSION_MINOR >= 23
+   switch (job->errorCode) {
+   case CXError_Success:
+     return NULL;
+   case CXError_Crashed:
+     return Tcl_NewStringObj("failed to create translation unit: libclang crashed.", -1);
+   case CXError_InvalidArguments:
+     return Tcl_NewStringObj("failed to create translation unit: invalid arguments.", -1);
+   case CXError_ASTReadError:
+     return Tcl_NewStringObj("failed to create translation unit: AST deserialization failed.", -1);
+   default:
+     return Tcl_NewStringObj("failed to create translation unit.", -1);
+   }
+#else
+   if (job->errorCode == 0) {
+      return NULL;
+   }
 
-static int tuDiagnosticNumberObjCmd(ClientData     clientData,
-                                    Tcl_Interp    *interp,
-                                    int            objc,
-                                    Tcl_Obj *const objv[])
+   return Tcl_NewStringObj("failed to create translation unit.", -1);
+#endif
+}
+
+/** Create the Tcl command of the translation unit parsed by job and return
+ * its fully qualified name.  The translation unit keeps job to be able to
+ * parse itself anew.
+ */
+static Tcl_Obj *createTUCommand(Tcl_Interp *interp,
+                                IndexInfo  *parent,
+                                Tcl_Obj    *tuNameObj,
+                                ParseJob   *job)
 {
-   enum {
-      command_ix,
-      nargs
-   };
+   Tcl_Obj *commandNameObj = NULL;
+   newQualifiedName(interp, tuNameObj, &commandNameObj);
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
-      return TCL_ERROR;
-   }
+   Tcl_Command cmd = Tcl_CreateObjCommand(interp, Tcl_GetString(commandNameObj),
+                                          tuInstanceObjCmd, NULL, tuDeleteProc);
+   Tcl_CmdInfo cmdinfo;
+   TUInfo     *info = createTUInfo(parent, cmd, job->tu);
+   Tcl_GetCommandInfoFromToken(cmd, &cmdinfo);
+   cmdinfo.objClientData = info;
+   cmdinfo.clientData = info;
+   cmdinfo.deleteData = info;
+   Tcl_SetCommandInfoFromToken(cmd, &cmdinfo);
 
-   TUInfo *info = (TUInfo *)clientData;
+   job->tu         = NULL;
+   info->parseArgs = job;
 
-   unsigned  result    = clang_getNumDiagnostics(info->translationUnit);
-   Tcl_Obj  *resultObj = Tcl_NewLongObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   markTUUsed(info);
+   enforceTUPool(parent, info);
 
-   return TCL_OK;
+   return commandNameObj;
 }
 
-//--------------------------------- translation unit instance's cursor command
-
-static int tuCursorObjCmd(ClientData     clientData,
-                          Tcl_Interp    *interp,
-                          int            objc,
-                          Tcl_Obj *const objv[])
+/** Replace the translation unit of info with the one parsed by job, as a
+ * reparse would.
+ */
+static void replaceTranslationUnit(TUInfo *info, ParseJob *job)
 {
-   TUInfo *info = (TUInfo *)clientData;
+   CXTranslationUnit old = info->translationUnit;
 
-   enum {
-      command_ix,
-      optional_ix
-   };
+   if (!info->suspended) {
+      unregisterTU(info);
+   }
+   info->translationUnit = job->tu;
+   info->suspended       = 0;
+   registerTU(info);
 
-   static const char *options[] = {
-      "-location",
-      "-file",
-      "-line",
-      "-column",
-      "-offset",
-      NULL,
-   };
+   // Cursors created before point into the disposed AST.
+   ++info->generation;
+   info->reparseGeneration = info->generation;
+   clearCursorHandles(info);
+   clearFileNames(info);
+   clearLineTables(info);
+   deleteASTIndex(info);
 
-   enum {
-      option_location,
-      option_file,
-      option_line,
-      option_column,
-      option_offset,
-   };
+   job->tu = NULL;
+   deleteParseJob(info->parseArgs);
+   info->parseArgs = job;
 
-   unsigned          options_found = 0;
-   CXSourceLocation  location      = clang_getNullLocation();
-   unsigned          line          = 0;
-   unsigned          column        = 0;
-   unsigned          offset        = 0;
-   CXFile            file          = NULL;
+   if (old != NULL) {
+      disposeTranslationUnitLater(info->parent, old);
+   }
+   enforceTUPool(info->parent, info);
+}
 
-   for (int i = optional_ix; i < objc; ++i) {
-      int optionNumber;
-      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
-                                       "option", 0, &optionNumber);
-      if (status != TCL_OK) {
-         return status;
-      }
+//--------------------------------------------------------------- async parses
 
-      if ((options_found & (1 << optionNumber)) != 0) {
-         Tcl_SetObjResult(interp,
-                          Tcl_ObjPrintf("%s is specified more than once.",
-                                        Tcl_GetStringFromObj(objv[i], NULL)));
-         return TCL_ERROR;
-      }
+/** A parse running on a background thread for the -async option of the
+ * translationUnit and reparse commands.
+ *
+ * The worker only runs the parse job.  Its outcome is posted back to the
+ * interpreter's thread as an event, where the translation unit is installed
+ * and the callback is run.
+ */
+typedef struct AsyncParse
+{
+   struct AsyncParse  *next;        // the next async parse of parent
+   struct AsyncParse **prevPtr;     // the link pointing to this one
+   IndexInfo          *parent;      // NULL after the index is deleted
+   Tcl_Interp         *interp;
+   Tcl_ThreadId        owner;       // the thread of interp
+   Tcl_ThreadId        worker;
+   int                 joined;      // whether worker has been joined
+   Tcl_Obj            *tuNameObj;   // the name of a new translation unit
+   TUInfo             *target;      // or the translation unit to reparse
+   unsigned            syncReparses; // target->syncReparses at the start
+   Tcl_Obj            *commandsObj; // the callbacks, a list
+   ParseJob           *job;
+   CXIndex             index;       // the worker index of job, or NULL
+} AsyncParse;
+
+typedef struct AsyncParseEvent
+{
+   Tcl_Event   header;
+   AsyncParse *parse;
+} AsyncParseEvent;
+
+static AsyncParse *startAsyncParse(Tcl_Interp *interp,
+                                   IndexInfo  *parent,
+                                   Tcl_Obj    *tuNameObj,
+                                   TUInfo     *target,
+                                   Tcl_Obj    *commandsObj,
+                                   ParseJob   *job);
+
+// The stack size of parse workers.  Clang recurses deeply on nested
+// expressions and templates.
+#define PARSE_WORKER_STACK_SIZE (8 * 1024 * 1024)
+
+static void unlinkAsyncParse(AsyncParse *parse)
+{
+   if (parse->prevPtr == NULL) {
+      return;
+   }
 
-      switch (optionNumber) {
+   *parse->prevPtr = parse->next;
+   if (parse->next != NULL) {
+      parse->next->prevPtr = parse->prevPtr;
+   }
+   parse->next    = NULL;
+   parse->prevPtr = NULL;
+}
 
-      case option_location:
-         if (options_found != 0) {
-            goto invalid_form;
-         }
+static void joinAsyncParse(AsyncParse *parse)
+{
+   if (!parse->joined) {
+      int result;
+      Tcl_JoinThread(parse->worker, &result);
+      parse->joined = 1;
+   }
+}
 
-         if (objc <= i + 1) {
-            Tcl_SetObjResult(interp,
-                             Tcl_NewStringObj("-location is not followed by a "
-                                              "source location",
-                                              -1));
-            return TCL_ERROR;
-         }
+/** Give back the worker index of a joined parse.  A later parse from
+ * scratch of its translation unit runs on the index of parent, like the
+ * ones of other translation units.
+ */
+static void releaseAsyncParseIndex(AsyncParse *parse)
+{
+   if (parse->index != NULL) {
+      releaseWorkerIndex(parse->parent, parse->index);
+      parse->index      = NULL;
+      parse->job->index = parse->parent->index;
+   }
+}
 
-         status = getLocationFromObj(interp, objv[i + 1], &location);
-         if (status != TCL_OK) {
-            return status;
-         }
+/** Wait for the async parses of an index that is being deleted.  Their
+ * events are still delivered, but only free them.
+ */
+static void cancelAsyncParses(IndexInfo *parent)
+{
+   while (parent->firstAsyncParse != NULL) {
+      AsyncParse *parse = parent->firstAsyncParse;
+      joinAsyncParse(parse);
+      unlinkAsyncParse(parse);
+      releaseAsyncParseIndex(parse);
+
+      // The translation unit must go before its index.
+      if (parse->job->tu != NULL) {
+         clang_disposeTranslationUnit(parse->job->tu);
+         parse->job->tu = NULL;
+      }
+      parse->parent = NULL;
+   }
+}
 
-         i++;
+static void runAsyncParseCallback(Tcl_Interp *interp,
+                                  Tcl_Obj    *commandObj,
+                                  Tcl_Obj    *nameObj,
+                                  int         errorCode)
+{
+   Tcl_Obj *scriptObj = Tcl_DuplicateObj(commandObj);
+   Tcl_IncrRefCount(scriptObj);
+   Tcl_ListObjAppendElement(NULL, scriptObj, nameObj);
+   Tcl_ListObjAppendElement(NULL, scriptObj, Tcl_NewIntObj(errorCode));
 
-         break;
+   int status = Tcl_EvalObjEx(interp, scriptObj, TCL_EVAL_GLOBAL);
+   if (status != TCL_OK) {
+      Tcl_BackgroundError(interp);
+   }
 
-      case option_file:
-         if ((options_found & (1 << option_location)) != 0) {
-            goto invalid_form;
-         }
+   Tcl_DecrRefCount(scriptObj);
+}
 
-         if (objc <= i + 1) {
-            Tcl_SetObjResult(interp,
-                             Tcl_NewStringObj("-file is not followed by a "
-                                              "filename",
-                                              -1));
-            return TCL_ERROR;
-         }
+static int asyncParseEventProc(Tcl_Event *evPtr, int flags)
+{
+   if (!(flags & TCL_FILE_EVENTS)) {
+      return 0;
+   }
 
-         const char *filename = Tcl_GetStringFromObj(objv[i + 1], NULL);
-         file = clang_getFile(info->translationUnit, filename);
-         if (file == NULL) {
-            goto invalid_location;
-         }
+   AsyncParse *parse     = ((AsyncParseEvent *)evPtr)->parse;
+   ParseJob   *job       = parse->job;
+   int         errorCode = job->errorCode;
+   Tcl_Obj    *nameObj   = NULL;
 
-         i++;
+   joinAsyncParse(parse);
+   if (parse->parent != NULL) {
+      releaseAsyncParseIndex(parse);
+   }
 
-         break;
+   // Don't pull the AST from under a traversal.  leaveTU posts the event
+   // again.
+   if (parse->parent != NULL && parse->target != NULL
+       && parse->target->cmd != NULL && parse->target->busyCount > 0) {
+      parse->target->deferredParse = parse;
+      return 1;
+   }
 
-      case option_line:
-      case option_column:
-         if ((options_found & ((1 << option_location)
-                               | (1 << option_offset))) != 0) {
-            goto invalid_form;
-         }
+   unlinkAsyncParse(parse);
 
-         if (objc <= i + 1) {
-            Tcl_SetObjResult(interp,
-                             Tcl_ObjPrintf("%s is not followed by a %s",
-                                           Tcl_GetStringFromObj(objv[i], NULL),
-                                           optionNumber == option_line
-                                           ? "line number"
-                                           : "column number"));
-            return TCL_ERROR;
-         }
+   if (parse->parent == NULL) {
 
-         status = getUnsignedFromObj(interp, objv[i + 1],
-                                     optionNumber == option_line
-                                     ? &line
-                                     : &column);
-         if (status != TCL_OK) {
-            return status;
-         }
+      // The index is gone, and so is the translation unit.
 
-         i++;
+   } else if (parse->target != NULL) {
 
-         break;
+      TUInfo *target = parse->target;
+      if (target->reparse == parse) {
+         target->reparse = NULL;
+      }
 
-      case option_offset:
-         if ((options_found & ((1 << option_location)
-                               | (1 << option_line)
-                               | (1 << option_column))) != 0) {
-            goto invalid_form;
+      if (target->cmd == NULL) {
+         // The command was deleted while the parse was running.
+         if (job->tu != NULL) {
+            clang_disposeTranslationUnit(job->tu);
+            job->tu = NULL;
          }
-
-         if (objc <= i + 1) {
-            Tcl_SetObjResult(interp,
-                             Tcl_NewStringObj("-offset is not "
-                                              "followed by an offset",
-                                              -1));
-            return TCL_ERROR;
+      } else {
+         nameObj = Tcl_NewObj();
+         Tcl_GetCommandFullName(parse->interp, target->cmd, nameObj);
+         if (job->tu != NULL
+             && parse->syncReparses != target->syncReparses) {
+            // A synchronous reparse made after the request is newer.
+            disposeTranslationUnitLater(parse->parent, job->tu);
+            job->tu = NULL;
+         } else if (job->tu != NULL) {
+            replaceTranslationUnit(target, job);
+            job = NULL;
          }
-         
-         status = getUnsignedFromObj(interp, objv[i + 1], &offset);
-         if (status != TCL_OK) {
-            return status;
+
+         // Run the requests that came in meanwhile.
+         if (target->nextReparse != NULL) {
+            Tcl_Obj *commandsObj = target->nextReparseCommands;
+            target->reparse = startAsyncParse(parse->interp, parse->parent,
+                                              NULL, target, commandsObj,
+                                              target->nextReparse);
+            Tcl_DecrRefCount(commandsObj);
+            target->nextReparse         = NULL;
+            target->nextReparseCommands = NULL;
          }
+      }
 
-         i++;
+   } else if (job->tu != NULL) {
 
-         break;
+      nameObj = createTUCommand(parse->interp, parse->parent,
+                                parse->tuNameObj, job);
+      job     = NULL;
 
-      default:
-         Tcl_Panic("unknown option number");
+   } else {
 
-      }
+      nameObj = parse->tuNameObj;
 
-      options_found |= 1 << optionNumber;
    }
 
-   CXCursor cursor;
-   unsigned line_and_column_form = (1 << option_file)
-      | (1 << option_line)
-      | (1 << option_column);
-   unsigned offset_form = (1 << option_file) | (1 << option_offset);
-   unsigned location_form = (1 << option_location);
-
-   if (options_found == 0) {
+   if (nameObj != NULL) {
+      int       numCommands;
+      Tcl_Obj **commands;
+      Tcl_ListObjGetElements(NULL, parse->commandsObj,
+                             &numCommands, &commands);
 
-      cursor = clang_getTranslationUnitCursor(info->translationUnit);
+      Tcl_IncrRefCount(nameObj);
+      for (int i = 0; i < numCommands; ++i) {
+         runAsyncParseCallback(parse->interp, commands[i],
+                               nameObj, errorCode);
+      }
+      Tcl_DecrRefCount(nameObj);
+   }
 
-   } else {
+   if (job != NULL) {
+      deleteParseJob(job);
+   }
+   if (parse->tuNameObj != NULL) {
+      Tcl_DecrRefCount(parse->tuNameObj);
+   }
+   Tcl_DecrRefCount(parse->commandsObj);
+   if (parse->target != NULL) {
+      releaseTUInfo(parse->target);
+   }
+   Tcl_Release(parse->interp);
+   Tcl_Free((char *)parse);
 
-      if ((options_found & line_and_column_form) == line_and_column_form) {
+   return 1;
+}
 
-         location = clang_getLocation(info->translationUnit,
-                                      file, line, column);
+static void queueAsyncParseEvent(AsyncParse *parse)
+{
+   AsyncParseEvent *event = (AsyncParseEvent *)Tcl_Alloc(sizeof *event);
+   event->header.proc = asyncParseEventProc;
+   event->parse       = parse;
 
-      } else if ((options_found & offset_form) == offset_form) {
+   Tcl_ThreadQueueEvent(parse->owner, &event->header, TCL_QUEUE_TAIL);
+   Tcl_ThreadAlert(parse->owner);
+}
 
-         location = clang_getLocationForOffset(info->translationUnit,
-                                               file, offset);
+static Tcl_ThreadCreateType asyncParseWorker(ClientData clientData)
+{
+   AsyncParse *parse = (AsyncParse *)clientData;
 
-      } else if ((options_found & location_form) == location_form) {
+   runParseJob(parse->job);
 
-        // Location provided as argument.
+   // parse belongs to the interpreter's thread from here on.
+   queueAsyncParseEvent(parse);
 
-      } else {
+   TCL_THREAD_CREATE_RETURN;
+}
 
-         goto invalid_form;
+/** Run job on a background thread.  When it's done, either create the
+ * translation unit command tuNameObj or replace the translation unit of
+ * target, then call each of commandsObj with the command name and the
+ * error code.
+ */
+static AsyncParse *startAsyncParse(Tcl_Interp *interp,
+                                   IndexInfo  *parent,
+                                   Tcl_Obj    *tuNameObj,
+                                   TUInfo     *target,
+                                   Tcl_Obj    *commandsObj,
+                                   ParseJob   *job)
+{
+   AsyncParse *parse = (AsyncParse *)Tcl_Alloc(sizeof *parse);
 
-      }
+   parse->parent      = parent;
+   parse->interp      = interp;
+   parse->owner       = Tcl_GetCurrentThread();
+   parse->joined      = 0;
+   parse->tuNameObj   = tuNameObj;
+   parse->target      = target;
+   parse->syncReparses = target != NULL ? target->syncReparses : 0;
+   parse->commandsObj = commandsObj;
+   parse->job         = job;
+   parse->index       = acquireWorkerIndex(parent);
 
-      if (clang_equalLocations(location, clang_getNullLocation())) {
-         goto invalid_location;
-      }
+   if (tuNameObj != NULL) {
+      Tcl_IncrRefCount(tuNameObj);
+   }
+   Tcl_IncrRefCount(commandsObj);
+   if (target != NULL) {
+      retainTUInfo(target);
+   }
+   Tcl_Preserve(interp);
 
-      cursor = clang_getCursor(info->translationUnit, location);
+   parse->next    = parent->firstAsyncParse;
+   parse->prevPtr = &parent->firstAsyncParse;
+   if (parent->firstAsyncParse != NULL) {
+      parent->firstAsyncParse->prevPtr = &parse->next;
+   }
+   parent->firstAsyncParse = parse;
 
+   if (parse->index != NULL) {
+      job->index = parse->index;
    }
 
-   if (clang_Cursor_isNull(cursor)) {
-      goto invalid_location;
+   if (parse->index == NULL
+       || Tcl_CreateThread(&parse->worker, asyncParseWorker, parse,
+                           PARSE_WORKER_STACK_SIZE,
+                           TCL_THREAD_JOINABLE) != TCL_OK) {
+      // Tcl without threads, or no index to spare.  Parse now, but still
+      // report through the event loop.
+      parse->joined = 1;
+      releaseAsyncParseIndex(parse);
+      runParseJob(job);
+      queueAsyncParseEvent(parse);
    }
 
-   Tcl_Obj *cursorObj = newCursorObj(cursor);
-   Tcl_SetObjResult(interp, cursorObj);
+   return parse;
+}
 
-   return TCL_OK;
+/** Reparse info in background.  While a reparse is running, further
+ * requests are merged into one that starts when it is done: the last
+ * request's unsaved files win and all the callbacks are called.
+ */
+static void requestBackgroundReparse(Tcl_Interp *interp,
+                                     TUInfo     *info,
+                                     Tcl_Obj    *commandObj,
+                                     ParseJob   *job)
+{
+   if (info->reparse == NULL) {
+      Tcl_Obj *commandsObj = Tcl_NewListObj(commandObj != NULL, &commandObj);
+      info->reparse = startAsyncParse(interp, info->parent, NULL, info,
+                                      commandsObj, job);
+      return;
+   }
 
- invalid_form:
-   Tcl_SetObjResult(interp,
-                    Tcl_NewStringObj("the specified location is not valid.",
-                                     -1));
-   return TCL_ERROR;
+   if (info->nextReparse != NULL) {
+      deleteParseJob(info->nextReparse);
+   } else {
+      info->nextReparseCommands = Tcl_NewListObj(0, NULL);
+      Tcl_IncrRefCount(info->nextReparseCommands);
+   }
+   info->nextReparse = job;
 
- invalid_location:
-   Tcl_SetObjResult(interp,
-                    Tcl_NewStringObj("the specified location is "
-                                     "not a part of the translation unit.",
-                                     -1));
-   return TCL_ERROR;
+   if (commandObj != NULL) {
+      Tcl_ListObjAppendElement(NULL, info->nextReparseCommands, commandObj);
+   }
 }
 
-//----------------------------- translation unit instance's diagnostic command
-
-static int tuDiagnosticObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+/** Drop the background reparses of info, because a synchronous reparse
+ * supersedes them.  The running one is discarded when it is done, and the
+ * one waiting for it is discarded now.  All their callbacks are still
+ * called when the running one is done.
+ */
+static void cancelBackgroundReparses(TUInfo *info)
 {
-   enum {
-      command_ix,
-      subcommand_ix,
-      numMandatoryArgs
-   };
+   ++info->syncReparses;
 
-   if (objc < numMandatoryArgs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
-      return TCL_ERROR;
+   if (info->nextReparse == NULL) {
+      return;
    }
 
-   static Command subcommands[] = {
-      { "decode",
-        tuDiagnosticDecodeObjCmd },
-      { "format",
-        tuDiagnosticFormatObjCmd },
-      { "number",
-        tuDiagnosticNumberObjCmd },
-      { NULL },
-   };
-
-   int commandNumber;
-   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
-                                          subcommands, sizeof subcommands[0],
-                                          "subcommand", 0, &commandNumber);
-   if (status != TCL_OK) {
-      return status;
+   AsyncParse *running = info->reparse;
+   if (Tcl_IsShared(running->commandsObj)) {
+      Tcl_Obj *commandsObj = Tcl_DuplicateObj(running->commandsObj);
+      Tcl_IncrRefCount(commandsObj);
+      Tcl_DecrRefCount(running->commandsObj);
+      running->commandsObj = commandsObj;
    }
+   Tcl_ListObjAppendList(NULL, running->commandsObj,
+                         info->nextReparseCommands);
 
-   return subcommands[commandNumber].proc(clientData, interp,
-                                          objc - subcommand_ix,
-                                          objv + subcommand_ix);
+   deleteParseJob(info->nextReparse);
+   Tcl_DecrRefCount(info->nextReparseCommands);
+   info->nextReparse         = NULL;
+   info->nextReparseCommands = NULL;
 }
 
-//------------------------------------------------- tuInclusionsHelper command
+//------------------------------------------------------ translation unit pool
 
-typedef struct InclusionsInfo {
-   unsigned    maxDepth;        /* Don't eval after this depth. */
-} InclusionsInfo;
+static Tcl_WideInt getTUResidentBytes(CXTranslationUnit tu)
+{
+   CXTUResourceUsage usage = clang_getCXTUResourceUsage(tu);
 
-static void tuInclusionsHelper(CXFile            includedFile,
-                               CXSourceLocation *inclusionStack,
-                               unsigned          depth,
-                               CXClientData      clientData)
+   Tcl_WideInt total = 0;
+   for (unsigned i = 0; i < usage.numEntries; ++i) {
+      total += usage.entries[i].amount;
+   }
+
+   clang_disposeCXTUResourceUsage(usage);
+
+   return total;
+}
+
+/** Evict the translation unit of info to free its memory.  The command
+ * stays, and parses it anew on its next use.  The values made from it
+ * before are rejected from now on, as those of an evicted translation unit.
+ */
+static void suspendTranslationUnit(TUInfo *info)
 {
-   int status = TCL_OK;
+   CXTranslationUnit tu = info->translationUnit;
 
-   struct VisitInfo *visitInfo = (VisitInfo *)clientData;
-   struct InclusionsInfo *inclusionsInfo = (InclusionsInfo *)visitInfo->clientData;
+   unregisterTU(info);
+   info->translationUnit = NULL;
+   info->suspended       = 1;
 
-   /*
-    * Return value does not drive the recursion, as is the case with
-    * clang_visitChildren.  Use visitInfo to keep recursion state.
-    */
-   switch (visitInfo->returnCode) {
-   case TCL_OK:
-   case TCL_RECURSE:
-      /* Evaluate the script */
-      break;
+   // Cursors created before point into the disposed AST.
+   ++info->generation;
+   clearCursorHandles(info);
+   clearFileNames(info);
+   clearLineTables(info);
+   deleteASTIndex(info);
 
-   case TCL_CONTINUE:
-      if(depth > inclusionsInfo->maxDepth) {
-         /* Do not recurse deeper than maxDepth. */
-         return;
-      } else if(depth <= inclusionsInfo->maxDepth) {
-         /* Keep recursing normally once out of the subtree. */
-         inclusionsInfo->maxDepth = 0;
-         visitInfo->returnCode = TCL_OK;
-      }
-      break;
+   ++info->parent->pool.evictions;
+   disposeTranslationUnitLater(info->parent, tu);
+}
 
-   default:
-      /* Ignore till the end for TCL_BREAK, TCL_ERROR, etc. */
+/** Evict translation units of parent, the least recently used first, until
+ * the pool is within its limits.  keep and the pinned translation units are
+ * never evicted.
+ */
+static void enforceTUPool(IndexInfo *parent, TUInfo *keep)
+{
+   TUPool *pool = &parent->pool;
+   if (pool->maxBytes == 0 && pool->maxTUs == 0) {
       return;
    }
 
+   int         numLoaded = 0;
+   Tcl_WideInt bytes     = 0;
+   pool->overLimit = 0;
+   for (TUInfo *info = parent->firstTU; info != NULL; info = info->next) {
+      if (info->suspended) {
+         continue;
+      }
+      ++numLoaded;
+      if (pool->maxBytes != 0) {
+         info->residentBytes = getTUResidentBytes(info->translationUnit);
+         bytes += info->residentBytes;
+      }
+   }
+
+   while ((pool->maxTUs != 0 && pool->maxTUs < numLoaded)
+          || (pool->maxBytes != 0 && pool->maxBytes < bytes)) {
+      TUInfo *victim = NULL;
+      for (TUInfo *info = parent->firstTU; info != NULL; info = info->next) {
+         if (!info->suspended && info != keep && info->pinCount == 0
+             && (victim == NULL || info->lastUse < victim->lastUse)) {
+            victim = info;
+         }
+      }
 
-   Tcl_Obj *filenameVarName = visitInfo->variableNames[0];
-   Tcl_Obj *stackVarName = visitInfo->variableNames[1];
-   Tcl_Obj *filenameObj = NULL;
-   Tcl_Obj *stackObj = NULL;
+      if (victim == NULL) {
+         // Try again when a translation unit is unpinned.
+         pool->overLimit = 1;
+         break;
+      }
 
-   /* File name. */
-   CXString filename = clang_getFileName(includedFile);
-   filenameObj = convertCXStringToObj(filename);
-   Tcl_IncrRefCount(filenameObj);
-   if (Tcl_ObjSetVar2(visitInfo->interp, filenameVarName,
-                      NULL, filenameObj, TCL_LEAVE_ERR_MSG) == NULL) {
-      status = TCL_ERROR;
-      goto cleanup;
+      --numLoaded;
+      bytes -= victim->residentBytes;
+      suspendTranslationUnit(victim);
    }
+}
 
-   /* Stack.  Grows to the right (lappend).*/
-   Tcl_Obj **elms = (Tcl_Obj **)Tcl_Alloc(depth * sizeof(Tcl_Obj *));
-   for (int i = 0; i < depth; i++) {
-      elms[depth - i - 1] = newLocationObj(inclusionStack[i]);
-   }
-   stackObj = Tcl_NewListObj(depth, elms);
-   Tcl_Free((char *)elms);
-   Tcl_IncrRefCount(stackObj);
-   if (Tcl_ObjSetVar2(visitInfo->interp, stackVarName,
-                      NULL, stackObj, TCL_LEAVE_ERR_MSG) == NULL) {
-      status = TCL_ERROR;
-      goto cleanup;
-   }
+/** Mark the translation unit of info as the most recently used, and parse
+ * it anew from its saved arguments if the pool has evicted it.
+ */
+static int usePooledTU(Tcl_Interp *interp, TUInfo *info)
+{
+   IndexInfo *parent = info->parent;
 
-   status = Tcl_EvalObjEx(visitInfo->interp, visitInfo->scriptObj, 0);
+   markTUUsed(info);
 
-cleanup:
-   if (filenameObj) {
-      Tcl_DecrRefCount(filenameObj);
-   }
-   if (stackObj) {
-      Tcl_DecrRefCount(stackObj);
+   if (!info->suspended) {
+      return TCL_OK;
    }
 
-   switch (status) {
-   case TCL_OK:
-   case TCL_RECURSE:
-      visitInfo->returnCode = status;
-      break;
-   case TCL_CONTINUE:
-      inclusionsInfo->maxDepth = depth;
-      visitInfo->returnCode = TCL_CONTINUE;
-      break;
-   case TCL_BREAK:
-      visitInfo->returnCode = TCL_BREAK;
-      break;
-   default:
-      visitInfo->returnCode = status;
+   ParseJob *job = info->parseArgs;
+   runParseJob(job);
+
+   Tcl_Obj *err = newParseErrorObj(job);
+   if (err != NULL) {
+      Tcl_SetObjResult(interp, err);
+      return TCL_ERROR;
    }
-   return;
+
+   info->translationUnit = job->tu;
+   info->suspended       = 0;
+   job->tu               = NULL;
+   registerTU(info);
+
+   ++parent->pool.restorations;
+   enforceTUPool(parent, info);
+
+   return TCL_OK;
 }
 
-//----------------------------- translation unit instance's inclusions command
+//------------------------------------------ indexName translationUnit command
 
-static int tuInclusionsObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+enum {
+   parseOptions_sourceFile,
+   parseOptions_precompiledFile,
+   parseOptions_unsavedFile,
+   parseOptions_async,
+   parseOptions_command,
+   parseOptions_compileCommand,
+   parseOptions_firstFlag
+};
+
+static const char *parseOptions[] = {
+   "-sourceFile",
+   "-precompiledFile",
+   "-unsavedFile",
+   "-async",
+   "-command",
+   "-compileCommand",
+
+   // flags
+   "-detailedPreprocessingRecord",
+   "-incomplete",
+   "-precompiledPreamble",
+   "-cacheCompletionResults",
+   "-forSerialization",
+   "-cxxChainedPCH",
+   "-skipFunctionBodies",
+   "-includeBriefCommentsInCodeCompletion",
+#if CINDEX_VERSION_MINOR >= 33
+   "-createPreambleOnFirstParse",
+#endif
+#if CINDEX_VERSION_MINOR >= 34
+   "-keepGoing",
+#endif
+   NULL
+};
+
+static const char * const *parseFlags
+  = &parseOptions[parseOptions_firstFlag];
+
+static int indexNameTranslationUnitObjCmd(ClientData     clientData,
+                                          Tcl_Interp    *interp,
+                                          int            objc,
+                                          Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      variableNames_ix,
-      script_ix,
-      nargs
+      options_ix
    };
 
-   Tcl_Obj *varNamesObj = NULL;
-   int status = TCL_OK;
-
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "{fileVarName filestackVarName} script");
-      status = TCL_ERROR;
-      goto cleanup;
+   if (objc < options_ix + 1) {
+      goto wrong_num_args;
    }
 
-   TUInfo *info = (TUInfo *)clientData;
+   enum {
+      parse_source,
+      parse_preparsed
+   }           parse           = parse_source;
+   unsigned    flags           = 0;
+   const char *sourceFilename  = NULL;
+   int         async           = 0;
+   Tcl_Obj    *commandObj      = NULL;
+   Tcl_Obj    *compileDbObj    = NULL;
+   Tcl_Obj    *compileFileObj  = NULL;
+   Tcl_Obj    *unsavedFileList = Tcl_NewObj();
+   Tcl_IncrRefCount(unsavedFileList);
 
-   int       numVars = 0;
-   Tcl_Obj **varNames = NULL;
-   varNamesObj = Tcl_DuplicateObj(objv[variableNames_ix]);
-   Tcl_IncrRefCount(varNamesObj);
-   status = Tcl_ListObjGetElements(interp, varNamesObj, &numVars, &varNames);
-   if (status != TCL_OK) {
-      goto cleanup;
-   } else if (numVars != 2) {
-      Tcl_SetObjResult(interp, Tcl_NewStringObj("invalid loop variables: must be fileVarName filestackVarName", -1));
-      status = TCL_ERROR;
-      goto cleanup;
-   }
+   int i;
+   for (i = options_ix; i < objc; ++i) {
+      const char *str = Tcl_GetStringFromObj(objv[i], NULL);
 
-   InclusionsInfo inclusionsInfo = {
-      .maxDepth         = 0,
-   };
+      if (str[0] != '-') {
+         break;
+      }
 
-   VisitInfo visitInfo = {
-      .interp           = interp,
-      .variableNames    = varNames,
-      .numVariables     = numVars,
-      .scriptObj        = objv[script_ix],
-      .returnCode       = TCL_OK,
-      .clientData = (void *)&inclusionsInfo
-   };
+      if (strcmp(str, "--") == 0) {
+         ++i;
+         break;
+      }
 
-   clang_getInclusions(info->translationUnit, tuInclusionsHelper, &visitInfo);
+      int optionNumber;
+      int status = Tcl_GetIndexFromObj(interp, objv[i], parseOptions,
+                                       "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         Tcl_DecrRefCount(unsavedFileList);
+         return status;
+      }
 
-   /* Convert traversal-related return codes to TCL_OK. */
-   switch (visitInfo.returnCode) {
-   case TCL_OK:
-   case TCL_CONTINUE:
-   case TCL_RECURSE:
-   case TCL_BREAK:
-      status = TCL_OK;
-      break;
-   default:
-      /* Keep the interpreter's result */
-      status = visitInfo.returnCode;
-   }
+      switch (optionNumber) {
+      case parseOptions_sourceFile: // -sourceFile filename
+         if (objc <= i + 1) {
+            Tcl_WrongNumArgs(interp, i, objv, "filename ...");
+            Tcl_DecrRefCount(unsavedFileList);
+            return TCL_ERROR;
+         }
+         sourceFilename = Tcl_GetStringFromObj(objv[i + 1], NULL);
+         ++i;
+         break;
 
-cleanup:
-   if (varNamesObj) {
-      Tcl_DecrRefCount(varNamesObj);
-   }
+      case parseOptions_unsavedFile: // -unsavedFile filename contents
+         if (objc <= i + 2) {
+            Tcl_WrongNumArgs(interp, i, objv, "filename contents ...");
+            Tcl_DecrRefCount(unsavedFileList);
+            return TCL_ERROR;
+         }
+         Tcl_ListObjAppendElement(NULL, unsavedFileList, objv[++i]);
+         Tcl_ListObjAppendElement(NULL, unsavedFileList, objv[++i]);
+         break;
 
-   return status;
-}
+      case parseOptions_precompiledFile: // -precompiledFile filename
+         parse = parse_preparsed;
+         if (objc <= i + 2) {
+            Tcl_WrongNumArgs(interp, i, objv, "-precompiledFile filename");
+            Tcl_DecrRefCount(unsavedFileList);
+            return TCL_ERROR;
+         }
+         sourceFilename = Tcl_GetStringFromObj(objv[i + 1], NULL);
+         ++i;
+         break;
 
-//---------------------------------- translation unit instance's index command
+      case parseOptions_async: // -async
+         async = 1;
+         break;
 
-static int tuIndexObjCmd(ClientData     clientData,
-                         Tcl_Interp    *interp,
-                         int            objc,
-                         Tcl_Obj *const objv[])
-{
-   enum {
-      command_ix,
-      nargs
-   };
+      case parseOptions_command: // -command callback
+         if (objc <= i + 1) {
+            Tcl_WrongNumArgs(interp, i, objv, "callback ...");
+            Tcl_DecrRefCount(unsavedFileList);
+            return TCL_ERROR;
+         }
+         commandObj = objv[++i];
+         break;
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
+      case parseOptions_compileCommand: // -compileCommand database filename
+         if (objc <= i + 2) {
+            Tcl_WrongNumArgs(interp, i, objv, "database filename ...");
+            Tcl_DecrRefCount(unsavedFileList);
+            return TCL_ERROR;
+         }
+         compileDbObj   = objv[++i];
+         compileFileObj = objv[++i];
+         break;
+
+      default:
+         flags |= 1 << (optionNumber - parseOptions_firstFlag);
+      }
+   }
+
+   if (objc <= i) {
+      goto wrong_num_args;
+   }
+
+   if (commandObj != NULL && !async) {
+      Tcl_SetObjResult(interp,
+                       Tcl_NewStringObj("-command requires -async", -1));
+      Tcl_DecrRefCount(unsavedFileList);
       return TCL_ERROR;
    }
 
-   TUInfo *info = (TUInfo *)clientData;
+   Tcl_Obj *tuNameObj = objv[i++];
 
-   Tcl_Obj *tuObj = Tcl_NewObj();
-   Tcl_GetCommandFullName(interp, info->parent->cmd, tuObj);
-   Tcl_SetObjResult(interp, tuObj);
+   // The compile command's arguments come before the ones given here.
+   int        numArgs        = objc - i;
+   Tcl_Obj  **argObjs        = (Tcl_Obj **)(objv + i);
+   Tcl_Obj   *compileArgsObj = NULL;
+   if (compileDbObj != NULL) {
+      int status = getCompileCommandFromObj(interp, compileDbObj,
+                                            compileFileObj,
+                                            &compileArgsObj,
+                                            &compileFileObj);
+      if (status != TCL_OK) {
+         Tcl_DecrRefCount(unsavedFileList);
+         return status;
+      }
+      Tcl_IncrRefCount(compileArgsObj);
+      Tcl_IncrRefCount(compileFileObj);
 
-   return TCL_OK;
-}
+      int length;
+      Tcl_ListObjLength(NULL, compileArgsObj, &length);
+      Tcl_ListObjReplace(NULL, compileArgsObj, length, 0, numArgs, argObjs);
+      Tcl_ListObjGetElements(NULL, compileArgsObj, &numArgs, &argObjs);
 
-//--------------- translation unit instance's isMultipleIncludeGuarded command
+      if (sourceFilename == NULL) {
+         sourceFilename = Tcl_GetString(compileFileObj);
+      }
+   }
 
-static int tuIsMultipleIncludeGuardedObjCmd(ClientData     clientData,
-                                            Tcl_Interp    *interp,
-                                            int            objc,
-                                            Tcl_Obj *const objv[])
-{
-   enum {
-      command_ix,
-      filename_ix,
-      nargs
-   };
+   IndexInfo *parent = (IndexInfo *)clientData;
+   ParseJob  *job    = createParseJob(parent->index,
+                                      parse == parse_preparsed,
+                                      sourceFilename, numArgs, argObjs,
+                                      unsavedFileList, flags);
+   Tcl_DecrRefCount(unsavedFileList);
+   if (compileArgsObj != NULL) {
+      Tcl_DecrRefCount(compileArgsObj);
+      Tcl_DecrRefCount(compileFileObj);
+   }
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename");
-      return TCL_ERROR;
+   if (async) {
+      Tcl_Obj *commandNameObj = NULL;
+      newQualifiedName(interp, tuNameObj, &commandNameObj);
+      startAsyncParse(interp, parent, commandNameObj, NULL,
+                      Tcl_NewListObj(commandObj != NULL, &commandObj), job);
+      Tcl_SetObjResult(interp, commandNameObj);
+
+      return TCL_OK;
    }
 
-   TUInfo *info = (TUInfo *)clientData;
+   runParseJob(job);
 
-   CXFile file;
-   int status = getFileFromObj(interp, info->translationUnit,
-                               objv[filename_ix], &file);
-   if (status != TCL_OK) {
-      return status;
+   Tcl_Obj *err = newParseErrorObj(job);
+   if (err != NULL) {
+      deleteParseJob(job);
+      Tcl_SetObjResult(interp, err);
+      return TCL_ERROR;
    }
 
-   unsigned result
-      = clang_isFileMultipleIncludeGuarded(info->translationUnit, file);
-   Tcl_Obj *resultObj = Tcl_NewLongObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   Tcl_Obj *commandNameObj = createTUCommand(interp, parent, tuNameObj, job);
+   Tcl_SetObjResult(interp, commandNameObj);
 
    return TCL_OK;
+
+ wrong_num_args:
+   Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                    "?options? ... ?--? "
+                    "translationUnitName commandLineArg...");
+   return TCL_ERROR;
 }
 
-//------------------------------- translation unit instance's location command
+//----------------------------------------------- indexName parseBatch command
 
-static int tuLocationObjCmd(ClientData     clientData,
-                            Tcl_Interp    *interp,
-                            int            objc,
-                            Tcl_Obj *const objv[])
+/** The parse jobs of a parseBatch command, shared by its workers.
+ */
+typedef struct ParseBatch
 {
-   TUInfo *info = (TUInfo *)clientData;
+   Tcl_Mutex   mutex;
+   int         numJobs;
+   int         nextJob;         // the next job to take, under mutex
+   ParseJob  **jobs;
+} ParseBatch;
 
-   enum {
-      command_ix,
-      option_ix
-   };
+/** A worker of a parseBatch command.  libclang doesn't allow concurrent
+ * parses on an index, so each worker acquires its own.
+ */
+typedef struct ParseBatchWorker
+{
+   ParseBatch   *batch;
+   CXIndex       index;
+   Tcl_ThreadId  thread;
+} ParseBatchWorker;
 
-   static const char *options[] = {
-      "-file",
-      "-line",
-      "-column",
-      "-offset",
-      NULL,
-   };
+static void runParseBatch(ParseBatch *batch, CXIndex index)
+{
+   for (;;) {
+      Tcl_MutexLock(&batch->mutex);
+      int i = batch->nextJob < batch->numJobs ? batch->nextJob++ : -1;
+      Tcl_MutexUnlock(&batch->mutex);
 
-   enum {
-      option_file,
-      option_line,
-      option_column,
-      option_offset,
-   };
+      if (i < 0) {
+         break;
+      }
 
-   unsigned options_found = 0;
-   unsigned line          = 0;
-   unsigned column        = 0;
-   unsigned offset        = 0;
-   CXFile   file          = NULL;
+      batch->jobs[i]->index = index;
+      runParseJob(batch->jobs[i]);
+   }
+}
 
-   for (int i = option_ix; i < objc; ++i) {
-      int optionNumber;
-      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
-                                       "option", 0, &optionNumber);
-      if (status != TCL_OK) {
-         return status;
-      }
+static Tcl_ThreadCreateType parseBatchWorker(ClientData clientData)
+{
+   ParseBatchWorker *worker = (ParseBatchWorker *)clientData;
+   runParseBatch(worker->batch, worker->index);
+   TCL_THREAD_CREATE_RETURN;
+}
 
-      if ((options_found & (1 << optionNumber)) != 0) {
-         Tcl_SetObjResult(interp,
-                          Tcl_ObjPrintf("%s is specified more than once.",
-                                        Tcl_GetStringFromObj(objv[i], NULL)));
-         return TCL_ERROR;
-      }
+static int indexNameParseBatchObjCmd(ClientData     clientData,
+                                     Tcl_Interp    *interp,
+                                     int            objc,
+                                     Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      options_ix
+   };
 
-      switch (optionNumber) {
+   IndexInfo *parent   = (IndexInfo *)clientData;
+   int        numJobs  = 1;
+   unsigned   flags    = 0;
 
-      case option_file:
-         if (objc <= i + 1) {
-            Tcl_SetObjResult(interp,
-                             Tcl_NewStringObj("-file is not followed by a "
-                                              "filename",
-                                              -1));
-            return TCL_ERROR;
-         }
+#ifdef _SC_NPROCESSORS_ONLN
+   long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+   if (0 < numProcessors) {
+      numJobs = numProcessors < INT_MAX ? numProcessors : INT_MAX;
+   }
+#endif
 
-         const char *filename = Tcl_GetStringFromObj(objv[i + 1], NULL);
-         file = clang_getFile(info->translationUnit, filename);
-         if (file == NULL) {
-            goto invalid_location;
-         }
+   int i;
+   for (i = options_ix; i < objc; ++i) {
+      const char *str = Tcl_GetStringFromObj(objv[i], NULL);
 
+      if (str[0] != '-') {
          break;
+      }
 
-      case option_line:
-      case option_column:
-         if ((options_found & (1 << option_offset)) != 0) {
-            goto invalid_form;
-         }
+      if (strcmp(str, "--") == 0) {
+         ++i;
+         break;
+      }
 
+      if (strcmp(str, "-jobs") == 0) {
          if (objc <= i + 1) {
-            const char *option = Tcl_GetStringFromObj(objv[i], NULL);
             Tcl_SetObjResult(interp,
-                             Tcl_ObjPrintf("%s is not followed by a %s number",
-                                           option, option + 1));
+                             Tcl_NewStringObj("-jobs is not followed by "
+                                              "the number of workers", -1));
             return TCL_ERROR;
          }
-
-         status = getUnsignedFromObj(interp, objv[i + 1],
-                                     optionNumber == option_line
-                                     ? &line
-                                     : &column);
+         int status = Tcl_GetIntFromObj(interp, objv[++i], &numJobs);
          if (status != TCL_OK) {
             return status;
          }
-
-         break;
-
-      case option_offset:
-         if ((options_found & ((1 << option_line) | (1 << option_column)))
-             != 0) {
-            goto invalid_form;
-         }
-
-         if (objc <= i + 1) {
+         if (numJobs < 1) {
             Tcl_SetObjResult(interp,
-                             Tcl_NewStringObj("-offset is not "
-                                              "followed by an offset",
-                                              -1));
+                             Tcl_NewStringObj("the number of workers "
+                                              "must be positive", -1));
             return TCL_ERROR;
          }
-         
-         status = getUnsignedFromObj(interp, objv[i + 1], &offset);
-         if (status != TCL_OK) {
-            return status;
-         }
+         continue;
+      }
 
+      int flagNumber;
+      int status = Tcl_GetIndexFromObj(interp, objv[i], parseFlags,
+                                       "option", 0, &flagNumber);
+      if (status != TCL_OK) {
+         return status;
+      }
+      flags |= 1 << flagNumber;
+   }
+
+   if (objc <= i) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                       "?-jobs n? ?options? ... ?--? "
+                       "{translationUnitName sourceFile ?commandLineArg ...?}"
+                       " ...");
+      return TCL_ERROR;
+   }
+
+   // Validate the specs before anything runs.
+   int specs_ix = i;
+   for (i = specs_ix; i < objc; ++i) {
+      int       n;
+      Tcl_Obj **elms;
+      int status = Tcl_ListObjGetElements(interp, objv[i], &n, &elms);
+      if (status != TCL_OK) {
+         return status;
+      }
+      if (n < 2) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("\"%s\" is not a list of a "
+                                        "translation unit name, a source "
+                                        "file and command line arguments",
+                                        Tcl_GetStringFromObj(objv[i], NULL)));
+         return TCL_ERROR;
+      }
+   }
+
+   ParseBatch batch;
+   batch.mutex   = NULL;
+   batch.numJobs = objc - specs_ix;
+   batch.nextJob = 0;
+   batch.jobs    = (ParseJob **)Tcl_Alloc(batch.numJobs * sizeof batch.jobs[0]);
+   for (i = 0; i < batch.numJobs; ++i) {
+      int       n;
+      Tcl_Obj **elms;
+      Tcl_ListObjGetElements(NULL, objv[specs_ix + i], &n, &elms);
+      batch.jobs[i] = createParseJob(parent->index, 0,
+                                     Tcl_GetStringFromObj(elms[1], NULL),
+                                     n - 2, elms + 2, NULL, flags);
+   }
+
+   // The calling thread is one of the workers, and parses on the index of
+   // parent.
+   if (batch.numJobs < numJobs) {
+      numJobs = batch.numJobs;
+   }
+   ParseBatchWorker *workers    = (ParseBatchWorker *)
+      Tcl_Alloc(numJobs * sizeof workers[0]);
+   int               numWorkers = 0;
+   while (numWorkers < numJobs - 1) {
+      ParseBatchWorker *worker = &workers[numWorkers];
+      worker->batch = &batch;
+      worker->index = acquireWorkerIndex(parent);
+      if (worker->index == NULL) {
+         break;
+      }
+      if (Tcl_CreateThread(&worker->thread, parseBatchWorker, worker,
+                           PARSE_WORKER_STACK_SIZE,
+                           TCL_THREAD_JOINABLE) != TCL_OK) {
+         releaseWorkerIndex(parent, worker->index);
          break;
+      }
+      ++numWorkers;
+   }
 
-      default:
-         Tcl_Panic("unknown option number");
+   runParseBatch(&batch, parent->index);
+
+   for (i = 0; i < numWorkers; ++i) {
+      int result;
+      Tcl_JoinThread(workers[i].thread, &result);
+      releaseWorkerIndex(parent, workers[i].index);
+   }
+   Tcl_Free((char *)workers);
+   Tcl_MutexFinalize(&batch.mutex);
 
+   // Register the translation units on this interpreter in spec order.
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+   for (i = 0; i < batch.numJobs; ++i) {
+      ParseJob *job = batch.jobs[i];
+      Tcl_Obj  *tuNameObj;
+      Tcl_ListObjIndex(NULL, objv[specs_ix + i], 0, &tuNameObj);
+
+      // A later parse from scratch runs on the index of parent, like the
+      // ones of other translation units, not on a worker's.
+      job->index = parent->index;
+
+      Tcl_Obj *status[2];
+      status[1] = newParseErrorObj(job);
+      if (status[1] == NULL) {
+         status[0] = Tcl_NewStringObj("ok", -1);
+         status[1] = createTUCommand(interp, parent, tuNameObj, job);
+      } else {
+         status[0] = Tcl_NewStringObj("error", -1);
+         deleteParseJob(job);
       }
 
-      options_found |= 1 << optionNumber;
+      Tcl_ListObjAppendElement(NULL, resultObj, tuNameObj);
+      Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewListObj(2, status));
    }
+   Tcl_Free((char *)batch.jobs);
 
-   CXSourceLocation location;
-   unsigned line_and_column_form = (1 << option_file)
-      | (1 << option_line)
-      | (1 << option_column);
-   unsigned offset_form = (1 << option_file) | (1 << option_offset);
-   if ((options_found & line_and_column_form) == line_and_column_form) {
+   Tcl_SetObjResult(interp, resultObj);
 
-      location = clang_getLocation(info->translationUnit,
-                                   file, line, column);
+   return TCL_OK;
+}
 
-   } else if ((options_found & offset_form) == offset_form) {
+//---------------------------------------------------------- indexName command
 
-      location = clang_getLocationForOffset(info->translationUnit,
-                                            file, offset);
+static int indexNameObjCmd(ClientData     clientData,
+                           Tcl_Interp    *interp,
+                           int            objc,
+                           Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      subcommand_ix,
+      numCommonArgs
+   };
 
-   } else {
+   if (objc < numCommonArgs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
+      return TCL_ERROR;
+   }
 
-      goto invalid_form;
+   static Command commands[] = {
+      { "options",
+        indexNameOptionsObjCmd },
+      { "parseBatch",
+        indexNameParseBatchObjCmd },
+      { "pool",
+        indexNamePoolObjCmd },
+      { "translationUnit",
+        indexNameTranslationUnitObjCmd },
+      { NULL }
+   };
 
+   int commandNumber;
+   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
+                                          commands, sizeof commands[0],
+                                          "subcommand", 0, &commandNumber);
+   if (status != TCL_OK) {
+      return status;
    }
 
-   if (clang_equalLocations(location, clang_getNullLocation())) {
-      goto invalid_location;
+   return commands[commandNumber].proc(clientData, interp,
+                                       objc - subcommand_ix,
+                                       objv + subcommand_ix);
+}
+
+//----------------------------------------------------- location equal command
+
+static int locationEqualObjCmd(ClientData     clientData,
+                               Tcl_Interp    *interp,
+                               int            objc,
+                               Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      location1_ix,
+      location2_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location1 location2");
+      return TCL_ERROR;
+   }
+
+   CXSourceLocation locations[2];
+   for (int i = 0; i < 2; ++i) {
+      int status = getLocationFromObj
+         (interp, objv[location1_ix + i], &locations[i]);
+      if (status != TCL_OK) {
+         return status;
+      }
    }
 
-   Tcl_Obj *resultObj = newLocationObj(location);
+   int      result    = clang_equalLocations(locations[0], locations[1]) != 0;
+   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
-
- invalid_form:
-   Tcl_SetObjResult(interp,
-                    Tcl_NewStringObj("the specified location is not valid.",
-                                     -1));
-   return TCL_ERROR;
-
- invalid_location:
-   Tcl_SetObjResult(interp,
-                    Tcl_NewStringObj("the specified location is "
-                                     "not a part of the translation unit.",
-                                     -1));
-   return TCL_ERROR;
 }
 
-//----------------------- translation unit instance's modificationTime command
+//--------------------------------------------------- location is null command
 
-static int tuModificationTimeObjCmd(ClientData     clientData,
-                                    Tcl_Interp    *interp,
-                                    int            objc,
-                                    Tcl_Obj *const objv[])
+static int locationIsNullObjCmd(ClientData     clientData,
+                                Tcl_Interp    *interp,
+                                int            objc,
+                                Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      filename_ix,
+      location_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location");
       return TCL_ERROR;
    }
 
-   TUInfo *info = (TUInfo *)clientData;
-
-   CXFile file;
-   int status = getFileFromObj(interp, info->translationUnit,
-                               objv[filename_ix], &file);
+   CXSourceLocation location;
+   int status = getLocationFromObj(interp, objv[location_ix], &location);
    if (status != TCL_OK) {
       return status;
    }
 
-   time_t   result    = clang_getFileTime(file);
-   Tcl_Obj *resultObj = newUintmaxObj(result);
+   int      result    = clang_equalLocations(location,
+                                             clang_getNullLocation()) != 0;
+   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-//-------------------------------- translation unit instance's reparse command
+//------------------------------------------------------ location null command
 
-static struct CXUnsavedFile *createUnsavedFileArray(Tcl_Obj *unsavedFileList)
+static int locationNullObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
 {
-   int       length;
-   Tcl_Obj **unsavedFileListElements;
-   Tcl_ListObjGetElements(NULL, unsavedFileList,
-                          &length, &unsavedFileListElements);
-
-   int numUnsavedFiles = length >> 1;
-
-   struct CXUnsavedFile *unsavedFiles
-      = (struct CXUnsavedFile *)
-        Tcl_Alloc(numUnsavedFiles * sizeof(struct CXUnsavedFile));
-
-   for (int i = 0; i < numUnsavedFiles; ++i) {
-      unsavedFiles[i].Filename
-         = Tcl_GetStringFromObj(unsavedFileListElements[i * 2], NULL);
+   enum {
+      command_ix,
+      nargs
+   };
 
-      int size;
-      unsavedFiles[i].Contents
-         = Tcl_GetStringFromObj(unsavedFileListElements[i * 2 + 1], &size);
-      unsavedFiles[i].Length = size;
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
+      return TCL_ERROR;
    }
 
-   return unsavedFiles;
+   CXSourceLocation  result    = clang_getNullLocation();
+   Tcl_Obj          *resultObj = newLocationObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
 }
 
-static int tuReparseObjCmd(ClientData     clientData,
-                           Tcl_Interp    *interp,
-                           int            objc,
-                           Tcl_Obj *const objv[])
+//------------------------------------------ location presumedLocation command
+
+static int locationPresumedLocationObjCmd(ClientData     clientData,
+                                          Tcl_Interp    *interp,
+                                          int            objc,
+                                          Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      options_ix
-   };
-
-   TUInfo *info = (TUInfo *)clientData;
-
-   enum {
-      unsavedFileOption
-   };
-
-   static const char *options[] = {
-      "-unsavedFile",           // -unsavedFile filename contents
-      NULL
+      location_ix,
+      nargs
    };
 
-   int      numUnsavedFiles = 0;
-   Tcl_Obj *unsavedFileList = Tcl_NewObj();
-   Tcl_IncrRefCount(unsavedFileList);
-
-   for (int i = options_ix; i < objc; ++i) {
-      int optionNumber;
-      int status = Tcl_GetIndexFromObj(interp, objv[i], options,
-                                       "option", 0, &optionNumber);
-      if (status != TCL_OK) {
-         Tcl_DecrRefCount(unsavedFileList);
-         return status;
-      }
-
-      if (optionNumber == unsavedFileOption) {
-         // -unsavedFile filename contents
-         if (objc <= i + 2) {
-            Tcl_WrongNumArgs(interp, i, objv, "filename contents ...");
-            Tcl_DecrRefCount(unsavedFileList);
-            return TCL_ERROR;
-         }
-         ++numUnsavedFiles;
-         Tcl_ListObjAppendElement(NULL, unsavedFileList, objv[++i]);
-         Tcl_ListObjAppendElement(NULL, unsavedFileList, objv[++i]);
-      } else {
-         Tcl_Panic("what?!");
-      }
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location");
+      return TCL_ERROR;
    }
 
-   struct CXUnsavedFile *unsavedFiles =
-      createUnsavedFileArray(unsavedFileList);
-   Tcl_DecrRefCount(unsavedFileList);
-
-   unsigned flags  = clang_defaultReparseOptions(info->translationUnit);
-   int      status = clang_reparseTranslationUnit(info->translationUnit,
-                                                  numUnsavedFiles,
-                                                  unsavedFiles, flags);
-
-   Tcl_Free((char *)unsavedFiles);
-
-   if (status != 0) {
-      Tcl_Obj *tuObj = Tcl_NewObj();
-      Tcl_GetCommandFullName(interp, info->cmd, tuObj);
-      Tcl_SetObjResult(interp,
-                       Tcl_ObjPrintf("translation unit \"%s\" is not valid",
-                                     Tcl_GetStringFromObj(tuObj, NULL)));
-      Tcl_DecrRefCount(tuObj);
-      return TCL_ERROR;
+   CXSourceLocation location;
+   int status = getLocationFromObj(interp, objv[location_ix], &location);
+   if (status != TCL_OK) {
+      return status;
    }
 
+   Tcl_Obj *resultObj = newPresumedLocationObj(location);
+   Tcl_SetObjResult(interp, resultObj);
+
    return TCL_OK;
 }
 
-//-------------------------- translation unit instance's resourceUsage command
+//---------------------------------------------------- location decode command
 
-static int tuResourceUsageObjCmd(ClientData     clientData,
-                                 Tcl_Interp    *interp,
-                                 int            objc,
-                                 Tcl_Obj *const objv[])
+typedef void (*LocationDecodeProc)
+(CXSourceLocation, CXFile*, unsigned *, unsigned *, unsigned *);
+
+static int locationDecodeObjCmd(ClientData     clientData,
+                                Tcl_Interp    *interp,
+                                int            objc,
+                                Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
+      location_ix,
       nargs
    };
-
+      
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location");
       return TCL_ERROR;
    }
 
-   TUInfo *info = (TUInfo *)clientData;
-
-   CXTUResourceUsage usage = clang_getCXTUResourceUsage(info->translationUnit);
-
-   Tcl_Obj **elms
-      = (Tcl_Obj **)Tcl_Alloc(2 * usage.numEntries * sizeof(Tcl_Obj *));
-
-   for (int i = 0; i < usage.numEntries; ++i) {
-      const char *name = clang_getTUResourceUsageName(usage.entries[i].kind);
-      elms[i * 2]      = Tcl_NewStringObj(name, -1);
-      elms[i * 2 + 1]  = newUintmaxObj(usage.entries[i].amount);
+   CXSourceLocation location;
+   int status = getLocationFromObj(interp, objv[location_ix], &location);
+   if (status != TCL_OK) {
+      return status;
    }
 
-   Tcl_Obj *resultObj = Tcl_NewListObj(usage.numEntries * 2, elms);
-
-   Tcl_Free((char *)elms);
-   clang_disposeCXTUResourceUsage(usage);
+   CXFile   file;
+   unsigned line;
+   unsigned column;
+   unsigned offset;
+   ((LocationDecodeProc)clientData)(location, &file, &line, &column, &offset);
 
+   Tcl_Obj *resultObj = newDecodedLocationObj
+      (getLocationTUInfo(objv[location_ix]), file, line, column, offset);
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-//----------------------------------- translation unit instance's save command
+//------------------------------------------------- location decodeAll command
 
-static int tuSaveObjCmd(ClientData     clientData,
-                        Tcl_Interp    *interp,
-                        int            objc,
-                        Tcl_Obj *const objv[])
+static int locationDecodeAllObjCmd(ClientData     clientData,
+                                   Tcl_Interp    *interp,
+                                   int            objc,
+                                   Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      filename_ix,
+      option_ix,
+      locations_ix,
       nargs
    };
 
+   static const char *options[] = {
+      "-expansion",
+      "-file",
+      "-presumed",
+      "-spelling",
+      NULL,
+   };
+
+   enum {
+      option_expansion,
+      option_file,
+      option_presumed,
+      option_spelling,
+   };
+
+   static LocationDecodeProc procs[] = {
+      clang_getExpansionLocation,
+      clang_getFileLocation,
+      NULL,
+      clang_getSpellingLocation,
+   };
+
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                       "-spelling|-expansion|-file|-presumed locations");
       return TCL_ERROR;
    }
 
-   TUInfo     *info     = (TUInfo *)clientData;
-   const char *filename = Tcl_GetStringFromObj(objv[filename_ix], NULL);
-   unsigned    flags    = clang_defaultSaveOptions(info->translationUnit);
-   int         status   = clang_saveTranslationUnit(info->translationUnit,
-                                                    filename, flags);
-   switch (status) {
+   int optionNumber;
+   int status = Tcl_GetIndexFromObj(interp, objv[option_ix], options,
+                                    "option", 0, &optionNumber);
+   if (status != TCL_OK) {
+      return status;
+   }
 
-   case CXSaveError_None:
-      break;
+   int       n;
+   Tcl_Obj **elms;
+   status = Tcl_ListObjGetElements(interp, objv[locations_ix], &n, &elms);
+   if (status != TCL_OK) {
+      return status;
+   }
 
-   case CXSaveError_Unknown:
-      Tcl_SetObjResult(interp,
-                       Tcl_ObjPrintf("an unknown error occurred "
-                                     "while attempting to save to \"%s\"",
-                                     filename));
-      return TCL_ERROR;
+   // Locations usually come from a handful of files.  The file name objects
+   // are shared between the results, keyed by CXFile or, for presumed
+   // locations, by the name libclang reports.
+   Tcl_HashTable fileNames;
+   Tcl_InitHashTable(&fileNames, optionNumber == option_presumed
+                     ? TCL_STRING_KEYS : TCL_ONE_WORD_KEYS);
 
-   case CXSaveError_TranslationErrors:
-   {
-      Tcl_Obj *tuObj = Tcl_NewObj();
-      Tcl_GetCommandFullName(interp, info->cmd, tuObj);
-      Tcl_SetObjResult(interp,
-                       Tcl_ObjPrintf("errors during translation prevented "
-                                     "the attempt to save \"%s\"",
-                                     Tcl_GetStringFromObj(tuObj, NULL)));
-      Tcl_DecrRefCount(tuObj);
-      return TCL_ERROR;
-   }
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
 
-   case CXSaveError_InvalidTU:
-   {
-      Tcl_Obj *tuObj = Tcl_NewObj();
-      Tcl_GetCommandFullName(interp, info->cmd, tuObj);
-      Tcl_SetObjResult(interp,
-                       Tcl_ObjPrintf("invalid translation unit \"%s\"",
-                                     Tcl_GetStringFromObj(tuObj, NULL)));
-      Tcl_DecrRefCount(tuObj);
-      return TCL_ERROR;
+   for (int i = 0; i < n; ++i) {
+      CXSourceLocation location;
+      status = getLocationFromObj(interp, elms[i], &location);
+      if (status != TCL_OK) {
+         Tcl_DecrRefCount(resultObj);
+         resultObj = NULL;
+         break;
+      }
+
+      enum {
+         filename_ix,
+         line_ix,
+         column_ix,
+         offset_ix,
+         nelms
+      };
+
+      Tcl_Obj       *decoded[nelms];
+      int            created;
+      Tcl_HashEntry *entry;
+      unsigned       line   = 0;
+      unsigned       column = 0;
+      unsigned       offset = 0;
+
+      if (clang_equalLocations(location, clang_getNullLocation())) {
+
+         decoded[filename_ix] = filenameNullObj;
+
+      } else if (optionNumber == option_presumed) {
+
+         CXString filename;
+         clang_getPresumedLocation(location, &filename, &line, &column);
+         entry = Tcl_CreateHashEntry(&fileNames, clang_getCString(filename),
+                                     &created);
+         if (created) {
+            Tcl_SetHashValue(entry,
+                             newFileNameObj(clang_getCString(filename)));
+         }
+         decoded[filename_ix] = (Tcl_Obj *)Tcl_GetHashValue(entry);
+         clang_disposeString(filename);
+
+      } else {
+
+         CXFile file;
+         procs[optionNumber](location, &file, &line, &column, &offset);
+         entry = Tcl_CreateHashEntry(&fileNames, (const char *)file,
+                                     &created);
+         if (created) {
+            TUInfo *tuInfo = getLocationTUInfo(elms[i]);
+            Tcl_Obj *filenameObj;
+            if (file == NULL) {
+               filenameObj = filenameNullObj;
+            } else if (tuInfo != NULL) {
+               filenameObj = newFileNameObjForTU(tuInfo, file);
+            } else {
+               CXString filename = clang_getFileName(file);
+               filenameObj = newFileNameObj(clang_getCString(filename));
+               clang_disposeString(filename);
+            }
+            Tcl_SetHashValue(entry, filenameObj);
+         }
+         decoded[filename_ix] = (Tcl_Obj *)Tcl_GetHashValue(entry);
+
+      }
+
+      decoded[line_ix]   = Tcl_NewLongObj(line);
+      decoded[column_ix] = Tcl_NewLongObj(column);
+      decoded[offset_ix] = Tcl_NewLongObj(offset);
+
+      Tcl_ListObjAppendElement
+         (NULL, resultObj,
+          Tcl_NewListObj(optionNumber == option_presumed ? offset_ix : nelms,
+                         decoded));
    }
 
-   default:
-      Tcl_SetObjResult(interp,
-                       Tcl_ObjPrintf("unknown error code is returned by "
-                                     "clang_saveTranslationUnit()"));
+   Tcl_DeleteHashTable(&fileNames);
+
+   if (resultObj == NULL) {
       return TCL_ERROR;
    }
 
+   Tcl_SetObjResult(interp, resultObj);
+
    return TCL_OK;
 }
 
-#if CINDEX_VERSION_MINOR >= 22
-//-------------------------- translation unit instance's skippedRanges command
+//--------------------------------------------------- location -> bool command
 
-static int tuSkippedRangesObjCmd(ClientData     clientData,
-                                 Tcl_Interp    *interp,
-                                 int            objc,
-                                 Tcl_Obj *const objv[])
+static int locationToBoolObjCmd(ClientData     clientData,
+                                Tcl_Interp    *interp,
+                                int            objc,
+                                Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      filename_ix,
+      location_ix,
       nargs
    };
 
-#if CINDEX_VERSION_MINOR >= 36
-   int margs = filename_ix;
-   const char *argspec = "?filename?";
-#else
-   int margs = nargs;
-   const char *argspec = "filename";
-#endif
-
-   if (objc < margs || objc > nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, argspec);
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location");
       return TCL_ERROR;
    }
 
-   Tcl_Obj *resultObj = NULL;
-   int      status    = TCL_OK;
+   CXSourceLocation location;
+   int status = getLocationFromObj(interp, objv[location_ix], &location);
+   if (status != TCL_OK) {
+      return status;
+   }
 
-   if (objc == nargs) {         // filename provided
-      TUInfo *info = (TUInfo *)clientData;
+   typedef unsigned (*LocationToUnsignedProc)(CXSourceLocation);
 
-      CXFile file;
-      status = getFileFromObj(interp, info->translationUnit,
-                                  objv[filename_ix], &file);
+   int      result    = ((LocationToUnsignedProc)clientData)(location) != 0;
+   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
+}
+
+//------------------------------------------------------- range create command
+
+static int rangeCreateObjCmd(ClientData     clientData,
+                             Tcl_Interp    *interp,
+                             int            objc,
+                             Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      location1_ix,
+      location2_ix,
+      nargs
+   };
+
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location1 location2");
+      return TCL_ERROR;
+   }
+
+   CXSourceLocation locations[2];
+   for (int i = 0; i < 2; ++i) {
+      int status = getLocationFromObj
+         (interp, objv[location1_ix + i], &locations[i]);
       if (status != TCL_OK) {
          return status;
       }
-
-      CXSourceRangeList *skippedRanges = clang_getSkippedRanges(info->translationUnit, file);
-      resultObj = newRangeListObj(skippedRanges);
-      clang_disposeSourceRangeList(skippedRanges);
-   } else {
-#if CINDEX_VERSION_MINOR >= 36
-      TUInfo *info = (TUInfo *)clientData;
-
-      CXSourceRangeList *skippedRanges = clang_getAllSkippedRanges(info->translationUnit);
-      resultObj = newRangeListObj(skippedRanges);
-      clang_disposeSourceRangeList(skippedRanges);
-#else
-      resultObj = Tcl_NewStringObj("must indicate the filename", -1);
-      status = TCL_ERROR;
-#endif
    }
 
+   CXSourceRange  result    = clang_getRange(locations[0], locations[1]);
+   Tcl_Obj       *resultObj
+      = newRangeObjForTU(getLocationTUInfo(objv[location1_ix]), result);
    Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-#endif
-#if CINDEX_VERSION_MINOR >= 38
-//----------------------------- translation unit instance's targetInfo command
-
-static int tuTargetInfoTripleObjCmd(ClientData     clientData,
-                                    Tcl_Interp    *interp,
-                                    int            objc,
-                                    Tcl_Obj *const objv[]);
-static int tuTargetInfoPointerWidthObjCmd(ClientData     clientData,
-                                          Tcl_Interp    *interp,
-                                          int            objc,
-                                          Tcl_Obj *const objv[]);
+//-------------------------------------------------------- range equal command
 
-static int tuTargetInfoObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+static int rangeEqualObjCmd(ClientData     clientData,
+                            Tcl_Interp    *interp,
+                            int            objc,
+                            Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      subcommand_ix,
-      numMandatoryArgs
+      range1_ix,
+      range2_ix,
+      nargs
    };
 
-   if (objc < numMandatoryArgs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
+   if (objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "range1 range2");
       return TCL_ERROR;
    }
 
-   static Command subcommands[] = {
-      { "triple",
-        tuTargetInfoTripleObjCmd },
-      { "pointerWidth",
-        tuTargetInfoPointerWidthObjCmd },
-      { NULL },
-   };
-
-   int commandNumber;
-   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
-                                          subcommands, sizeof subcommands[0],
-                                          "subcommand", 0, &commandNumber);
-   if (status != TCL_OK) {
-      return status;
+   CXSourceRange ranges[2];
+   for (int i = 0; i < 2; ++i) {
+      int status = getRangeFromObj(interp, objv[range1_ix + i], &ranges[i]);
+      if (status != TCL_OK) {
+         return status;
+      }
    }
 
-   return subcommands[commandNumber].proc(clientData, interp,
-                                          objc - subcommand_ix,
-                                          objv + subcommand_ix);
+   int      result    = clang_equalRanges(ranges[0], ranges[1]) != 0;
+   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
+   Tcl_SetObjResult(interp, resultObj);
+
+   return TCL_OK;
 }
 
-//------------------------translation unit instance's targetInfoTriple command
+//--------------------------------------------------------- range null command
 
-static int tuTargetInfoTripleObjCmd(ClientData     clientData,
-                                    Tcl_Interp    *interp,
-                                    int            objc,
-                                    Tcl_Obj *const objv[])
+static int rangeNullObjCmd(ClientData     clientData,
+                           Tcl_Interp    *interp,
+                           int            objc,
+                           Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
@@ -4904,708 +11607,1094 @@ static int tuTargetInfoTripleObjCmd(ClientData     clientData,
       return TCL_ERROR;
    }
 
-   TUInfo *info = (TUInfo *)clientData;
-
-   CXTargetInfo  targetinfo = clang_getTranslationUnitTargetInfo(info->translationUnit);
-   CXString      triple     = clang_TargetInfo_getTriple(targetinfo);
-   Tcl_Obj      *resultObj  = convertCXStringToObj(triple);
+   CXSourceRange  result    = clang_getNullRange();
+   Tcl_Obj       *resultObj = newRangeObj(result);
    Tcl_SetObjResult(interp, resultObj);
 
-   clang_TargetInfo_dispose(targetinfo);
-
    return TCL_OK;
 }
 
-//------------------translation unit instance's targetInfoPointerWidth command
+//------------------------------------------------------ range is null command
 
-static int tuTargetInfoPointerWidthObjCmd(ClientData     clientData,
-                                          Tcl_Interp    *interp,
-                                          int            objc,
-                                          Tcl_Obj *const objv[])
+static int rangeIsNullObjCmd(ClientData     clientData,
+                             Tcl_Interp    *interp,
+                             int            objc,
+                             Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
+      range_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "range");
       return TCL_ERROR;
    }
 
-   TUInfo *info = (TUInfo *)clientData;
+   CXSourceRange range;
+   int status = getRangeFromObj(interp, objv[range_ix], &range);
+   if (status != TCL_OK) {
+      return status;
+   }
 
-   CXTargetInfo  targetinfo   = clang_getTranslationUnitTargetInfo(info->translationUnit);
-   int           pointerWidth = clang_TargetInfo_getPointerWidth(targetinfo);
-   Tcl_Obj      *resultObj    = Tcl_NewIntObj(pointerWidth);
+   int      result    = clang_equalRanges(range, clang_getNullRange()) != 0;
+   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
    Tcl_SetObjResult(interp, resultObj);
 
-   clang_TargetInfo_dispose(targetinfo);
+   return TCL_OK;
+}
+
+//-------------------------------------------------- range -> location command
+
+static int rangeToLocationObjCmd(ClientData     clientData,
+                                 Tcl_Interp    *interp,
+                                 int            objc,
+                                 Tcl_Obj *const objv[])
+{
+   if (objc != 2) {
+      Tcl_WrongNumArgs(interp, 1, objv, "range");
+      return TCL_ERROR;
+   }
+
+   CXSourceRange range;
+   int status = getRangeFromObj(interp, objv[1], &range);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   typedef CXSourceLocation (*ProcType)(CXSourceRange); 
+
+   CXSourceLocation  location  = ((ProcType)clientData)(range);
+   Tcl_Obj          *resultObj
+      = newLocationObjForTU(getLocationTUInfo(objv[1]), location);
+   Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-#endif
+//------------------------------------------------------- foreachChild command
 
-//----------------------------- translation unit instance's sourceFile command
+/** A node of a foreachChild traversal whose children are being visited.
+ *
+ * The children are pool[begin .. end - 1] of the ForeachChildState.
+ */
+typedef struct ForeachChildFrame {
+   CXCursor  parent;
+   Tcl_Obj  *parentObj;
+   int       begin;
+   int       end;
+   int       next;              // the child to be visited next
+} ForeachChildFrame;
+
+/** The state of a foreachChild loop.
+ *
+ * The traversal is driven by an explicit stack of frames instead of the
+ * recursion of clang_visitChildren, so that the loop body can be evaluated
+ * by the non-recursive engine and can yield.  The parents of the frames are
+ * the ancestors of the current cursor.  ancestorsObj, the list given to the
+ * script, is rebuilt only when the stack changes.
+ */
+typedef struct ForeachChildState {
+   TUInfo            *tuInfo;
+   unsigned           generation;
+   Tcl_Obj           *varNamesObj;
+   Tcl_Obj           *childVarName;
+   Tcl_Obj           *ancestorsVarName;  // NULL with one loop variable
+   Tcl_Obj           *scriptObj;
+   CursorScope        scope;
+   CXCursor          *pool;
+   int                poolSize;
+   int                poolCapacity;
+   ForeachChildFrame *frames;
+   int                depth;
+   int                frameCapacity;
+   CXCursor           current;           // the cursor being visited
+   Tcl_Obj           *currentObj;
+   Tcl_Obj           *ancestorsObj;      // NULL if it must be rebuilt
+} ForeachChildState;
+
+static enum CXChildVisitResult collectForeachChildren(CXCursor     cursor,
+                                                      CXCursor     parent,
+                                                      CXClientData data)
+{
+   ForeachChildState *state = (ForeachChildState *)data;
+
+   if (! isCursorInScope(&state->scope, cursor)) {
+      return CXChildVisit_Continue;
+   }
 
-static int tuSourceFileObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+   if (state->poolSize == state->poolCapacity) {
+      state->poolCapacity = state->poolCapacity == 0
+         ? 256 : state->poolCapacity * 2;
+      state->pool         = (CXCursor *)
+         Tcl_Realloc((char *)state->pool,
+                     state->poolCapacity * sizeof state->pool[0]);
+   }
+   state->pool[state->poolSize++] = cursor;
+
+   return CXChildVisit_Continue;
+}
+
+static void invalidateForeachChildAncestors(ForeachChildState *state)
 {
-   enum {
-      command_ix,
-      nargs
-   };
+   if (state->ancestorsObj != NULL) {
+      Tcl_DecrRefCount(state->ancestorsObj);
+      state->ancestorsObj = NULL;
+   }
+}
+
+static void pushForeachChildFrame(ForeachChildState *state,
+                                  CXCursor           parent,
+                                  Tcl_Obj           *parentObj)
+{
+   if (state->depth == state->frameCapacity) {
+      state->frameCapacity = state->frameCapacity == 0
+         ? 16 : state->frameCapacity * 2;
+      state->frames        = (ForeachChildFrame *)
+         Tcl_Realloc((char *)state->frames,
+                     state->frameCapacity * sizeof state->frames[0]);
+   }
+
+   ForeachChildFrame *frame = &state->frames[state->depth++];
+   frame->parent    = parent;
+   frame->parentObj = parentObj;
+   Tcl_IncrRefCount(parentObj);
+   frame->begin     = state->poolSize;
+   clang_visitChildren(parent, collectForeachChildren, state);
+   frame->end       = state->poolSize;
+   frame->next      = frame->begin;
+
+   invalidateForeachChildAncestors(state);
+}
+
+static void popForeachChildFrame(ForeachChildState *state)
+{
+   ForeachChildFrame *frame = &state->frames[--state->depth];
+   state->poolSize = frame->begin;
+   Tcl_DecrRefCount(frame->parentObj);
+
+   invalidateForeachChildAncestors(state);
+}
+
+static ForeachChildState *createForeachChildState(Tcl_Obj     *varNamesObj,
+                                                  Tcl_Obj     *scriptObj,
+                                                  CursorScope *scope,
+                                                  TUInfo      *tuInfo,
+                                                  CXCursor     cursor,
+                                                  Tcl_Obj     *cursorObj)
+{
+   ForeachChildState *state = (ForeachChildState *)Tcl_Alloc(sizeof *state);
+
+   int       numVars;
+   Tcl_Obj **varNames;
+   Tcl_ListObjGetElements(NULL, varNamesObj, &numVars, &varNames);
+
+   state->tuInfo           = tuInfo;
+   state->generation       = tuInfo->generation;
+   state->varNamesObj      = varNamesObj;
+   state->childVarName     = varNames[0];
+   state->ancestorsVarName = numVars == 2 ? varNames[1] : NULL;
+   state->scriptObj        = scriptObj;
+   state->scope            = *scope;
+   state->pool             = NULL;
+   state->poolSize         = 0;
+   state->poolCapacity     = 0;
+   state->frames           = NULL;
+   state->depth            = 0;
+   state->frameCapacity    = 0;
+   state->currentObj       = NULL;
+   state->ancestorsObj     = NULL;
+
+   pinTU(tuInfo);
+   Tcl_IncrRefCount(varNamesObj);
+   Tcl_IncrRefCount(scriptObj);
+
+   pushForeachChildFrame(state, cursor, cursorObj);
+
+   return state;
+}
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
-      return TCL_ERROR;
+static void deleteForeachChildState(ForeachChildState *state)
+{
+   while (state->depth > 0) {
+      popForeachChildFrame(state);
    }
 
-   TUInfo            *info      = (TUInfo *)clientData;
-   CXTranslationUnit  tu        = info->translationUnit;
-   CXString           result    = clang_getTranslationUnitSpelling(tu);
-   Tcl_Obj           *resultObj = convertCXStringToObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   if (state->currentObj != NULL) {
+      Tcl_DecrRefCount(state->currentObj);
+   }
+   Tcl_DecrRefCount(state->varNamesObj);
+   Tcl_DecrRefCount(state->scriptObj);
+   unpinTU(state->tuInfo);
+   clearCursorScope(&state->scope);
 
-   return TCL_OK;
+   Tcl_Free((char *)state->pool);
+   Tcl_Free((char *)state->frames);
+   Tcl_Free((char *)state);
 }
 
-//------------------------------- translation unit instance's uniqueID command
-
-static int tuUniqueIDObjCmd(ClientData     clientData,
-                            Tcl_Interp    *interp,
-                            int            objc,
-                            Tcl_Obj *const objv[])
+// Move to the next cursor and set the loop variables.  Returns TCL_BREAK at
+// the end of the traversal.
+static int nextForeachChild(Tcl_Interp *interp, ForeachChildState *state)
 {
-   enum {
-      command_ix,
-      filename_ix,
-      nargs
-   };
+   ForeachChildFrame *frame = NULL;
+   while (state->depth > 0) {
+      frame = &state->frames[state->depth - 1];
+      if (frame->next < frame->end) {
+         break;
+      }
+      popForeachChildFrame(state);
+   }
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename");
-      return TCL_ERROR;
+   if (state->depth == 0) {
+      return TCL_BREAK;
    }
 
-   TUInfo *info = (TUInfo *)clientData;
+   state->current = state->pool[frame->next++];
 
-   CXFile file;
-   int status = getFileFromObj(interp, info->translationUnit,
-                               objv[filename_ix], &file);
-   if (status != TCL_OK) {
-      return status;
+   if (state->currentObj != NULL) {
+      Tcl_DecrRefCount(state->currentObj);
    }
+   state->currentObj = newCursorObjForTU(state->tuInfo, state->current);
+   Tcl_IncrRefCount(state->currentObj);
 
-   CXFileUniqueID uniqueId;
-   if (clang_getFileUniqueID(file, &uniqueId)) {
-      Tcl_SetObjResult(interp,
-                       Tcl_NewStringObj("failed to get file unique ID.", -1));
+   if (Tcl_ObjSetVar2(interp, state->childVarName, NULL, state->currentObj,
+                      TCL_LEAVE_ERR_MSG) == NULL) {
       return TCL_ERROR;
    }
 
-   enum {
-      ndata = sizeof uniqueId.data / sizeof uniqueId.data[0]
-   };
-   Tcl_Obj *elms[ndata];
-   for (int i = 0; i < ndata; ++i) {
-      elms[i] = newUintmaxObj(uniqueId.data[i]);
+   if (state->ancestorsVarName == NULL) {
+      return TCL_OK;
+   }
+
+   if (state->ancestorsObj == NULL) {
+      state->ancestorsObj = Tcl_NewListObj(0, NULL);
+      Tcl_IncrRefCount(state->ancestorsObj);
+      for (int i = 0; i < state->depth; ++i) {
+         Tcl_ListObjAppendElement(NULL, state->ancestorsObj,
+                                  state->frames[i].parentObj);
+      }
+   }
+
+   if (Tcl_ObjSetVar2(interp, state->ancestorsVarName, NULL,
+                      state->ancestorsObj, TCL_LEAVE_ERR_MSG) == NULL) {
+      return TCL_ERROR;
    }
-   Tcl_Obj *resultObj = Tcl_NewListObj(ndata, elms);
-   Tcl_SetObjResult(interp, resultObj);
 
    return TCL_OK;
 }
 
-#if CINDEX_VERSION_MINOR >= 13
-//----------------------------------------------- cursorAndRangeVisitor helper
+// Act on the completion code of the loop body.  Returns TCL_OK to go on to
+// the next cursor.  Other codes end the loop.
+static int foreachChildBodyDone(Tcl_Interp        *interp,
+                                ForeachChildState *state,
+                                int                status)
+{
+   switch (status) {
+   case TCL_BREAK:
+   case TCL_RETURN:
+   case TCL_ERROR:
+      return status;
+   }
 
-enum CXVisitorResult foreachCursorAndRangeVisitor(void *context,
-                                                  CXCursor cursor,
-                                                  CXSourceRange range) {
-   int status = TCL_OK;
-   Tcl_Obj *cursorObj = NULL;
-   Tcl_Obj *rangeObj = NULL;
+   // The loop goes on only if the body left the AST alone.
+   if (checkTraversedTU(interp, state->tuInfo, state->generation, "cursor")
+       != TCL_OK) {
+      return TCL_ERROR;
+   }
 
-   VisitInfo *visitInfo = (VisitInfo *)context;
+   switch (status) {
+   case TCL_OK:
+   case TCL_CONTINUE:
+      return TCL_OK;
 
-   cursorObj = newCursorObj(cursor);
-   Tcl_IncrRefCount(cursorObj);
-   if (Tcl_ObjSetVar2(visitInfo->interp, visitInfo->variableNames[0],
-                      NULL, cursorObj, TCL_LEAVE_ERR_MSG) == NULL) {
-      status = TCL_ERROR;
-      goto cleanup;
+   case TCL_RECURSE:
+      pushForeachChildFrame(state, state->current, state->currentObj);
+      return TCL_OK;
+
+   case TCL_RECURSE_BREAK: {
+      // Skip the remaining siblings.
+      ForeachChildFrame *frame = &state->frames[state->depth - 1];
+      frame->next = frame->end;
+      return TCL_OK;
    }
 
-   rangeObj = newRangeObj(range);
-   Tcl_IncrRefCount(rangeObj);
-   if (Tcl_ObjSetVar2(visitInfo->interp, visitInfo->variableNames[1],
-                      NULL, rangeObj, TCL_LEAVE_ERR_MSG) == NULL) {
-      status = TCL_ERROR;
-      goto cleanup;
+   default:
+      return status;
    }
+}
 
-   status = Tcl_EvalObjEx(visitInfo->interp, visitInfo->scriptObj, 0);
+static int finishForeachChild(Tcl_Interp        *interp,
+                              ForeachChildState *state,
+                              int                status)
+{
+   deleteForeachChildState(state);
 
-cleanup:
-   if (cursorObj) {
-      Tcl_DecrRefCount(cursorObj);
+   if (status == TCL_BREAK) {
+      Tcl_ResetResult(interp);
+      return TCL_OK;
    }
-   if (rangeObj) {
-      Tcl_DecrRefCount(rangeObj);
+
+   return status;
+}
+
+#ifdef CINDEX_USE_NRE
+static int foreachChildNRStep(Tcl_Interp *interp, ForeachChildState *state);
+
+static int foreachChildNRCallback(ClientData  data[],
+                                  Tcl_Interp *interp,
+                                  int         result)
+{
+   ForeachChildState *state = (ForeachChildState *)data[0];
+
+   int status = foreachChildBodyDone(interp, state, result);
+   if (status != TCL_OK) {
+      return finishForeachChild(interp, state, status);
    }
-   switch (status) {
-   case TCL_OK:
-   case TCL_CONTINUE:
-      return CXVisit_Continue;
-   case TCL_BREAK:
-      return CXVisit_Break;
-   default:
-      visitInfo->returnCode = status;
-      return CXVisit_Break;
+
+   return foreachChildNRStep(interp, state);
+}
+
+static int foreachChildNRStep(Tcl_Interp *interp, ForeachChildState *state)
+{
+   int status = nextForeachChild(interp, state);
+   if (status != TCL_OK) {
+      return finishForeachChild(interp, state, status);
    }
+
+   Tcl_NRAddCallback(interp, foreachChildNRCallback, state, NULL, NULL, NULL);
+
+   return Tcl_NREvalObj(interp, state->scriptObj, 0);
 }
+#endif
 
-//--------------------------- translation unit instance's findIncludes command
+enum ForeachChildSyntax {
+    foreachChildTopLevelSyntax,
+    foreachChildSubcommandSyntax
+};
 
-static int tuFindIncludesObjCmd(ClientData     clientData,
+static int foreachChildNRObjCmd(ClientData     clientData,
                                 Tcl_Interp    *interp,
                                 int            objc,
                                 Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      filename_ix,
-      varNames_ix,
+      varName_ix,
+      cursor_ix,
       script_ix,
       nargs
    };
 
+   char *wrongNumArgsErrMsg = NULL;
+   Tcl_Obj *varNameObjArg = NULL;
+   Tcl_Obj *cursorObjArg = NULL;
    int status = TCL_OK;
-   Tcl_Obj *varNamesObj = NULL;
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "filename variableNames script");
-      status = TCL_ERROR;
-      goto cleanup;
+   enum ForeachChildSyntax syntax = (enum ForeachChildSyntax)clientData;
+
+   if (objc < nargs) {
+      wrongNumArgsErrMsg = syntax == foreachChildTopLevelSyntax
+         ? "?-files files? ?-mainFileOnly? ?-excludeSystemHeaders? "
+           "varName cursor script"
+         : "?-files files? ?-mainFileOnly? ?-excludeSystemHeaders? "
+           "cursor varName script";
+      Tcl_WrongNumArgs(interp, command_ix, objv, wrongNumArgsErrMsg);
+      return TCL_ERROR;
    }
 
-   TUInfo *info = (TUInfo *)clientData;
+   // The options precede the fixed arguments, args[varName_ix ...].
+   int             numOptions = objc - nargs;
+   Tcl_Obj *const *args       = objv + numOptions;
 
-   int       numVars;
-   Tcl_Obj **varNames;
-   varNamesObj = Tcl_DuplicateObj(objv[varNames_ix]);
+   switch (syntax) {
+   case foreachChildTopLevelSyntax:
+      varNameObjArg = args[varName_ix];
+      cursorObjArg = args[cursor_ix];
+      break;
+   case foreachChildSubcommandSyntax:
+      varNameObjArg = args[cursor_ix];
+      cursorObjArg = args[varName_ix];
+      break;
+   }
+
+   /*
+    * I think this is a Tcl bug.  I don't modify the list, why should I need
+    * to duplicate it?  It is the bytecode guy the one that modifies it!
+    */
+   int       numVars = 0;
+   Tcl_Obj **varNames = NULL;
+   Tcl_Obj  *varNamesObj = Tcl_DuplicateObj(varNameObjArg);
    Tcl_IncrRefCount(varNamesObj);
    status = Tcl_ListObjGetElements(interp, varNamesObj, &numVars, &varNames);
    if (status != TCL_OK) {
       goto cleanup;
-   } else if (numVars != 2) {
-      Tcl_SetObjResult(interp, Tcl_NewStringObj("invalid loop variables: must be cursor range", -1));
+   }
+
+   if (numVars != 1 && numVars != 2) {
+      Tcl_SetObjResult(interp,
+                       Tcl_NewStringObj("one of two variable names "
+                                        "are expected", -1));
       status = TCL_ERROR;
       goto cleanup;
    }
 
-   CXFile file;
-   status = getFileFromObj(interp, info->translationUnit,
-                               objv[filename_ix], &file);
+   CXCursor cursor;
+   status = getCursorFromObj(interp, cursorObjArg, &cursor);
    if (status != TCL_OK) {
       goto cleanup;
    }
 
-   VisitInfo visitInfo = {
-      .interp = interp,
-      .variableNames = varNames,
-      .numVariables = numVars,
-      .scriptObj = objv[script_ix],
-      .returnCode = TCL_OK
-   };
-   CXCursorAndRangeVisitor visitor = {
-      .context = (void *)&visitInfo,
-      .visit = foreachCursorAndRangeVisitor,
-   };
-   CXResult result = clang_findIncludesInFile(info->translationUnit, file,
-                                              visitor);
-   switch (result) {
-   case CXResult_Success:
-   case CXResult_VisitBreak:
-      status = visitInfo.returnCode;
-      break;
-   case CXResult_Invalid:
-      Tcl_SetObjResult(interp, Tcl_NewStringObj("error while finding includes", -1));
-      status = TCL_ERROR;
-      break;
+   TUInfo *tuInfo = getCursorTUInfo(cursorObjArg);
+
+   CursorScope scope;
+   initCursorScope(&scope);
+   status = parseCursorScopeOptions(interp, &scope, tuInfo->translationUnit,
+                                    numOptions, objv + 1);
+   if (status != TCL_OK) {
+      clearCursorScope(&scope);
+      goto cleanup;
    }
 
-cleanup:
-   if (varNamesObj) {
-      Tcl_DecrRefCount(varNamesObj);
+   ForeachChildState *state
+      = createForeachChildState(varNamesObj, args[script_ix], &scope,
+                                tuInfo, cursor,
+                                newCursorObjForTU(tuInfo, cursor));
+
+#ifdef CINDEX_USE_NRE
+   status = foreachChildNRStep(interp, state);
+#else
+   for (;;) {
+      status = nextForeachChild(interp, state);
+      if (status != TCL_OK) {
+         break;
+      }
+
+      status = Tcl_EvalObjEx(interp, state->scriptObj, 0);
+      status = foreachChildBodyDone(interp, state, status);
+      if (status != TCL_OK) {
+         break;
+      }
    }
 
+   status = finishForeachChild(interp, state, status);
+#endif
+
+cleanup:
+   Tcl_DecrRefCount(varNamesObj);
+
    return status;
 }
+
+#ifdef CINDEX_USE_NRE
+static int foreachChildObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
+{
+   return Tcl_NRCallObjProc(interp, foreachChildNRObjCmd, clientData,
+                            objc, objv);
+}
+#else
+#define foreachChildObjCmd foreachChildNRObjCmd
 #endif
 
-//------------------------------------------ translation unit instance command
+//------------------------------------------------------ cursor select command
 
-static int tuInstanceObjCmd(ClientData     clientData,
-                            Tcl_Interp    *interp,
-                            int            objc,
-                            Tcl_Obj *const objv[])
+typedef struct SelectInfo {
+   TUInfo        *tuInfo;
+   CursorKindSet *kinds;        // NULL selects all kinds
+   CursorScope    scope;
+   int            maxDepth;     // 0 for no limit
+   int            limit;        // 0 for no limit
+   int            depth;
+   int            count;
+   Tcl_Obj       *resultObj;
+} SelectInfo;
+
+static enum CXChildVisitResult selectHelper(CXCursor     cursor,
+                                            CXCursor     parent,
+                                            CXClientData clientData)
+{
+   SelectInfo *info = (SelectInfo *)clientData;
+
+   // Prune the subtrees outside of the requested files.
+   if (! isCursorInScope(&info->scope, cursor)) {
+      return CXChildVisit_Continue;
+   }
+
+   if (info->kinds == NULL
+       || cursorKindSetContains(info->kinds, clang_getCursorKind(cursor))) {
+      Tcl_ListObjAppendElement(NULL, info->resultObj,
+                               newCursorObjForTU(info->tuInfo, cursor));
+      if (++info->count == info->limit) {
+         return CXChildVisit_Break;
+      }
+   }
+
+   if (info->maxDepth != 0 && info->depth == info->maxDepth) {
+      return CXChildVisit_Continue;
+   }
+
+   // Recurse by ourselves to keep track of the depth.
+   ++info->depth;
+   unsigned broken = clang_visitChildren(cursor, selectHelper, info);
+   --info->depth;
+
+   return broken ? CXChildVisit_Break : CXChildVisit_Continue;
+}
+
+static int cursorSelectObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
 {
    enum {
-      command_ix,
-      subcommand_ix,
-      numCommonArgs,
+      command_ix,
+      cursor_ix,
+      optional_ix
+   };
+
+   static const char *options[] = {
+      "-kind",
+      "-file",
+      "-maxDepth",
+      "-limit",
+      NULL,
+   };
+
+   enum {
+      option_kind,
+      option_file,
+      option_maxDepth,
+      option_limit,
    };
 
-   if (objc < numCommonArgs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
+   if (objc < optional_ix) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                       "cursor ?-kind kinds? ?-file filename? "
+                       "?-files files? ?-mainFileOnly? "
+                       "?-excludeSystemHeaders? ?-maxDepth depth? "
+                       "?-limit count?");
       return TCL_ERROR;
    }
 
-   static Command subcommands[] = {
-      { "cursor",
-        tuCursorObjCmd },
-      { "diagnostic",
-        tuDiagnosticObjCmd },
-      { "diagnostics",
-        tuDiagnosticListObjCmd },
-#if CINDEX_VERSION_MINOR >= 13
-      { "findIncludes",
-        tuFindIncludesObjCmd },
-#endif
-      { "inclusions",
-        tuInclusionsObjCmd },
-      { "index",
-        tuIndexObjCmd },
-      { "isMultipleIncludeGuarded",
-        tuIsMultipleIncludeGuardedObjCmd },
-      { "location",
-        tuLocationObjCmd },
-      { "modificationTime",
-        tuModificationTimeObjCmd },
-      { "reparse",
-        tuReparseObjCmd },
-      { "resourceUsage",
-        tuResourceUsageObjCmd },
-      { "save",
-        tuSaveObjCmd },
-      { "sourceFile",
-        tuSourceFileObjCmd },
-      { "skippedRanges",
-        tuSkippedRangesObjCmd },
-#if CINDEX_VERSION_MINOR >= 38
-      { "targetInfo",
-        tuTargetInfoObjCmd },
-#endif
-      { "uniqueID",
-        tuUniqueIDObjCmd },
-      { NULL },
-   };
-
-   int commandNumber;
-   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
-                                          subcommands, sizeof subcommands[0],
-                                          "subcommand", 0, &commandNumber);
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
    if (status != TCL_OK) {
       return status;
    }
 
-   return subcommands[commandNumber].proc(clientData, interp,
-                                          objc - subcommand_ix,
-                                          objv + subcommand_ix);
-}
+   CursorKindSet kinds;
+   SelectInfo    info = {
+      .tuInfo = getCursorTUInfo(objv[cursor_ix]),
+   };
+   initCursorScope(&info.scope);
 
-//-------------------------------------------------- indexName options command
+   unsigned options_found = 0;
+   for (int i = optional_ix; i < objc; ++i) {
+      status = parseCursorScopeOption(interp, &info.scope,
+                                      info.tuInfo->translationUnit, options,
+                                      objc, objv, &i);
+      if (status == TCL_OK) {
+         continue;
+      }
+      if (status != TCL_CONTINUE) {
+         goto cleanup;
+      }
 
-static int indexNameOptionsObjCmd(ClientData     clientData,
-                                  Tcl_Interp    *interp,
-                                  int            objc,
-                                  Tcl_Obj *const objv[])
-{
-   static BitMask options[] = {
-      { "-backgroundIndexing" },
-      { "-backgroundEditing" },
-      { "-background", CXGlobalOpt_ThreadBackgroundPriorityForAll },
-      { NULL }
-   };
+      int optionNumber;
+      status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                   "option", 0, &optionNumber);
+      if (status != TCL_OK) {
+         goto cleanup;
+      }
 
-   enum {
-      subcommand_ix,
-      options_ix
-   };
+      if ((options_found & (1 << optionNumber)) != 0) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("%s is specified more than once.",
+                                        Tcl_GetStringFromObj(objv[i], NULL)));
+         status = TCL_ERROR;
+         goto cleanup;
+      }
+      options_found |= 1 << optionNumber;
 
-   IndexInfo *info = (IndexInfo *)clientData;
+      if (objc <= i + 1) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("%s is not followed by a value",
+                                        Tcl_GetStringFromObj(objv[i], NULL)));
+         status = TCL_ERROR;
+         goto cleanup;
+      }
 
-   if (objc == subcommand_ix + 1) {
-      unsigned value = clang_CXIndex_getGlobalOptions(info->index);
-      return bitMaskToString(interp, options, noneTagObj, value);
-   }
+      Tcl_Obj *valueObj = objv[++i];
 
-   unsigned value = 0;
+      switch (optionNumber) {
 
-   if (objc == options_ix + 1
-       && (objv[options_ix] == noneTagObj
-           || strcmp(Tcl_GetStringFromObj(objv[options_ix], NULL),
-                     Tcl_GetStringFromObj(noneTagObj, NULL)) == 0)) {
-      // The option list is -none, or ...
-   } else {
-      // ... a list of options
-      for (int i = 1; i < objc; ++i) {
-         int number;
-         int status = Tcl_GetIndexFromObjStruct(interp, objv[i],
-                                                options, sizeof options[0],
-                                                "option", 0, &number);
+      case option_kind:
+         status = getCursorKindSetFromObj(interp, valueObj, &kinds);
          if (status != TCL_OK) {
-            return status;
+            goto cleanup;
          }
+         info.kinds = &kinds;
+         break;
+
+      case option_file:
+         status = addCursorScopeFile(interp, &info.scope,
+                                     info.tuInfo->translationUnit, valueObj);
+         if (status != TCL_OK) {
+            goto cleanup;
+         }
+         break;
+
+      case option_maxDepth:
+      case option_limit: {
+         int value;
+         status = Tcl_GetIntFromObj(interp, valueObj, &value);
+         if (status != TCL_OK) {
+            goto cleanup;
+         }
+         if (value <= 0) {
+            Tcl_SetObjResult(interp,
+                             Tcl_ObjPrintf("%s must be a positive integer",
+                                           options[optionNumber]));
+            status = TCL_ERROR;
+            goto cleanup;
+         }
+         if (optionNumber == option_maxDepth) {
+            info.maxDepth = value;
+         } else {
+            info.limit = value;
+         }
+         break;
+      }
 
-         value |= options[number].mask == 0
-            ? 1 << number
-            : options[number].mask;
       }
    }
 
-   clang_CXIndex_setGlobalOptions(info->index, value);
+   info.depth     = 1;
+   info.resultObj = Tcl_NewListObj(0, NULL);
+   enterTU(info.tuInfo);
+   clang_visitChildren(cursor, selectHelper, &info);
+   leaveTU(info.tuInfo);
 
-   return TCL_OK;
+   Tcl_SetObjResult(interp, info.resultObj);
+
+cleanup:
+   clearCursorScope(&info.scope);
+
+   return status;
 }
 
-//------------------------------------------ indexName translationUnit command
+//---------------------------------------------------------------- walk command
 
-enum {
-   parseOptions_sourceFile,
-   parseOptions_precompiledFile,
-   parseOptions_unsavedFile,
-   parseOptions_firstFlag
-};
+/** What walk does when it visits a cursor of a kind.
+ *
+ * The scripts recurse and continue are recognized and carried out without
+ * evaluating them.
+ */
+typedef enum WalkAction {
+   walkActionScript,
+   walkActionRecurse,
+   walkActionContinue
+} WalkAction;
+
+typedef struct WalkHandler {
+   enum CXCursorKind  kind;
+   WalkAction         action;
+   Tcl_Obj           *scriptObj;
+} WalkHandler;
+
+typedef struct WalkInfo {
+   Tcl_Interp    *interp;
+   Tcl_Obj       *varNameObj;
+   TUInfo        *tuInfo;
+   unsigned       generation;   // tuInfo->generation at the start
+   CursorScope    scope;
+   CursorKindSet  kinds;        // the kinds in handlers
+   WalkHandler   *handlers;
+   int            numHandlers;
+   WalkHandler    defaultHandler;
+   int            returnCode;
+   int            skipping;     // skipping the children of skipParent
+   CXCursor       skipParent;   // after recursebreak
+} WalkInfo;
+
+static void setWalkHandlerScript(WalkHandler *handler, Tcl_Obj *scriptObj)
+{
+   const char *script = Tcl_GetStringFromObj(scriptObj, NULL);
+
+   handler->scriptObj = scriptObj;
+   handler->action    = strcmp(script, "recurse") == 0 ? walkActionRecurse
+      : strcmp(script, "continue") == 0 ? walkActionContinue
+      : walkActionScript;
+}
+
+static enum CXChildVisitResult walkHelper(CXCursor     cursor,
+                                          CXCursor     parent,
+                                          CXClientData clientData)
+{
+   WalkInfo *info = (WalkInfo *)clientData;
+
+   if (info->skipping) {
+      if (clang_equalCursors(parent, info->skipParent)) {
+         return CXChildVisit_Continue;
+      }
+      info->skipping = 0;
+   }
 
-static const char *parseOptions[] = {
-   "-sourceFile",
-   "-precompiledFile",
-   "-unsavedFile",
+   if (! isCursorInScope(&info->scope, cursor)) {
+      return CXChildVisit_Continue;
+   }
 
-   // flags
-   "-detailedPreprocessingRecord",
-   "-incomplete",
-   "-precompiledPreamble",
-   "-cacheCompletionResults",
-   "-forSerialization",
-   "-cxxChainedPCH",
-   "-skipFunctionBodies",
-   "-includeBriefCommentsInCodeCompletion",
-#if CINDEX_VERSION_MINOR >= 33
-   "-createPreambleOnFirstParse",
-#endif
-#if CINDEX_VERSION_MINOR >= 34
-   "-keepGoing",
-#endif
-   NULL
-};
+   enum CXCursorKind  kind    = clang_getCursorKind(cursor);
+   WalkHandler       *handler = &info->defaultHandler;
+   if (cursorKindSetContains(&info->kinds, kind)) {
+      for (int i = 0; i < info->numHandlers; ++i) {
+         if (info->handlers[i].kind == kind) {
+            handler = &info->handlers[i];
+            break;
+         }
+      }
+   }
 
-static const char * const *parseFlags
-  = &parseOptions[parseOptions_firstFlag];
+   switch (handler->action) {
+   case walkActionRecurse:
+      return CXChildVisit_Recurse;
+   case walkActionContinue:
+      return CXChildVisit_Continue;
+   case walkActionScript:
+      break;
+   }
 
-static int indexNameTranslationUnitObjCmd(ClientData     clientData,
-                                          Tcl_Interp    *interp,
-                                          int            objc,
-                                          Tcl_Obj *const objv[])
+   int      status    = TCL_OK;
+   Tcl_Obj *cursorObj = newCursorObjForTU(info->tuInfo, cursor);
+   Tcl_IncrRefCount(cursorObj);
+   if (Tcl_ObjSetVar2(info->interp, info->varNameObj, NULL, cursorObj,
+                      TCL_LEAVE_ERR_MSG) == NULL) {
+      status = TCL_ERROR;
+   } else {
+      status = Tcl_EvalObjEx(info->interp, handler->scriptObj, 0);
+   }
+   Tcl_DecrRefCount(cursorObj);
+
+   // The handler may have deleted the translation unit.  Its AST is kept
+   // until walk returns, but there is no point in going on.
+   if (status != TCL_BREAK && status != TCL_RETURN && status != TCL_ERROR
+       && checkTraversedTU(info->interp, info->tuInfo, info->generation,
+                           "cursor") != TCL_OK) {
+      status = TCL_ERROR;
+   }
+
+   switch (status) {
+   case TCL_OK:
+   case TCL_CONTINUE:
+      return CXChildVisit_Continue;
+   case TCL_RECURSE:
+      return CXChildVisit_Recurse;
+   case TCL_RECURSE_BREAK:
+      // clang_visitChildren can't leave a level, so the remaining siblings
+      // are skipped as they are visited.
+      info->skipping   = 1;
+      info->skipParent = parent;
+      return CXChildVisit_Continue;
+   default:
+      info->returnCode = status;
+      return CXChildVisit_Break;
+   }
+}
+
+static int walkObjCmd(ClientData     clientData,
+                      Tcl_Interp    *interp,
+                      int            objc,
+                      Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      options_ix
+      optional_ix
    };
 
-   if (objc < options_ix + 1) {
-      goto wrong_num_args;
-   }
-
+   // The options precede the fixed arguments.
    enum {
-      parse_source,
-      parse_preparsed
-   }           parse           = parse_source;
-   unsigned    flags           = 0;
-   const char *sourceFilename  = NULL;
-   int         numUnsavedFiles = 0;
-   Tcl_Obj    *unsavedFileList = Tcl_NewObj();
-   Tcl_IncrRefCount(unsavedFileList);
+      varName_ix,
+      cursor_ix,
+      handlers_ix,
+      nargs
+   };
 
-   int i;
-   for (i = options_ix; i < objc; ++i) {
-      const char *str = Tcl_GetStringFromObj(objv[i], NULL);
+   if (objc < optional_ix + nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                       "?-files files? ?-mainFileOnly? "
+                       "?-excludeSystemHeaders? "
+                       "varName cursor {kind script ... ?default script?}");
+      return TCL_ERROR;
+   }
 
-      if (str[0] != '-') {
-         break;
-      }
+   int             numOptions = objc - nargs;
+   Tcl_Obj *const *args       = objv + numOptions;
 
-      if (strcmp(str, "--") == 0) {
-         ++i;
-         break;
-      }
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, args[cursor_ix], &cursor);
+   if (status != TCL_OK) {
+      return status;
+   }
+
+   TUInfo      *tuInfo = getCursorTUInfo(args[cursor_ix]);
+   CursorScope  scope;
+   initCursorScope(&scope);
+   status = parseCursorScopeOptions(interp, &scope, tuInfo->translationUnit,
+                                    numOptions - optional_ix,
+                                    objv + optional_ix);
+   if (status != TCL_OK) {
+      clearCursorScope(&scope);
+      return status;
+   }
 
-      int optionNumber;
-      int status = Tcl_GetIndexFromObj(interp, objv[i], parseOptions,
-                                       "option", 0, &optionNumber);
-      if (status != TCL_OK) {
-         Tcl_DecrRefCount(unsavedFileList);
-         return status;
-      }
+   // The handler list is duplicated so that scripts can't shimmer it.
+   Tcl_Obj *handlersObj = Tcl_DuplicateObj(args[handlers_ix]);
+   Tcl_IncrRefCount(handlersObj);
 
-      switch (optionNumber) {
-      case parseOptions_sourceFile: // -sourceFile filename
-         if (objc <= i + 1) {
-            Tcl_WrongNumArgs(interp, i, objv, "filename ...");
-            Tcl_DecrRefCount(unsavedFileList);
-            return TCL_ERROR;
-         }
-         sourceFilename = Tcl_GetStringFromObj(objv[i + 1], NULL);
-         ++i;
-         break;
+   int       n;
+   Tcl_Obj **elms;
+   status = Tcl_ListObjGetElements(interp, handlersObj, &n, &elms);
+   if (status != TCL_OK) {
+      goto cleanup;
+   }
 
-      case parseOptions_unsavedFile: // -unsavedFile filename contents
-         if (objc <= i + 2) {
-            Tcl_WrongNumArgs(interp, i, objv, "filename contents ...");
-            Tcl_DecrRefCount(unsavedFileList);
-            return TCL_ERROR;
+   if (n % 2 != 0) {
+      Tcl_SetObjResult(interp,
+                       Tcl_NewStringObj("extra kind with no script", -1));
+      status = TCL_ERROR;
+      goto cleanup;
+   }
+
+   WalkInfo info = {
+      .interp      = interp,
+      .varNameObj  = args[varName_ix],
+      .tuInfo      = tuInfo,
+      .generation  = tuInfo->generation,
+      .scope       = scope,
+      .handlers    = (WalkHandler *)Tcl_Alloc(n / 2 * sizeof(WalkHandler)
+                                              + 1),
+      .numHandlers = 0,
+      .defaultHandler = {
+         .action = walkActionRecurse,
+      },
+      .returnCode  = TCL_OK,
+      .skipping    = 0,
+   };
+   memset(&info.kinds, 0, sizeof info.kinds);
+
+   for (int i = 0; i < n; i += 2) {
+      WalkHandler *handler;
+
+      if (strcmp(Tcl_GetStringFromObj(elms[i], NULL), "default") == 0) {
+         handler = &info.defaultHandler;
+      } else {
+         enum CXCursorKind kind;
+         status = getCursorKindFromObj(interp, elms[i], &kind);
+         if (status != TCL_OK) {
+            goto free_handlers;
          }
-         ++numUnsavedFiles;
-         Tcl_ListObjAppendElement(NULL, unsavedFileList, objv[++i]);
-         Tcl_ListObjAppendElement(NULL, unsavedFileList, objv[++i]);
-         break;
 
-      case parseOptions_precompiledFile: // -precompiledFile filename
-         parse = parse_preparsed;
-         if (objc <= i + 2) {
-            Tcl_WrongNumArgs(interp, i, objv, "-precompiledFile filename");
-            Tcl_DecrRefCount(unsavedFileList);
-            return TCL_ERROR;
+         if (cursorKindSetContains(&info.kinds, kind)) {
+            Tcl_SetObjResult(interp,
+                             Tcl_ObjPrintf("%s is specified more than once.",
+                                           Tcl_GetStringFromObj(elms[i],
+                                                                NULL)));
+            status = TCL_ERROR;
+            goto free_handlers;
          }
-         sourceFilename = Tcl_GetStringFromObj(objv[i + 1], NULL);
-         ++i;
-         break;
+         cursorKindSetAdd(&info.kinds, kind);
 
-      default:
-         flags |= 1 << (optionNumber - parseOptions_firstFlag);
+         handler       = &info.handlers[info.numHandlers++];
+         handler->kind = kind;
       }
-   }
 
-   if (objc <= i) {
-      goto wrong_num_args;
+      setWalkHandlerScript(handler, elms[i + 1]);
    }
 
-   Tcl_Obj *tuNameObj = objv[i++];
+   enterTU(tuInfo);
+   clang_visitChildren(cursor, walkHelper, &info);
+   leaveTU(tuInfo);
 
-   Tcl_Obj *const  *argObjs = objv + i;
-   int              nargs   = objc - i;
-   char           **args    = (char **)Tcl_Alloc(nargs * sizeof *args);
-   for (i = 0; i < nargs; ++i) {
-      args[i] = Tcl_GetStringFromObj(argObjs[i], NULL);
+   status = info.returnCode;
+   if (status == TCL_BREAK) {
+      status = TCL_OK;
    }
 
-   struct CXUnsavedFile *unsavedFiles =
-      createUnsavedFileArray(unsavedFileList);
-   Tcl_DecrRefCount(unsavedFileList);
+ free_handlers:
+   Tcl_Free((char *)info.handlers);
 
-   IndexInfo *parent = (IndexInfo *)clientData;
-   CXTranslationUnit tu = NULL;
-#if CINDEX_VERSION_MINOR >= 23
-   enum CXErrorCode ec;
-#endif
-   switch (parse) {
-   case parse_source:
-#if CINDEX_VERSION_MINOR >= 23
-      ec = clang_parseTranslationUnit2(parent->index, sourceFilename,
-                                       (const char *const *)args, nargs,
-                                       unsavedFiles, numUnsavedFiles, flags,
-                                       &tu);
-#else
-      tu = clang_parseTranslationUnit(parent->index, sourceFilename,
-                                      (const char *const *)args, nargs,
-                                      unsavedFiles, numUnsavedFiles, flags);
-#endif
-      break;
-   case parse_preparsed:
-#if CINDEX_VERSION_MINOR >= 23
-      ec = clang_createTranslationUnit2(parent->index, sourceFilename, &tu);
-#else
-      tu = clang_createTranslationUnit(parent->index, sourceFilename);
-#endif
-      break;
-   default:
-      tu = NULL;
-   }
+ cleanup:
+   Tcl_DecrRefCount(handlersObj);
+   clearCursorScope(&scope);
 
-   Tcl_Free((char *)args);
-   Tcl_Free((char *)unsavedFiles);
+   return status;
+}
 
-   Tcl_Obj *err = NULL;
-#if CINDEX_VERSION_MINOR >= 23
-   switch (ec) {
-   case CXError_Failure:
-     err = Tcl_NewStringObj("failed to create translation unit.", -1);
-     break;
-   case CXError_Crashed:
-     err = Tcl_NewStringObj("failed to create translation unit: libclang crashed.", -1);
-     break;
-   case CXError_InvalidArguments:
-     err = Tcl_NewStringObj("failed to create translation unit: invalid arguments.", -1);
-     break;
-   case CXError_ASTReadError:
-     err = Tcl_NewStringObj("failed to create translation unit: AST deserialization failed.", -1);
-     break;
-   case CXError_Success:
-     /* Just don't set err. */
-     break;
-   }
-#else
-   if (tu == NULL) {
-      err = Tcl_NewStringObj("failed to create translation unit.", -1);
-   }
-#endif
-   if (err != NULL) {
-      Tcl_SetObjResult(interp, err);
-      return TCL_ERROR;
-   }
+//---------------------------------------------------- cursor iterator command
 
-   Tcl_Obj *commandNameObj = NULL;
-   newQualifiedName(interp, tuNameObj, &commandNameObj);
+/** The information associated to a cursor iterator Tcl command.
+ *
+ * The cursors to be visited are kept in pending[head .. tail - 1].  The
+ * children of a cursor are added when the iterator advances past it, so a
+ * traversal costs nothing more than the steps actually taken.  In preorder,
+ * pending is a stack whose top is pending[tail - 1].  In breadth first
+ * order, it is a queue.
+ */
+typedef struct CursorIterator {
+   Tcl_Command  cmd;
+   TUInfo      *tuInfo;
+   unsigned     generation;     // tuInfo->generation at creation
+   int          breadthFirst;
+   CursorScope  scope;
+   CXCursor    *pending;
+   int          head;
+   int          tail;
+   int          capacity;
+   CXCursor     current;        // the cursor returned last
+   int          expandCurrent;  // 0 after skipChildren or at the start
+} CursorIterator;
+
+static void pushIteratorCursor(CursorIterator *iterator, CXCursor cursor)
+{
+   if (iterator->tail == iterator->capacity) {
+      if (iterator->head > iterator->capacity / 2) {
+         memmove(iterator->pending, iterator->pending + iterator->head,
+                 (iterator->tail - iterator->head)
+                 * sizeof iterator->pending[0]);
+         iterator->tail -= iterator->head;
+         iterator->head  = 0;
+      } else {
+         iterator->capacity = iterator->capacity == 0
+            ? 64 : iterator->capacity * 2;
+         iterator->pending  = (CXCursor *)
+            Tcl_Realloc((char *)iterator->pending,
+                        iterator->capacity * sizeof iterator->pending[0]);
+      }
+   }
 
-   Tcl_Command cmd = Tcl_CreateObjCommand(interp, Tcl_GetString(commandNameObj),
-                                          tuInstanceObjCmd, NULL, tuDeleteProc);
-   Tcl_CmdInfo cmdinfo;
-   TUInfo     *info = createTUInfo(parent, cmd, tu);
-   Tcl_GetCommandInfoFromToken(cmd, &cmdinfo);
-   cmdinfo.objClientData = info;
-   cmdinfo.clientData = info;
-   cmdinfo.deleteData = info;
-   Tcl_SetCommandInfoFromToken(cmd, &cmdinfo);
+   iterator->pending[iterator->tail++] = cursor;
+}
 
-   Tcl_SetObjResult(interp, commandNameObj);
+static enum CXChildVisitResult iteratorChildrenHelper(CXCursor     cursor,
+                                                      CXCursor     parent,
+                                                      CXClientData data)
+{
+   CursorIterator *iterator = (CursorIterator *)data;
 
-   return TCL_OK;
+   if (isCursorInScope(&iterator->scope, cursor)) {
+      pushIteratorCursor(iterator, cursor);
+   }
 
- wrong_num_args:
-   Tcl_WrongNumArgs(interp, command_ix + 1, objv,
-                    "?options? ... ?--? "
-                    "translationUnitName commandLineArg...");
-   return TCL_ERROR;
+   return CXChildVisit_Continue;
 }
 
-//---------------------------------------------------------- indexName command
-
-static int indexNameObjCmd(ClientData     clientData,
-                           Tcl_Interp    *interp,
-                           int            objc,
-                           Tcl_Obj *const objv[])
+// Advance iterator.  Returns 0 if there are no more cursors.
+static int advanceIterator(CursorIterator *iterator)
 {
-   enum {
-      command_ix,
-      subcommand_ix,
-      numCommonArgs
-   };
+   if (iterator->expandCurrent) {
+      int first = iterator->tail;
+      clang_visitChildren(iterator->current, iteratorChildrenHelper,
+                          iterator);
 
-   if (objc < numCommonArgs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
-      return TCL_ERROR;
+      // The first child must be on the top of the stack.
+      if (!iterator->breadthFirst) {
+         for (int i = first, j = iterator->tail - 1; i < j; ++i, --j) {
+            CXCursor tmp          = iterator->pending[i];
+            iterator->pending[i]  = iterator->pending[j];
+            iterator->pending[j]  = tmp;
+         }
+      }
    }
 
-   static Command commands[] = {
-      { "options",
-        indexNameOptionsObjCmd },
-      { "translationUnit",
-        indexNameTranslationUnitObjCmd },
-      { NULL }
-   };
+   if (iterator->head == iterator->tail) {
+      iterator->expandCurrent = 0;
+      return 0;
+   }
 
-   int commandNumber;
-   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
-                                          commands, sizeof commands[0],
-                                          "subcommand", 0, &commandNumber);
-   if (status != TCL_OK) {
-      return status;
+   iterator->current = iterator->breadthFirst
+      ? iterator->pending[iterator->head++]
+      : iterator->pending[--iterator->tail];
+   iterator->expandCurrent = 1;
+
+   if (iterator->head == iterator->tail) {
+      iterator->head = iterator->tail = 0;
    }
 
-   return commands[commandNumber].proc(clientData, interp,
-                                       objc - subcommand_ix,
-                                       objv + subcommand_ix);
+   return 1;
 }
 
-//----------------------------------------------------- location equal command
-
-static int locationEqualObjCmd(ClientData     clientData,
-                               Tcl_Interp    *interp,
-                               int            objc,
-                               Tcl_Obj *const objv[])
+static int checkIteratorTU(Tcl_Interp *interp, CursorIterator *iterator)
 {
-   enum {
-      command_ix,
-      location1_ix,
-      location2_ix,
-      nargs
-   };
+   TUInfo *tuInfo = iterator->tuInfo;
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location1 location2");
+   if (tuInfo->translationUnit == NULL) {
+      Tcl_SetObjResult(interp,
+                       Tcl_NewStringObj("the iterator's translation unit "
+                                        "has been deleted", -1));
       return TCL_ERROR;
    }
 
-   CXSourceLocation locations[2];
-   for (int i = 0; i < 2; ++i) {
-      int status = getLocationFromObj
-         (interp, objv[location1_ix + i], &locations[i]);
-      if (status != TCL_OK) {
-         return status;
-      }
+   if (tuInfo->generation != iterator->generation) {
+      setStaleTUError(interp, tuInfo, iterator->generation, "iterator");
+      return TCL_ERROR;
    }
 
-   int      result    = clang_equalLocations(locations[0], locations[1]) != 0;
-   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
-   Tcl_SetObjResult(interp, resultObj);
-
    return TCL_OK;
 }
 
-//--------------------------------------------------- location is null command
-
-static int locationIsNullObjCmd(ClientData     clientData,
-                                Tcl_Interp    *interp,
-                                int            objc,
-                                Tcl_Obj *const objv[])
+static int iteratorNextObjCmd(ClientData     clientData,
+                              Tcl_Interp    *interp,
+                              int            objc,
+                              Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      location_ix,
+      varName_ix,
       nargs
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location");
+   if (objc != varName_ix && objc != nargs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "?varName?");
       return TCL_ERROR;
    }
 
-   CXSourceLocation location;
-   int status = getLocationFromObj(interp, objv[location_ix], &location);
+   CursorIterator *iterator = (CursorIterator *)clientData;
+
+   int status = checkIteratorTU(interp, iterator);
    if (status != TCL_OK) {
       return status;
    }
 
-   int      result    = clang_equalLocations(location,
-                                             clang_getNullLocation()) != 0;
-   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   int      found     = advanceIterator(iterator);
+   Tcl_Obj *cursorObj = found
+      ? newCursorObjForTU(iterator->tuInfo, iterator->current)
+      : Tcl_NewObj();
 
-   return TCL_OK;
-}
+   if (objc == varName_ix) {
+      Tcl_SetObjResult(interp, cursorObj);
+      return TCL_OK;
+   }
 
-//------------------------------------------------------ location null command
+   Tcl_IncrRefCount(cursorObj);
+   if (found && Tcl_ObjSetVar2(interp, objv[varName_ix], NULL, cursorObj,
+                               TCL_LEAVE_ERR_MSG) == NULL) {
+      status = TCL_ERROR;
+   } else {
+      Tcl_SetObjResult(interp, Tcl_NewBooleanObj(found));
+   }
+   Tcl_DecrRefCount(cursorObj);
 
-static int locationNullObjCmd(ClientData     clientData,
-                              Tcl_Interp    *interp,
-                              int            objc,
-                              Tcl_Obj *const objv[])
+   return status;
+}
+
+static int iteratorSkipChildrenObjCmd(ClientData     clientData,
+                                      Tcl_Interp    *interp,
+                                      int            objc,
+                                      Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
@@ -5617,190 +12706,279 @@ static int locationNullObjCmd(ClientData     clientData,
       return TCL_ERROR;
    }
 
-   CXSourceLocation  result    = clang_getNullLocation();
-   Tcl_Obj          *resultObj = newLocationObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   CursorIterator *iterator = (CursorIterator *)clientData;
+   iterator->expandCurrent  = 0;
 
    return TCL_OK;
 }
 
-//------------------------------------------ location presumedLocation command
-
-static int locationPresumedLocationObjCmd(ClientData     clientData,
-                                          Tcl_Interp    *interp,
-                                          int            objc,
-                                          Tcl_Obj *const objv[])
+static int iteratorCloseObjCmd(ClientData     clientData,
+                               Tcl_Interp    *interp,
+                               int            objc,
+                               Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      location_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "");
       return TCL_ERROR;
    }
 
-   CXSourceLocation location;
-   int status = getLocationFromObj(interp, objv[location_ix], &location);
-   if (status != TCL_OK) {
-      return status;
-   }
-
-   Tcl_Obj *resultObj = newPresumedLocationObj(location);
-   Tcl_SetObjResult(interp, resultObj);
+   CursorIterator *iterator = (CursorIterator *)clientData;
+   Tcl_DeleteCommandFromToken(interp, iterator->cmd);
 
    return TCL_OK;
 }
 
-//---------------------------------------------------- location decode command
+static void iteratorDeleteProc(ClientData clientData)
+{
+   CursorIterator *iterator = (CursorIterator *)clientData;
 
-typedef void (*LocationDecodeProc)
-(CXSourceLocation, CXFile*, unsigned *, unsigned *, unsigned *);
+   unpinTU(iterator->tuInfo);
+   clearCursorScope(&iterator->scope);
+   Tcl_Free((char *)iterator->pending);
+   Tcl_Free((char *)iterator);
+}
 
-static int locationDecodeObjCmd(ClientData     clientData,
-                                Tcl_Interp    *interp,
-                                int            objc,
-                                Tcl_Obj *const objv[])
+static int iteratorInstanceObjCmd(ClientData     clientData,
+                                  Tcl_Interp    *interp,
+                                  int            objc,
+                                  Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      location_ix,
-      nargs
+      subcommand_ix,
+      numCommonArgs,
    };
-      
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location");
+
+   if (objc < numCommonArgs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
       return TCL_ERROR;
    }
 
-   CXSourceLocation location;
-   int status = getLocationFromObj(interp, objv[location_ix], &location);
+   static Command subcommands[] = {
+      { "close",
+        iteratorCloseObjCmd },
+      { "next",
+        iteratorNextObjCmd },
+      { "skipChildren",
+        iteratorSkipChildrenObjCmd },
+      { NULL },
+   };
+
+   int commandNumber;
+   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
+                                          subcommands, sizeof subcommands[0],
+                                          "subcommand", 0, &commandNumber);
    if (status != TCL_OK) {
       return status;
    }
 
-   CXFile   file;
-   unsigned line;
-   unsigned column;
-   unsigned offset;
-   ((LocationDecodeProc)clientData)(location, &file, &line, &column, &offset);
-
-   Tcl_Obj *resultObj = newDecodedLocationObj(file, line, column, offset);
-   Tcl_SetObjResult(interp, resultObj);
-
-   return TCL_OK;
+   return subcommands[commandNumber].proc(clientData, interp,
+                                          objc - subcommand_ix,
+                                          objv + subcommand_ix);
 }
 
-//--------------------------------------------------- location -> bool command
-
-static int locationToBoolObjCmd(ClientData     clientData,
+static int cursorIteratorObjCmd(ClientData     clientData,
                                 Tcl_Interp    *interp,
                                 int            objc,
                                 Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      location_ix,
-      nargs
+      name_ix,
+      cursor_ix,
+      optional_ix
    };
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location");
+   static const char *options[] = {
+      "-order",
+      NULL
+   };
+
+   static const char *orders[] = {
+      "preorder",
+      "bfs",
+      NULL
+   };
+
+   if (objc < optional_ix) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv,
+                       "name cursor ?-order preorder|bfs? ?-files files? "
+                       "?-mainFileOnly? ?-excludeSystemHeaders?");
       return TCL_ERROR;
    }
 
-   CXSourceLocation location;
-   int status = getLocationFromObj(interp, objv[location_ix], &location);
+   CXCursor cursor;
+   int status = getCursorFromObj(interp, objv[cursor_ix], &cursor);
    if (status != TCL_OK) {
       return status;
    }
 
-   typedef unsigned (*LocationToUnsignedProc)(CXSourceLocation);
-
-   int      result    = ((LocationToUnsignedProc)clientData)(location) != 0;
-   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
-   Tcl_SetObjResult(interp, resultObj);
-
-   return TCL_OK;
-}
+   TUInfo      *tuInfo = getCursorTUInfo(objv[cursor_ix]);
+   CursorScope  scope;
+   initCursorScope(&scope);
 
-//------------------------------------------------------- range create command
+   int order = 0;
+   for (int i = optional_ix; i < objc; ++i) {
+      status = parseCursorScopeOption(interp, &scope,
+                                      tuInfo->translationUnit, options,
+                                      objc, objv, &i);
+      if (status == TCL_OK) {
+         continue;
+      }
+      if (status != TCL_CONTINUE) {
+         clearCursorScope(&scope);
+         return status;
+      }
 
-static int rangeCreateObjCmd(ClientData     clientData,
-                             Tcl_Interp    *interp,
-                             int            objc,
-                             Tcl_Obj *const objv[])
-{
-   enum {
-      command_ix,
-      location1_ix,
-      location2_ix,
-      nargs
-   };
+      int option;
+      status = Tcl_GetIndexFromObj(interp, objv[i], options,
+                                   "option", 0, &option);
+      if (status == TCL_OK && objc <= i + 1) {
+         Tcl_SetObjResult(interp,
+                          Tcl_NewStringObj("-order is not followed by an "
+                                           "order", -1));
+         status = TCL_ERROR;
+      }
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "location1 location2");
-      return TCL_ERROR;
-   }
+      if (status == TCL_OK) {
+         status = Tcl_GetIndexFromObj(interp, objv[++i], orders,
+                                      "order", 0, &order);
+      }
 
-   CXSourceLocation locations[2];
-   for (int i = 0; i < 2; ++i) {
-      int status = getLocationFromObj
-         (interp, objv[location1_ix + i], &locations[i]);
       if (status != TCL_OK) {
+         clearCursorScope(&scope);
          return status;
       }
    }
 
-   CXSourceRange  result    = clang_getRange(locations[0], locations[1]);
-   Tcl_Obj       *resultObj = newRangeObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   // An open iterator keeps its translation unit in the pool.
+   pinTU(tuInfo);
+
+   CursorIterator *iterator = (CursorIterator *)Tcl_Alloc(sizeof *iterator);
+   iterator->tuInfo        = tuInfo;
+   iterator->generation    = tuInfo->generation;
+   iterator->breadthFirst  = order == 1;
+   iterator->scope         = scope;
+   iterator->pending       = NULL;
+   iterator->head          = 0;
+   iterator->tail          = 0;
+   iterator->capacity      = 0;
+   iterator->current       = cursor;
+   iterator->expandCurrent = 1;   // start with the children of cursor
+
+   Tcl_Obj *commandNameObj = NULL;
+   newQualifiedName(interp, objv[name_ix], &commandNameObj);
+
+   iterator->cmd = Tcl_CreateObjCommand(interp, Tcl_GetString(commandNameObj),
+                                        iteratorInstanceObjCmd, iterator,
+                                        iteratorDeleteProc);
+
+   Tcl_SetObjResult(interp, commandNameObj);
 
    return TCL_OK;
 }
 
-//-------------------------------------------------------- range equal command
+//------------------------------------------------------- exportReader command
 
-static int rangeEqualObjCmd(ClientData     clientData,
-                            Tcl_Interp    *interp,
-                            int            objc,
-                            Tcl_Obj *const objv[])
+/** The information associated to an exportReader Tcl command.
+ *
+ * Only the trailer and the string offsets are read when the command is
+ * created.  Nodes and strings are read when they are asked for.
+ */
+typedef struct ExportReader {
+   Tcl_Channel   channel;
+   Tcl_WideInt   numNodes;
+   Tcl_WideInt   numStrings;
+   Tcl_WideInt   blobPos;
+   uint32_t     *stringOffsets;    // numStrings + 1 entries
+   Tcl_Obj     **strings;          // NULL until read
+} ExportReader;
+
+static void exportReaderDeleteProc(ClientData clientData)
+{
+   ExportReader *reader = (ExportReader *)clientData;
+
+   for (Tcl_WideInt i = 0; i < reader->numStrings; ++i) {
+      if (reader->strings[i] != NULL) {
+         Tcl_DecrRefCount(reader->strings[i]);
+      }
+   }
+   Tcl_Free((char *)reader->strings);
+   Tcl_Free((char *)reader->stringOffsets);
+   Tcl_Close(NULL, reader->channel);
+   Tcl_Free((char *)reader);
+}
+
+static int readExport(Tcl_Interp   *interp,
+                      ExportReader *reader,
+                      Tcl_WideInt   position,
+                      void         *buffer,
+                      int           size)
 {
-   enum {
-      command_ix,
-      range1_ix,
-      range2_ix,
-      nargs
-   };
+   if (Tcl_Seek(reader->channel, position, SEEK_SET) < 0
+       || Tcl_Read(reader->channel, (char *)buffer, size) != size) {
+      Tcl_SetObjResult(interp,
+                       Tcl_NewStringObj("the export file is truncated", -1));
+      return TCL_ERROR;
+   }
 
-   if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "range1 range2");
+   return TCL_OK;
+}
+
+static int getExportStringObj(Tcl_Interp    *interp,
+                              ExportReader  *reader,
+                              uint32_t       id,
+                              Tcl_Obj      **result)
+{
+   if (id == exportNoString) {
+      *result = filenameNullObj;
+      return TCL_OK;
+   }
+
+   if (reader->numStrings <= id) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("invalid string id %u", id));
       return TCL_ERROR;
    }
 
-   CXSourceRange ranges[2];
-   for (int i = 0; i < 2; ++i) {
-      int status = getRangeFromObj(interp, objv[range1_ix + i], &ranges[i]);
+   if (reader->strings[id] == NULL) {
+      uint32_t begin = reader->stringOffsets[id];
+      uint32_t end   = reader->stringOffsets[id + 1];
+      if (end <= begin) {
+         Tcl_SetObjResult(interp,
+                          Tcl_ObjPrintf("invalid string id %u", id));
+         return TCL_ERROR;
+      }
+
+      char *buffer = Tcl_Alloc(end - begin);
+      int   status = readExport(interp, reader, reader->blobPos + begin,
+                                buffer, end - begin);
+      if (status == TCL_OK) {
+         // Without the terminating NUL.
+         reader->strings[id] = Tcl_NewStringObj(buffer, end - begin - 1);
+         Tcl_IncrRefCount(reader->strings[id]);
+      }
+      Tcl_Free(buffer);
+
       if (status != TCL_OK) {
          return status;
       }
    }
 
-   int      result    = clang_equalRanges(ranges[0], ranges[1]) != 0;
-   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   *result = reader->strings[id];
 
    return TCL_OK;
 }
 
-//--------------------------------------------------------- range null command
-
-static int rangeNullObjCmd(ClientData     clientData,
-                           Tcl_Interp    *interp,
-                           int            objc,
-                           Tcl_Obj *const objv[])
+static int exportReaderCountObjCmd(ClientData     clientData,
+                                   Tcl_Interp    *interp,
+                                   int            objc,
+                                   Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
@@ -5812,306 +12990,234 @@ static int rangeNullObjCmd(ClientData     clientData,
       return TCL_ERROR;
    }
 
-   CXSourceRange  result    = clang_getNullRange();
-   Tcl_Obj       *resultObj = newRangeObj(result);
-   Tcl_SetObjResult(interp, resultObj);
+   ExportReader *reader = (ExportReader *)clientData;
+   Tcl_SetObjResult(interp, Tcl_NewWideIntObj(reader->numNodes));
 
    return TCL_OK;
 }
 
-//------------------------------------------------------ range is null command
-
-static int rangeIsNullObjCmd(ClientData     clientData,
-                             Tcl_Interp    *interp,
-                             int            objc,
-                             Tcl_Obj *const objv[])
+static int exportReaderNodeObjCmd(ClientData     clientData,
+                                  Tcl_Interp    *interp,
+                                  int            objc,
+                                  Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      range_ix,
+      index_ix,
       nargs
    };
 
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "range");
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "index");
       return TCL_ERROR;
    }
 
-   CXSourceRange range;
-   int status = getRangeFromObj(interp, objv[range_ix], &range);
+   ExportReader *reader = (ExportReader *)clientData;
+
+   Tcl_WideInt index;
+   int status = Tcl_GetWideIntFromObj(interp, objv[index_ix], &index);
    if (status != TCL_OK) {
       return status;
    }
 
-   int      result    = clang_equalRanges(range, clang_getNullRange()) != 0;
-   Tcl_Obj *resultObj = Tcl_NewIntObj(result);
-   Tcl_SetObjResult(interp, resultObj);
-
-   return TCL_OK;
-}
-
-//-------------------------------------------------- range -> location command
-
-static int rangeToLocationObjCmd(ClientData     clientData,
-                                 Tcl_Interp    *interp,
-                                 int            objc,
-                                 Tcl_Obj *const objv[])
-{
-   if (objc != 2) {
-      Tcl_WrongNumArgs(interp, 1, objv, "range");
+   if (index < 0 || reader->numNodes <= index) {
+      Tcl_SetObjResult(interp,
+                       Tcl_ObjPrintf("node index %s is out of range",
+                                     Tcl_GetStringFromObj(objv[index_ix],
+                                                          NULL)));
       return TCL_ERROR;
    }
 
-   CXSourceRange range;
-   int status = getRangeFromObj(interp, objv[1], &range);
+   unsigned char record[exportRecordSize];
+   status = readExport(interp, reader,
+                       exportHeaderSize + index * exportRecordSize,
+                       record, sizeof record);
    if (status != TCL_OK) {
       return status;
    }
 
-   typedef CXSourceLocation (*ProcType)(CXSourceRange); 
-
-   CXSourceLocation  location  = ((ProcType)clientData)(range);
-   Tcl_Obj          *resultObj = newLocationObj(location);
-   Tcl_SetObjResult(interp, resultObj);
-
-   return TCL_OK;
-}
-
-//------------------------------------------------------- foreachChild command
-
-typedef struct ForeachChildInfo {
-   Tcl_Obj    *ancestorStackObj;
-} ForeachChildInfo;
-
-static enum CXChildVisitResult foreachChildHelper(CXCursor     cursor,
-                                                  CXCursor     parentCursor,
-                                                  CXClientData clientData)
-{
-   int status = TCL_OK;
-   Tcl_Obj *childObj = NULL;
-   Tcl_Obj *parentObj = NULL;
-
-   VisitInfo *visitInfo = (VisitInfo *)clientData;
-
-   /*
-    *  CXChildVisit_Break breaks out of the traversal of current cursor, while
-    *  we often want to break out of the whole traversal.  Use TCL_BREAK break
-    *  for the latter (as it's natural to think of the recursive loop a
-    *  foreach of its linearization), but still support the former behaviour
-    *  with the custom return code TCL_RECURSE_BREAK.
-    */
-   if (visitInfo->returnCode == TCL_BREAK) {
-      return CXChildVisit_Break;
-   }
-
-   Tcl_Obj *childVariableName = visitInfo->variableNames[0];
-   childObj = newCursorObj(cursor);
-   Tcl_IncrRefCount(childObj);
-   if (Tcl_ObjSetVar2(visitInfo->interp, childVariableName,
-                      NULL, childObj, TCL_LEAVE_ERR_MSG) == NULL) {
-      status = TCL_ERROR;
-      goto cleanup;
-   }
-
-   if (visitInfo->numVariables == 2) {
-      ForeachChildInfo *foreachChildInfo =
-         (ForeachChildInfo *)visitInfo->clientData;
-      Tcl_Obj  *ancestorStackObj = foreachChildInfo->ancestorStackObj;
-      int       ancestorStackSize = 0;
-      Tcl_Obj **ancestorStack = NULL;
-      CXCursor  ancestorCursor;
-      int       i;
+   Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+   Tcl_IncrRefCount(resultObj);
 
-      status = Tcl_ListObjGetElements(visitInfo->interp,
-                                      ancestorStackObj,
-                                      &ancestorStackSize, &ancestorStack);
+   uint32_t  kind     = getUint32(record);
+   Tcl_Obj  *kindName = getCursorKindNameObj(kind);
+   Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj("kind", -1));
+   Tcl_ListObjAppendElement(NULL, resultObj,
+                            kindName != NULL ? kindName
+                            : Tcl_NewLongObj(kind));
+
+   Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj("parent", -1));
+   Tcl_ListObjAppendElement(NULL, resultObj,
+                            Tcl_NewIntObj((int32_t)getUint32(record + 4)));
+
+   static const char *stringFields[] = { "spelling", "usr", "file" };
+   for (int i = 0; i < 3; ++i) {
+      Tcl_Obj *stringObj;
+      status = getExportStringObj(interp, reader,
+                                  getUint32(record + 8 + i * 4), &stringObj);
       if (status != TCL_OK) {
-         goto cleanup;
-      }
-      for (i = ancestorStackSize - 1; i >= 0; i--) {
-         status = getCursorFromObj(visitInfo->interp, ancestorStack[i],
-                                   &ancestorCursor);
-         if (status != TCL_OK) {
-            goto cleanup;
-         }
-
-         if (clang_equalCursors(ancestorCursor, parentCursor) != 0) {
-            break;
-         }
+         Tcl_DecrRefCount(resultObj);
+         return status;
       }
+      Tcl_ListObjAppendElement(NULL, resultObj,
+                               Tcl_NewStringObj(stringFields[i], -1));
+      Tcl_ListObjAppendElement(NULL, resultObj, stringObj);
+   }
 
-      /*
-       * Not a sibling (i would be == to ancestorStackSize - 1): either
-       * recursing or rewinding.
-       */
-      if (i < 0 || i < ancestorStackSize - 1) {
-         /* We are going to modify the list, duplicate if shared. */
-         if (Tcl_IsShared(ancestorStackObj)) {
-            ancestorStackObj = Tcl_DuplicateObj(ancestorStackObj);
-            foreachChildInfo->ancestorStackObj = ancestorStackObj;
-         }
+   Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj("offset", -1));
+   Tcl_ListObjAppendElement(NULL, resultObj,
+                            Tcl_NewLongObj(getUint32(record + 20)));
 
-         if (i < 0) {
-            /* Not found: we are recursing. */
-            parentObj = newCursorObj(parentCursor);
-            Tcl_IncrRefCount(parentObj);
-            status = Tcl_ListObjAppendElement(visitInfo->interp, ancestorStackObj,
-                                              parentObj);
-         } else {
-            /* Found: remove rewinded ancestors. */
-            status = Tcl_ListObjReplace(visitInfo->interp, ancestorStackObj,
-                                        /* (size-1) - (i+1) */
-                                        i+1, ancestorStackSize - i,
-                                        0, NULL);
-         }
-      }
-      if (status != TCL_OK) {
-         goto cleanup;
-      }
+   Tcl_SetObjResult(interp, resultObj);
+   Tcl_DecrRefCount(resultObj);
 
-      Tcl_Obj *ancestorsVariableName = visitInfo->variableNames[1];
-      if (Tcl_ObjSetVar2(visitInfo->interp, ancestorsVariableName,
-                         NULL, ancestorStackObj, TCL_LEAVE_ERR_MSG) == NULL) {
-         status = TCL_ERROR;
-         goto cleanup;
-      }
-   }
+   return TCL_OK;
+}
 
-   status = Tcl_EvalObjEx(visitInfo->interp, visitInfo->scriptObj, 0);
+static int exportReaderInstanceObjCmd(ClientData     clientData,
+                                      Tcl_Interp    *interp,
+                                      int            objc,
+                                      Tcl_Obj *const objv[])
+{
+   enum {
+      command_ix,
+      subcommand_ix,
+      numCommonArgs,
+   };
 
-cleanup:
-   if (childObj) {
-      Tcl_DecrRefCount(childObj);
-   }
-   if (parentObj) {
-      Tcl_DecrRefCount(parentObj);
+   if (objc < numCommonArgs) {
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "subcommand");
+      return TCL_ERROR;
    }
 
-   switch (status) {
-   case TCL_OK:
-   case TCL_CONTINUE:
-      return CXChildVisit_Continue;
-   case TCL_RECURSE:
-      return CXChildVisit_Recurse;
-   case TCL_RECURSE_BREAK:
-      return CXChildVisit_Break;
-   case TCL_BREAK:
-      visitInfo->returnCode = TCL_BREAK;
-      return CXChildVisit_Break;
-   default:
-      visitInfo->returnCode = status;
-      return CXChildVisit_Break;
+   static Command subcommands[] = {
+      { "count",
+        exportReaderCountObjCmd },
+      { "node",
+        exportReaderNodeObjCmd },
+      { NULL },
+   };
+
+   int commandNumber;
+   int status = Tcl_GetIndexFromObjStruct(interp, objv[subcommand_ix],
+                                          subcommands, sizeof subcommands[0],
+                                          "subcommand", 0, &commandNumber);
+   if (status != TCL_OK) {
+      return status;
    }
-}
 
-enum ForeachChildSyntax {
-    foreachChildTopLevelSyntax,
-    foreachChildSubcommandSyntax
-};
+   return subcommands[commandNumber].proc(clientData, interp,
+                                          objc - subcommand_ix,
+                                          objv + subcommand_ix);
+}
 
-static int foreachChildObjCmd(ClientData     clientData,
+static int exportReaderObjCmd(ClientData     clientData,
                               Tcl_Interp    *interp,
                               int            objc,
                               Tcl_Obj *const objv[])
 {
    enum {
       command_ix,
-      varName_ix,
-      cursor_ix,
-      script_ix,
+      name_ix,
+      filename_ix,
       nargs
    };
 
-   char *wrongNumArgsErrMsg = NULL;
-   Tcl_Obj *varNameObjArg = NULL;
-   Tcl_Obj *cursorObjArg = NULL;
-   Tcl_Obj *varNamesObj = NULL;
-   Tcl_Obj *ancestorStackObj = NULL;
-   int status = TCL_OK;
-
-   switch ((enum ForeachChildSyntax)clientData) {
-   case foreachChildTopLevelSyntax:
-      varNameObjArg = objv[varName_ix];
-      cursorObjArg = objv[cursor_ix];
-      wrongNumArgsErrMsg = "varName cursor script";
-      break;
-   case foreachChildSubcommandSyntax:
-      varNameObjArg = objv[cursor_ix];
-      cursorObjArg = objv[varName_ix];
-      wrongNumArgsErrMsg = "cursor varName script";
-      break;
-   }
-
    if (objc != nargs) {
-      Tcl_WrongNumArgs(interp, command_ix, objv, wrongNumArgsErrMsg);
-      status = TCL_ERROR;
-      goto cleanup;
+      Tcl_WrongNumArgs(interp, command_ix + 1, objv, "name filename");
+      return TCL_ERROR;
    }
 
-   /*
-    * I think this is a Tcl bug.  I don't modify the list, why should I need
-    * to duplicate it?  It is the bytecode guy the one that modifies it!
-    */
-   int       numVars = 0;
-   Tcl_Obj **varNames = NULL;
-   varNamesObj = Tcl_DuplicateObj(varNameObjArg);
-   Tcl_IncrRefCount(varNamesObj);
-   status = Tcl_ListObjGetElements(interp, varNamesObj, &numVars, &varNames);
-   if (status != TCL_OK) {
-      goto cleanup;
+   const char  *filename = Tcl_GetStringFromObj(objv[filename_ix], NULL);
+   Tcl_Channel  channel  = Tcl_OpenFileChannel(interp, filename, "r", 0);
+   if (channel == NULL) {
+      return TCL_ERROR;
    }
 
-   if (numVars != 1 && numVars != 2) {
-      Tcl_SetObjResult(interp,
-                       Tcl_NewStringObj("one of two variable names "
-                                        "are expected", -1));
-      status = TCL_ERROR;
-      goto cleanup;
+   if (Tcl_SetChannelOption(interp, channel, "-translation", "binary")
+       != TCL_OK) {
+      Tcl_Close(NULL, channel);
+      return TCL_ERROR;
    }
 
-   CXCursor cursor;
-   status = getCursorFromObj(interp, cursorObjArg, &cursor);
-   if (status != TCL_OK) {
-      goto cleanup;
+   ExportReader *reader = (ExportReader *)Tcl_Alloc(sizeof *reader);
+   reader->channel       = channel;
+   reader->stringOffsets = NULL;
+   reader->strings       = NULL;
+   reader->numStrings    = 0;
+
+   unsigned char trailer[exportTrailerSize];
+   Tcl_WideInt   end = Tcl_Seek(channel, 0, SEEK_END);
+   if (end < exportHeaderSize + exportTrailerSize
+       || readExport(interp, reader, end - exportTrailerSize,
+                     trailer, sizeof trailer) != TCL_OK
+       || memcmp(trailer + 32, exportMagic, sizeof exportMagic) != 0) {
+      goto invalid_file;
+   }
+
+   // Check the trailer against the file size before computing any size
+   // from it, so that a corrupted file can't overflow them.
+   uint64_t limit      = end - exportTrailerSize;
+   uint64_t numNodes   = getUint64(trailer);
+   uint64_t numStrings = getUint64(trailer + 8);
+   uint64_t blobPos    = getUint64(trailer + 16);
+   uint64_t offsetsPos = getUint64(trailer + 24);
+   if ((limit - exportHeaderSize) / exportRecordSize < numNodes
+       || blobPos != exportHeaderSize + numNodes * exportRecordSize
+       || offsetsPos < blobPos || limit < offsetsPos
+       || (limit - offsetsPos) / 4 <= numStrings
+       || (INT_MAX - 1) / sizeof reader->strings[0] <= numStrings) {
+      goto invalid_file;
+   }
+
+   reader->numNodes   = numNodes;
+   reader->numStrings = numStrings;
+   reader->blobPos    = blobPos;
+
+   size_t         numOffsets = numStrings + 1;
+   size_t         size       = numOffsets * 4;
+   unsigned char *offsets    = (unsigned char *)Tcl_Alloc(size);
+   if (readExport(interp, reader, offsetsPos, offsets, (int)size)
+       != TCL_OK) {
+      Tcl_Free((char *)offsets);
+      goto invalid_file;
    }
 
-   if (numVars == 2) {
-      ancestorStackObj = Tcl_NewObj();
-      Tcl_IncrRefCount(ancestorStackObj);
+   // The strings must lie between blobPos and offsetsPos.
+   reader->stringOffsets = (uint32_t *)Tcl_Alloc(size);
+   for (size_t i = 0; i < numOffsets; ++i) {
+      reader->stringOffsets[i] = getUint32(offsets + i * 4);
+      if (offsetsPos - blobPos < reader->stringOffsets[i]) {
+         Tcl_Free((char *)offsets);
+         goto invalid_file;
+      }
    }
+   Tcl_Free((char *)offsets);
 
-   ForeachChildInfo foreachChildInfo = {
-      .ancestorStackObj = ancestorStackObj,
-   };
+   reader->strings = (Tcl_Obj **)
+      Tcl_Alloc(numStrings * sizeof reader->strings[0] + 1);
+   memset(reader->strings, 0, numStrings * sizeof reader->strings[0]);
 
-   VisitInfo visitInfo = {
-      .interp     = interp,
-      .variableNames = varNames,
-      .numVariables = numVars,
-      .scriptObj  = objv[script_ix],
-      .returnCode = TCL_OK,
-      .clientData = &foreachChildInfo,
-   };
+   Tcl_Obj *commandNameObj = NULL;
+   newQualifiedName(interp, objv[name_ix], &commandNameObj);
 
-   clang_visitChildren(cursor, foreachChildHelper, &visitInfo);
+   Tcl_CreateObjCommand(interp, Tcl_GetString(commandNameObj),
+                        exportReaderInstanceObjCmd, reader,
+                        exportReaderDeleteProc);
 
-   status = visitInfo.returnCode;
-   switch (status) {
-   case TCL_BREAK:
-   case TCL_RECURSE_BREAK:
-      status = TCL_OK;
-      break;
-   }
+   Tcl_SetObjResult(interp, commandNameObj);
 
-cleanup:
-   if (ancestorStackObj) {
-      Tcl_DecrRefCount(ancestorStackObj);
-   }
-   if (varNamesObj) {
-      Tcl_DecrRefCount(varNamesObj);
-   }
+   return TCL_OK;
 
-   return status;
+ invalid_file:
+   Tcl_SetObjResult(interp,
+                    Tcl_ObjPrintf("\"%s\" is not a cindex export file",
+                                  filename));
+   Tcl_Free((char *)reader->stringOffsets);
+   Tcl_Free((char *)reader);
+   Tcl_Close(NULL, channel);
+
+   return TCL_ERROR;
 }
 
 //-------------------------------------------------------------- index command
@@ -6169,7 +13275,7 @@ static int indexObjCmd(ClientData     clientData,
                                           indexNameObjCmd, NULL, indexDeleteProc);
 
    Tcl_CmdInfo cmdinfo;
-   IndexInfo  *info = createIndexInfo(interp, index, cmd);
+   IndexInfo  *info = createIndexInfo(interp, index, mask, cmd);
 
    Tcl_GetCommandInfoFromToken(cmd, &cmdinfo);
    cmdinfo.objClientData = info;
@@ -6429,7 +13535,11 @@ cursorGetSpellingNameRange(CXCursor cursor, unsigned index)
 
 int Cindex_Init(Tcl_Interp *interp)
 {
+#ifdef CINDEX_USE_NRE
+   if (Tcl_InitStubs(interp, "8.6", 0) == NULL) {
+#else
    if (Tcl_InitStubs(interp, "8.5", 0) == NULL) {
+#endif
       return TCL_ERROR;
    }
 
@@ -6500,6 +13610,11 @@ int Cindex_Init(Tcl_Interp *interp)
    availabilityMessageTagObj     = Tcl_NewStringObj("message", -1);
    Tcl_IncrRefCount(availabilityMessageTagObj);
 
+   Tcl_RegisterObjType(&cursorObjType);
+   Tcl_RegisterObjType(&typeObjType);
+   Tcl_RegisterObjType(&locationObjType);
+   Tcl_RegisterObjType(&rangeObjType);
+
    Tcl_Namespace *cindexNs
       = Tcl_CreateNamespace(interp, "cindex", NULL, NULL);
 
@@ -6515,21 +13630,42 @@ int Cindex_Init(Tcl_Interp *interp)
       { "bist",
         bistObjCmd },
 #endif
+      { "exportReader",
+        exportReaderObjCmd },
       { "foreachChild",
         foreachChildObjCmd,
-        (ClientData)foreachChildTopLevelSyntax },
+        (ClientData)foreachChildTopLevelSyntax,
+        foreachChildNRObjCmd },
       { "index",
         indexObjCmd },
       { "recurse",
         recurseObjCmd },
       { "recursebreak",
         recurseBreakObjCmd },
+      { "walk",
+        walkObjCmd },
       { NULL }
    };
    createAndExportCommands(interp, "cindex::%s", cmdTable);
 
    //-------------------------------------------------------------------------
 
+   Tcl_Namespace *compilationDatabaseNs
+      = Tcl_CreateNamespace(interp, "cindex::compilationDatabase", NULL, NULL);
+   Tcl_CreateEnsemble(interp, "::cindex::compilationDatabase",
+                      compilationDatabaseNs, 0);
+   Tcl_Export(interp, cindexNs, "compilationDatabase", 0);
+
+   static Command compilationDatabaseCmdTable[] = {
+      { "load",
+        compilationDatabaseLoadObjCmd },
+      { NULL }
+   };
+   createAndExportCommands(interp, "cindex::compilationDatabase::%s",
+                           compilationDatabaseCmdTable);
+
+   //-------------------------------------------------------------------------
+
    Tcl_Namespace *cursorNs
       = Tcl_CreateNamespace(interp, "cindex::cursor", NULL, NULL);
    Tcl_CreateEnsemble(interp, "::cindex::cursor", cursorNs, 0);
@@ -6591,6 +13727,86 @@ int Cindex_Init(Tcl_Interp *interp)
    overloadedDeclsInfo.getIndex = &clang_getOverloadedDecl;
    overloadedDeclsInfo.returnType = CursorToCursorListInfo_Unsigned;
 
+   static Command cursorIsCmdTable[] = {
+#if CINDEX_VERSION_MINOR >= 30
+      { "anonymous",
+        cursorToBoolObjCmd,             clang_Cursor_isAnonymous },
+#endif
+      { "attribute",
+        cursorToKindToBoolObjCmd,       clang_isAttribute },
+      { "bitField",
+        cursorToBoolObjCmd,             clang_Cursor_isBitField },
+#if CINDEX_VERSION_MINOR >= 35
+      { "cxxConstructorConverting",
+        cursorToBoolObjCmd,             clang_CXXConstructor_isConvertingConstructor },
+      { "cxxConstructorCopy",
+        cursorToBoolObjCmd,             clang_CXXConstructor_isCopyConstructor },
+      { "cxxConstructorDefault",
+        cursorToBoolObjCmd,             clang_CXXConstructor_isDefaultConstructor },
+      { "cxxConstructorMove",
+        cursorToBoolObjCmd,             clang_CXXConstructor_isMoveConstructor },
+#endif
+#if CINDEX_VERSION_MINOR >= 32
+      { "cxxFieldMutable",
+        cursorToBoolObjCmd,             clang_CXXField_isMutable },
+#endif
+#if CINDEX_VERSION_MINOR >= 25
+      { "cxxMethodConst",
+        cursorToBoolObjCmd,             clang_CXXMethod_isConst },
+#endif
+#if CINDEX_VERSION_MINOR >= 35
+      { "cxxMethodDefaulted",
+        cursorToBoolObjCmd,             clang_CXXMethod_isDefaulted },
+#endif
+      { "cxxMethodPureVirtual",
+        cursorToBoolObjCmd,             clang_CXXMethod_isPureVirtual },
+      { "cxxMethodStatic",
+        cursorToBoolObjCmd,             clang_CXXMethod_isStatic },
+      { "cxxMethodVirtual",
+        cursorToBoolObjCmd,             clang_CXXMethod_isVirtual },
+      { "declaration",
+        cursorToKindToBoolObjCmd,       clang_isDeclaration },
+      { "definition",
+        cursorToBoolObjCmd,             clang_isCursorDefinition },
+      { "dynamicCall",
+        cursorToBoolObjCmd,             clang_Cursor_isDynamicCall },
+      { "unexposed",
+        cursorToKindToBoolObjCmd,       clang_isUnexposed },
+      { "expression",
+        cursorToKindToBoolObjCmd,       clang_isExpression },
+#if CINDEX_VERSION_MINOR >= 33
+      { "functionInlined",
+        cursorToBoolObjCmd,             clang_Cursor_isFunctionInlined },
+#endif
+      { "invalid",
+        cursorToKindToBoolObjCmd,       clang_isInvalid },
+      { "null",
+        cursorToBoolObjCmd,             clang_Cursor_isNull },
+      { "valid",
+        cursorToBoolObjCmd},
+#if CINDEX_VERSION_MINOR >= 33
+      { "macroFunctionLike",
+        cursorToBoolObjCmd,             clang_Cursor_isMacroFunctionLike },
+      { "macroBuiltin",
+        cursorToBoolObjCmd,             clang_Cursor_isMacroBuiltin },
+#endif
+      { "objCOptional",
+        cursorToBoolObjCmd,             clang_Cursor_isObjCOptional },
+      { "preprocessing",
+        cursorToKindToBoolObjCmd,       clang_isPreprocessing },
+      { "reference",
+        cursorToKindToBoolObjCmd,       clang_isReference },
+      { "statement",
+        cursorToKindToBoolObjCmd,       clang_isStatement },
+      { "translationUnit",
+        cursorToKindToBoolObjCmd,       clang_isTranslationUnit },
+      { "variadic",
+        cursorToBoolObjCmd,             clang_Cursor_isVariadic },
+      { "virtualBase",
+        cursorToBoolObjCmd,             clang_isVirtualBase },
+      { NULL }
+   };
+
    static Command cursorCmdTable[] = {
       { "argument",
         cursorUnsignedToCursorObjCmd,
@@ -6598,6 +13814,9 @@ int Cindex_Init(Tcl_Interp *interp)
       { "arguments",
         cursorToCursorListObjCmd,
         &argumentsInfo },
+      { "attrs",
+        cursorAttrsObjCmd,
+        cursorCmdTable },
       { "availability",
         cursorToEnumObjCmd,
         &cursorAvailabilityInfo },
@@ -6607,6 +13826,9 @@ int Cindex_Init(Tcl_Interp *interp)
       { "canonicalCursor",
         cursorToCursorObjCmd,
         clang_getCanonicalCursor },
+      { "children",
+        cursorNavigationObjCmd,
+        (ClientData)cursorNavigationChildren },
       { "commentRange",
         cursorToRangeObjCmd,
         clang_Cursor_getCommentRange },
@@ -6621,6 +13843,9 @@ int Cindex_Init(Tcl_Interp *interp)
       { "definition",
         cursorToCursorObjCmd,
         clang_getCursorDefinition },
+      { "depth",
+        cursorNavigationObjCmd,
+        (ClientData)cursorNavigationDepth },
       { "displayName",
         cursorToStringObjCmd,
         clang_getCursorDisplayName },
@@ -6638,9 +13863,13 @@ int Cindex_Init(Tcl_Interp *interp)
       { "evaluate",
         cursorEvaluateObjCmd },
 #endif
+      { "filter",
+        cursorFilterObjCmd,
+        cursorIsCmdTable },
       { "foreachChild",
         foreachChildObjCmd,
-        (ClientData)foreachChildSubcommandSyntax },
+        (ClientData)foreachChildSubcommandSyntax,
+        foreachChildNRObjCmd },
       { "fieldDeclBitWidth",
         cursorToIntObjCmd,
         clang_getFieldDeclBitWidth },
@@ -6658,6 +13887,11 @@ int Cindex_Init(Tcl_Interp *interp)
       { "includedFile",
         cursorToFileObjCmd,
         clang_getIncludedFile },
+      { "iterator",
+        cursorIteratorObjCmd },
+      { "kind",
+        cursorToKindObjCmd,
+        clang_getCursorKind },
       { "language",
         cursorToEnumObjCmd,
         &cursorLanguageInfo },
@@ -6675,6 +13909,12 @@ int Cindex_Init(Tcl_Interp *interp)
         cursorToStringObjCmd,
         clang_Cursor_getMangling },
 #endif
+      { "map",
+        cursorMapObjCmd,
+        cursorCmdTable },
+      { "nextSibling",
+        cursorNavigationObjCmd,
+        (ClientData)cursorNavigationNextSibling },
       { "null",
         cursorNullObjCmd },
       { "numArguments",
@@ -6708,6 +13948,9 @@ int Cindex_Init(Tcl_Interp *interp)
         &overloadedDeclsInfo },
       { "overriddenCursors",
         cursorOverriddenCursorsObjCmd },
+      { "parent",
+        cursorNavigationObjCmd,
+        (ClientData)cursorNavigationParent },
       { "platformAvailability",
         cursorPlatformAvailabilityObjCmd },
       { "rawCommentText",
@@ -6727,6 +13970,10 @@ int Cindex_Init(Tcl_Interp *interp)
       { "semanticParent",
         cursorToCursorObjCmd,
         clang_getCursorSemanticParent },
+      { "select",
+        cursorSelectObjCmd },
+      { "sort",
+        cursorSortObjCmd },
       { "specializedTemplate",
         cursorToCursorObjCmd,
         clang_getSpecializedCursorTemplate },
@@ -6769,85 +14016,6 @@ int Cindex_Init(Tcl_Interp *interp)
    Tcl_CreateEnsemble(interp, "::cindex::cursor::is", cursorIsNs, 0);
    Tcl_Export(interp, cursorNs, "is", 0);
 
-   static Command cursorIsCmdTable[] = {
-#if CINDEX_VERSION_MINOR >= 30
-      { "anonymous",
-        cursorToBoolObjCmd,             clang_Cursor_isAnonymous },
-#endif
-      { "attribute",
-        cursorToKindToBoolObjCmd,       clang_isAttribute },
-      { "bitField",
-        cursorToBoolObjCmd,             clang_Cursor_isBitField },
-#if CINDEX_VERSION_MINOR >= 35
-      { "cxxConstructorConverting",
-        cursorToBoolObjCmd,             clang_CXXConstructor_isConvertingConstructor },
-      { "cxxConstructorCopy",
-        cursorToBoolObjCmd,             clang_CXXConstructor_isCopyConstructor },
-      { "cxxConstructorDefault",
-        cursorToBoolObjCmd,             clang_CXXConstructor_isDefaultConstructor },
-      { "cxxConstructorMove",
-        cursorToBoolObjCmd,             clang_CXXConstructor_isMoveConstructor },
-#endif
-#if CINDEX_VERSION_MINOR >= 32
-      { "cxxFieldMutable",
-        cursorToBoolObjCmd,             clang_CXXField_isMutable },
-#endif
-#if CINDEX_VERSION_MINOR >= 25
-      { "cxxMethodConst",
-        cursorToBoolObjCmd,             clang_CXXMethod_isConst },
-#endif
-#if CINDEX_VERSION_MINOR >= 35
-      { "cxxMethodDefaulted",
-        cursorToBoolObjCmd,             clang_CXXMethod_isDefaulted },
-#endif
-      { "cxxMethodPureVirtual",
-        cursorToBoolObjCmd,             clang_CXXMethod_isPureVirtual },
-      { "cxxMethodStatic",
-        cursorToBoolObjCmd,             clang_CXXMethod_isStatic },
-      { "cxxMethodVirtual",
-        cursorToBoolObjCmd,             clang_CXXMethod_isVirtual },
-      { "declaration",
-        cursorToKindToBoolObjCmd,       clang_isDeclaration },
-      { "definition",
-        cursorToBoolObjCmd,             clang_isCursorDefinition },
-      { "dynamicCall",
-        cursorToBoolObjCmd,             clang_Cursor_isDynamicCall },
-      { "unexposed",
-        cursorToKindToBoolObjCmd,       clang_isUnexposed },
-      { "expression",
-        cursorToKindToBoolObjCmd,       clang_isExpression },
-#if CINDEX_VERSION_MINOR >= 33
-      { "functionInlined",
-        cursorToBoolObjCmd,             clang_Cursor_isFunctionInlined },
-#endif
-      { "invalid",
-        cursorToKindToBoolObjCmd,       clang_isInvalid },
-      { "null",
-        cursorToBoolObjCmd,             clang_Cursor_isNull },
-      { "valid",
-        cursorToBoolObjCmd},
-#if CINDEX_VERSION_MINOR >= 33
-      { "macroFunctionLike",
-        cursorToBoolObjCmd,             clang_Cursor_isMacroFunctionLike },
-      { "macroBuiltin",
-        cursorToBoolObjCmd,             clang_Cursor_isMacroBuiltin },
-#endif
-      { "objCOptional",
-        cursorToBoolObjCmd,             clang_Cursor_isObjCOptional },
-      { "preprocessing",
-        cursorToKindToBoolObjCmd,       clang_isPreprocessing },
-      { "reference",
-        cursorToKindToBoolObjCmd,       clang_isReference },
-      { "statement",
-        cursorToKindToBoolObjCmd,       clang_isStatement },
-      { "translationUnit",
-        cursorToKindToBoolObjCmd,       clang_isTranslationUnit },
-      { "variadic",
-        cursorToBoolObjCmd,             clang_Cursor_isVariadic },
-      { "virtualBase",
-        cursorToBoolObjCmd,             clang_isVirtualBase },
-      { NULL }
-   };
    createAndExportCommands(interp, "cindex::cursor::is::%s", cursorIsCmdTable);
 
    //-------------------------------------------------------------------------
@@ -6858,6 +14026,8 @@ int Cindex_Init(Tcl_Interp *interp)
    Tcl_Export(interp, cindexNs, "location", 0);
 
    static Command locationCmdTable[] = {
+      { "decodeAll",
+        locationDecodeAllObjCmd },
       { "equal",
         locationEqualObjCmd },
       { "expansionLocation",
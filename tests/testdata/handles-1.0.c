@@ -0,0 +1 @@
+typedef struct Point { int x; } Point_t;
@@ -0,0 +1,2 @@
+struct A { int a; };
+struct B { int b; };
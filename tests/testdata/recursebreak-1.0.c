@@ -0,0 +1,2 @@
+struct A { int a1; int a2; };
+struct B { int b1; int b2; };
@@ -0,0 +1,2 @@
+#include "scope-1.0.h"
+int inMain;
@@ -0,0 +1 @@
+int inHeader;